@@ -0,0 +1,184 @@
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#include "driver/i2c.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An I2C master port shared by the drivers of the devices on its bus. A transaction holds the bus from its start
+ * condition to its stop condition, the drivers waiting for the bus are queued on its lock. A register read is a
+ * single write-then-read transaction with a repeated start, the register pointer cannot be moved by another driver
+ * in between. The transactions are built in the bus's preallocated command buffer when the driver supports it.
+ */
+typedef uint32_t i2c_bus_handle_t;
+typedef uint32_t i2c_bus_device_handle_t;
+
+#define I2C_BUS_STATUS_OK          0x0000
+#define I2C_BUS_STATUS_FAILED      0x0001
+#define I2C_BUS_STATUS_TIMEDOUT    0x0002
+
+/**
+ * @brief   A device's part of a transaction: a write, then a read after a repeated start. Either part may be empty.
+ */
+typedef struct I2C_BUS_TRANSFER_TAG
+{
+    i2c_bus_device_handle_t device;
+    const uint8_t * write;
+    size_t write_length;
+    uint8_t * read;
+    size_t read_length;
+    int status;                     // Set once the transfer ran
+} I2C_BUS_TRANSFER;
+
+/**
+ * @brief   Transaction counters of a device on the bus
+ */
+typedef struct I2C_BUS_STATISTICS_TAG
+{
+    uint32_t transactions;          // Transactions completed, errors included
+    uint32_t errors;                // Transactions the device did not acknowledge or that failed on the bus
+    uint32_t timeouts;              // Transactions not started because the bus stayed busy
+    int64_t latency;                // Duration of the last transaction in us, waiting for the bus included
+    int64_t max_latency;            // Longest transaction in us
+    int64_t total_latency;          // Duration of every transaction in us
+} I2C_BUS_STATISTICS;
+
+/**
+ * @brief Configure an I2C port as a master and install its driver
+ *
+ * @param[in]  port        The I2C port
+ * @param[in]  config      The port's master configuration
+ *
+ * @return
+ *          - Handle to the bus
+ *          - 0 if the port could not be installed
+ */
+i2c_bus_handle_t i2c_bus_create(i2c_port_t port, const i2c_config_t * config);
+
+/**
+ * @brief Uninstall the port's driver and dispose of the bus. None of its devices may be used anymore.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ */
+void i2c_bus_destroy(i2c_bus_handle_t bus);
+
+/**
+ * @brief Get the I2C port of a bus
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ *
+ * @return
+ *          - The bus's I2C port
+ */
+i2c_port_t i2c_bus_get_port(i2c_bus_handle_t bus);
+
+/**
+ * @brief Add a device to the bus. A device added twice shares its handle and counters.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in]  address     The device's 7 bits address
+ *
+ * @return
+ *          - Handle to the device
+ *          - 0 if the bus holds I2C_BUS_MAX_DEVICES devices already
+ */
+i2c_bus_device_handle_t i2c_bus_add_device(i2c_bus_handle_t bus, uint8_t address);
+
+/**
+ * @brief Get the address of a device on the bus
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ *
+ * @return
+ *          - The device's 7 bits address
+ */
+uint8_t i2c_bus_get_address(i2c_bus_device_handle_t device);
+
+/**
+ * @brief Write to a device in a single transaction
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[in]  data        The bytes to write
+ * @param[in]  length      Number of bytes to write
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the device acknowledged every byte
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_write(i2c_bus_device_handle_t device, const uint8_t * data, size_t length);
+
+/**
+ * @brief Read from a device in a single transaction
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[out] data        Receives the bytes read
+ * @param[in]  length      Number of bytes to read
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the bytes were read
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_read(i2c_bus_device_handle_t device, uint8_t * data, size_t length);
+
+/**
+ * @brief Write to a device then read from it in a single transaction, with a repeated start between the two
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[in]  write       The bytes to write, usually a register pointer
+ * @param[in]  write_length  Number of bytes to write
+ * @param[out] read        Receives the bytes read
+ * @param[in]  read_length Number of bytes to read
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the bytes were read
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_write_read(i2c_bus_device_handle_t device, const uint8_t * write, size_t write_length, uint8_t * read, size_t read_length);
+
+/**
+ * @brief Run the transfers of several devices in a single transaction, each one after a repeated start. When the
+ *        transaction fails, the transfers are run again one by one, so that only the failing devices fail.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in,out] transfers  The transfers, their status is set
+ * @param[in]  count       Number of transfers, up to I2C_BUS_MAX_TRANSFERS
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if every transfer succeeded
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED if a transfer failed
+ */
+int i2c_bus_transfer_batch(i2c_bus_handle_t bus, I2C_BUS_TRANSFER * transfers, size_t count);
+
+/**
+ * @brief Check whether a device acknowledges its address, without adding it to the bus
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in]  address     The 7 bits address to probe
+ *
+ * @return
+ *          - true if a device acknowledged the address
+ */
+bool i2c_bus_probe(i2c_bus_handle_t bus, uint8_t address);
+
+/**
+ * @brief Get the transaction counters of a device
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[out] statistics  The device's counters
+ */
+void i2c_bus_get_statistics(i2c_bus_device_handle_t device, I2C_BUS_STATISTICS * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
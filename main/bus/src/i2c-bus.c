@@ -0,0 +1,485 @@
+#include "i2c-bus.h"
+
+#include "device-config.h"
+
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ACK_CHECK_EN   0x1     /*!< I2C master will check ack from slave*/
+#define ACK_VAL        0x0     /*!< I2C ack value */
+#define NACK_VAL       0x1     /*!< I2C nack value */
+
+// Start, address, write, repeated start, address, read and last byte read for each transfer, then the stop
+#define I2C_BUS_TRANSFER_COMMANDS  7
+#define I2C_BUS_MAX_COMMANDS       (I2C_BUS_TRANSFER_COMMANDS * I2C_BUS_MAX_TRANSFERS + 1)
+
+struct I2C_BUS_TAG;
+
+typedef struct I2C_BUS_DEVICE_TAG
+{
+    struct I2C_BUS_TAG * bus;
+    uint8_t address;
+    I2C_BUS_STATISTICS statistics;  // Updated while holding the bus
+} I2C_BUS_DEVICE;
+
+typedef struct I2C_BUS_TAG
+{
+    i2c_port_t port;
+    SemaphoreHandle_t lock;         // Held for a transaction, the drivers waiting for the bus are queued on it
+    I2C_BUS_DEVICE devices[I2C_BUS_MAX_DEVICES];
+    uint8_t device_count;
+#ifdef I2C_LINK_RECOMMENDED_SIZE
+    uint8_t commands[I2C_LINK_RECOMMENDED_SIZE(I2C_BUS_MAX_COMMANDS)];
+#endif
+} I2C_BUS;
+
+static const char *TAG = "I2C Bus";
+
+// Build the transaction in the bus's command buffer, the older drivers allocate each command of the transaction
+static i2c_cmd_handle_t i2c_bus_create_commands(I2C_BUS * bus)
+{
+#ifdef I2C_LINK_RECOMMENDED_SIZE
+    return i2c_cmd_link_create_static(bus->commands, sizeof(bus->commands));
+#else
+    return i2c_cmd_link_create();
+#endif
+}
+
+static void i2c_bus_delete_commands(i2c_cmd_handle_t cmd)
+{
+#ifdef I2C_LINK_RECOMMENDED_SIZE
+    i2c_cmd_link_delete_static(cmd);
+#else
+    i2c_cmd_link_delete(cmd);
+#endif
+}
+
+// Add a transfer to the transaction: the write, then the read after a repeated start. Either part may be empty.
+static void i2c_bus_add_commands(i2c_cmd_handle_t cmd, const I2C_BUS_TRANSFER * transfer)
+{
+    uint8_t address = ((I2C_BUS_DEVICE *) transfer->device)->address;
+
+    i2c_master_start(cmd);
+
+    if (transfer->write_length > 0 || transfer->read_length == 0)
+    {
+        i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+
+        if (transfer->write_length > 0)
+        {
+            i2c_master_write(cmd, (uint8_t *) transfer->write, transfer->write_length, ACK_CHECK_EN);
+        }
+    }
+
+    if (transfer->read_length > 0)
+    {
+        // Repeated start, the bus is not released between the write and the read
+        if (transfer->write_length > 0)
+        {
+            i2c_master_start(cmd);
+        }
+
+        i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_READ, ACK_CHECK_EN);
+
+        if (transfer->read_length > 1)
+        {
+            i2c_master_read(cmd, transfer->read, transfer->read_length - 1, ACK_VAL);
+        }
+
+        i2c_master_read_byte(cmd, transfer->read + transfer->read_length - 1, NACK_VAL);
+    }
+}
+
+/**
+ * @brief Run transfers in a single transaction, each one after a repeated start, while holding the bus
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the transaction completed
+ *          - I2C_BUS_STATUS_TIMEDOUT if the driver timed out waiting for the bus
+ *          - I2C_BUS_STATUS_FAILED otherwise, a device did not acknowledge or the transaction failed on the bus
+ */
+static int i2c_bus_run(I2C_BUS * bus, I2C_BUS_TRANSFER * transfers, size_t count)
+{
+    i2c_cmd_handle_t cmd = i2c_bus_create_commands(bus);
+    esp_err_t status = (cmd != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+
+    if (cmd != NULL)
+    {
+        for (size_t index = 0; index < count; ++index)
+        {
+            i2c_bus_add_commands(cmd, &transfers[index]);
+        }
+
+        i2c_master_stop(cmd);
+
+        status = i2c_master_cmd_begin(bus->port, cmd, I2C_BUS_TIMEOUT / portTICK_PERIOD_MS);
+        i2c_bus_delete_commands(cmd);
+    }
+
+    int bus_status = (status == ESP_OK) ? I2C_BUS_STATUS_OK :
+        (status == ESP_ERR_TIMEOUT) ? I2C_BUS_STATUS_TIMEDOUT : I2C_BUS_STATUS_FAILED;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        transfers[index].status = bus_status;
+    }
+
+    return bus_status;
+}
+
+/**
+ * @brief Count the transfers in their device's statistics, the devices of a transaction share its latency
+ */
+static void i2c_bus_count(const I2C_BUS_TRANSFER * transfers, size_t count, int64_t started)
+{
+    int64_t latency = esp_timer_get_time() - started;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        I2C_BUS_DEVICE * device = (I2C_BUS_DEVICE *) transfers[index].device;
+
+        device->statistics.transactions++;
+        device->statistics.errors += (transfers[index].status != I2C_BUS_STATUS_OK) ? 1 : 0;
+        device->statistics.latency = latency;
+        device->statistics.max_latency = (latency > device->statistics.max_latency) ? latency : device->statistics.max_latency;
+        device->statistics.total_latency += latency;
+    }
+}
+
+/**
+ * @brief Run a transaction, waiting for the bus
+ */
+static int i2c_bus_transfer(I2C_BUS_DEVICE * device, const uint8_t * write, size_t write_length, uint8_t * read, size_t read_length)
+{
+    I2C_BUS * bus = device->bus;
+    int64_t started = esp_timer_get_time();
+
+    if (xSemaphoreTake(bus->lock, I2C_BUS_TIMEOUT / portTICK_PERIOD_MS) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Bus %d busy for %dms, device 0x%02x not addressed\n", bus->port, I2C_BUS_TIMEOUT, device->address);
+        device->statistics.timeouts++;
+        return I2C_BUS_STATUS_TIMEDOUT;
+    }
+
+    I2C_BUS_TRANSFER transfer =
+    {
+        .device = (i2c_bus_device_handle_t) device,
+        .write = write,
+        .write_length = write_length,
+        .read = read,
+        .read_length = read_length
+    };
+
+    i2c_bus_run(bus, &transfer, 1);
+    i2c_bus_count(&transfer, 1, started);
+
+    xSemaphoreGive(bus->lock);
+
+    return transfer.status;
+}
+
+/**
+ * @brief Configure an I2C port as a master and install its driver
+ *
+ * @param[in]  port        The I2C port
+ * @param[in]  config      The port's master configuration
+ *
+ * @return
+ *          - Handle to the bus
+ *          - 0 if the port could not be installed
+ */
+i2c_bus_handle_t i2c_bus_create(i2c_port_t port, const i2c_config_t * config)
+{
+    I2C_BUS * bus = calloc(1, sizeof(I2C_BUS));
+
+    if (bus == NULL)
+    {
+        return 0;
+    }
+
+    bus->port = port;
+    bus->lock = xSemaphoreCreateMutex();
+
+    if (bus->lock == NULL || i2c_param_config(port, config) != ESP_OK || i2c_driver_install(port, config->mode, 0, 0, 0) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to install the driver of I2C port %d\n", port);
+
+        if (bus->lock != NULL)
+        {
+            vSemaphoreDelete(bus->lock);
+        }
+
+        free(bus);
+        return 0;
+    }
+
+    return (i2c_bus_handle_t) bus;
+}
+
+/**
+ * @brief Uninstall the port's driver and dispose of the bus. None of its devices may be used anymore.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ */
+void i2c_bus_destroy(i2c_bus_handle_t bus)
+{
+    I2C_BUS * i2c_bus = (I2C_BUS *) bus;
+
+    if (i2c_bus != NULL)
+    {
+        i2c_driver_delete(i2c_bus->port);
+        vSemaphoreDelete(i2c_bus->lock);
+        free(i2c_bus);
+    }
+}
+
+/**
+ * @brief Get the I2C port of a bus
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ *
+ * @return
+ *          - The bus's I2C port
+ */
+i2c_port_t i2c_bus_get_port(i2c_bus_handle_t bus)
+{
+    return ((I2C_BUS *) bus)->port;
+}
+
+/**
+ * @brief Add a device to the bus. A device added twice shares its handle and counters.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in]  address     The device's 7 bits address
+ *
+ * @return
+ *          - Handle to the device
+ *          - 0 if the bus holds I2C_BUS_MAX_DEVICES devices already
+ */
+i2c_bus_device_handle_t i2c_bus_add_device(i2c_bus_handle_t bus, uint8_t address)
+{
+    I2C_BUS * i2c_bus = (I2C_BUS *) bus;
+
+    if (i2c_bus == NULL)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(i2c_bus->lock, portMAX_DELAY);
+
+    I2C_BUS_DEVICE * device = NULL;
+
+    for (uint8_t index = 0; index < i2c_bus->device_count && device == NULL; ++index)
+    {
+        device = (i2c_bus->devices[index].address == address) ? &i2c_bus->devices[index] : NULL;
+    }
+
+    if (device == NULL && i2c_bus->device_count < I2C_BUS_MAX_DEVICES)
+    {
+        device = &i2c_bus->devices[i2c_bus->device_count++];
+        device->bus = i2c_bus;
+        device->address = address;
+        memset(&device->statistics, 0, sizeof(device->statistics));
+    }
+
+    xSemaphoreGive(i2c_bus->lock);
+
+    if (device == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to add device 0x%02x, the bus holds %d devices\n", address, I2C_BUS_MAX_DEVICES);
+    }
+
+    return (i2c_bus_device_handle_t) device;
+}
+
+/**
+ * @brief Get the address of a device on the bus
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ *
+ * @return
+ *          - The device's 7 bits address
+ */
+uint8_t i2c_bus_get_address(i2c_bus_device_handle_t device)
+{
+    return ((I2C_BUS_DEVICE *) device)->address;
+}
+
+/**
+ * @brief Write to a device in a single transaction
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[in]  data        The bytes to write
+ * @param[in]  length      Number of bytes to write
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the device acknowledged every byte
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_write(i2c_bus_device_handle_t device, const uint8_t * data, size_t length)
+{
+    return (device != 0) ? i2c_bus_transfer((I2C_BUS_DEVICE *) device, data, length, NULL, 0) : I2C_BUS_STATUS_FAILED;
+}
+
+/**
+ * @brief Read from a device in a single transaction
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[out] data        Receives the bytes read
+ * @param[in]  length      Number of bytes to read
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the bytes were read
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_read(i2c_bus_device_handle_t device, uint8_t * data, size_t length)
+{
+    if (device == 0 || length == 0)
+    {
+        return I2C_BUS_STATUS_FAILED;
+    }
+
+    return i2c_bus_transfer((I2C_BUS_DEVICE *) device, NULL, 0, data, length);
+}
+
+/**
+ * @brief Write to a device then read from it in a single transaction, with a repeated start between the two
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[in]  write       The bytes to write, usually a register pointer
+ * @param[in]  write_length  Number of bytes to write
+ * @param[out] read        Receives the bytes read
+ * @param[in]  read_length Number of bytes to read
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if the bytes were read
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED otherwise
+ */
+int i2c_bus_write_read(i2c_bus_device_handle_t device, const uint8_t * write, size_t write_length, uint8_t * read, size_t read_length)
+{
+    if (device == 0 || read_length == 0)
+    {
+        return I2C_BUS_STATUS_FAILED;
+    }
+
+    return i2c_bus_transfer((I2C_BUS_DEVICE *) device, write, write_length, read, read_length);
+}
+
+/**
+ * @brief Run the transfers of several devices in a single transaction, each one after a repeated start. When the
+ *        transaction fails, the transfers are run again one by one, so that only the failing devices fail.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in,out] transfers  The transfers, their status is set
+ * @param[in]  count       Number of transfers, up to I2C_BUS_MAX_TRANSFERS
+ *
+ * @return
+ *          - I2C_BUS_STATUS_OK if every transfer succeeded
+ *          - I2C_BUS_STATUS_TIMEDOUT if the bus stayed busy for I2C_BUS_TIMEOUT ms
+ *          - I2C_BUS_STATUS_FAILED if a transfer failed
+ */
+int i2c_bus_transfer_batch(i2c_bus_handle_t bus, I2C_BUS_TRANSFER * transfers, size_t count)
+{
+    I2C_BUS * i2c_bus = (I2C_BUS *) bus;
+    int64_t started = esp_timer_get_time();
+
+    if (i2c_bus == NULL || count == 0 || count > I2C_BUS_MAX_TRANSFERS)
+    {
+        return I2C_BUS_STATUS_FAILED;
+    }
+
+    if (xSemaphoreTake(i2c_bus->lock, I2C_BUS_TIMEOUT / portTICK_PERIOD_MS) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Bus %d busy for %dms, %d transfers not run\n", i2c_bus->port, I2C_BUS_TIMEOUT, (int) count);
+
+        for (size_t index = 0; index < count; ++index)
+        {
+            ((I2C_BUS_DEVICE *) transfers[index].device)->statistics.timeouts++;
+            transfers[index].status = I2C_BUS_STATUS_TIMEDOUT;
+        }
+
+        return I2C_BUS_STATUS_TIMEDOUT;
+    }
+
+    int status = i2c_bus_run(i2c_bus, transfers, count);
+
+    // A device that did not acknowledge aborted the transaction, the transfers are run again to isolate it
+    for (size_t index = 0; status != I2C_BUS_STATUS_OK && count > 1 && index < count; ++index)
+    {
+        i2c_bus_run(i2c_bus, &transfers[index], 1);
+    }
+
+    i2c_bus_count(transfers, count, started);
+
+    xSemaphoreGive(i2c_bus->lock);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        if (transfers[index].status != I2C_BUS_STATUS_OK)
+        {
+            return I2C_BUS_STATUS_FAILED;
+        }
+    }
+
+    return I2C_BUS_STATUS_OK;
+}
+
+/**
+ * @brief Check whether a device acknowledges its address, without adding it to the bus
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[in]  address     The 7 bits address to probe
+ *
+ * @return
+ *          - true if a device acknowledged the address
+ */
+bool i2c_bus_probe(i2c_bus_handle_t bus, uint8_t address)
+{
+    I2C_BUS * i2c_bus = (I2C_BUS *) bus;
+
+    if (i2c_bus == NULL || xSemaphoreTake(i2c_bus->lock, I2C_BUS_TIMEOUT / portTICK_PERIOD_MS) != pdTRUE)
+    {
+        return false;
+    }
+
+    // An empty write: the address alone
+    i2c_cmd_handle_t cmd = i2c_bus_create_commands(i2c_bus);
+    esp_err_t status = ESP_ERR_NO_MEM;
+
+    if (cmd != NULL)
+    {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+        i2c_master_stop(cmd);
+
+        status = i2c_master_cmd_begin(i2c_bus->port, cmd, I2C_BUS_TIMEOUT / portTICK_PERIOD_MS);
+        i2c_bus_delete_commands(cmd);
+    }
+
+    xSemaphoreGive(i2c_bus->lock);
+
+    return status == ESP_OK;
+}
+
+/**
+ * @brief Get the transaction counters of a device
+ *
+ * @param[in]  device      The device handle returned from i2c_bus_add_device
+ * @param[out] statistics  The device's counters
+ */
+void i2c_bus_get_statistics(i2c_bus_device_handle_t device, I2C_BUS_STATISTICS * statistics)
+{
+    I2C_BUS_DEVICE * bus_device = (I2C_BUS_DEVICE *) device;
+
+    if (bus_device != NULL)
+    {
+        *statistics = bus_device->statistics;
+    }
+}
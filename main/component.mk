@@ -8,13 +8,17 @@
 CFLAGS += -Wno-char-subscripts 
 
 COMPONENT_ADD_INCLUDEDIRS :=  \
+bus/inc	\
 device/inc	\
 sensors/inc	\
+storage/inc	\
 telemetry/inc	\
 .
 
 COMPONENT_SRCDIRS :=  \
+bus/src	\
 device/src	\
 sensors/src \
+storage/src	\
 telemetry/src	\
 .
@@ -8,12 +8,53 @@ extern "C" {
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 
+#include "telemetry-data.h"
+#include "device.h"
+
 /* Sensor configuration from menu-config */
 #define I2C_SCL_IO                   CONFIG_I2C_SCL_IO
 #define I2C_SDA_IO                   CONFIG_I2C_SDA_IO
 #define I2C_PORT                     I2C_NUM_1
 #define I2C_FREQ_HZ                  100000     /*!< I2C master clock frequency */
 #define MCP9808_SENSOR_ADDR          CONFIG_MCP9808_SENSOR_ADDR
+#define MCP9808_ALERT_IO             CONFIG_MCP9808_ALERT_IO
+#define MCP9808_ALERT_LOWER          CONFIG_MCP9808_ALERT_LOWER
+#define MCP9808_ALERT_UPPER          CONFIG_MCP9808_ALERT_UPPER
+#define MCP9808_ALERT_CRITICAL       CONFIG_MCP9808_ALERT_CRITICAL
+#define MCP9808_ALERT_HYSTERESIS     1.5        /*!< Degrees the temperature moves back into the window to clear the alert */
+#define I2C_BUS_MAX_DEVICES          8          /*!< Devices sharing an I2C bus */
+#define I2C_BUS_TIMEOUT              1000       /*!< ms a transaction waits for the bus, then for its completion */
+#define I2C_BUS_MAX_TRANSFERS        I2C_BUS_MAX_DEVICES   /*!< Transfers batched in a single transaction */
+
+#if defined(CONFIG_MCP9808_RESOLUTION_0_5)
+#define MCP9808_DEFAULT_RESOLUTION   MCP9808_RESOLUTION_0_5
+#elif defined(CONFIG_MCP9808_RESOLUTION_0_25)
+#define MCP9808_DEFAULT_RESOLUTION   MCP9808_RESOLUTION_0_25
+#elif defined(CONFIG_MCP9808_RESOLUTION_0_125)
+#define MCP9808_DEFAULT_RESOLUTION   MCP9808_RESOLUTION_0_125
+#else
+#define MCP9808_DEFAULT_RESOLUTION   MCP9808_RESOLUTION_0_0625
+#endif
+
+#if defined(CONFIG_MCP9808_SCAN)
+#define MCP9808_SCAN                 true
+#else
+#define MCP9808_SCAN                 false
+#endif
+
+#if defined(CONFIG_MCP9808_ONE_SHOT)
+#define MCP9808_DEFAULT_MODE         MCP9808_MODE_ONE_SHOT
+#else
+#define MCP9808_DEFAULT_MODE         MCP9808_MODE_CONTINUOUS
+#endif
+
+#if defined(CONFIG_LDR_STREAM)
+#define LDR_DEFAULT_MODE             LDR_MODE_STREAM
+#define LDR_SAMPLE_RATE              CONFIG_LDR_SAMPLE_RATE
+#else
+#define LDR_DEFAULT_MODE             LDR_MODE_SINGLE
+#define LDR_SAMPLE_RATE              4000
+#endif
 
 /* IoT configuration from menu-config */
 #define HUB_WIFI_SSID                 CONFIG_WIFI_SSID
@@ -21,12 +62,103 @@ extern "C" {
 #define HUB_AZURE_HOST_NAME           CONFIG_AZURE_HOST_NAME
 #define HUB_AZURE_DEVICE_ID           CONFIG_AZURE_DEVICE_ID
 #define HUB_AZURE_DEVICE_PRIMARY_KEY  CONFIG_AZURE_DEVICE_PRIMARY_KEY
+#define IOTHUB_EVENT_POOL_SIZE        8          /*!< Sent messages awaiting confirmation without heap allocation */
+
+/* Telemetry configuration from menu-config */
+#define TELEMETRY_MESSAGE_POOL_SIZE   CONFIG_TELEMETRY_MESSAGE_POOL_SIZE
+#define TELEMETRY_MESSAGE_ARENA_SIZE  CONFIG_TELEMETRY_MESSAGE_ARENA_SIZE
+#define TELEMETRY_MESSAGE_MAX_FIELDS  CONFIG_TELEMETRY_MESSAGE_MAX_FIELDS
+#define TELEMETRY_QUEUE_LENGTH        CONFIG_TELEMETRY_QUEUE_LENGTH
+#define TELEMETRY_SAMPLE_SEND_TIMEOUT 500        /*!< ms the block policy waits for room in the telemetry queue */
+
+#if defined(CONFIG_TELEMETRY_QUEUE_DROP_OLDEST)
+#define TELEMETRY_QUEUE_POLICY        TELEMETRY_RING_DROP_OLDEST
+#elif defined(CONFIG_TELEMETRY_QUEUE_DROP_NEWEST)
+#define TELEMETRY_QUEUE_POLICY        TELEMETRY_RING_DROP_NEWEST
+#else
+#define TELEMETRY_QUEUE_POLICY        TELEMETRY_RING_BLOCK
+#endif
+
+#define TELEMETRY_BACKLOG_LENGTH      CONFIG_TELEMETRY_BACKLOG_LENGTH
+#define TELEMETRY_LOG_PARTITION       CONFIG_TELEMETRY_LOG_PARTITION
+#define TELEMETRY_LOG_REPLAY_BATCH    CONFIG_TELEMETRY_LOG_REPLAY_BATCH
+#define TELEMETRY_LOG_REPLAY_INTERVAL CONFIG_TELEMETRY_LOG_REPLAY_INTERVAL
+
+#define TELEMETRY_SERIES_BLOCK_SIZE   CONFIG_TELEMETRY_SERIES_BLOCK_SIZE
+#define TELEMETRY_SERIES_BATCH_CYCLES CONFIG_TELEMETRY_SERIES_BATCH_CYCLES
+#define TELEMETRY_SERIES_OUTPUT_SIZE  (TELEMETRY_MESSAGE_MAX_FIELDS * (TELEMETRY_SERIES_BLOCK_SIZE + 32) + TELEMETRY_MESSAGE_ARENA_SIZE)
+
+#define TELEMETRY_BATCH_SIZE          CONFIG_TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_INTERVAL      CONFIG_TELEMETRY_BATCH_INTERVAL
+#define TELEMETRY_BATCH_MAX_PAYLOAD   CONFIG_TELEMETRY_BATCH_MAX_PAYLOAD
+
+#define TELEMETRY_BENCHMARK_ITERATIONS      1000   /*!< Messages serialized by each benchmark run unless set by the method call */
+#define TELEMETRY_BENCHMARK_MAX_ITERATIONS  2000   /*!< Largest iterations of a method call, the runs block the hub task */
+#define TELEMETRY_BENCHMARK_RESPONSE_SIZE   3072   /*!< Size of the benchmark method's json response */
+#define LDR_BENCHMARK_ITERATIONS            1000   /*!< DMA blocks of the LDR benchmark unless set by the method call */
+#define LDR_BENCHMARK_MAX_ITERATIONS        2000   /*!< Largest DMA blocks of a method call, the run blocks the hub task */
+
+#if defined(CONFIG_TELEMETRY_ENCODING_CBOR)
+#define TELEMETRY_DEFAULT_ENCODING    TELEMETRY_ENCODING_CBOR
+#elif defined(CONFIG_TELEMETRY_ENCODING_SERIES)
+#define TELEMETRY_DEFAULT_ENCODING    TELEMETRY_ENCODING_SERIES
+#else
+#define TELEMETRY_DEFAULT_ENCODING    TELEMETRY_ENCODING_JSON
+#endif
+
+/* Device sensors */
+#define DEVICE_MAX_SENSORS            10         /*!< Sensors a device can hold, a full bus of MCP9808 and the others */
+#define DEVICE_SENSOR_NAME_LENGTH     16         /*!< Sensor names, including the null terminator */
+#define DEVICE_SENSOR_STATE_SIZE      256        /*!< Bytes of driver state held in each sensor table entry */
+#define DEVICE_MIN_SENSOR_INTERVAL    100        /*!< Shortest sensor reading interval in ms */
+#define DEVICE_MAX_SENSOR_INTERVAL    3600000    /*!< Longest sensor reading interval in ms */
+#define DEVICE_READ_TIMEOUT           1000       /*!< ms to wait for the sensors of a sampling cycle */
+#define DEVICE_WORKER_STACK_SIZE      2048       /*!< Stack of the task reading each sensor bus */
+#define DEVICE_POLL_FRAME_SIZE        1024       /*!< Stack of the polling task's scheduling, logging and posting */
+#define DEVICE_POLL_STACK_SIZE        (DEVICE_WORKER_STACK_SIZE + DEVICE_POLL_FRAME_SIZE)  /*!< Also reads a single bus in place */
+#define DEVICE_MAX_CATCH_UP           3          /*!< Missed readings caught up before they are skipped */
+#define DEVICE_SENSOR_FAILURE_THRESHOLD  3       /*!< Consecutive failed readings opening a sensor's circuit */
+#define DEVICE_SENSOR_BACKOFF_MIN     5000       /*!< ms before the first probe of an open circuit */
+#define DEVICE_SENSOR_BACKOFF_MAX     600000     /*!< Longest ms between the probes of an open circuit */
+#define DEVICE_SENSOR_CACHE_SIZE      8          /*!< Samples of a sensor's last good result kept to be posted again */
+#define DEVICE_SENSOR_MAX_AGE         300000     /*!< ms after which a sensor's last good result is no longer posted */
+
+#if defined(CONFIG_DEVICE_OVERRUN_CATCH_UP)
+#define DEVICE_DEFAULT_OVERRUN_POLICY DEVICE_OVERRUN_CATCH_UP
+#else
+#define DEVICE_DEFAULT_OVERRUN_POLICY DEVICE_OVERRUN_SKIP
+#endif
 
 /* Thread initialization synchronization bits for RTOS event groups */
 #define WIFI_CONNECTED_BIT            BIT0
 #define IOTHUB_INITIALIZED_BIT        BIT1
 #define IOTHUB_CONNECTED_BIT          BIT2
 
+/*
+ * A sensor's configuration
+ */
+typedef struct {
+    /*
+    * The sensor's name, its key in the sensorIntervals device twin property
+    */
+    char name[DEVICE_SENSOR_NAME_LENGTH];
+
+    /*
+    * Number of ms between each reading of this sensor. 0 follows sensor_sampling_rate
+    * Range: 0, DEVICE_MIN_SENSOR_INTERVAL - DEVICE_MAX_SENSOR_INTERVAL
+    * Default: set by device_add_sensor
+    */
+    uint32_t interval;
+
+    /*
+    * The sensor's alert, set from the sensorAlerts device twin property. An alert reads the sensor right away.
+    * Range: -40 - 125 for the limits, 0 - 6 for the hysteresis
+    * Default: disabled, or set by device_set_sensor_alert
+    */
+    SENSOR_ALERT alert;
+    volatile bool alert_changed;    // Set once the alert is updated, cleared when it was programmed in the sensor
+} sensor_config_t;
+
 /*
  * The device configuration type
  */
@@ -45,13 +177,54 @@ typedef struct {
     * Default: 100 (10 times per second)
     */
     uint16_t hub_pooling_rate;
+
+    /*
+    * The wire format of the telemetry messages sent to the IoT hub.
+    * Values: json, cbor, series
+    * Default: set from menu-config
+    */
+    TELEMETRY_ENCODING telemetry_encoding;
+
+    /*
+    * Number of json or cbor sampling cycles sent in a single IoT hub message.
+    * Range: 1 - 1000
+    * Default: set from menu-config
+    */
+    uint16_t telemetry_batch_size;
+
+    /*
+    * Maximum number of ms a sampling cycle waits in a batch before the batch is sent.
+    * Range: 1000 - 3600000
+    * Default: set from menu-config
+    */
+    uint32_t telemetry_batch_interval;
+
+    /*
+    * Maximum size in bytes of a batched message payload.
+    * Range: TELEMETRY_MESSAGE_ARENA_SIZE - TELEMETRY_BATCH_MAX_PAYLOAD
+    * Default: TELEMETRY_BATCH_MAX_PAYLOAD
+    */
+    uint16_t telemetry_batch_max_payload;
+
+    /*
+    * What the sampling loop does with the readings a late sampling cycle missed.
+    * Values: skip, catchUp
+    * Default: set from menu-config
+    */
+    DEVICE_OVERRUN_POLICY overrun_policy;
+
+    /*
+    * Configuration of the sensors added to the device, by order of addition.
+    */
+    sensor_config_t sensors[DEVICE_MAX_SENSORS];
+    uint8_t sensor_count;
 } device_config_t;
 
 /* 
  * FreeRTOS event group to synchronize thread initialization:
  *   - IoT Hub thread waits for Wi-Fi to be connected
  *   - IoT Hub event pump thread waits or IoT Hub to be initialized
- *   - Sensor thread waits for IoT Hub to be connected
+ *   - IoT Hub thread holds the sensor samples until IoT Hub is connected
  */
 EventGroupHandle_t _wifi_event_group;
 
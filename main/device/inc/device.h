@@ -16,9 +16,46 @@ typedef uint32_t DEVICE_HANDLE;
 #define DEVICE_STATUS_OK           0x0000
 #define DEVICE_STATUS_FAILED       0x0001
 
+/**
+ * @brief   What the sampling loop does when a cycle ends after a sensor's next reading was due
+ */
+typedef enum
+{
+    DEVICE_OVERRUN_SKIP,        // Skip the missed readings, the sensor keeps its phase
+    DEVICE_OVERRUN_CATCH_UP     // Read the sensor again right away, up to DEVICE_MAX_CATCH_UP missed readings
+} DEVICE_OVERRUN_POLICY;
+
+/**
+ * @brief   A sensor's circuit breaker state, posted as the sensor's <name>Health telemetry field
+ */
+typedef enum
+{
+    DEVICE_SENSOR_HEALTH_CLOSED = 0,    // Read on its schedule
+    DEVICE_SENSOR_HEALTH_OPEN = 1,      // Failing, not read until its backoff elapsed
+    DEVICE_SENSOR_HEALTH_HALF_OPEN = 2  // Probed once after its backoff
+} DEVICE_SENSOR_HEALTH;
+
+/**
+ * @brief   Sampling cycle statistics. Sensors on different buses are read concurrently, a cycle's wall time
+ *          is lower than the total time of its readings when it reads several buses.
+ */
+typedef struct DEVICE_STATISTICS_TAG
+{
+    uint32_t cycles;            // Sampling cycles run
+    int64_t cycle_time;         // Wall time of the last cycle's readings in us
+    int64_t max_cycle_time;     // Longest cycle wall time in us
+    int64_t read_time;          // Total time of the last cycle's readings in us
+    int64_t jitter;             // Largest period jitter of the last cycle's readings in us
+    int64_t max_jitter;         // Largest period jitter in us
+    uint32_t overruns;          // Readings that ended after the sensor's next reading was due
+    uint32_t skipped;           // Readings skipped by the overrun policy
+    uint32_t cached;            // Results posted again from the sensors' cache, instead of a reading
+    uint32_t triggered;         // Readings out of the schedule, triggered by the sensors' alerts
+} DEVICE_STATISTICS;
+
 /**
  * @brief Create a device. Each device create a thread, read sensors and dispatch sensor telemetry to the iot-hub
- *        through a messaging queue.
+ *        through a messaging queue of TELEMETRY_SAMPLE records.
  * 
  * @param[in]  deviceId      The device's name
  * @param[in]  telemetry_queue  The queue's handle on which telemetry data will be posted.
@@ -26,7 +63,7 @@ typedef uint32_t DEVICE_HANDLE;
  * @return 
  *          - The device's handle  
  */
-DEVICE_HANDLE device_create(const char * deviceId, QueueHandle_t telemetry_queue);
+DEVICE_HANDLE device_create(const char * deviceId, telemetry_ring_handle_t telemetry_queue);
 
 /**
  * @brief Stops the device and dispose of    allocated resources
@@ -37,20 +74,40 @@ DEVICE_HANDLE device_create(const char * deviceId, QueueHandle_t telemetry_queue
 void device_destroy(DEVICE_HANDLE handle);
 
 /**
- * @brief Add a sensor to this device. Each sensor's add its telemetry to the messaging
+ * @brief Add a sensor to this device. Each sensor's add its telemetry to the messaging. The sensor declares
+ *        its telemetry fields in the device's telemetry schema, the device declares the sensor's <name>Health,
+ *        <name>Failures and <name>Age fields.
  *
  * @param[in]  handle            The device's handle from device_create
+ * @param[in]  name              The sensor's name, its key in the sensorIntervals device twin property
  * @param[in]  sensor_interface  The sensor's interface
  * @param[in]  sensor_options    The sensor's options to be used in SENSOR_SET_OPTIONS
+ * @param[in]  interval          Number of ms between the sensor's readings, 0 follows the device sampling rate
  *
  * @return
  *          - DEVICE_STATUS_OK if sensor added successfully
- *          - DEVICE_STATUS_FAILED if unable to add sensor
+ *          - DEVICE_STATUS_FAILED if unable to add sensor, or if its fields would not fit in a telemetry message.
+ *            The sensor's fields are then removed from the schema, the device is left as it was.
  */
-uint32_t device_add_sensor(DEVICE_HANDLE handle, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, void * sensor_options);
+uint32_t device_add_sensor(DEVICE_HANDLE handle, const char * name, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, void * sensor_options, uint32_t interval);
  
 /**
- * @brief  Starts reading telemetry from the sensor and send data to the messaging queue.
+ * @brief  Set the alert of a sensor that supports SENSOR_SET_ALERT. The alert is programmed in the sensor when the
+ *         device starts, or before the next sampling cycle of a started device.
+ *
+ * @param[in]  handle          The device's handle from device_create
+ * @param[in]  name            The sensor's name given to device_add_sensor
+ * @param[in]  alert           The sensor's alert
+ *
+ * @return
+ *          - DEVICE_STATUS_OK if the alert was set
+ *          - DEVICE_STATUS_FAILED if the device has no such sensor
+ */
+uint32_t device_set_sensor_alert(DEVICE_HANDLE handle, const char * name, const SENSOR_ALERT * alert);
+
+/**
+ * @brief  Starts reading telemetry from the sensor and send data to the messaging queue. The sensors are read
+ *         right away, without waiting for the IoT hub connection.
  *
  * @param[in]  handle          The device's handle from device_create
  * 
@@ -60,6 +117,56 @@ uint32_t device_add_sensor(DEVICE_HANDLE handle, const SENSOR_INTERFACE_DESCRIPT
  */
 uint32_t device_start(DEVICE_HANDLE handle);
 
+/**
+ * @brief  Get the device's telemetry schema, in which the field ids of the posted samples are declared
+ *
+ * @param[in]  handle          The device's handle from device_create
+ *
+ * @return
+ *          - The telemetry schema handle
+ */
+telemetry_schema_handle_t device_get_telemetry_schema(DEVICE_HANDLE handle);
+
+/**
+ * @brief  Get the field of the device's telemetry schema in which the time a sample was taken is sent
+ *
+ * @param[in]  handle          The device's handle from device_create
+ *
+ * @return
+ *          - The sampleTime field id
+ */
+telemetry_field_id_t device_get_sample_time_field(DEVICE_HANDLE handle);
+
+/**
+ * @brief  Get the device's sampling cycle statistics
+ *
+ * @param[in]  handle          The device's handle from device_create
+ * @param[out] statistics      The sampling cycle statistics
+ */
+void device_get_statistics(DEVICE_HANDLE handle, DEVICE_STATISTICS * statistics);
+
+/**
+ * @brief  Get the overrun policy from its name
+ *
+ * @param[in]  name        The policy's name: "skip" or "catchUp"
+ * @param[out] policy      The overrun policy
+ *
+ * @return
+ *          - true if the name is a known policy
+ *          - false otherwise
+ */
+bool device_overrun_policy_from_name(const char * name, DEVICE_OVERRUN_POLICY * policy);
+
+/**
+ * @brief  Get the name of an overrun policy
+ *
+ * @param[in]  policy      The overrun policy
+ *
+ * @return
+ *          - The policy's name
+ */
+const char * device_overrun_policy_get_name(DEVICE_OVERRUN_POLICY policy);
+
 #ifdef __cplusplus
 }
 #endif
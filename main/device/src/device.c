@@ -1,31 +1,335 @@
 #include "device.h"
 #include "device-config.h"
 
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
-typedef struct SENSOR_QUEUE_TAG
+#define DEVICE_SAMPLE_SENSOR_ID     0xFF    // Sensor id of the device's own samples
+
+/*
+ * A sensor's last good result, posted again when the sensor is due before its minimum interval or its reading failed
+ */
+typedef struct DEVICE_SENSOR_CACHE_TAG
 {
+    int64_t time;               // Time in us of the cached reading, 0 while the cache is empty
+    uint8_t count;
+    TELEMETRY_SAMPLE samples[DEVICE_SENSOR_CACHE_SIZE];
+} DEVICE_SENSOR_CACHE;
+
+/*
+ * An entry of the device's sensor table. The driver's state, options included, is created in place in the entry.
+ */
+struct DEVICE_TAG;
+
+typedef struct DEVICE_SENSOR_TAG
+{
+    struct DEVICE_TAG * device;
     SENSOR_HANDLE handle;
+    uint8_t id;
+    uint8_t worker;             // Index of the worker reading the sensor's bus
+    int status;                 // Status of the last reading
+    int64_t read_time;          // Duration of the last reading in us
+    int64_t last_started;       // Start in us of the cycle of the previous reading, 0 before the first reading
+    TickType_t last_due;        // Scheduled tick of the previous reading
+    DEVICE_SENSOR_HEALTH health;
+    uint16_t consecutive_failures;
+    TickType_t backoff;         // Ticks the sensor is left alone after its circuit opened
+    TickType_t min_interval;    // Ticks the driver needs between two readings
+    bool resting;               // Due before its minimum interval, the cycle posts its cache without reading it
+    bool triggered;             // Read out of its schedule by the cycle, after its alert
+    DEVICE_SENSOR_CACHE cache;
+    telemetry_field_id_t health_field;
+    telemetry_field_id_t failures_field;
+    telemetry_field_id_t age_field;
     const SENSOR_INTERFACE_DESCRIPTION * interface;
-    struct SENSOR_QUEUE_TAG * next;
-} SENSOR_QUEUE;
+    uint64_t state[(DEVICE_SENSOR_STATE_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+} DEVICE_SENSOR;
+
+/*
+ * Reads the sensors of one bus in its own task, so that sensors on different buses are read concurrently
+ */
+typedef struct DEVICE_WORKER_TAG
+{
+    uint32_t bus;
+    TaskHandle_t task;
+    EventGroupHandle_t done;    // The device's read events, the worker's bit is set once its sensors are read
+    EventBits_t done_bit;
+    bool busy;                  // Reading, possibly past the previous cycle's timeout
+    uint8_t pending_count;
+    DEVICE_SENSOR * pending[DEVICE_MAX_SENSORS];
+    int status[DEVICE_MAX_SENSORS];             // Results of the pending sensors, owned by the worker until it is done
+    int64_t read_time[DEVICE_MAX_SENSORS];
+} DEVICE_WORKER;
+
+typedef struct DEVICE_SCHEDULE_ENTRY_TAG
+{
+    TickType_t due;             // Tick at which the sensor is due for reading
+    DEVICE_SENSOR * sensor;
+} DEVICE_SCHEDULE_ENTRY;
 
 typedef struct DEVICE_TAG
 {
     char * deviceId;
-    QueueHandle_t telemetry_queue;
-    SENSOR_QUEUE * sensors;
+    telemetry_ring_handle_t telemetry_queue;
+    telemetry_schema_handle_t schema;
+    DEVICE_SENSOR sensors[DEVICE_MAX_SENSORS];     // Sensor table, by order of addition
+    uint8_t sensor_count;
+    DEVICE_SCHEDULE_ENTRY schedule[DEVICE_MAX_SENSORS];    // Min-heap of the sensors' next readings
+    uint8_t schedule_count;
+    DEVICE_WORKER workers[DEVICE_MAX_SENSORS];
+    uint8_t worker_count;
+    EventGroupHandle_t read_events;
+    TaskHandle_t poll_task;
+    uint32_t triggered;         // Bits of the sensors whose alert requested a reading, set from interrupt handlers
+    DEVICE_STATISTICS statistics;
+    telemetry_field_id_t cycle_time_field;
+    telemetry_field_id_t read_time_field;
+    telemetry_field_id_t jitter_field;
+    telemetry_field_id_t overruns_field;
+    telemetry_field_id_t sample_time_field;
 } DEVICE;
 
 static const char *TAG = "DEVICE";
 
 void task_poll_sensors_telemetry(void * ptr);
+void task_read_sensors(void * ptr);
+
+// Tick comparison that survives the tick count wrapping around
+static bool device_tick_before(TickType_t tick, TickType_t other)
+{
+    return (int32_t)(tick - other) < 0;
+}
+
+/**
+ * @brief Add a sensor's next reading to the schedule's min-heap
+ */
+static void device_schedule_push(DEVICE * device, DEVICE_SENSOR * sensor, TickType_t due)
+{
+    size_t index = device->schedule_count++;
+
+    // Sift up
+    while (index > 0 && device_tick_before(due, device->schedule[(index - 1) / 2].due))
+    {
+        device->schedule[index] = device->schedule[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+
+    device->schedule[index].due = due;
+    device->schedule[index].sensor = sensor;
+}
+
+/**
+ * @brief Remove the earliest reading from the schedule's min-heap
+ */
+static DEVICE_SCHEDULE_ENTRY device_schedule_pop(DEVICE * device)
+{
+    DEVICE_SCHEDULE_ENTRY first = device->schedule[0];
+    DEVICE_SCHEDULE_ENTRY last = device->schedule[--device->schedule_count];
+    size_t index = 0;
+
+    // Sift down
+    while (true)
+    {
+        size_t child = 2 * index + 1;
+
+        if (child >= device->schedule_count)
+        {
+            break;
+        }
+
+        if (child + 1 < device->schedule_count && device_tick_before(device->schedule[child + 1].due, device->schedule[child].due))
+        {
+            child++;
+        }
+
+        if (!device_tick_before(device->schedule[child].due, last.due))
+        {
+            break;
+        }
+
+        device->schedule[index] = device->schedule[child];
+        index = child;
+    }
+
+    device->schedule[index] = last;
+
+    return first;
+}
+
+/**
+ * @brief Get a sensor's reading interval, as currently set from the device twin
+ */
+static TickType_t device_get_sensor_interval(const DEVICE_SENSOR * sensor)
+{
+    uint32_t interval = _device_configuration.sensors[sensor->id].interval;
+
+    if (interval == 0)
+    {
+        interval = _device_configuration.sensor_sampling_rate;
+    }
+
+    TickType_t ticks = interval / portTICK_PERIOD_MS;
+
+    return (ticks > 0) ? ticks : 1;
+}
+
+/**
+ * @brief Get the tick of a sensor's next reading. The schedule is absolute: the next reading is due one interval
+ *        after the scheduled tick of the current one, whatever the time the reading took. When the cycle overran
+ *        the next due tick, the overrun policy either reads the sensor again right away to catch up, or skips
+ *        the missed readings while keeping the sensor's phase.
+ */
+static TickType_t device_get_next_due(DEVICE * device, const DEVICE_SENSOR * sensor, TickType_t due, TickType_t now)
+{
+    TickType_t interval = device_get_sensor_interval(sensor);
+    TickType_t next = due + interval;
+
+    if (device_tick_before(now, next))
+    {
+        return next;
+    }
+
+    // Number of readings due at or before now
+    uint32_t missed = (now - next) / interval + 1;
+    device->statistics.overruns++;
+
+    if (_device_configuration.overrun_policy == DEVICE_OVERRUN_CATCH_UP && missed <= DEVICE_MAX_CATCH_UP)
+    {
+        return next;
+    }
+
+    device->statistics.skipped += missed;
+
+    return next + missed * interval;
+}
+
+/**
+ * @brief Track a sensor's reading in its circuit breaker. After DEVICE_SENSOR_FAILURE_THRESHOLD consecutive
+ *        failures the circuit opens: the sensor is not read until its backoff elapsed, then a single half open
+ *        probe closes the circuit on success, or reopens it with a doubled backoff.
+ *
+ * @return
+ *          - The tick before which the sensor must not be read again
+ */
+static TickType_t device_track_health(DEVICE_SENSOR * sensor, TickType_t now)
+{
+    if (sensor->status == SENSOR_STATUS_OK)
+    {
+        if (sensor->health != DEVICE_SENSOR_HEALTH_CLOSED)
+        {
+            ESP_LOGI(TAG, "Sensor %s recovered\n", _device_configuration.sensors[sensor->id].name);
+        }
+
+        sensor->health = DEVICE_SENSOR_HEALTH_CLOSED;
+        sensor->consecutive_failures = 0;
+        sensor->backoff = 0;
+
+        return now;
+    }
+
+    sensor->consecutive_failures += (sensor->consecutive_failures < UINT16_MAX) ? 1 : 0;
+
+    if (sensor->health == DEVICE_SENSOR_HEALTH_HALF_OPEN)
+    {
+        TickType_t backoff_max = DEVICE_SENSOR_BACKOFF_MAX / portTICK_PERIOD_MS;
+        sensor->backoff = (sensor->backoff < backoff_max / 2) ? sensor->backoff * 2 : backoff_max;
+    }
+    else if (sensor->consecutive_failures >= DEVICE_SENSOR_FAILURE_THRESHOLD)
+    {
+        sensor->backoff = DEVICE_SENSOR_BACKOFF_MIN / portTICK_PERIOD_MS;
+    }
+    else
+    {
+        return now;
+    }
+
+    ESP_LOGE(TAG, "Sensor %s failed %d times, retrying in %dms\n", _device_configuration.sensors[sensor->id].name,
+        sensor->consecutive_failures, (int) (sensor->backoff * portTICK_PERIOD_MS));
+
+    sensor->health = DEVICE_SENSOR_HEALTH_OPEN;
+
+    return now + sensor->backoff;
+}
+
+/**
+ * @brief Check whether a sensor is due before its driver's minimum interval since its previous reading
+ */
+static bool device_sensor_is_resting(const DEVICE_SENSOR * sensor, TickType_t now)
+{
+    return sensor->last_started != 0 && (TickType_t)(now - sensor->last_due) < sensor->min_interval;
+}
+
+/**
+ * @brief Post a sensor's result and its age. A good reading is posted and captured in the sensor's cache, otherwise
+ *        the cached result is posted again, unless it is older than DEVICE_SENSOR_MAX_AGE.
+ *
+ * @return
+ *          - true if a result was posted
+ */
+static bool device_post_sensor_results(DEVICE * device, DEVICE_SENSOR * sensor, TELEMETRY_SAMPLE_WRITER * writer)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (!sensor->resting && sensor->status == SENSOR_STATUS_OK)
+    {
+        telemetry_sample_writer_capture(writer, sensor->cache.samples, DEVICE_SENSOR_CACHE_SIZE);
+        sensor->interface->sensor_post_results(sensor->handle, writer);
+
+        // A result larger than the cache is not cached
+        sensor->cache.time = (writer->captured <= DEVICE_SENSOR_CACHE_SIZE) ? now : 0;
+        sensor->cache.count = writer->captured;
+        telemetry_sample_writer_capture(writer, NULL, 0);
+
+        telemetry_sample_write(writer, sensor->age_field, 0);
+
+        return true;
+    }
+
+    if (sensor->cache.time == 0 || now - sensor->cache.time > (int64_t) DEVICE_SENSOR_MAX_AGE * 1000)
+    {
+        return false;
+    }
+
+    for (uint8_t index = 0; index < sensor->cache.count; ++index)
+    {
+        telemetry_sample_write(writer, sensor->cache.samples[index].field_id, sensor->cache.samples[index].value);
+    }
+
+    telemetry_sample_write(writer, sensor->age_field, (now - sensor->cache.time) / 1000);
+    device->statistics.cached++;
+
+    return true;
+}
+
+/**
+ * @brief Get the period jitter of a sensor's reading: the difference in us between the time elapsed since its
+ *        previous reading and the scheduled period
+ */
+static int64_t device_get_period_jitter(DEVICE_SENSOR * sensor, TickType_t due, int64_t started)
+{
+    int64_t jitter = 0;
+
+    if (sensor->last_started != 0)
+    {
+        int64_t period = (int64_t)(TickType_t)(due - sensor->last_due) * portTICK_PERIOD_MS * 1000;
+        jitter = (started - sensor->last_started) - period;
+    }
+
+    sensor->last_started = started;
+    sensor->last_due = due;
+
+    return (jitter < 0) ? -jitter : jitter;
+}
 
 /**
  * @brief Create a device. Each device create a thread, read sensors and dispatch sensor telemetry to the iot-hub
- *        through a messaging queue.
+ *        through a messaging queue of TELEMETRY_SAMPLE records.
  * 
  * @param[in]  deviceId         The device's name
  * @param[in]  telemetry_queue  The queue's handle on which telemetry data will be posted.
@@ -33,13 +337,31 @@ void task_poll_sensors_telemetry(void * ptr);
  * @return 
  *          - The device's handle  
  */
-DEVICE_HANDLE device_create(const char * deviceId, QueueHandle_t telemetry_queue)
+DEVICE_HANDLE device_create(const char * deviceId, telemetry_ring_handle_t telemetry_queue)
 {
     DEVICE * device = malloc(sizeof(DEVICE));
     device->deviceId = malloc(strlen(deviceId) + 1);
     strcpy(device->deviceId, deviceId);
-    device->sensors = NULL;
+    device->sensor_count = 0;
     device->telemetry_queue = telemetry_queue;
+    device->worker_count = 0;
+    device->read_events = NULL;
+    device->poll_task = NULL;
+    device->triggered = 0;
+    memset(&device->statistics, 0, sizeof(device->statistics));
+    device->schema = telemetry_schema_create();
+    telemetry_schema_add_string(device->schema, "deviceId", deviceId);
+
+    // Wall time of the sampling cycle's reads against their total time, which shows the concurrency's speedup
+    device->cycle_time_field = telemetry_schema_add_number_range(device->schema, "cycleTime", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+    device->read_time_field = telemetry_schema_add_number_range(device->schema, "readTime", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+
+    // Deviation of the readings from their absolute schedule
+    device->jitter_field = telemetry_schema_add_number_range(device->schema, "jitter", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+    device->overruns_field = telemetry_schema_add_number_range(device->schema, "overruns", 0, 0, UINT32_MAX);
+
+    // Set by the IoT hub when it sends a sample, declared here so that the sensors' arena check accounts for it
+    device->sample_time_field = telemetry_schema_add_number(device->schema, "sampleTime", 0);
 
     return (DEVICE_HANDLE) device;
 }
@@ -61,44 +383,110 @@ void device_destroy(DEVICE_HANDLE handle)
             free(device->deviceId);
         }
 
-        while (device->sensors != NULL)
+        for (uint8_t index = 0; index < device->sensor_count; ++index)
         {
-            SENSOR_QUEUE * sensor = device->sensors;
-            device->sensors = sensor->next;
-            sensor->interface->sensor_destroy(sensor->handle);
-            free(sensor);
+            device->sensors[index].interface->sensor_destroy(device->sensors[index].handle);
         }
 
+        telemetry_schema_destroy(device->schema);
         free(device);
     }
 }
 
+// A sensor left out: its fields are removed from the schema and its driver is destroyed
+static uint32_t device_discard_sensor(DEVICE * device, DEVICE_SENSOR * sensor, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, size_t field_count)
+{
+    telemetry_schema_truncate(device->schema, field_count);
+    sensor_interface->sensor_destroy(sensor->handle);
+
+    return DEVICE_STATUS_FAILED;
+}
+
 /**
- * @brief Add a sensor to this device. Each sensor's add its telemetry to the messaging
+ * @brief Add a sensor to this device. Each sensor's add its telemetry to the messaging. The sensor declares
+ *        its telemetry fields in the device's telemetry schema, the device declares the sensor's <name>Health,
+ *        <name>Failures and <name>Age fields.
  *
  * @param[in]  handle             The device's handle from device_create
+ * @param[in]  name               The sensor's name, its key in the sensorIntervals device twin property
  * @param[in]  sensor_interface   The sensor's interface
  * @param[in]  sensor_options     The sensor's options to be used in SENSOR_SET_OPTIONS
+ * @param[in]  interval           Number of ms between the sensor's readings, 0 follows the device sampling rate
  *
  * @return
  *          - DEVICE_STATUS_OK if sensor added successfully
- *          - DEVICE_STATUS_FAILED if unable to add sensor
+ *          - DEVICE_STATUS_FAILED if unable to add sensor, or if its fields would not fit in a telemetry message.
+ *            The sensor's fields are then removed from the schema, the device is left as it was.
  */
-uint32_t device_add_sensor(DEVICE_HANDLE handle, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, void * sensor_options)
+uint32_t device_add_sensor(DEVICE_HANDLE handle, const char * name, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, void * sensor_options, uint32_t interval)
 {
     DEVICE * device = (DEVICE *) handle;
     
-    if (device != NULL)
+    if (device != NULL && device->sensor_count < DEVICE_MAX_SENSORS)
     {
-        SENSOR_QUEUE * sensor = malloc(sizeof(SENSOR_QUEUE));
+        DEVICE_SENSOR * sensor = &device->sensors[device->sensor_count];
+        size_t field_count = telemetry_schema_get_field_count(device->schema);
+        sensor->handle = sensor_interface->sensor_create(sensor->state, sizeof(sensor->state));
 
-        if (sensor != NULL)
+        if (sensor->handle != 0)
         {
-            sensor->handle = sensor_interface->sensor_create();
             sensor_interface->sensor_set_options(sensor->handle, sensor_options);
+
+            if (sensor_interface->sensor_declare_fields(sensor->handle, device->schema) != SENSOR_STATUS_OK)
+            {
+                ESP_LOGE(TAG, "Sensor %s left out, unable to declare its telemetry fields\n", name);
+                return device_discard_sensor(device, sensor, sensor_interface, field_count);
+            }
+
+            // The sensor's circuit breaker state and consecutive failures, keyed by the sensor's name
+            char key[DEVICE_SENSOR_NAME_LENGTH + 8];
+            snprintf(key, sizeof(key), "%sHealth", name);
+            sensor->health_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, DEVICE_SENSOR_HEALTH_HALF_OPEN);
+            snprintf(key, sizeof(key), "%sFailures", name);
+            sensor->failures_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, UINT16_MAX);
+
+            // Number of ms since the posted result was read, 0 unless the sensor's cached result is posted again
+            snprintf(key, sizeof(key), "%sAge", name);
+            sensor->age_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, DEVICE_SENSOR_MAX_AGE);
+
+            if (sensor->health_field == TELEMETRY_FIELD_ID_INVALID || sensor->failures_field == TELEMETRY_FIELD_ID_INVALID ||
+                sensor->age_field == TELEMETRY_FIELD_ID_INVALID)
+            {
+                ESP_LOGE(TAG, "Sensor %s left out, unable to declare its health fields\n", name);
+                return device_discard_sensor(device, sensor, sensor_interface, field_count);
+            }
+
+            // Every message of the device is built from the schema's skeleton, it must fit in a message arena
+            size_t required = telemetry_schema_get_skeleton_size(device->schema);
+
+            if (required > TELEMETRY_MESSAGE_ARENA_SIZE)
+            {
+                ESP_LOGE(TAG, "Sensor %s left out, the telemetry message would need %d bytes of the %d bytes of a message arena\n",
+                    name, (int) required, TELEMETRY_MESSAGE_ARENA_SIZE);
+                return device_discard_sensor(device, sensor, sensor_interface, field_count);
+            }
+
+            sensor->device = device;
+            sensor->id = device->sensor_count++;
+            sensor->last_started = 0;
+            sensor->health = DEVICE_SENSOR_HEALTH_CLOSED;
+            sensor->consecutive_failures = 0;
+            sensor->backoff = 0;
+            sensor->min_interval = 0;
+            sensor->resting = false;
+            sensor->triggered = false;
+            sensor->cache.time = 0;
+            sensor->cache.count = 0;
+
+            sensor_config_t * config = &_device_configuration.sensors[sensor->id];
+            strncpy(config->name, name, sizeof(config->name) - 1);
+            config->name[sizeof(config->name) - 1] = '\0';
+            config->interval = interval;
+            config->alert.enabled = false;
+            config->alert_changed = false;
+            _device_configuration.sensor_count = device->sensor_count;
+
             sensor->interface = sensor_interface;
-            sensor->next = device->sensors;
-            device->sensors = sensor;
 
             return DEVICE_STATUS_OK;
         }
@@ -108,7 +496,129 @@ uint32_t device_add_sensor(DEVICE_HANDLE handle, const SENSOR_INTERFACE_DESCRIPT
 }
  
 /**
- * @brief  Starts reading telemetry from the sensor and send data to the messaging queue.
+ * @brief  Set the alert of a sensor that supports SENSOR_SET_ALERT. The alert is programmed in the sensor when the
+ *         device starts, or before the next sampling cycle of a started device.
+ *
+ * @param[in]  handle          The device's handle from device_create
+ * @param[in]  name            The sensor's name given to device_add_sensor
+ * @param[in]  alert           The sensor's alert
+ *
+ * @return
+ *          - DEVICE_STATUS_OK if the alert was set
+ *          - DEVICE_STATUS_FAILED if the device has no such sensor
+ */
+uint32_t device_set_sensor_alert(DEVICE_HANDLE handle, const char * name, const SENSOR_ALERT * alert)
+{
+    DEVICE * device = (DEVICE *) handle;
+
+    for (uint8_t index = 0; device != NULL && index < device->sensor_count; ++index)
+    {
+        sensor_config_t * config = &_device_configuration.sensors[index];
+
+        if (strcmp(config->name, name) == 0)
+        {
+            config->alert = *alert;
+            config->alert_changed = true;
+
+            return DEVICE_STATUS_OK;
+        }
+    }
+
+    return DEVICE_STATUS_FAILED;
+}
+
+/**
+ * @brief Program the alerts updated since the previous cycle in their sensors
+ */
+static void device_apply_alerts(DEVICE * device)
+{
+    for (uint8_t index = 0; index < device->sensor_count; ++index)
+    {
+        DEVICE_SENSOR * sensor = &device->sensors[index];
+        sensor_config_t * config = &_device_configuration.sensors[index];
+
+        // The driver of a sensor whose bus worker is still busy is left to it, its alert is set once it is done
+        if (!config->alert_changed || device->workers[sensor->worker].busy)
+        {
+            continue;
+        }
+
+        config->alert_changed = false;
+
+        if (sensor->interface->sensor_set_alert == NULL)
+        {
+            ESP_LOGE(TAG, "Sensor %s has no alert\n", config->name);
+        }
+        else if (sensor->interface->sensor_set_alert(sensor->handle, &config->alert) != SENSOR_STATUS_OK)
+        {
+            ESP_LOGE(TAG, "Unable to set the alert of sensor %s\n", config->name);
+        }
+    }
+}
+
+/**
+ * @brief Request a reading of the sensor out of its schedule. Called from the sensor's interrupt handler, so it
+ *        lives in IRAM.
+ */
+static void IRAM_ATTR device_sensor_triggered(void * context)
+{
+    DEVICE_SENSOR * sensor = (DEVICE_SENSOR *) context;
+    DEVICE * device = sensor->device;
+    BaseType_t woken = pdFALSE;
+
+    __atomic_fetch_or(&device->triggered, (uint32_t) 1 << sensor->id, __ATOMIC_RELAXED);
+
+    if (device->poll_task != NULL)
+    {
+        vTaskNotifyGiveFromISR(device->poll_task, &woken);
+    }
+
+    if (woken == pdTRUE)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief Assign a sensor to the worker of its bus, starting the worker on the bus's first sensor
+ */
+static uint32_t device_assign_worker(DEVICE * device, DEVICE_SENSOR * sensor)
+{
+    uint32_t bus = sensor->interface->sensor_get_bus(sensor->handle);
+
+    for (sensor->worker = 0; sensor->worker < device->worker_count; ++sensor->worker)
+    {
+        if (device->workers[sensor->worker].bus == bus)
+        {
+            return DEVICE_STATUS_OK;
+        }
+    }
+
+    if (device->read_events == NULL && (device->read_events = xEventGroupCreate()) == NULL)
+    {
+        return DEVICE_STATUS_FAILED;
+    }
+
+    DEVICE_WORKER * worker = &device->workers[device->worker_count];
+    worker->bus = bus;
+    worker->done = device->read_events;
+    worker->done_bit = (EventBits_t) 1 << device->worker_count;
+    worker->busy = false;
+    worker->pending_count = 0;
+
+    if (xTaskCreate(task_read_sensors, "Sensor Bus Thread", DEVICE_WORKER_STACK_SIZE, (void *) worker, 5, &worker->task) != pdPASS)
+    {
+        return DEVICE_STATUS_FAILED;
+    }
+
+    device->worker_count++;
+
+    return DEVICE_STATUS_OK;
+}
+
+/**
+ * @brief  Starts reading telemetry from the sensor and send data to the messaging queue. The sensors are read
+ *         right away, without waiting for the IoT hub connection.
  *
  * @param[in]  handle          The device's handle from device_create
  * 
@@ -122,62 +632,462 @@ uint32_t device_start(DEVICE_HANDLE handle)
 
     if (device != NULL)
     {
-        SENSOR_QUEUE * sensor = device->sensors;
+        if (!telemetry_schema_compile(device->schema))
+        {
+            ESP_LOGE(TAG, "Failed to compile the telemetry schema\n");
+            return DEVICE_STATUS_FAILED;
+        }
 
-        while (sensor != NULL)
+        for (uint8_t index = 0; index < device->sensor_count; ++index)
         {
+            DEVICE_SENSOR * sensor = &device->sensors[index];
+
             if (sensor->interface->sensor_initialize(sensor->handle) != SENSOR_STATUS_OK)
             {
                 ESP_LOGI(TAG, "Failed to initialize sensor\n");
                 return DEVICE_STATUS_FAILED;
             }
 
-            sensor = sensor->next;
+            if (sensor->interface->sensor_set_trigger != NULL)
+            {
+                sensor->interface->sensor_set_trigger(sensor->handle, device_sensor_triggered, sensor);
+            }
+
+            // Rounded up, a sensor is never read sooner than its driver supports
+            uint32_t min_interval = sensor_get_min_interval(sensor->interface, sensor->handle);
+            sensor->min_interval = (min_interval + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+            if (device_assign_worker(device, sensor) != DEVICE_STATUS_OK)
+            {
+                ESP_LOGE(TAG, "Failed to start the sensor's bus worker\n");
+                return DEVICE_STATUS_FAILED;
+            }
         }
 
-        xTaskCreate(task_poll_sensors_telemetry, "Sensors Polling Thread", 2048, (void *) device, 5, NULL);
+        device_apply_alerts(device);
+
+        xTaskCreate(task_poll_sensors_telemetry, "Sensors Polling Thread", DEVICE_POLL_STACK_SIZE, (void *) device, 5, &device->poll_task);
         return DEVICE_STATUS_OK;
     }
 
     return DEVICE_STATUS_FAILED;
 }
 
+/**
+ * @brief  Get the device's telemetry schema, in which the field ids of the posted samples are declared
+ *
+ * @param[in]  handle          The device's handle from device_create
+ *
+ * @return
+ *          - The telemetry schema handle
+ */
+telemetry_schema_handle_t device_get_telemetry_schema(DEVICE_HANDLE handle)
+{
+    DEVICE * device = (DEVICE *) handle;
+    return (device != NULL) ? device->schema : 0;
+}
+
+/**
+ * @brief  Get the field of the device's telemetry schema in which the time a sample was taken is sent
+ *
+ * @param[in]  handle          The device's handle from device_create
+ *
+ * @return
+ *          - The sampleTime field id
+ */
+telemetry_field_id_t device_get_sample_time_field(DEVICE_HANDLE handle)
+{
+    DEVICE * device = (DEVICE *) handle;
+    return (device != NULL) ? device->sample_time_field : 0;
+}
+
+/**
+ * @brief  Get the device's sampling cycle statistics
+ *
+ * @param[in]  handle          The device's handle from device_create
+ * @param[out] statistics      The sampling cycle statistics
+ */
+void device_get_statistics(DEVICE_HANDLE handle, DEVICE_STATISTICS * statistics)
+{
+    DEVICE * device = (DEVICE *) handle;
+
+    if (device != NULL)
+    {
+        *statistics = device->statistics;
+    }
+}
+
+/**
+ * @brief  Get the overrun policy from its name
+ *
+ * @param[in]  name        The policy's name: "skip" or "catchUp"
+ * @param[out] policy      The overrun policy
+ *
+ * @return
+ *          - true if the name is a known policy
+ *          - false otherwise
+ */
+bool device_overrun_policy_from_name(const char * name, DEVICE_OVERRUN_POLICY * policy)
+{
+    if (name == NULL)
+    {
+        return false;
+    }
+
+    if (strcasecmp(name, "skip") == 0)
+    {
+        *policy = DEVICE_OVERRUN_SKIP;
+        return true;
+    }
+
+    if (strcasecmp(name, "catchUp") == 0)
+    {
+        *policy = DEVICE_OVERRUN_CATCH_UP;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief  Get the name of an overrun policy
+ *
+ * @param[in]  policy      The overrun policy
+ *
+ * @return
+ *          - The policy's name
+ */
+const char * device_overrun_policy_get_name(DEVICE_OVERRUN_POLICY policy)
+{
+    return (policy == DEVICE_OVERRUN_CATCH_UP) ? "catchUp" : "skip";
+}
+
+/**
+ * @brief Read the pending sensors of a worker's bus: every conversion is started, the task sleeps once through the
+ *        longest one, then each reading is polled and fetched. Blocking sensors are read when their reading is
+ *        started. The results are left in the worker, the sensors themselves are only read.
+ */
+static void device_read_bus(DEVICE_WORKER * worker)
+{
+    int64_t started[DEVICE_MAX_SENSORS];
+    uint32_t conversion_time = 0;
+
+    for (uint8_t index = 0; index < worker->pending_count; ++index)
+    {
+        DEVICE_SENSOR * sensor = worker->pending[index];
+        uint32_t sensor_conversion_time;
+        started[index] = esp_timer_get_time();
+        worker->status[index] = sensor_begin_reading(sensor->interface, sensor->handle, &sensor_conversion_time);
+        worker->read_time[index] = esp_timer_get_time() - started[index];
+
+        if (worker->status[index] == SENSOR_STATUS_OK && sensor_conversion_time > conversion_time)
+        {
+            conversion_time = sensor_conversion_time;
+        }
+    }
+
+    if (conversion_time > 0)
+    {
+        vTaskDelay(conversion_time / portTICK_PERIOD_MS + 1);
+    }
+
+    TickType_t deadline = xTaskGetTickCount() + DEVICE_READ_TIMEOUT / portTICK_PERIOD_MS;
+
+    for (uint8_t index = 0; index < worker->pending_count; ++index)
+    {
+        DEVICE_SENSOR * sensor = worker->pending[index];
+        int status = worker->status[index];
+
+        if (status != SENSOR_STATUS_OK)
+        {
+            continue;
+        }
+
+        while ((status = sensor_poll_reading(sensor->interface, sensor->handle)) == SENSOR_STATUS_PENDING)
+        {
+            if (!device_tick_before(xTaskGetTickCount(), deadline))
+            {
+                status = SENSOR_STATUS_TIMEDOUT;
+                break;
+            }
+
+            vTaskDelay(1);
+        }
+
+        if (status == SENSOR_STATUS_OK)
+        {
+            status = sensor_fetch_reading(sensor->interface, sensor->handle);
+        }
+
+        worker->status[index] = status;
+
+        // From the start of the conversion to its result
+        worker->read_time[index] = esp_timer_get_time() - started[index];
+    }
+}
+
+/**
+ * @brief Copy the results of a worker that is done to its sensors
+ */
+static void device_collect_results(DEVICE_WORKER * worker)
+{
+    for (uint8_t index = 0; index < worker->pending_count; ++index)
+    {
+        worker->pending[index]->status = worker->status[index];
+        worker->pending[index]->read_time = worker->read_time[index];
+    }
+}
+
+void task_read_sensors(void * ptr)
+{
+    DEVICE_WORKER * worker = (DEVICE_WORKER *) ptr;
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        device_read_bus(worker);
+
+        xEventGroupSetBits(worker->done, worker->done_bit);
+    }
+}
+
+/**
+ * @brief Read the due sensors, concurrently across buses. Sensors of a bus still busy with a reading that timed out
+ *        in a previous cycle are skipped. A busy worker owns its sensors: they are left alone until its done bit is
+ *        seen, and only then are its results copied to them.
+ */
+static void device_read_sensors(DEVICE * device, DEVICE_SENSOR ** sensors, uint8_t count)
+{
+    EventBits_t busy_bits = 0;
+
+    for (uint8_t index = 0; index < device->worker_count; ++index)
+    {
+        busy_bits |= device->workers[index].busy ? device->workers[index].done_bit : 0;
+    }
+
+    // Workers that completed after their cycle timed out are free again, their late results are dropped
+    EventBits_t done_bits = (busy_bits != 0) ? xEventGroupClearBits(device->read_events, busy_bits) : 0;
+
+    for (uint8_t index = 0; index < device->worker_count; ++index)
+    {
+        DEVICE_WORKER * worker = &device->workers[index];
+        worker->busy = worker->busy && !(done_bits & worker->done_bit);
+
+        if (!worker->busy)
+        {
+            worker->pending_count = 0;
+        }
+    }
+
+    uint8_t active_count = 0;
+    DEVICE_WORKER * active = NULL;
+
+    for (uint8_t index = 0; index < count; ++index)
+    {
+        DEVICE_WORKER * worker = &device->workers[sensors[index]->worker];
+        sensors[index]->status = SENSOR_STATUS_TIMEDOUT;
+        sensors[index]->read_time = 0;
+
+        if (!worker->busy)
+        {
+            active_count += (worker->pending_count == 0) ? 1 : 0;
+            active = worker;
+            worker->pending[worker->pending_count++] = sensors[index];
+        }
+    }
+
+    // A single bus is read in place, without a task switch: the drivers then run on the DEVICE_POLL_STACK_SIZE stack
+    if (active_count == 1)
+    {
+        device_read_bus(active);
+        device_collect_results(active);
+
+        return;
+    }
+
+    EventBits_t wait_bits = 0;
+
+    for (uint8_t index = 0; index < device->worker_count; ++index)
+    {
+        DEVICE_WORKER * worker = &device->workers[index];
+
+        if (worker->pending_count > 0)
+        {
+            worker->busy = true;
+            wait_bits |= worker->done_bit;
+            xTaskNotifyGive(worker->task);
+        }
+    }
+
+    if (wait_bits == 0)
+    {
+        return;
+    }
+
+    done_bits = xEventGroupWaitBits(device->read_events, wait_bits, pdTRUE, pdTRUE, DEVICE_READ_TIMEOUT / portTICK_PERIOD_MS);
+
+    for (uint8_t index = 0; index < device->worker_count; ++index)
+    {
+        DEVICE_WORKER * worker = &device->workers[index];
+
+        if (!(wait_bits & worker->done_bit))
+        {
+            continue;
+        }
+
+        if (done_bits & worker->done_bit)
+        {
+            worker->busy = false;
+            device_collect_results(worker);
+        }
+        else
+        {
+            // Its sensors keep the timeout they were given above, the readings still in progress are not posted
+            ESP_LOGE(TAG, "Sensor bus 0x%x timed out after %dms\n", worker->bus, DEVICE_READ_TIMEOUT);
+        }
+    }
+}
+
 void task_poll_sensors_telemetry(void * ptr)
 {
     DEVICE * device = (DEVICE *) ptr;
 
-    ESP_LOGI(TAG, "Waiting or IoT Hub Connection");
+    // The hub task holds the samples until it is connected
+    ESP_LOGI(TAG, "Starting telemetry readings");
 
-    // Wait until IoT Hub is connected
-    xEventGroupWaitBits(_wifi_event_group, IOTHUB_CONNECTED_BIT, false, true, portMAX_DELAY);
+    // Every sensor is due right away
+    TickType_t now = xTaskGetTickCount();
 
-    ESP_LOGI(TAG, "Hub Connected. Starting telemetry readings");
+    for (uint8_t index = 0; index < device->sensor_count; ++index)
+    {
+        device_schedule_push(device, &device->sensors[index], now);
+    }
 
-    while(true)
+    while(device->schedule_count > 0)
     {
-        telemetry_message_handle_t message = telemetry_message_create_new();
-        telemetry_message_add_string(message, "deviceId", device->deviceId);
-        
-        SENSOR_QUEUE * sensor = device->sensors;
+        device_apply_alerts(device);
+
+        now = xTaskGetTickCount();
+        uint32_t triggered = __atomic_exchange_n(&device->triggered, 0, __ATOMIC_RELAXED);
 
-        while (sensor != NULL)
+        // Sleep until the next sensor is due or an alert triggers a reading. An interval changed from the twin applies
+        // from the sensor's next reading.
+        if (triggered == 0 && device_tick_before(now, device->schedule[0].due))
         {
-            if (sensor->interface->sensor_read(sensor->handle) == SENSOR_STATUS_OK)
+            ulTaskNotifyTake(pdTRUE, device->schedule[0].due - now);
+            continue;
+        }
+
+        // Every sensor due makes up one sampling cycle, the sensors due before their minimum interval are not read
+        DEVICE_SCHEDULE_ENTRY due[DEVICE_MAX_SENSORS];
+        DEVICE_SENSOR * sensors[DEVICE_MAX_SENSORS];
+        uint8_t count = 0;
+        uint8_t read_count = 0;
+
+        while (device->schedule_count > 0 && !device_tick_before(now, device->schedule[0].due))
+        {
+            due[count] = device_schedule_pop(device);
+            DEVICE_SENSOR * sensor = due[count++].sensor;
+            sensor->resting = device_sensor_is_resting(sensor, now);
+            sensor->triggered = false;
+            triggered &= ~((uint32_t) 1 << sensor->id);
+
+            if (sensor->resting)
+            {
+                continue;
+            }
+
+            // An open circuit is only due once its backoff elapsed, its reading is the half open probe
+            if (sensor->health == DEVICE_SENSOR_HEALTH_OPEN)
             {
-                sensor->interface->sensor_post_results(sensor->handle, message);
+                sensor->health = DEVICE_SENSOR_HEALTH_HALF_OPEN;
             }
 
-            sensor = sensor->next;
+            sensors[read_count++] = sensor;
         }
-        
-        // Send temperature on telemetry queue
-        if (!xQueueSend(device->telemetry_queue, &message, 500))
+
+        // The sensors whose alert triggered are read right away, even within their minimum interval: the alert
+        // follows a new conversion. A failing sensor is left to its circuit breaker.
+        for (uint8_t index = 0; index < device->sensor_count; ++index)
         {
-            ESP_LOGE(TAG, "Failed to send telemetry to queue within 500ms\n");
-            telemetry_message_destroy(message);
+            DEVICE_SENSOR * sensor = &device->sensors[index];
+
+            if ((triggered & ((uint32_t) 1 << sensor->id)) && sensor->health == DEVICE_SENSOR_HEALTH_CLOSED)
+            {
+                sensor->resting = false;
+                sensor->triggered = true;
+                due[count].due = now;
+                due[count++].sensor = sensor;
+                sensors[read_count++] = sensor;
+                device->statistics.triggered++;
+            }
+        }
+
+        TELEMETRY_SAMPLE_WRITER writer;
+        telemetry_sample_writer_begin(&writer, device->telemetry_queue);
+
+        int64_t started = esp_timer_get_time();
+        device_read_sensors(device, sensors, read_count);
+        int64_t cycle_time = esp_timer_get_time() - started;
+        int64_t read_time = 0;
+        int64_t jitter = 0;
+
+        for (uint8_t index = 0; index < count; ++index)
+        {
+            DEVICE_SENSOR * sensor = due[index].sensor;
+            writer.sensor_id = sensor->id;
+
+            // Post the readings by value on the telemetry queue, the hub task encodes them
+            device_post_sensor_results(device, sensor, &writer);
+
+            // A triggered reading is an extra, it leaves the sensor's schedule and circuit breaker alone
+            if (sensor->triggered)
+            {
+                read_time += sensor->read_time;
+                telemetry_sample_write(&writer, sensor->health_field, sensor->health);
+                telemetry_sample_write(&writer, sensor->failures_field, sensor->consecutive_failures);
+                continue;
+            }
+
+            TickType_t end = xTaskGetTickCount();
+            TickType_t retry = end;
+
+            // A resting sensor was not read, its health and phase are left as they are
+            if (!sensor->resting)
+            {
+                int64_t sensor_jitter = device_get_period_jitter(sensor, due[index].due, started);
+                jitter = (sensor_jitter > jitter) ? sensor_jitter : jitter;
+                read_time += sensor->read_time;
+                retry = device_track_health(sensor, end);
+            }
+
+            TickType_t next = device_get_next_due(device, sensor, due[index].due, end);
+
+            telemetry_sample_write(&writer, sensor->health_field, sensor->health);
+            telemetry_sample_write(&writer, sensor->failures_field, sensor->consecutive_failures);
+
+            device_schedule_push(device, sensor, device_tick_before(next, retry) ? retry : next);
         }
 
-        // Wait for current sampling delay
-        vTaskDelay(_device_configuration.sensor_sampling_rate/portTICK_PERIOD_MS);
+        device->statistics.cycles++;
+        device->statistics.cycle_time = cycle_time;
+        device->statistics.read_time = read_time;
+        device->statistics.max_cycle_time = (cycle_time > device->statistics.max_cycle_time) ? cycle_time : device->statistics.max_cycle_time;
+        device->statistics.jitter = jitter;
+        device->statistics.max_jitter = (jitter > device->statistics.max_jitter) ? jitter : device->statistics.max_jitter;
+
+        writer.sensor_id = DEVICE_SAMPLE_SENSOR_ID;
+        telemetry_sample_write(&writer, device->cycle_time_field, cycle_time / 1000.0);
+        telemetry_sample_write(&writer, device->read_time_field, read_time / 1000.0);
+        telemetry_sample_write(&writer, device->jitter_field, jitter / 1000.0);
+        telemetry_sample_write(&writer, device->overruns_field, device->statistics.overruns);
+
+        if (telemetry_sample_writer_end(&writer) > 0)
+        {
+            ESP_LOGE(TAG, "Failed to send %d telemetry samples to queue within %dms\n", writer.dropped, TELEMETRY_SAMPLE_SEND_TIMEOUT);
+        }
     }
+
+    vTaskDelete(NULL);
 }
@@ -18,24 +18,49 @@
 
 #include "device-config.h"
 #include "iot-hub.h"
-#include "telemetry-data.h"
+#include "telemetry-series.h"
+#include "telemetry-batch.h"
+#include "telemetry-benchmark.h"
+#include "ldr.h"
+#include "telemetry-ring.h"
+#include "telemetry-log.h"
 
 typedef struct 
 {
     const char * hostname;
     const char * device_id;
     const char * primary_key;
-    QueueHandle_t telemetry_queue;
+    telemetry_ring_handle_t telemetry_queue;
+    telemetry_log_handle_t telemetry_log;
+    telemetry_schema_handle_t telemetry_schema;
+    telemetry_field_id_t sample_time_field;
 } hub_configuration_t;
 
 typedef struct
 {
     IOTHUB_MESSAGE_HANDLE messageHandle;
     size_t messageTrackingId;  // For tracking the messages within the user callback.
+    bool pooled;               // Taken from the event pool rather than the heap
+    bool in_use;
 } EVENT_INSTANCE;
 
 static const char *TAG = "iot-hub";
 static hub_configuration_t _config;
+static telemetry_message_handle_t _pending_message;
+static telemetry_series_batch_handle_t _series_batch;
+static telemetry_batch_handle_t _batch;
+static TickType_t _batch_started;
+static uint32_t _pending_timestamp;
+static TickType_t _replay_started;
+static TELEMETRY_SAMPLE _backlog[TELEMETRY_BACKLOG_LENGTH];
+static uint16_t _backlog_first;
+static uint16_t _backlog_count;
+static uint32_t _backlog_dropped;
+static uint32_t _first_sample_time;
+static uint32_t _hub_connected_time;
+static bool _first_sample_received;
+static EVENT_INSTANCE _event_pool[IOTHUB_EVENT_POOL_SIZE];
+static IOTHUB_DISPATCH_STATISTICS _dispatch_statistics;
 IOTHUB_CLIENT_LL_HANDLE _iotHubClientHandle = NULL;
 
 void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void * ptr)
@@ -43,6 +68,11 @@ void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLI
     if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED) {
         ESP_LOGI(TAG, "Connected to IoT Hub\n");
         xEventGroupSetBits(_wifi_event_group, IOTHUB_CONNECTED_BIT);
+
+        if (_hub_connected_time == 0)
+        {
+            _hub_connected_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        }
     }
     else if (reason == IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN) {
         ESP_LOGE(TAG, "Disconnected from IoT Hub: Expired shared access token");
@@ -60,15 +90,54 @@ void ReportedStateCallback(int status_code, void * userContextCallback)
     ESP_LOGI(TAG, "Reported State Callback with status code %d", status_code)
 }
 
-esp_err_t iothub_reportTwinData()
+/**
+ * @brief Send a telemetry message as a reported state patch and destroy it. The hub merges the patches, which
+ *        keeps each one within a message arena.
+ *
+ * @param[in]  name        The reported property holding the message's fields, NULL to report them at the root
+ * @param[in]  child       The property of name holding the message's fields, NULL to report them in name
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ */
+static esp_err_t iothub_reportNestedTwinPatch(const char * name, const char * child, telemetry_message_handle_t handle)
 {
-    telemetry_message_handle_t handle = telemetry_message_create_new();
-    telemetry_message_add_number( handle, "samplingRate", _device_configuration.sensor_sampling_rate);
-    telemetry_message_add_number( handle, "hubPoolingRate", _device_configuration.hub_pooling_rate);
-    
     char * data = telemetry_message_to_json(handle);
 
-    int status = IoTHubClient_LL_SendReportedState(_iotHubClientHandle, (unsigned char *) data, strlen(data), ReportedStateCallback, NULL);
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to serialize reported state");
+        telemetry_message_destroy(handle);
+        return ESP_FAIL;
+    }
+
+    char * patch = data;
+
+    if (name != NULL)
+    {
+        size_t size = strlen(name) + strlen(data) + ((child != NULL) ? strlen(child) + 12 : 6);
+
+        if ((patch = malloc(size)) == NULL)
+        {
+            ESP_LOGE(TAG, "No memory for the reported state");
+            telemetry_message_destroy(handle);
+            return ESP_FAIL;
+        }
+
+        if (child != NULL)
+        {
+            snprintf(patch, size, "{\"%s\":{\"%s\":%s}}", name, child, data);
+        }
+        else
+        {
+            snprintf(patch, size, "{\"%s\":%s}", name, data);
+        }
+    }
+
+    int status = IoTHubClient_LL_SendReportedState(_iotHubClientHandle, (unsigned char *) patch, strlen(patch), ReportedStateCallback, NULL);
+
+    if (patch != data)
+    {
+        free(patch);
+    }
 
     telemetry_message_dispose_json(data);
     telemetry_message_destroy(handle);
@@ -76,6 +145,186 @@ esp_err_t iothub_reportTwinData()
     return (status == IOTHUB_CLIENT_OK) ? ESP_OK : ESP_FAIL;
 }
 
+/**
+ * @brief Send a telemetry message as a reported state patch and destroy it. The hub merges the patches, which
+ *        keeps each one within a message arena.
+ *
+ * @param[in]  name        The reported property holding the message's fields, NULL to report them at the root
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ */
+esp_err_t iothub_reportTwinPatch(const char * name, telemetry_message_handle_t handle)
+{
+    return iothub_reportNestedTwinPatch(name, NULL, handle);
+}
+
+esp_err_t iothub_reportTwinData()
+{
+    TELEMETRY_STATISTICS statistics;
+    telemetry_get_statistics(&statistics);
+
+    telemetry_message_handle_t handle = telemetry_message_create_new();
+    telemetry_message_add_number( handle, "samplingRate", _device_configuration.sensor_sampling_rate);
+    telemetry_message_add_number( handle, "hubPoolingRate", _device_configuration.hub_pooling_rate);
+    telemetry_message_add_string( handle, "telemetryEncoding", telemetry_encoding_get_name(_device_configuration.telemetry_encoding));
+    telemetry_message_add_number( handle, "batchSize", _device_configuration.telemetry_batch_size);
+    telemetry_message_add_number( handle, "batchInterval", _device_configuration.telemetry_batch_interval);
+    telemetry_message_add_number( handle, "batchMaxPayload", _device_configuration.telemetry_batch_max_payload);
+    telemetry_message_add_string( handle, "overrunPolicy", device_overrun_policy_get_name(_device_configuration.overrun_policy));
+
+    esp_err_t status = iothub_reportTwinPatch(NULL, handle);
+
+    handle = telemetry_message_create_new();
+    telemetry_message_add_number( handle, "telemetryArenaSize", statistics.arena_size);
+    telemetry_message_add_number( handle, "telemetryArenaHighWaterMark", statistics.high_water_mark);
+    telemetry_message_add_number( handle, "telemetryPoolHighWaterMark", statistics.pool_high_water_mark);
+    telemetry_message_add_number( handle, "telemetryPoolExhausted", statistics.pool_exhausted);
+    telemetry_message_add_number( handle, "telemetryArenaOverflows", statistics.arena_overflows);
+
+    if (iothub_reportTwinPatch(NULL, handle) != ESP_OK)
+    {
+        status = ESP_FAIL;
+    }
+
+    handle = telemetry_message_create_new();
+
+    for (uint8_t index = 0; index < _device_configuration.sensor_count; ++index)
+    {
+        telemetry_message_add_number( handle, _device_configuration.sensors[index].name, _device_configuration.sensors[index].interval);
+    }
+
+    if (iothub_reportTwinPatch("sensorIntervals", handle) != ESP_OK)
+    {
+        status = ESP_FAIL;
+    }
+
+    // The alerts set on the sensors, one patch each
+    for (uint8_t index = 0; index < _device_configuration.sensor_count; ++index)
+    {
+        const sensor_config_t * sensor = &_device_configuration.sensors[index];
+
+        if (!sensor->alert.enabled)
+        {
+            continue;
+        }
+
+        handle = telemetry_message_create_new();
+        telemetry_message_add_boolean( handle, "enabled", sensor->alert.enabled);
+        telemetry_message_add_number( handle, "lower", sensor->alert.lower);
+        telemetry_message_add_number( handle, "upper", sensor->alert.upper);
+        telemetry_message_add_number( handle, "critical", sensor->alert.critical);
+        telemetry_message_add_number( handle, "hysteresis", sensor->alert.hysteresis);
+
+        if (iothub_reportNestedTwinPatch("sensorAlerts", sensor->name, handle) != ESP_OK)
+        {
+            status = ESP_FAIL;
+        }
+    }
+
+    TELEMETRY_RING_STATISTICS ring_statistics;
+    telemetry_ring_get_statistics(_config.telemetry_queue, &ring_statistics);
+
+    handle = telemetry_message_create_new();
+    telemetry_message_add_number( handle, "telemetryQueueHighWaterMark", ring_statistics.high_water_mark);
+    telemetry_message_add_number( handle, "telemetryQueueDroppedOldest", ring_statistics.dropped_oldest);
+    telemetry_message_add_number( handle, "telemetryQueueDroppedNewest", ring_statistics.dropped_newest);
+    telemetry_message_add_number( handle, "telemetryQueueBlocked", ring_statistics.blocked);
+    telemetry_message_add_number( handle, "telemetryQueueTimedOut", ring_statistics.timed_out);
+
+    if (iothub_reportTwinPatch(NULL, handle) != ESP_OK)
+    {
+        status = ESP_FAIL;
+    }
+
+    handle = telemetry_message_create_new();
+    telemetry_message_add_number( handle, "bootToFirstSample", _first_sample_time);
+    telemetry_message_add_number( handle, "bootToHubConnected", _hub_connected_time);
+    telemetry_message_add_number( handle, "telemetryBacklogDropped", _backlog_dropped);
+
+    if (iothub_reportTwinPatch(NULL, handle) != ESP_OK)
+    {
+        status = ESP_FAIL;
+    }
+
+    if (_config.telemetry_log != 0)
+    {
+        TELEMETRY_LOG_STATISTICS log_statistics;
+        telemetry_log_get_statistics(_config.telemetry_log, &log_statistics);
+
+        handle = telemetry_message_create_new();
+        telemetry_message_add_number( handle, "telemetryLogCapacity", log_statistics.capacity);
+        telemetry_message_add_number( handle, "telemetryLogPending", log_statistics.pending);
+        telemetry_message_add_number( handle, "telemetryLogDropped", log_statistics.dropped);
+        telemetry_message_add_number( handle, "telemetryLogErases", log_statistics.erases);
+        telemetry_message_add_number( handle, "telemetryLogTorn", log_statistics.torn);
+        telemetry_message_add_number( handle, "telemetryLogFailures", log_statistics.failures);
+
+        if (iothub_reportTwinPatch(NULL, handle) != ESP_OK)
+        {
+            status = ESP_FAIL;
+        }
+    }
+
+    handle = telemetry_message_create_new();
+    telemetry_message_add_number( handle, "telemetryMessagesSent", _dispatch_statistics.messages);
+    telemetry_message_add_number( handle, "telemetryPayloadBytes", _dispatch_statistics.payload_bytes);
+    telemetry_message_add_number( handle, "telemetryPayloadCopies", _dispatch_statistics.payload_copies);
+    telemetry_message_add_number( handle, "telemetryAllocations", _dispatch_statistics.allocations);
+
+    if (iothub_reportTwinPatch(NULL, handle) != ESP_OK)
+    {
+        status = ESP_FAIL;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Update a sensor's alert from its desired sensorAlerts property. The properties left out keep their value,
+ *        an alert out of the sensor's range is ignored.
+ */
+static void iothub_update_sensor_alert(sensor_config_t * sensor, cJSON * alertItem)
+{
+    SENSOR_ALERT alert = sensor->alert;
+    cJSON * item;
+
+    if ((item = cJSON_GetObjectItem(alertItem, "enabled")) != NULL)
+    {
+        alert.enabled = (item->type == cJSON_True);
+    }
+
+    if ((item = cJSON_GetObjectItem(alertItem, "lower")) != NULL)
+    {
+        alert.lower = item->valuedouble;
+    }
+
+    if ((item = cJSON_GetObjectItem(alertItem, "upper")) != NULL)
+    {
+        alert.upper = item->valuedouble;
+    }
+
+    if ((item = cJSON_GetObjectItem(alertItem, "critical")) != NULL)
+    {
+        alert.critical = item->valuedouble;
+    }
+
+    if ((item = cJSON_GetObjectItem(alertItem, "hysteresis")) != NULL)
+    {
+        alert.hysteresis = item->valuedouble;
+    }
+
+    if (alert.enabled && (alert.lower < -40 || alert.lower >= alert.upper || alert.upper > alert.critical || alert.critical > 125 ||
+        alert.hysteresis < 0 || alert.hysteresis > 6))
+    {
+        ESP_LOGE(TAG, "Invalid alert for sensor %s", sensor->name);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Sensor %s alert updated: %s %.2f to %.2f, critical %.2f", sensor->name, alert.enabled ? "enabled" : "disabled",
+        alert.lower, alert.upper, alert.critical);
+    sensor->alert = alert;
+    sensor->alert_changed = true;
+}
+
 void DeviceTwinUpdateStateCallback(DEVICE_TWIN_UPDATE_STATE update_state, const unsigned char* payLoad, size_t size, void* userContextCallback)
 {
     cJSON * root = cJSON_Parse( (const char *)payLoad);
@@ -98,6 +347,77 @@ void DeviceTwinUpdateStateCallback(DEVICE_TWIN_UPDATE_STATE update_state, const
             ESP_LOGI(TAG, "Pooling rate updated: %d", poolingRateItem->valueint);
             _device_configuration.hub_pooling_rate = poolingRateItem->valueint;
         }
+
+        cJSON * sensorIntervalsItem = cJSON_GetObjectItem(desired, "sensorIntervals");
+
+        for (uint8_t index = 0; sensorIntervalsItem != NULL && index < _device_configuration.sensor_count; ++index)
+        {
+            sensor_config_t * sensor = &_device_configuration.sensors[index];
+            cJSON * intervalItem = cJSON_GetObjectItem(sensorIntervalsItem, sensor->name);
+
+            // 0 makes the sensor follow the sampling rate
+            if (intervalItem != NULL && (intervalItem->valueint == 0 || (intervalItem->valueint >= DEVICE_MIN_SENSOR_INTERVAL && intervalItem->valueint <= DEVICE_MAX_SENSOR_INTERVAL)))
+            {
+                ESP_LOGI(TAG, "Sensor %s interval updated: %d", sensor->name, intervalItem->valueint);
+                sensor->interval = intervalItem->valueint;
+            }
+        }
+
+        cJSON * sensorAlertsItem = cJSON_GetObjectItem(desired, "sensorAlerts");
+
+        for (uint8_t index = 0; sensorAlertsItem != NULL && index < _device_configuration.sensor_count; ++index)
+        {
+            sensor_config_t * sensor = &_device_configuration.sensors[index];
+            cJSON * alertItem = cJSON_GetObjectItem(sensorAlertsItem, sensor->name);
+
+            if (alertItem != NULL)
+            {
+                iothub_update_sensor_alert(sensor, alertItem);
+            }
+        }
+
+        cJSON * batchSizeItem = cJSON_GetObjectItem(desired, "batchSize");
+
+        if (batchSizeItem != NULL && batchSizeItem->valueint > 0 && batchSizeItem->valueint <= 1000)
+        {
+            ESP_LOGI(TAG, "Telemetry batch size updated: %d", batchSizeItem->valueint);
+            _device_configuration.telemetry_batch_size = batchSizeItem->valueint;
+        }
+
+        cJSON * batchIntervalItem = cJSON_GetObjectItem(desired, "batchInterval");
+
+        if (batchIntervalItem != NULL && batchIntervalItem->valueint >= 1000)
+        {
+            ESP_LOGI(TAG, "Telemetry batch interval updated: %d", batchIntervalItem->valueint);
+            _device_configuration.telemetry_batch_interval = batchIntervalItem->valueint;
+        }
+
+        cJSON * batchMaxPayloadItem = cJSON_GetObjectItem(desired, "batchMaxPayload");
+
+        // A batch must at least hold one message
+        if (batchMaxPayloadItem != NULL && batchMaxPayloadItem->valueint >= TELEMETRY_MESSAGE_ARENA_SIZE)
+        {
+            _device_configuration.telemetry_batch_max_payload = (batchMaxPayloadItem->valueint < TELEMETRY_BATCH_MAX_PAYLOAD) ? batchMaxPayloadItem->valueint : TELEMETRY_BATCH_MAX_PAYLOAD;
+            ESP_LOGI(TAG, "Telemetry batch max payload updated: %d", _device_configuration.telemetry_batch_max_payload);
+        }
+
+        cJSON * encodingItem = cJSON_GetObjectItem(desired, "telemetryEncoding");
+        TELEMETRY_ENCODING encoding;
+
+        if (encodingItem != NULL && telemetry_encoding_from_name(encodingItem->valuestring, &encoding))
+        {
+            ESP_LOGI(TAG, "Telemetry encoding updated: %s", telemetry_encoding_get_name(encoding));
+            _device_configuration.telemetry_encoding = encoding;
+        }
+
+        cJSON * overrunPolicyItem = cJSON_GetObjectItem(desired, "overrunPolicy");
+        DEVICE_OVERRUN_POLICY policy;
+
+        if (overrunPolicyItem != NULL && device_overrun_policy_from_name(overrunPolicyItem->valuestring, &policy))
+        {
+            ESP_LOGI(TAG, "Overrun policy updated: %s", device_overrun_policy_get_name(policy));
+            _device_configuration.overrun_policy = policy;
+        }
     }
     
     cJSON_Delete(root);
@@ -221,6 +541,95 @@ static int ToggleLight(bool on, unsigned char** response, size_t* resp_size)
     return status;
 }
 
+/**
+ * @brief Reject a benchmark method call whose iterations exceed the maximum with status 400: the benchmarks run on
+ *        the hub task, too many iterations would hold it and trip the task watchdog
+ */
+static int RejectIterations(uint32_t maximum, unsigned char** response, size_t* resp_size)
+{
+    char json[64];
+    int length = snprintf(json, sizeof(json), "{ \"Response\": \"iterations must be at most %u\" }", (unsigned int) maximum);
+
+    ESP_LOGW(TAG, "%s", json);
+
+    if (length < 0 || (size_t) length >= sizeof(json) || (*response = malloc(length)) == NULL)
+    {
+        return -1;
+    }
+
+    *resp_size = length;
+    (void)memcpy(*response, json, *resp_size);
+
+    return 400;
+}
+
+/**
+ * @brief Run the telemetry serialization benchmarks on sensor sets of 3 to 64 fields, in json and cbor, and
+ *        respond with their json results. The hub task is blocked while they run.
+ */
+static int BenchmarkTelemetry(uint32_t iterations, unsigned char** response, size_t* resp_size)
+{
+    static const uint8_t fieldCounts[] = TELEMETRY_BENCHMARK_FIELD_COUNTS;
+    static const TELEMETRY_ENCODING encodings[] = { TELEMETRY_ENCODING_JSON, TELEMETRY_ENCODING_CBOR };
+
+    TELEMETRY_BENCHMARK_RESULT results[sizeof(fieldCounts) * sizeof(encodings) / sizeof(encodings[0])];
+    size_t count = 0;
+
+    for (size_t field = 0; field < sizeof(fieldCounts); ++field)
+    {
+        for (size_t encoding = 0; encoding < sizeof(encodings) / sizeof(encodings[0]); ++encoding)
+        {
+            telemetry_benchmark_run(fieldCounts[field], encodings[encoding], iterations, &results[count++]);
+
+            // Let the idle task run between the runs, for the task watchdog
+            vTaskDelay(1);
+        }
+    }
+
+    if ((*response = malloc(TELEMETRY_BENCHMARK_RESPONSE_SIZE)) == NULL)
+    {
+        return -1;
+    }
+
+    *resp_size = telemetry_benchmark_write_json(results, count, (char *) *response, TELEMETRY_BENCHMARK_RESPONSE_SIZE);
+
+    if (*resp_size == 0)
+    {
+        free(*response);
+        *response = NULL;
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "%s", (const char *) *response);
+
+    return 200;
+}
+
+/**
+ * @brief Run the LDR window statistics benchmark and respond with its json result. The hub task is blocked
+ *        while it runs.
+ */
+static int BenchmarkLdr(uint32_t iterations, unsigned char** response, size_t* resp_size)
+{
+    LDR_BENCHMARK_RESULT result;
+    ldr_benchmark_run(iterations, &result);
+
+    char json[128];
+    int length = snprintf(json, sizeof(json), "{\"iterations\":%u,\"samples\":%u,\"samplesPerSecond\":%u,\"flicker\":%.1f}",
+        (unsigned int) iterations, (unsigned int) result.samples, (unsigned int) result.samples_per_second, result.flicker);
+
+    if (length < 0 || (size_t) length >= sizeof(json) || (*response = malloc(length)) == NULL)
+    {
+        return -1;
+    }
+
+    *resp_size = length;
+    (void)memcpy(*response, json, *resp_size);
+
+    ESP_LOGI(TAG, "%s", json);
+
+    return 200;
+}
 
 static int DeviceMethodCallback(const char* method_name, const unsigned char* payload, size_t size, unsigned char** response, size_t* resp_size, void* userContextCallback)
 {
@@ -232,9 +641,79 @@ static int DeviceMethodCallback(const char* method_name, const unsigned char* pa
 
         return ToggleLight(light, response, resp_size);
     }
+    else if (strcasecmp(method_name, "benchmarktelemetry") == 0)
+    {
+        cJSON * root = cJSON_Parse( (const char *)payload);
+        cJSON * iterationsItem = cJSON_GetObjectItem(root, "iterations");
+        uint32_t iterations = (iterationsItem != NULL && iterationsItem->valueint > 0) ? iterationsItem->valueint : TELEMETRY_BENCHMARK_ITERATIONS;
+        bool bounded = iterationsItem == NULL || iterationsItem->valuedouble <= TELEMETRY_BENCHMARK_MAX_ITERATIONS;
+        cJSON_Delete(root);
+
+        if (!bounded)
+        {
+            return RejectIterations(TELEMETRY_BENCHMARK_MAX_ITERATIONS, response, resp_size);
+        }
+
+        return BenchmarkTelemetry(iterations, response, resp_size);
+    }
+    else if (strcasecmp(method_name, "benchmarkldr") == 0)
+    {
+        cJSON * root = cJSON_Parse( (const char *)payload);
+        cJSON * iterationsItem = cJSON_GetObjectItem(root, "iterations");
+        uint32_t iterations = (iterationsItem != NULL && iterationsItem->valueint > 0) ? iterationsItem->valueint : LDR_BENCHMARK_ITERATIONS;
+        bool bounded = iterationsItem == NULL || iterationsItem->valuedouble <= LDR_BENCHMARK_MAX_ITERATIONS;
+        cJSON_Delete(root);
+
+        if (!bounded)
+        {
+            return RejectIterations(LDR_BENCHMARK_MAX_ITERATIONS, response, resp_size);
+        }
+
+        return BenchmarkLdr(iterations, response, resp_size);
+    }
     return -1;
 }
 
+/**
+ * @brief Take an event instance from the pool, or from the heap once every pooled instance awaits its confirmation.
+ *        Events are only used from the hub task.
+ */
+static EVENT_INSTANCE * event_instance_acquire()
+{
+    for (size_t index = 0; index < IOTHUB_EVENT_POOL_SIZE; ++index)
+    {
+        if (!_event_pool[index].in_use)
+        {
+            _event_pool[index].in_use = true;
+            _event_pool[index].pooled = true;
+            return &_event_pool[index];
+        }
+    }
+
+    EVENT_INSTANCE * event = (EVENT_INSTANCE *) calloc(1, sizeof(EVENT_INSTANCE));
+
+    if (event != NULL)
+    {
+        event->in_use = true;
+        _dispatch_statistics.allocations++;
+        _dispatch_statistics.last_allocations++;
+    }
+
+    return event;
+}
+
+static void event_instance_release(EVENT_INSTANCE * event)
+{
+    if (event->pooled)
+    {
+        event->in_use = false;
+    }
+    else
+    {
+        free(event);
+    }
+}
+
 void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
 {
     EVENT_INSTANCE* eventInstance = (EVENT_INSTANCE*)userContextCallback;
@@ -246,45 +725,303 @@ void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* us
     /* Some device specific action code goes here... */
 
     IoTHubMessage_Destroy(eventInstance->messageHandle);
-    free(eventInstance);
+    event_instance_release(eventInstance);
 }
 
-esp_err_t dispatch_telemetry_data(telemetry_message_handle_t telemetry_message)
+/**
+ * @brief Send a serialized telemetry payload to the IoT hub, tagged with the content type of its wire format. The
+ *        payload is serialized in place, in a message arena or the batch buffer, and only copied by the IoT SDK.
+ */
+esp_err_t send_telemetry_payload(const uint8_t * data, size_t length, TELEMETRY_ENCODING encoding)
 {
     static int messageCounter;
 
-    EVENT_INSTANCE * message = (EVENT_INSTANCE *) calloc(1, sizeof(EVENT_INSTANCE));
+    _dispatch_statistics.last_payload_copies = 0;
+    _dispatch_statistics.last_allocations = 0;
 
-    char * json = telemetry_message_to_json(telemetry_message);
+    EVENT_INSTANCE * message = event_instance_acquire();
+
+    if (message == NULL)
+    {
+        ESP_LOGE(TAG, "No memory for the IoT Message event\n");
+        return ESP_FAIL;
+    }
 
     message->messageTrackingId = ++messageCounter;
-    message->messageHandle = IoTHubMessage_CreateFromByteArray((const unsigned char*)json, strlen(json));
+
+    // The SDK allocates its message and copies the payload into it
+    message->messageHandle = IoTHubMessage_CreateFromByteArray(data, length);
+    _dispatch_statistics.allocations++;
+    _dispatch_statistics.last_allocations++;
+    _dispatch_statistics.payload_copies++;
+    _dispatch_statistics.last_payload_copies++;
 
     if (message->messageHandle == NULL)
     {
         ESP_LOGE(TAG, "IoT Message creation failed\n");
+        event_instance_release(message);
         return ESP_FAIL;
     }
 
     IoTHubMessage_SetMessageId(message->messageHandle, "MSG_ID");
     IoTHubMessage_SetCorrelationId(message->messageHandle, "CORE_ID");
+    IoTHubMessage_SetContentTypeSystemProperty(message->messageHandle, telemetry_encoding_get_content_type(encoding));
 
-     ESP_LOGI(TAG, "Sending Message: %s", json);
+    // Sampling times are in ms since boot, the uptime when sent relates them to the hub's enqueued time
+    char uptime[12];
+    snprintf(uptime, sizeof(uptime), "%u", (unsigned int) (xTaskGetTickCount() * portTICK_PERIOD_MS));
+    Map_AddOrUpdate(IoTHubMessage_Properties(message->messageHandle), "uptime", uptime);
 
-    telemetry_message_dispose_json(json);
-    telemetry_message_destroy(telemetry_message);
+    if (telemetry_encoding_get_content_encoding(encoding) != NULL)
+    {
+        IoTHubMessage_SetContentEncodingSystemProperty(message->messageHandle, telemetry_encoding_get_content_encoding(encoding));
+    }
 
     if (IoTHubClient_LL_SendEventAsync(_iotHubClientHandle, message->messageHandle, SendConfirmationCallback, message) != IOTHUB_CLIENT_OK)
     {
         ESP_LOGE(TAG, "IoTHubClient_LL_SendEventAsync Failed\n");
+        IoTHubMessage_Destroy(message->messageHandle);
+        event_instance_release(message);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "IoTHubClient_LL_SendEventAsync accepted message [%d] for transmission to IoT Hub.\n", messageCounter);
+    _dispatch_statistics.messages++;
+    _dispatch_statistics.payload_bytes += length;
+
+    ESP_LOGI(TAG, "IoTHubClient_LL_SendEventAsync accepted message [%d] for transmission to IoT Hub: %d bytes, %d copies, %d allocations.\n",
+        messageCounter, (int) length, _dispatch_statistics.last_payload_copies, _dispatch_statistics.last_allocations);
 
     return ESP_OK;
 }
 
+/**
+ * @brief Send the batched json or cbor sampling cycles, if any, and reset the batch
+ */
+esp_err_t dispatch_telemetry_batch()
+{
+    size_t length;
+    const uint8_t * data = telemetry_batch_serialize(_batch, &length);
+    esp_err_t status = ESP_OK;
+
+    if (data != NULL)
+    {
+        TELEMETRY_ENCODING encoding = telemetry_batch_get_encoding(_batch);
+
+        ESP_LOGI(TAG, "Sending %s batch Message: %d cycles in %d bytes", telemetry_encoding_get_name(encoding), telemetry_batch_get_count(_batch), (int) length);
+        status = send_telemetry_payload(data, length, encoding);
+    }
+
+    telemetry_batch_reset(_batch);
+
+    return status;
+}
+
+/**
+ * @brief Send the batch once its oldest sampling cycle waited for the twin's batch interval
+ */
+esp_err_t dispatch_expired_telemetry_batch()
+{
+    if (_batch == 0 || telemetry_batch_get_count(_batch) == 0)
+    {
+        return ESP_OK;
+    }
+
+    if ((xTaskGetTickCount() - _batch_started) * portTICK_PERIOD_MS < _device_configuration.telemetry_batch_interval)
+    {
+        return ESP_OK;
+    }
+
+    return dispatch_telemetry_batch();
+}
+
+/**
+ * @brief Append a sampling cycle's message to the batch. The batch is sent once it holds the twin's batch
+ *        size, its oldest cycle waited for the batch interval or the next cycle would exceed the maximum payload.
+ */
+esp_err_t batch_telemetry_data(telemetry_message_handle_t telemetry_message)
+{
+    TELEMETRY_ENCODING encoding = _device_configuration.telemetry_encoding;
+
+    if (_batch == 0)
+    {
+        _batch = telemetry_batch_create();
+
+        if (_batch == 0)
+        {
+            ESP_LOGE(TAG, "No memory for the telemetry batch, dropping message\n");
+            telemetry_message_destroy(telemetry_message);
+            return ESP_FAIL;
+        }
+    }
+
+    telemetry_batch_set_max_payload(_batch, _device_configuration.telemetry_batch_max_payload);
+
+    if (!telemetry_batch_append(_batch, telemetry_message, encoding))
+    {
+        dispatch_telemetry_batch();
+
+        if (!telemetry_batch_append(_batch, telemetry_message, encoding))
+        {
+            ESP_LOGE(TAG, "Telemetry message larger than the %d bytes batch payload, dropping message\n", _device_configuration.telemetry_batch_max_payload);
+            telemetry_message_destroy(telemetry_message);
+            return ESP_FAIL;
+        }
+    }
+
+    telemetry_message_destroy(telemetry_message);
+
+    if (telemetry_batch_get_count(_batch) == 1)
+    {
+        _batch_started = xTaskGetTickCount();
+    }
+
+    if (telemetry_batch_get_count(_batch) >= _device_configuration.telemetry_batch_size)
+    {
+        return dispatch_telemetry_batch();
+    }
+
+    return dispatch_expired_telemetry_batch();
+}
+
+esp_err_t dispatch_telemetry_data(telemetry_message_handle_t telemetry_message)
+{
+    if (_device_configuration.telemetry_batch_size > 1)
+    {
+        return batch_telemetry_data(telemetry_message);
+    }
+
+    // Batching was turned off from the twin, send the cycles batched so far first
+    if (_batch != 0 && telemetry_batch_get_count(_batch) > 0)
+    {
+        dispatch_telemetry_batch();
+    }
+
+    TELEMETRY_ENCODING encoding = _device_configuration.telemetry_encoding;
+    size_t length;
+    const uint8_t * data = telemetry_message_serialize(telemetry_message, encoding, &length);
+
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "Telemetry message serialization failed: arena of %d bytes is full\n", TELEMETRY_MESSAGE_ARENA_SIZE);
+        telemetry_message_destroy(telemetry_message);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Sending %s Message: %d bytes (%d arena bytes)", telemetry_encoding_get_name(encoding), (int) length, (int) telemetry_message_get_bytes_used(telemetry_message));
+
+    if (encoding == TELEMETRY_ENCODING_JSON)
+    {
+        ESP_LOGD(TAG, "Message: %s", (const char *) data);
+    }
+
+    // The IoT message holds its own copy of the payload
+    esp_err_t status = send_telemetry_payload(data, length, encoding);
+    telemetry_message_destroy(telemetry_message);
+
+    return status;
+}
+
+/**
+ * @brief Send the compressed time series batch, if it holds any cycle, and reset it
+ */
+esp_err_t dispatch_telemetry_series()
+{
+    size_t length;
+    const uint8_t * data = telemetry_series_batch_serialize(_series_batch, &length);
+    esp_err_t status = ESP_OK;
+
+    if (data != NULL)
+    {
+        ESP_LOGI(TAG, "Sending series Message: %d cycles in %d bytes", (int) telemetry_series_batch_get_cycle_count(_series_batch), (int) length);
+        status = send_telemetry_payload(data, length, TELEMETRY_ENCODING_SERIES);
+    }
+
+    telemetry_series_batch_reset(_series_batch);
+
+    return status;
+}
+
+/**
+ * @brief Append a sample from the telemetry queue to the compressed time series batch. The batch is sent
+ *        once it holds TELEMETRY_SERIES_BATCH_CYCLES cycles or one of its blocks is full.
+ */
+void collect_telemetry_series_sample(const TELEMETRY_SAMPLE * sample)
+{
+    if (_series_batch == 0)
+    {
+        _series_batch = telemetry_series_batch_create(_config.telemetry_schema);
+
+        if (_series_batch == 0)
+        {
+            ESP_LOGE(TAG, "No memory for the telemetry series batch, dropping sample\n");
+            return;
+        }
+    }
+
+    if (!telemetry_series_batch_append(_series_batch, sample))
+    {
+        dispatch_telemetry_series();
+        telemetry_series_batch_append(_series_batch, sample);
+    }
+
+    if (telemetry_series_batch_get_cycle_count(_series_batch) >= TELEMETRY_SERIES_BATCH_CYCLES)
+    {
+        dispatch_telemetry_series();
+    }
+}
+
+/**
+ * @brief Encode a sample from the telemetry queue into the message of its sampling cycle. The message is
+ *        dispatched once the cycle's end marker is received.
+ */
+void collect_telemetry_sample(const TELEMETRY_SAMPLE * sample)
+{
+    if (_device_configuration.telemetry_encoding == TELEMETRY_ENCODING_SERIES)
+    {
+        collect_telemetry_series_sample(sample);
+        return;
+    }
+
+    // The encoding was changed from the twin, send what was batched so far
+    if (_series_batch != 0 && telemetry_series_batch_get_cycle_count(_series_batch) > 0)
+    {
+        dispatch_telemetry_series();
+    }
+
+    // A new cycle started while the previous one lost its end marker to a full queue
+    if (_pending_message != 0 && sample->timestamp != _pending_timestamp)
+    {
+        dispatch_telemetry_data(_pending_message);
+        _pending_message = 0;
+    }
+
+    if (_pending_message == 0)
+    {
+        _pending_message = telemetry_message_create_from_schema(_config.telemetry_schema);
+        _pending_timestamp = sample->timestamp;
+
+        if (_pending_message == 0)
+        {
+            ESP_LOGE(TAG, "No telemetry message available, dropping sample\n");
+            return;
+        }
+
+        // Samples held while the hub was unreachable are sent late, each cycle carries its sampling time
+        telemetry_message_set_number(_pending_message, _config.sample_time_field, sample->timestamp);
+    }
+
+    if (sample->field_id != TELEMETRY_FIELD_ID_INVALID)
+    {
+        telemetry_message_set_number(_pending_message, sample->field_id, sample->value);
+    }
+
+    if (sample->flags & TELEMETRY_SAMPLE_END_OF_CYCLE)
+    {
+        dispatch_telemetry_data(_pending_message);
+        _pending_message = 0;
+    }
+}
+
 esp_err_t iothub_connect()
 {
     ESP_LOGI(TAG, "Connecting to Hub");
@@ -358,17 +1095,153 @@ void iothub_disconnect()
     
 }
 
-void task_process_sensor_telemetry(void * ptr)
+/**
+ * @brief Pop a sample from the telemetry queue, noting when the device's first sample was taken
+ */
+static bool pop_telemetry_sample(TELEMETRY_SAMPLE * sample, TickType_t timeout)
+{
+    if (!telemetry_ring_pop(_config.telemetry_queue, sample, timeout))
+    {
+        return false;
+    }
+
+    if (!_first_sample_received)
+    {
+        _first_sample_received = true;
+        _first_sample_time = sample->timestamp;
+        ESP_LOGI(TAG, "First telemetry sample taken %dms after boot", (int) _first_sample_time);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Hold the queued samples while the hub is unreachable, waiting up to the timeout for the first one.
+ *        They are kept in the RAM backlog until it is full, then with the backlog in the telemetry log. Without
+ *        a log a full backlog drops its oldest samples.
+ */
+static void hold_telemetry_samples(TickType_t timeout)
+{
+    TELEMETRY_SAMPLE sample;
+
+    while (pop_telemetry_sample(&sample, timeout))
+    {
+        timeout = 0;
+
+        if (_config.telemetry_log != 0 && (_backlog_count == TELEMETRY_BACKLOG_LENGTH || telemetry_log_get_pending(_config.telemetry_log) > 0))
+        {
+            // The backlog holds older samples, it is logged first
+            for (; _backlog_count > 0; --_backlog_count)
+            {
+                if (!telemetry_log_append(_config.telemetry_log, &_backlog[_backlog_first]))
+                {
+                    ESP_LOGE(TAG, "Unable to write the telemetry log, dropping sample\n");
+                }
+
+                _backlog_first = (_backlog_first + 1) % TELEMETRY_BACKLOG_LENGTH;
+            }
+
+            if (!telemetry_log_append(_config.telemetry_log, &sample))
+            {
+                ESP_LOGE(TAG, "Unable to write the telemetry log, dropping sample\n");
+            }
+
+            continue;
+        }
+
+        if (_backlog_count == TELEMETRY_BACKLOG_LENGTH)
+        {
+            _backlog_first = (_backlog_first + 1) % TELEMETRY_BACKLOG_LENGTH;
+            _backlog_count--;
+            _backlog_dropped++;
+        }
+
+        _backlog[(_backlog_first + _backlog_count) % TELEMETRY_BACKLOG_LENGTH] = sample;
+        _backlog_count++;
+    }
+}
+
+/**
+ * @brief Encode and send the samples held in the RAM backlog, once the hub is connected
+ */
+static void flush_telemetry_backlog()
+{
+    ESP_LOGI(TAG, "Sending %d samples held while the hub was unreachable", _backlog_count);
+
+    for (; _backlog_count > 0; --_backlog_count)
+    {
+        collect_telemetry_sample(&_backlog[_backlog_first]);
+        _backlog_first = (_backlog_first + 1) % TELEMETRY_BACKLOG_LENGTH;
+    }
+}
+
+/**
+ * @brief Whether every collected sample left the hub task: no cycle, batch or series waits to be sent
+ */
+static bool telemetry_samples_dispatched()
+{
+    return _pending_message == 0 &&
+        (_batch == 0 || telemetry_batch_get_count(_batch) == 0) &&
+        (_series_batch == 0 || telemetry_series_batch_get_cycle_count(_series_batch) == 0);
+}
+
+/**
+ * @brief Replay up to TELEMETRY_LOG_REPLAY_BATCH logged samples, at most every TELEMETRY_LOG_REPLAY_INTERVAL ms.
+ *        They are encoded and batched like the queued samples.
+ */
+static void replay_telemetry_log()
+{
+    TELEMETRY_SAMPLE sample;
+
+    if ((xTaskGetTickCount() - _replay_started) * portTICK_PERIOD_MS < TELEMETRY_LOG_REPLAY_INTERVAL)
+    {
+        return;
+    }
+
+    _replay_started = xTaskGetTickCount();
+
+    for (uint16_t count = 0; count < TELEMETRY_LOG_REPLAY_BATCH && telemetry_log_read(_config.telemetry_log, &sample); ++count)
+    {
+        collect_telemetry_sample(&sample);
+    }
+}
+
+/**
+ * @brief Process the events of the hub until its send queue is empty, then persist the read cursor of the
+ *        telemetry log once the replayed samples were all sent
+ */
+static void process_hub_events()
 {
-    telemetry_message_handle_t message;
     IOTHUB_CLIENT_STATUS status;
 
+    do
+    {
+        IoTHubClient_LL_DoWork(_iotHubClientHandle);
+    }
+    while ((IoTHubClient_LL_GetSendStatus(_iotHubClientHandle, &status) == IOTHUB_CLIENT_OK) && (status == IOTHUB_CLIENT_SEND_STATUS_BUSY));
+
+    if (_config.telemetry_log != 0 && telemetry_samples_dispatched())
+    {
+        telemetry_log_commit(_config.telemetry_log);
+    }
+}
+
+void task_process_sensor_telemetry(void * ptr)
+{
+    TELEMETRY_SAMPLE sample;
+
     while(true)
     {
-        xEventGroupWaitBits(_wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
-        
+        TickType_t pooling_rate = _device_configuration.hub_pooling_rate / portTICK_PERIOD_MS;
+        EventBits_t bits = xEventGroupGetBits(_wifi_event_group);
+
+        // The sensors are read from boot, their samples are held until the hub is connected
+        if ((bits & WIFI_CONNECTED_BIT) == 0)
+        {
+            hold_telemetry_samples(pooling_rate);
+        }
         // Reconnect to hub everytime we are disonnected
-        if ((xEventGroupGetBits(_wifi_event_group) & IOTHUB_INITIALIZED_BIT) == 0) 
+        else if ((bits & IOTHUB_INITIALIZED_BIT) == 0) 
         {
             if (iothub_connect() == ESP_OK)
             {
@@ -376,36 +1249,71 @@ void task_process_sensor_telemetry(void * ptr)
                 xEventGroupSetBits(_wifi_event_group, IOTHUB_INITIALIZED_BIT);
             }
         } 
+        else if ((bits & IOTHUB_CONNECTED_BIT) == 0)
+        {
+            hold_telemetry_samples(pooling_rate);
+
+            // Process events from the hub queue, until the connection is authenticated
+            process_hub_events();
+        }
+        else if (_backlog_count > 0)
+        {
+            flush_telemetry_backlog();
+        }
+        // Until the log is replayed the samples go through it, to keep their order
+        else if (_config.telemetry_log != 0 && telemetry_log_get_pending(_config.telemetry_log) > 0)
+        {
+            hold_telemetry_samples(pooling_rate);
+            replay_telemetry_log();
+            dispatch_expired_telemetry_batch();
+            process_hub_events();
+        }
         // Process data from the telemetry queue
-        else if (xQueueReceive(_config.telemetry_queue, &message, _device_configuration.hub_pooling_rate / portTICK_PERIOD_MS)) 
+        else if (pop_telemetry_sample(&sample, pooling_rate)) 
         {
-            dispatch_telemetry_data(message);
+            // Encode every queued sample in bulk before sending
+            do
+            {
+                collect_telemetry_sample(&sample);
+            }
+            while (pop_telemetry_sample(&sample, 0));
         } 
         else 
         {
+            dispatch_expired_telemetry_batch();
+
             // Process events from the hub queue
-            do    
-            {
-                IoTHubClient_LL_DoWork(_iotHubClientHandle);
-            }
-            while ((IoTHubClient_LL_GetSendStatus(_iotHubClientHandle, &status) == IOTHUB_CLIENT_OK) && (status == IOTHUB_CLIENT_SEND_STATUS_BUSY));
+            process_hub_events();
         }
 
-        if ((xEventGroupGetBits(_wifi_event_group) & IOTHUB_INITIALIZED_BIT) == 0)
+        if ((bits & WIFI_CONNECTED_BIT) != 0 && (xEventGroupGetBits(_wifi_event_group) & IOTHUB_INITIALIZED_BIT) == 0)
         {
             ESP_LOGI(TAG, "Disconected from hub");
             iothub_disconnect();
-            vTaskDelay(_device_configuration.hub_pooling_rate / portTICK_PERIOD_MS);
+            vTaskDelay(pooling_rate);
         }
     }    
 }
 
-esp_err_t iothub_init(const char * hostname, const char * device_id, const char * primary_key, const QueueHandle_t telemetry_queue)
+/**
+ * @brief Get the telemetry dispatch statistics
+ *
+ * @param[out] statistics   The payload copy and allocation counters
+ */
+void iothub_get_dispatch_statistics(IOTHUB_DISPATCH_STATISTICS * statistics)
+{
+    *statistics = _dispatch_statistics;
+}
+
+esp_err_t iothub_init(const char * hostname, const char * device_id, const char * primary_key, telemetry_ring_handle_t telemetry_queue, telemetry_log_handle_t telemetry_log, telemetry_schema_handle_t telemetry_schema, telemetry_field_id_t sample_time_field)
 {
     _config.hostname = hostname;
     _config.device_id = device_id;
     _config.primary_key = primary_key;
     _config.telemetry_queue = telemetry_queue;
+    _config.telemetry_log = telemetry_log;
+    _config.telemetry_schema = telemetry_schema;
+    _config.sample_time_field = sample_time_field;
 
     xTaskCreate(task_process_sensor_telemetry, "IoT Hub Thread", 8192, (void *) telemetry_queue, 5, NULL);
 
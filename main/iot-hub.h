@@ -5,22 +5,50 @@
 extern "C" {
 #endif
 
+#include "telemetry-sample.h"
+#include "telemetry-log.h"
+
 #define ESP_ERR_IOTHUB_BASE           0x1300
 
+/**
+ * @brief   Telemetry dispatch statistics. Payloads are serialized in place, in a message arena or the
+ *          batch buffer, the IoT SDK then copies each payload once into the message it allocates.
+ */
+typedef struct IOTHUB_DISPATCH_STATISTICS_TAG
+{
+    uint32_t messages;              // Messages accepted by the IoT hub client
+    uint32_t payload_bytes;         // Total size of the accepted payloads
+    uint32_t payload_copies;        // Copies of serialized payloads
+    uint32_t allocations;           // Heap allocations: IoT SDK messages and events beyond the event pool
+    uint8_t last_payload_copies;    // Payload copies of the last dispatch
+    uint8_t last_allocations;       // Heap allocations of the last dispatch
+} IOTHUB_DISPATCH_STATISTICS;
+
 /**
  * @brief Initialize iot hub device communication. Start the tasks that read telemetry off the sensors queue
- * and upload data to the Azure's hub 
+ * and upload data to the Azure's hub. The samples taken before the hub is connected are held, then sent with
+ * their sampleTime field.
  * 
  * @param[in]  hostname         The IoT hub's host name
  * @param[in]  device_dd        The IoT hub's device Id.
  * @param[in]  primary_key      The secret device's primary key
- * @param[in]  telemetry_queue  The sensor telemetry messaging queue
+ * @param[in]  telemetry_queue  The sensor telemetry messaging queue of TELEMETRY_SAMPLE records
+ * @param[in]  telemetry_log    The log in which the samples are kept while the hub is unreachable, 0 for none
+ * @param[in]  telemetry_schema The telemetry schema in which the samples' fields are declared
+ * @param[in]  sample_time_field The schema's field in which the time a sample was taken is sent
  * 
  * @return 
  *          - ESP_OK if the iothub driver has been successfully initialized 
  *          - ESP_FAIL otherwise
  */
-esp_err_t iothub_init(const char * hostname, const char * device_id, const char * primary_key, const QueueHandle_t telemetry_queue);
+esp_err_t iothub_init(const char * hostname, const char * device_id, const char * primary_key, telemetry_ring_handle_t telemetry_queue, telemetry_log_handle_t telemetry_log, telemetry_schema_handle_t telemetry_schema, telemetry_field_id_t sample_time_field);
+
+/**
+ * @brief Get the telemetry dispatch statistics
+ *
+ * @param[out] statistics   The payload copy and allocation counters
+ */
+void iothub_get_dispatch_statistics(IOTHUB_DISPATCH_STATISTICS * statistics);
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -11,11 +12,14 @@
 
 #include "nvs_flash.h"
 
-#include "driver/i2c.h"
+#include "i2c-bus.h"
 
 #include "device-config.h"
 #include "iot-hub.h"
-#include "telemetry-data.h"
+#include "telemetry-sample.h"
+#include "telemetry-ring.h"
+#include "telemetry-log.h"
+#include "storage-partition.h"
 
 #include "device.h"
 #include "sensor.h"
@@ -127,7 +131,7 @@ esp_err_t initialize_wifi()
     return status;
 }
 
-esp_err_t initialize_i2c() 
+i2c_bus_handle_t initialize_i2c() 
 {
 
     i2c_config_t config = 
@@ -143,9 +147,8 @@ esp_err_t initialize_i2c()
         .master.clk_speed = I2C_FREQ_HZ
     };
 
-    i2c_param_config(I2C_PORT, &config);
-
-    return i2c_driver_install(I2C_PORT, config.mode, 0, 0, 0);
+    // The bus is shared by the drivers of the devices on the port
+    return i2c_bus_create(I2C_PORT, &config);
 }
 
 void app_main()
@@ -153,45 +156,124 @@ void app_main()
     // Initialize default configuration
     _device_configuration.sensor_sampling_rate = 30000;
     _device_configuration.hub_pooling_rate = 500;
+    _device_configuration.telemetry_encoding = TELEMETRY_DEFAULT_ENCODING;
+    _device_configuration.telemetry_batch_size = TELEMETRY_BATCH_SIZE;
+    _device_configuration.telemetry_batch_interval = TELEMETRY_BATCH_INTERVAL;
+    _device_configuration.telemetry_batch_max_payload = TELEMETRY_BATCH_MAX_PAYLOAD;
+    _device_configuration.overrun_policy = DEVICE_DEFAULT_OVERRUN_POLICY;
 
     // Initialize the telemetry queue
-    QueueHandle_t telemetry_queue = xQueueCreate(1, sizeof(telemetry_message_handle_t));
+    telemetry_ring_handle_t telemetry_queue = telemetry_ring_create(TELEMETRY_QUEUE_LENGTH, TELEMETRY_QUEUE_POLICY);
     
+    // Mount the telemetry log kept while the hub is unreachable
+    telemetry_log_handle_t telemetry_log = 0;
+    STORAGE_HANDLE telemetry_storage = (strlen(TELEMETRY_LOG_PARTITION) > 0) ? storage_partition_create(TELEMETRY_LOG_PARTITION) : 0;
+
+    if (telemetry_storage != 0)
+    {
+        telemetry_log = telemetry_log_create(storage_partition_get_interface(), telemetry_storage);
+    }
+
     // Initialize WiFi
     nvs_flash_init();
     initialize_wifi();
 
     // Initialize i2c Driver
-    initialize_i2c();
+    i2c_bus_handle_t i2c_bus = initialize_i2c();
 
     // Initialize Pins
     gpio_pad_select_gpio(2);
     gpio_set_direction(2, GPIO_MODE_OUTPUT);
 
-    // Initialize threads
-    iothub_init(HUB_AZURE_HOST_NAME, HUB_AZURE_DEVICE_ID, HUB_AZURE_DEVICE_PRIMARY_KEY, telemetry_queue);
-
     DHT_SENSOR_OPTIONS dht_options = 
     {
         .type = DHT_11,
-        .pin = 18
+        .pin = 18,
+        .capture = DHT_CAPTURE_INTERRUPT
     };
 
     MCP9808_SENSOR_OPTIONS mcp9808_options = 
     {
-        .i2c_port = I2C_PORT,
-        .i2c_address = MCP9808_SENSOR_ADDR
+        .i2c_bus = i2c_bus,
+        .i2c_address = MCP9808_SENSOR_ADDR,
+        .alert_pin = MCP9808_ALERT_IO,
+        .resolution = MCP9808_DEFAULT_RESOLUTION,
+        .mode = MCP9808_DEFAULT_MODE
     };
 
     LDR_SENSOR_OPTIONS ldr_options = 
     {
-        .pin = 32
+        .pin = 32,
+        .mode = LDR_DEFAULT_MODE,
+        .sample_rate = LDR_SAMPLE_RATE
     };
 
     DEVICE_HANDLE device = device_create(HUB_AZURE_DEVICE_ID, telemetry_queue);
-    device_add_sensor(device, dht_get_inteface(), &dht_options);
-    device_add_sensor(device, mcp9808_get_inteface(), &mcp9808_options);
-    device_add_sensor(device, ldr_get_inteface(), &ldr_options);
-    
-    device_start(device);
+
+    if (device_add_sensor(device, "dht", dht_get_inteface(), &dht_options, 60000) != DEVICE_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "Error adding the dht sensor");
+    }
+
+    if (device_add_sensor(device, "ldr", ldr_get_inteface(), &ldr_options, 1000) != DEVICE_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "Error adding the ldr sensor");
+    }
+
+    if (MCP9808_SCAN)
+    {
+        // Each sensor found is read along with the others, keyed by its address
+        uint8_t addresses[MCP9808_MAX_SENSORS];
+        size_t count = mcp9808_scan(i2c_bus, addresses, MCP9808_MAX_SENSORS);
+        size_t added = 0;
+
+        for (size_t index = 0; index < count; ++index)
+        {
+            char name[DEVICE_SENSOR_NAME_LENGTH];
+            MCP9808_SENSOR_OPTIONS options = mcp9808_options;
+            options.i2c_address = addresses[index];
+            options.alert_pin = -1;
+            options.address_keys = true;
+
+            snprintf(name, sizeof(name), "mcp9808_%02x", addresses[index]);
+
+            // The device runs with the sensors that fit in its telemetry message, the others are left out
+            if (device_add_sensor(device, name, mcp9808_get_inteface(), &options, 10000) != DEVICE_STATUS_OK)
+            {
+                ESP_LOGE(TAG, "Error adding the %s sensor, %d of the MCP9808 sensors found are left out", name, (int) (count - added));
+                break;
+            }
+
+            ++added;
+        }
+
+        ESP_LOGI(TAG, "%d MCP9808 sensors found, %d added", (int) count, (int) added);
+    }
+    else if (device_add_sensor(device, "mcp9808", mcp9808_get_inteface(), &mcp9808_options, 10000) != DEVICE_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "Error adding the mcp9808 sensor");
+    }
+
+    if (!MCP9808_SCAN && MCP9808_ALERT_IO >= 0)
+    {
+        SENSOR_ALERT mcp9808_alert =
+        {
+            .enabled = true,
+            .lower = MCP9808_ALERT_LOWER,
+            .upper = MCP9808_ALERT_UPPER,
+            .critical = MCP9808_ALERT_CRITICAL,
+            .hysteresis = MCP9808_ALERT_HYSTERESIS
+        };
+
+        device_set_sensor_alert(device, "mcp9808", &mcp9808_alert);
+    }
+
+    // Initialize threads
+    iothub_init(HUB_AZURE_HOST_NAME, HUB_AZURE_DEVICE_ID, HUB_AZURE_DEVICE_PRIMARY_KEY, telemetry_queue, telemetry_log, device_get_telemetry_schema(device),
+        device_get_sample_time_field(device));
+
+    if (device_start(device) != DEVICE_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "Error starting the device, no telemetry is read");
+    }
 }
@@ -0,0 +1,62 @@
+#ifndef __DHT_DECODE_H__
+#define __DHT_DECODE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    DHT_11,
+    DHT_21,
+    DHT_22,
+    DHT_AM2301
+} DHT_TYPE;
+
+#define DHT_DATA_SIZE              5       /*!< 16 bits humidity, 16 bits temperature and the checksum */
+#define DHT_MAX_EDGES              96      /*!< Edges captured per reading, room for a few glitches */
+
+/* A captured edge: the time in us, modulo DHT_EDGE_TIME_MASK + 1, and the line's level after the edge */
+#define DHT_EDGE_LEVEL             0x8000
+#define DHT_EDGE_TIME_MASK         0x7FFF
+
+#define DHT_DECODE_OK              0x0000
+#define DHT_DECODE_NO_RESPONSE     0x0001  /*!< The sensor's 80us low and high response was not found */
+#define DHT_DECODE_TRUNCATED       0x0002  /*!< The trace ends before the end of the 40th bit */
+#define DHT_DECODE_INVALID_PULSE   0x0003  /*!< A bit's low or high pulse is out of range */
+#define DHT_DECODE_CHECKSUM        0x0004  /*!< The checksum byte does not match the data */
+
+/**
+ * @brief Decode the bytes of a DHT transmission from its captured edges. Pulses shorter than DHT_GLITCH_TIME
+ *        are merged into the pulse they interrupt and repeated edges of the same level are ignored. Only depends
+ *        on its arguments.
+ *
+ * @param[in]  edges       The captured edges, from the host releasing the line
+ * @param[in]  count       The number of edges
+ * @param[out] data        The 5 bytes of the transmission, including the checksum
+ *
+ * @return
+ *          - DHT_DECODE_OK if the transmission was decoded and its checksum matches
+ *          - DHT_DECODE_NO_RESPONSE, DHT_DECODE_TRUNCATED, DHT_DECODE_INVALID_PULSE or DHT_DECODE_CHECKSUM otherwise
+ */
+int dht_decode(const uint16_t * edges, size_t count, uint8_t * data);
+
+/**
+ * @brief Convert the bytes of a DHT transmission to degrees Celsius and relative humidity percents
+ *
+ * @param[in]  type        The sensor's model
+ * @param[in]  data        The 5 bytes of the transmission
+ * @param[out] temperature The temperature
+ * @param[out] humidity    The humidity
+ */
+void dht_convert(DHT_TYPE type, const uint8_t * data, double * temperature, double * humidity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
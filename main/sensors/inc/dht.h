@@ -2,26 +2,29 @@
 #define __DHT_H__
 
 #include "sensor.h"
+#include "dht-decode.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief   How the sensor's transmission is captured
+ */
 typedef enum
 {
-    DHT_11,
-    DHT_21,
-    DHT_22,
-    DHT_AM2301
-} DHT_TYPE;
+    DHT_CAPTURE_INTERRUPT,      // The edges are timestamped by a GPIO interrupt, then decoded
+    DHT_CAPTURE_POLLING         // The pulses are timed by polling the line in a critical section
+} DHT_CAPTURE;
 
 /**
- * @brief   The DHT sensor's options. The sensor type (dht11, 21 or 22) and pin number
+ * @brief   The DHT sensor's options. The sensor type (dht11, 21 or 22), pin number and capture mode
  */
 typedef struct DHT_SENSOR_OPTIONS_TAG
 {
     DHT_TYPE type;
     uint8_t pin;
+    DHT_CAPTURE capture;
 } DHT_SENSOR_OPTIONS;
 
 /**
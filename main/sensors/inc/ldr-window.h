@@ -0,0 +1,91 @@
+#ifndef __LDR_WINDOW_H__
+#define __LDR_WINDOW_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LDR_ADC_MAX                4095    /*!< Largest 12 bits reading */
+#define LDR_ADC_VOLTAGE            3.3     /*!< Voltage of the largest reading, 11dB attenuation */
+
+/**
+ * @brief   The samples accumulated since the last report. Only depends on its samples, the background task
+ *          adds each DMA block to it and the report takes its statistics.
+ */
+typedef struct LDR_WINDOW_TAG
+{
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum;
+    uint64_t sum_squares;
+    int32_t reference;              // Level whose rising crossings count the flicker, -1 until the first sample
+    bool above;                     // The signal last crossed the reference upward
+    uint32_t crossings;             // Rising crossings of the reference
+    uint32_t first_crossing;        // Sample index of the first and last rising crossings
+    uint32_t last_crossing;
+} LDR_WINDOW;
+
+/**
+ * @brief   Statistics of a window, in volts
+ */
+typedef struct LDR_WINDOW_STATISTICS_TAG
+{
+    uint32_t count;
+    double mean;
+    double min;
+    double max;
+    double rms;
+    double flicker;                 // Frequency of the light's flicker in Hz, 0 if the window holds less than a period
+} LDR_WINDOW_STATISTICS;
+
+/**
+ * @brief Empty a window
+ *
+ * @param[out] window      The window
+ * @param[in]  reference   The flicker's reference level, the last window's mean reading. -1 takes the first sample.
+ */
+void ldr_window_reset(LDR_WINDOW * window, int32_t reference);
+
+/**
+ * @brief Convert the words of an I2S ADC DMA buffer to readings: the channel is in the 4 most significant bits,
+ *        the reading in the 12 others. The words of other channels are dropped.
+ *
+ * @param[in]  words       The DMA buffer's words
+ * @param[in]  count       The number of words
+ * @param[in]  channel     The ADC1 channel of the sensor
+ * @param[out] samples     The readings, may be words
+ *
+ * @return
+ *          - The number of readings
+ */
+size_t ldr_window_convert(const uint16_t * words, size_t count, uint8_t channel, uint16_t * samples);
+
+/**
+ * @brief Add readings to a window
+ *
+ * @param[in,out] window   The window
+ * @param[in]  samples     The readings
+ * @param[in]  count       The number of readings
+ */
+void ldr_window_add(LDR_WINDOW * window, const uint16_t * samples, size_t count);
+
+/**
+ * @brief Get the mean, min, max, RMS and flicker frequency of a window. The flicker is estimated from the rising
+ *        crossings of the reference level, with some hysteresis against the ADC's noise.
+ *
+ * @param[in]  window      The window
+ * @param[in]  sample_rate The readings per second
+ * @param[out] statistics  The window's statistics
+ */
+void ldr_window_get_statistics(const LDR_WINDOW * window, uint32_t sample_rate, LDR_WINDOW_STATISTICS * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,14 +7,35 @@
 extern "C" {
 #endif
 
+/**
+ * @brief   How the LDR is sampled
+ */
+typedef enum
+{
+    LDR_MODE_SINGLE,        // A single conversion per reading
+    LDR_MODE_STREAM         // Continuous conversions through the I2S DMA, a reading reports the window since the last one
+} LDR_MODE;
+
 /**
  * @brief   The LDR (Light Dependent Resistor) sensor's options. 
  */
 typedef struct LDR_SENSOR_OPTIONS_TAG
 {
     uint8_t pin;    // GPIO pin 32-39 
+    LDR_MODE mode;
+    uint32_t sample_rate;   // Conversions per second of the stream mode, well above twice the lighting's flicker
 } LDR_SENSOR_OPTIONS;
 
+/**
+ * @brief   Result of a window statistics benchmark run
+ */
+typedef struct LDR_BENCHMARK_RESULT_TAG
+{
+    uint32_t samples;               // DMA words converted and added to the window
+    uint32_t samples_per_second;
+    double flicker;                 // Flicker of the benchmark's 100Hz signal, as estimated by the window
+} LDR_BENCHMARK_RESULT;
+
 /**
  * @brief   Get the LDR sensor interface
  * 
@@ -23,6 +44,16 @@ typedef struct LDR_SENSOR_OPTIONS_TAG
  */
 const SENSOR_INTERFACE_DESCRIPTION * ldr_get_inteface();
 
+/**
+ * @brief Measure the cost of the stream mode's background work: DMA blocks of a 100Hz flicker are converted and
+ *        added to a window, then the window's statistics are taken. The run blocks the calling task, which yields a
+ *        tick every 64 blocks.
+ *
+ * @param[in]  iterations  The number of DMA blocks
+ * @param[out] result      The benchmark result
+ */
+void ldr_benchmark_run(uint32_t iterations, LDR_BENCHMARK_RESULT * result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,19 +2,47 @@
 #define __MCP9808_H__
 
 #include "sensor.h"
-#include "driver/i2c.h"
+#include "i2c-bus.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define MCP9808_FIRST_ADDRESS      0x18
+#define MCP9808_MAX_SENSORS        8            /*!< Sensors on a bus, one by address from MCP9808_FIRST_ADDRESS */
+
+/**
+ * @brief   The ambient temperature's resolution, the finer the longer a conversion
+ */
+typedef enum
+{
+    MCP9808_RESOLUTION_0_0625,      // 0.0625C, 250ms conversions, the power-up default
+    MCP9808_RESOLUTION_0_125,       // 0.125C, 130ms conversions
+    MCP9808_RESOLUTION_0_25,        // 0.25C, 65ms conversions
+    MCP9808_RESOLUTION_0_5          // 0.5C, 30ms conversions
+} MCP9808_RESOLUTION;
+
+/**
+ * @brief   When the sensor converts the temperature
+ */
+typedef enum
+{
+    MCP9808_MODE_CONTINUOUS,        // Converts continuously, a reading returns the last conversion right away
+    MCP9808_MODE_ONE_SHOT           // Shut down between readings, a reading wakes it for a single conversion
+} MCP9808_MODE;
+
 /**
- * @brief   The MCP9808 sensor's options. 
+ * @brief   The MCP9808 sensor's options. The alert is only updated while the sensor converts, in one-shot mode
+ *          an excursion is signaled by the reading that converts it.
  */
 typedef struct MCP9808_SENSOR_OPTIONS_TAG
 {
-    i2c_port_t i2c_port; 
+    i2c_bus_handle_t i2c_bus;   // The bus from i2c_bus_create, shared with the other devices on the port
     uint8_t i2c_address;
+    int8_t alert_pin;           // GPIO connected to the ALERT output, -1 if it is not connected
+    MCP9808_RESOLUTION resolution;
+    MCP9808_MODE mode;
+    bool address_keys;          // Keys the telemetry fields by address, mcp9808_18_temperature, for several sensors on a bus
 } MCP9808_SENSOR_OPTIONS;
 
 /**
@@ -25,6 +53,19 @@ typedef struct MCP9808_SENSOR_OPTIONS_TAG
  */
 const SENSOR_INTERFACE_DESCRIPTION * mcp9808_get_inteface();
 
+/**
+ * @brief Scan a bus for MCP9808 sensors. Each address that acknowledges is added to the bus, and kept if its
+ *        manufacturer and device Ids are the MCP9808's.
+ *
+ * @param[in]  bus         The bus handle returned from i2c_bus_create
+ * @param[out] addresses   The addresses of the sensors found
+ * @param[in]  size        Number of addresses that fit, MCP9808_MAX_SENSORS for the whole range
+ *
+ * @return
+ *          - The number of sensors found
+ */
+size_t mcp9808_scan(i2c_bus_handle_t bus, uint8_t * addresses, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
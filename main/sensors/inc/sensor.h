@@ -1,7 +1,7 @@
 #ifndef __SENSOR_H__
 #define __SENSOR_H__
 
-#include "telemetry-data.h"
+#include "telemetry-sample.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,14 +12,63 @@ typedef uint32_t SENSOR_HANDLE;
 #define SENSOR_STATUS_OK           0x0000
 #define SENSOR_STATUS_FAILED       0x0001
 #define SENSOR_STATUS_TIMEDOUT     0x0002
+#define SENSOR_STATUS_PENDING      0x0003
 
-typedef SENSOR_HANDLE (*SENSOR_CREATE) ();
+/* Peripheral buses returned by SENSOR_GET_BUS, sensors on different buses are read concurrently */
+#define SENSOR_BUS_GPIO(pin)       (0x0100 | (pin))
+#define SENSOR_BUS_I2C(port)       (0x0200 | (port))
+#define SENSOR_BUS_ADC(unit)       (0x0300 | (unit))
+
+/*
+ * Sensors are created in place, in storage owned by the device. SENSOR_CREATE returns 0 when the storage is too
+ * small for the sensor's state. SENSOR_DESTROY releases the sensor's resources, not its storage.
+ */
+typedef SENSOR_HANDLE (*SENSOR_CREATE) (void * storage, size_t size);
 typedef void (*SENSOR_DESTROY) (SENSOR_HANDLE handle);
 typedef void (*SENSOR_SET_OPTIONS) (SENSOR_HANDLE handle, void * options);
 typedef void* (*SENSOR_GET_OPTIONS) (SENSOR_HANDLE handle);
+typedef int (*SENSOR_DECLARE_FIELDS) (SENSOR_HANDLE handle, telemetry_schema_handle_t schema);
 typedef int (*SENSOR_INITIALIZE) (SENSOR_HANDLE handle);
 typedef int (*SENSOR_READ) (SENSOR_HANDLE handle);
-typedef int (*SENSOR_POST_RESULTS) (SENSOR_HANDLE handle, telemetry_message_handle_t message);
+typedef int (*SENSOR_POST_RESULTS) (SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer);
+typedef uint32_t (*SENSOR_GET_BUS) (SENSOR_HANDLE handle);
+
+/*
+ * Shortest number of ms between two readings the sensor supports. The device serves the sensor's last good
+ * result, rather than reading it, when it is due sooner. A sensor without a minimum leaves it NULL.
+ */
+typedef uint32_t (*SENSOR_GET_MIN_INTERVAL) (SENSOR_HANDLE handle);
+
+/*
+ * A window alert: the sensor raises its trigger as soon as it converts a value out of [lower, upper] or above critical,
+ * and again once the value is back within the window by more than the hysteresis.
+ */
+typedef struct SENSOR_ALERT_TAG
+{
+    bool enabled;
+    float lower;
+    float upper;
+    float critical;
+    float hysteresis;
+} SENSOR_ALERT;
+
+/*
+ * Event readings. SENSOR_SET_TRIGGER registers the function the sensor calls, from its interrupt handler, when the
+ * sensor must be read out of its schedule. SENSOR_SET_ALERT programs the sensor's alert. A sensor without events
+ * leaves them NULL.
+ */
+typedef void (*SENSOR_TRIGGER) (void * context);
+typedef void (*SENSOR_SET_TRIGGER) (SENSOR_HANDLE handle, SENSOR_TRIGGER trigger, void * context);
+typedef int (*SENSOR_SET_ALERT) (SENSOR_HANDLE handle, const SENSOR_ALERT * alert);
+
+/*
+ * Asynchronous readings. SENSOR_BEGIN_READ starts a conversion and returns right away with the number of ms
+ * it takes; once they elapsed SENSOR_POLL returns SENSOR_STATUS_PENDING until the result is available and
+ * SENSOR_FETCH collects it. A sensor with only a blocking SENSOR_READ leaves them NULL.
+ */
+typedef int (*SENSOR_BEGIN_READ) (SENSOR_HANDLE handle, uint32_t * conversion_time);
+typedef int (*SENSOR_POLL) (SENSOR_HANDLE handle);
+typedef int (*SENSOR_FETCH) (SENSOR_HANDLE handle);
 
 typedef struct SENSOR_INTERFACE_DESCRIPTION_TAG
 {
@@ -27,11 +76,82 @@ typedef struct SENSOR_INTERFACE_DESCRIPTION_TAG
     SENSOR_DESTROY sensor_destroy;
     SENSOR_SET_OPTIONS sensor_set_options;
     SENSOR_GET_OPTIONS sensor_get_options;
+    SENSOR_DECLARE_FIELDS sensor_declare_fields;
     SENSOR_INITIALIZE sensor_initialize;
     SENSOR_READ sensor_read;
     SENSOR_POST_RESULTS sensor_post_results;
+    SENSOR_GET_BUS sensor_get_bus;
+    SENSOR_BEGIN_READ sensor_begin_read;
+    SENSOR_POLL sensor_poll;
+    SENSOR_FETCH sensor_fetch;
+    SENSOR_GET_MIN_INTERVAL sensor_get_min_interval;
+    SENSOR_SET_TRIGGER sensor_set_trigger;
+    SENSOR_SET_ALERT sensor_set_alert;
 } SENSOR_INTERFACE_DESCRIPTION;
 
+/**
+ * @brief Start a sensor's reading. A sensor with only a blocking SENSOR_READ is read right away.
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ * @param[out] conversion_time   Number of ms before the reading may be polled
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading started
+ *          - SENSOR_STATUS_FAILED if unable to start the reading
+ */
+int sensor_begin_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle, uint32_t * conversion_time);
+
+/**
+ * @brief Check whether a started reading is complete
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading is complete
+ *          - SENSOR_STATUS_PENDING if the conversion is still in progress
+ *          - SENSOR_STATUS_FAILED if the reading failed
+ */
+int sensor_poll_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle);
+
+/**
+ * @brief Collect a complete reading, the sensor then posts it with SENSOR_POST_RESULTS
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading was collected
+ *          - SENSOR_STATUS_FAILED if the reading is invalid
+ */
+int sensor_fetch_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle);
+
+/**
+ * @brief Get the shortest number of ms between two readings of a sensor
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - The sensor's minimum reading interval, 0 if it has none
+ */
+uint32_t sensor_get_min_interval(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle);
+
+/**
+ * @brief Read a sensor, blocking the calling task until the reading is complete or timed out
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ * @param[in]  timeout           Number of ms to wait for the conversion past its announced time
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading is complete
+ *          - SENSOR_STATUS_TIMEDOUT if the conversion did not complete in time
+ *          - SENSOR_STATUS_FAILED if the reading failed
+ */
+int sensor_read_blocking(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle, uint32_t timeout);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,184 @@
+#include "dht-decode.h"
+
+#include <string.h>
+
+#define DHT_GLITCH_TIME            8       /*!< us, shorter pulses are noise */
+#define DHT_RESPONSE_MIN           50      /*!< us, the sensor's response pulses last ~80us */
+#define DHT_RESPONSE_MAX           120
+#define DHT_BIT_LOW_MIN            30      /*!< us, each bit starts with ~50us low */
+#define DHT_BIT_LOW_MAX            90
+#define DHT_BIT_HIGH_MIN           10      /*!< us, then ~27us high for a 0 or ~70us high for a 1 */
+#define DHT_BIT_HIGH_MAX           100
+#define DHT_BIT_THRESHOLD          48
+
+typedef struct DHT_PULSE_READER_TAG
+{
+    const uint16_t * edges;
+    size_t count;
+    size_t index;                   // The edge starting the next pulse
+} DHT_PULSE_READER;
+
+static uint16_t dht_edge_elapsed(const uint16_t * edges, size_t from, size_t to)
+{
+    return (edges[to] - edges[from]) & DHT_EDGE_TIME_MASK;
+}
+
+static bool dht_edge_level(const uint16_t * edges, size_t index)
+{
+    return (edges[index] & DHT_EDGE_LEVEL) != 0;
+}
+
+/**
+ * @brief Read the next pulse: the line's level from an edge to the next edge of the other level
+ */
+static bool dht_read_pulse(DHT_PULSE_READER * reader, bool * level, uint16_t * duration)
+{
+    const uint16_t * edges = reader->edges;
+    size_t start = reader->index;
+    size_t next = start + 1;
+
+    if (start >= reader->count)
+    {
+        return false;
+    }
+
+    *level = dht_edge_level(edges, start);
+
+    while (next < reader->count)
+    {
+        if (dht_edge_level(edges, next) == *level)
+        {
+            // An edge of the other level was missed
+            ++next;
+        }
+        else if (next + 1 < reader->count && dht_edge_level(edges, next + 1) == *level && dht_edge_elapsed(edges, next, next + 1) < DHT_GLITCH_TIME)
+        {
+            // A glitch, the line came back right away
+            next += 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    // The pulse's end was not captured
+    if (next >= reader->count)
+    {
+        return false;
+    }
+
+    *duration = dht_edge_elapsed(edges, start, next);
+    reader->index = next;
+
+    return true;
+}
+
+// A pulse ending on the last captured edge may have been cut by a glitch the trace does not show the end of
+static int dht_get_invalid_pulse_status(const DHT_PULSE_READER * reader)
+{
+    return (reader->index + 1 >= reader->count) ? DHT_DECODE_TRUNCATED : DHT_DECODE_INVALID_PULSE;
+}
+
+/**
+ * @brief Decode the bytes of a DHT transmission from its captured edges. Pulses shorter than DHT_GLITCH_TIME
+ *        are merged into the pulse they interrupt and repeated edges of the same level are ignored. Only depends
+ *        on its arguments.
+ *
+ * @param[in]  edges       The captured edges, from the host releasing the line
+ * @param[in]  count       The number of edges
+ * @param[out] data        The 5 bytes of the transmission, including the checksum
+ *
+ * @return
+ *          - DHT_DECODE_OK if the transmission was decoded and its checksum matches
+ *          - DHT_DECODE_NO_RESPONSE, DHT_DECODE_TRUNCATED, DHT_DECODE_INVALID_PULSE or DHT_DECODE_CHECKSUM otherwise
+ */
+int dht_decode(const uint16_t * edges, size_t count, uint8_t * data)
+{
+    DHT_PULSE_READER reader = { edges, count, 0 };
+    bool level;
+    uint16_t duration;
+    bool response_low = false;
+    bool responded = false;
+
+    memset(data, 0, DHT_DATA_SIZE);
+
+    // The sensor answers the start signal with ~80us low then ~80us high
+    while (!responded && dht_read_pulse(&reader, &level, &duration))
+    {
+        bool in_range = (duration >= DHT_RESPONSE_MIN && duration <= DHT_RESPONSE_MAX);
+
+        responded = level && response_low && in_range;
+        response_low = !level && in_range;
+    }
+
+    if (!responded)
+    {
+        return DHT_DECODE_NO_RESPONSE;
+    }
+
+    for (uint8_t bit = 0; bit < DHT_DATA_SIZE * 8; ++bit)
+    {
+        if (!dht_read_pulse(&reader, &level, &duration))
+        {
+            return DHT_DECODE_TRUNCATED;
+        }
+
+        if (level || duration < DHT_BIT_LOW_MIN || duration > DHT_BIT_LOW_MAX)
+        {
+            return dht_get_invalid_pulse_status(&reader);
+        }
+
+        if (!dht_read_pulse(&reader, &level, &duration))
+        {
+            return DHT_DECODE_TRUNCATED;
+        }
+
+        if (!level || duration < DHT_BIT_HIGH_MIN || duration > DHT_BIT_HIGH_MAX)
+        {
+            return dht_get_invalid_pulse_status(&reader);
+        }
+
+        // Most significant bit first
+        if (duration > DHT_BIT_THRESHOLD)
+        {
+            data[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xFF) != data[4])
+    {
+        return DHT_DECODE_CHECKSUM;
+    }
+
+    return DHT_DECODE_OK;
+}
+
+/**
+ * @brief Convert the bytes of a DHT transmission to degrees Celsius and relative humidity percents
+ *
+ * @param[in]  type        The sensor's model
+ * @param[in]  data        The 5 bytes of the transmission
+ * @param[out] temperature The temperature
+ * @param[out] humidity    The humidity
+ */
+void dht_convert(DHT_TYPE type, const uint8_t * data, double * temperature, double * humidity)
+{
+    // dht11 has 8 bits for humidity, 8 bits not used, 8 bits for temperature, 8 bits unused and 8-bit crc check
+    // the other sensors have 16 bits for humidity, 16 bits for temperature and 8 bit crc check
+    if (type == DHT_11)
+    {
+        *humidity = data[0];
+        *temperature = data[2];
+    }
+    else
+    {
+        *humidity = (data[0] * 256 + data[1]) / 10.0;
+        *temperature = ((data[2] & 0x7F) * 256 + data[3]) / 10.0;
+
+        if (data[2] & 0x80)
+        {
+            *temperature *= -1;
+        }
+    }
+}
@@ -1,21 +1,38 @@
 #include "dht.h"
+#include "dht-decode.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/portmacro.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "driver/gpio.h"
+#include "soc/gpio_struct.h"
 
 #include <string.h>
 
-SENSOR_HANDLE dht_create();
+#define DHT_START_SIGNAL_TIME      20      /*!< ms the line is held low to start a reading */
+#define DHT_TRANSMISSION_TIME      6000    /*!< us from the line's release to the end of the transmission */
+#define DHT11_MIN_INTERVAL         1000    /*!< Shortest ms between two readings of a DHT11 */
+#define DHT22_MIN_INTERVAL         2000    /*!< Shortest ms between two readings of the other models */
+#define DHT_MIN_TEMPERATURE        -40     /*!< Measuring range of the models, in degrees */
+#define DHT_MAX_TEMPERATURE        80
+
+SENSOR_HANDLE dht_create(void * storage, size_t size);
 void dht_destroy(SENSOR_HANDLE handle);
 void dht_set_options(SENSOR_HANDLE handle, void * options);
 void* dht_get_options(SENSOR_HANDLE handle);
+int dht_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema);
 int dht_initialize(SENSOR_HANDLE handle);
-int dht_read(SENSOR_HANDLE handle);
-int dht_post(SENSOR_HANDLE handle, telemetry_message_handle_t message);
+int dht_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer);
+uint32_t dht_get_bus(SENSOR_HANDLE handle);
+int dht_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time);
+int dht_poll(SENSOR_HANDLE handle);
+int dht_fetch(SENSOR_HANDLE handle);
+uint32_t dht_get_min_interval(SENSOR_HANDLE handle);
 
 static const SENSOR_INTERFACE_DESCRIPTION dht_handle_interface_description =
 {
@@ -23,9 +40,17 @@ static const SENSOR_INTERFACE_DESCRIPTION dht_handle_interface_description =
     dht_destroy,
     dht_set_options,
     dht_get_options,
+    dht_declare_fields,
     dht_initialize,
-    dht_read,
-    dht_post
+    NULL,
+    dht_post,
+    dht_get_bus,
+    dht_begin_read,
+    dht_poll,
+    dht_fetch,
+    dht_get_min_interval,
+    NULL,
+    NULL
 };
 
 typedef enum
@@ -35,12 +60,25 @@ typedef enum
     DHT_SENSOR_STATUS_INVALID_TELEMETRY
 } DHT_SENSOR_STATUS;
 
+typedef enum
+{
+    DHT_CAPTURE_IDLE,
+    DHT_CAPTURE_STARTING,       // The start signal holds the line low
+    DHT_CAPTURE_RECEIVING       // The line was released, the interrupt timestamps the sensor's edges
+} DHT_CAPTURE_PHASE;
+
 typedef struct DHT_SENSOR_TAG
 {
-    DHT_SENSOR_OPTIONS * options;
+    DHT_SENSOR_OPTIONS options;
     double temperature;
     double humidity;
+    telemetry_field_id_t temperature_field;
+    telemetry_field_id_t humidity_field;
     DHT_SENSOR_STATUS status;
+    DHT_CAPTURE_PHASE phase;
+    int64_t released;
+    volatile uint8_t edge_count;
+    uint16_t edges[DHT_MAX_EDGES];
 } DHT_SENSOR;
 
 PRIVILEGED_DATA portMUX_TYPE _readerMux = portMUX_INITIALIZER_UNLOCKED;
@@ -69,13 +107,23 @@ int32_t dht_readPulse(uint8_t pin, int32_t usTimeOut, bool state )
 	return usTime;
 }
 
-SENSOR_HANDLE dht_create()
+SENSOR_HANDLE dht_create(void * storage, size_t size)
 {
-    DHT_SENSOR * sensor = malloc(sizeof(DHT_SENSOR));
-    sensor->options = malloc(sizeof(DHT_SENSOR_OPTIONS));
+    if (size < sizeof(DHT_SENSOR))
+    {
+        ESP_LOGE(TAG, "Sensor storage too small: %d bytes, expected %d\n", (int) size, (int) sizeof(DHT_SENSOR));
+        return 0;
+    }
+
+    DHT_SENSOR * sensor = (DHT_SENSOR *) storage;
+    memset(&sensor->options, 0, sizeof(sensor->options));
     sensor->temperature = 0;
     sensor->humidity = 0;
+    sensor->temperature_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->humidity_field = TELEMETRY_FIELD_ID_INVALID;
     sensor->status = DHT_SENSOR_STATUS_CREATED;
+    sensor->phase = DHT_CAPTURE_IDLE;
+    sensor->edge_count = 0;
 
     return (SENSOR_HANDLE) sensor;
 }
@@ -84,14 +132,15 @@ void dht_destroy(SENSOR_HANDLE handle)
 {
     DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
 
+    // The storage belongs to the device
     if (sensor != NULL)
     {
-        if(sensor->options != NULL)
+        if (sensor->options.capture == DHT_CAPTURE_INTERRUPT)
         {
-            free(sensor->options);
+            gpio_isr_handler_remove(sensor->options.pin);
         }
 
-        free(sensor);
+        sensor->status = DHT_SENSOR_STATUS_CREATED;
     }
 }
 
@@ -102,51 +151,188 @@ void dht_set_options(SENSOR_HANDLE handle, void * options)
 
     if (sensor != NULL)
     {
-        sensor->options->pin = opt->pin;
-        sensor->options->type = opt->type;
+        sensor->options.pin = opt->pin;
+        sensor->options.type = opt->type;
+        sensor->options.capture = opt->capture;
     }
 }
 
 void* dht_get_options(SENSOR_HANDLE handle)
 {
     DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
-    return (void *) sensor->options;
+    return (void *) &sensor->options;
+}
+
+int dht_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+
+    // The DHT11 reports whole degrees and percents, the other models tenths
+    int8_t precision = (sensor->options.type == DHT_11) ? 0 : 1;
+
+    sensor->temperature_field = telemetry_schema_add_number_range(schema, "temperature", precision, DHT_MIN_TEMPERATURE, DHT_MAX_TEMPERATURE);
+    sensor->humidity_field = telemetry_schema_add_number_range(schema, "humidity", precision, 0, 100);
+
+    if (sensor->temperature_field == TELEMETRY_FIELD_ID_INVALID ||
+        sensor->humidity_field == TELEMETRY_FIELD_ID_INVALID)
+    {
+        ESP_LOGE(TAG, "Unable to declare telemetry fields\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    return SENSOR_STATUS_OK;
+}
+
+// The pin's level read from the input registers, gpio_get_level is not in IRAM
+static inline IRAM_ATTR bool dht_get_pin_level(uint8_t pin)
+{
+    return (((pin < 32) ? (GPIO.in >> pin) : (GPIO.in1.data >> (pin - 32))) & 0x01) != 0;
+}
+
+// Timestamp each edge of the line with its new level, the transmission is decoded once complete. In IRAM with
+// everything it calls, the edges keep being captured while the flash cache is disabled.
+static void IRAM_ATTR dht_edge_isr(void * arg)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) arg;
+    uint8_t count = sensor->edge_count;
+
+    if (count < DHT_MAX_EDGES)
+    {
+        uint16_t level = dht_get_pin_level(sensor->options.pin) ? DHT_EDGE_LEVEL : 0;
+        sensor->edges[count] = ((uint16_t) esp_timer_get_time() & DHT_EDGE_TIME_MASK) | level;
+        sensor->edge_count = count + 1;
+    }
 }
 
 int dht_initialize(SENSOR_HANDLE handle)
 {
-    vPortCPUInitializeMutex( &_readerMux );
-    
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+    uint8_t pin = sensor->options.pin;
+
+    if (sensor->options.capture == DHT_CAPTURE_POLLING)
+    {
+        vPortCPUInitializeMutex( &_readerMux );
+        return SENSOR_STATUS_OK;
+    }
+
+    // The service is shared with other drivers, it may already be installed. Its handlers are all in IRAM.
+    esp_err_t status = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+
+    if (status != ESP_OK && status != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "Unable to install the GPIO interrupt service: %d\n", status);
+        return SENSOR_STATUS_FAILED;
+    }
+
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    gpio_intr_disable(pin);
+
+    if (gpio_isr_handler_add(pin, dht_edge_isr, sensor) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to add the pin's interrupt handler\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
     return SENSOR_STATUS_OK;
 }
 
-int dht_read(SENSOR_HANDLE handle)
+int dht_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time)
 {
     DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+    uint8_t pin = sensor->options.pin;
+
+    if (sensor->options.capture == DHT_CAPTURE_INTERRUPT)
+    {
+        gpio_intr_disable(pin);
+        sensor->edge_count = 0;
+        sensor->phase = DHT_CAPTURE_STARTING;
+    }
+
+    // send start signal: the line is held low while the task sleeps, instead of a busy wait in the critical section
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+
+    *conversion_time = DHT_START_SIGNAL_TIME;
+
+    return SENSOR_STATUS_OK;
+}
+
+int dht_poll(SENSOR_HANDLE handle)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+    uint8_t pin = sensor->options.pin;
+
+    // The polling capture reads the transmission in the fetch
+    if (sensor->options.capture == DHT_CAPTURE_POLLING)
+    {
+        return SENSOR_STATUS_OK;
+    }
+
+    if (sensor->phase == DHT_CAPTURE_STARTING)
+    {
+        // The start signal ended: release the line, the interrupt captures its rising edge then the sensor's
+        gpio_intr_enable(pin);
+        gpio_set_direction(pin, GPIO_MODE_INPUT);
+        sensor->released = esp_timer_get_time();
+        sensor->phase = DHT_CAPTURE_RECEIVING;
+        return SENSOR_STATUS_PENDING;
+    }
+
+    if (sensor->phase == DHT_CAPTURE_RECEIVING &&
+        sensor->edge_count < DHT_MAX_EDGES &&
+        esp_timer_get_time() - sensor->released < DHT_TRANSMISSION_TIME)
+    {
+        return SENSOR_STATUS_PENDING;
+    }
+
+    // Complete, or as much of it as the sensor sent
+    gpio_intr_disable(pin);
+    sensor->phase = DHT_CAPTURE_IDLE;
+
+    return SENSOR_STATUS_OK;
+}
+
+static int dht_fetch_edges(DHT_SENSOR * sensor)
+{
+    uint8_t dht_data[DHT_DATA_SIZE];
+    int status = dht_decode(sensor->edges, sensor->edge_count, dht_data);
+
+    if (status != DHT_DECODE_OK)
+    {
+        ESP_LOGE(TAG, "Error decoding the sensor's transmission: %d, %d edges\n", status, sensor->edge_count);
+        sensor->status = DHT_SENSOR_STATUS_INVALID_TELEMETRY;
+        return SENSOR_STATUS_FAILED;
+    }
+
+    dht_convert(sensor->options.type, dht_data, &sensor->temperature, &sensor->humidity);
     sensor->status = DHT_SENSOR_STATUS_READY;
 
-    // sensor data is made up of 5 bytes:
-    // dht11 has 8 bits for humidity, 8 bits not used, 8 bits for temperature, 8 bits unused and 8-bit crc check
-    // the other sensors have 16 bits for humidity, 16 bits for temperature and 8 bit crc check
+    return SENSOR_STATUS_OK;
+}
 
-    uint8_t dht_data[5];       // read 5 bytes (40 bits)
+int dht_fetch(SENSOR_HANDLE handle)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+
+    if (sensor->options.capture == DHT_CAPTURE_INTERRUPT)
+    {
+        return dht_fetch_edges(sensor);
+    }
+
+    sensor->status = DHT_SENSOR_STATUS_READY;
+
+    // sensor data is made up of 5 bytes, converted by dht_convert
+    uint8_t dht_data[DHT_DATA_SIZE];       // read 5 bytes (40 bits)
     uint8_t byte_index = 0;    
     uint8_t bit_index = 7;     // start with most significant bit
-    uint8_t pin = sensor->options->pin;
+    uint8_t pin = sensor->options.pin;
 
     // Clear all bits
     memset(dht_data, 0, sizeof(dht_data));
 
     taskENTER_CRITICAL(&_readerMux);
 
-    // send start signal
-    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
-    
-    // Set the line low for 20ms
-    gpio_set_level(pin, 0);
-    ets_delay_us(20000);
-
-    // Start reading the data.
+    // The start signal ended, start reading the data.
     gpio_set_direction(pin, GPIO_MODE_INPUT);
 
     // DHT sensor will keep the line low for ~80us.
@@ -224,35 +410,37 @@ int dht_read(SENSOR_HANDLE handle)
         return SENSOR_STATUS_FAILED;
     }    
     
-    if (sensor->options->type == DHT_11)
-    {
-        sensor->humidity = dht_data[0];
-        sensor->temperature = dht_data[2];
-    }
-    else
-    {
-        sensor->humidity = (dht_data[0] * 256 + dht_data[1]) / 10.0;
-        sensor->temperature = ((dht_data[2] & 0x7F) * 256 + dht_data[1]) / 10.0;
-
-        if (dht_data[2] &0x80)
-        {
-            sensor->temperature *= -1;
-        }
-    }
+    dht_convert(sensor->options.type, dht_data, &sensor->temperature, &sensor->humidity);
 
     return SENSOR_STATUS_OK;
 }
 
-int dht_post(SENSOR_HANDLE handle, telemetry_message_handle_t message)
+int dht_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer)
 {
     DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
     
     if (sensor->status == DHT_SENSOR_STATUS_READY)
     {
-        telemetry_message_add_number(message, "temperature", sensor->temperature);
-        telemetry_message_add_number(message, "humidity", sensor->humidity);
+        telemetry_sample_write(writer, sensor->temperature_field, sensor->temperature);
+        telemetry_sample_write(writer, sensor->humidity_field, sensor->humidity);
         return SENSOR_STATUS_OK;
     }
 
     return SENSOR_STATUS_FAILED;
 }
+
+uint32_t dht_get_bus(SENSOR_HANDLE handle)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+
+    // The data line is bit-banged on its own GPIO
+    return SENSOR_BUS_GPIO(sensor->options.pin);
+}
+
+uint32_t dht_get_min_interval(SENSOR_HANDLE handle)
+{
+    DHT_SENSOR * sensor = (DHT_SENSOR *) handle;
+
+    // Read sooner, the sensor returns its previous conversion or does not answer
+    return (sensor->options.type == DHT_11) ? DHT11_MIN_INTERVAL : DHT22_MIN_INTERVAL;
+}
@@ -0,0 +1,155 @@
+#include "ldr-window.h"
+
+#include <math.h>
+
+#define LDR_CHANNEL_SHIFT          12      /*!< The channel's bits in an I2S ADC word */
+#define LDR_READING_MASK           0x0FFF
+#define LDR_FLICKER_HYSTERESIS     16      /*!< Readings, ~13mV, the signal moves past the reference to cross it */
+
+static double ldr_window_voltage(double reading)
+{
+    return reading / LDR_ADC_MAX * LDR_ADC_VOLTAGE;
+}
+
+/**
+ * @brief Empty a window
+ *
+ * @param[out] window      The window
+ * @param[in]  reference   The flicker's reference level, the last window's mean reading. -1 takes the first sample.
+ */
+void ldr_window_reset(LDR_WINDOW * window, int32_t reference)
+{
+    window->count = 0;
+    window->min = LDR_ADC_MAX;
+    window->max = 0;
+    window->sum = 0;
+    window->sum_squares = 0;
+    window->reference = reference;
+
+    // The first rising crossing is only counted once the signal went below the reference
+    window->above = true;
+    window->crossings = 0;
+    window->first_crossing = 0;
+    window->last_crossing = 0;
+}
+
+/**
+ * @brief Convert the words of an I2S ADC DMA buffer to readings: the channel is in the 4 most significant bits,
+ *        the reading in the 12 others. The words of other channels are dropped.
+ *
+ * @param[in]  words       The DMA buffer's words
+ * @param[in]  count       The number of words
+ * @param[in]  channel     The ADC1 channel of the sensor
+ * @param[out] samples     The readings, may be words
+ *
+ * @return
+ *          - The number of readings
+ */
+size_t ldr_window_convert(const uint16_t * words, size_t count, uint8_t channel, uint16_t * samples)
+{
+    size_t converted = 0;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        uint16_t word = words[index];
+
+        if ((word >> LDR_CHANNEL_SHIFT) == channel)
+        {
+            samples[converted++] = word & LDR_READING_MASK;
+        }
+    }
+
+    return converted;
+}
+
+/**
+ * @brief Add readings to a window
+ *
+ * @param[in,out] window   The window
+ * @param[in]  samples     The readings
+ * @param[in]  count       The number of readings
+ */
+void ldr_window_add(LDR_WINDOW * window, const uint16_t * samples, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (window->reference < 0)
+    {
+        window->reference = samples[0];
+    }
+
+    // Kept in locals through the loop, the window is only written back once
+    uint16_t min = window->min;
+    uint16_t max = window->max;
+    uint64_t sum = 0;
+    uint64_t sum_squares = 0;
+    bool above = window->above;
+    int32_t upper = window->reference + LDR_FLICKER_HYSTERESIS;
+    int32_t lower = window->reference - LDR_FLICKER_HYSTERESIS;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        uint32_t sample = samples[index];
+
+        min = (sample < min) ? sample : min;
+        max = (sample > max) ? sample : max;
+        sum += sample;
+        sum_squares += sample * sample;
+
+        if (!above && (int32_t) sample >= upper)
+        {
+            above = true;
+
+            if (window->crossings++ == 0)
+            {
+                window->first_crossing = window->count + index;
+            }
+
+            window->last_crossing = window->count + index;
+        }
+        else if (above && (int32_t) sample <= lower)
+        {
+            above = false;
+        }
+    }
+
+    window->min = min;
+    window->max = max;
+    window->sum += sum;
+    window->sum_squares += sum_squares;
+    window->above = above;
+    window->count += count;
+}
+
+/**
+ * @brief Get the mean, min, max, RMS and flicker frequency of a window. The flicker is estimated from the rising
+ *        crossings of the reference level, with some hysteresis against the ADC's noise.
+ *
+ * @param[in]  window      The window
+ * @param[in]  sample_rate The readings per second
+ * @param[out] statistics  The window's statistics
+ */
+void ldr_window_get_statistics(const LDR_WINDOW * window, uint32_t sample_rate, LDR_WINDOW_STATISTICS * statistics)
+{
+    statistics->count = window->count;
+
+    if (window->count == 0)
+    {
+        statistics->mean = statistics->min = statistics->max = statistics->rms = statistics->flicker = 0;
+        return;
+    }
+
+    statistics->mean = ldr_window_voltage((double) window->sum / window->count);
+    statistics->min = ldr_window_voltage(window->min);
+    statistics->max = ldr_window_voltage(window->max);
+    statistics->rms = ldr_window_voltage(sqrt((double) window->sum_squares / window->count));
+
+    // Whole periods between the first and last rising crossings
+    uint32_t span = window->last_crossing - window->first_crossing;
+
+    statistics->flicker = (window->crossings >= 2 && span > 0) ?
+        (double) (window->crossings - 1) * sample_rate / span : 0;
+}
@@ -1,21 +1,38 @@
 #include "ldr.h"
+#include "ldr-window.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/portmacro.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "driver/adc.h"
+#include "driver/i2s.h"
 
+#include <math.h>
 #include <string.h>
 
-SENSOR_HANDLE ldr_create();
+#define LDR_I2S_PORT               I2S_NUM_0   /*!< The only I2S port wired to the ADC */
+#define LDR_DMA_BUFFER_COUNT       4
+#define LDR_DMA_BUFFER_LENGTH      256     /*!< Words of a DMA buffer, the samples the stream task reads at once */
+#define LDR_MIN_SAMPLE_RATE        1000
+#define LDR_MAX_SAMPLE_RATE        40000
+#define LDR_MAX_RESISTANCE         10.0    /*!< kOhm of the light resistance at a 0V reading */
+#define LDR_STREAM_STACK_SIZE      2048
+#define LDR_LOCK_TIMEOUT           100     /*!< ms a reading waits for the stream task to release the window */
+
+SENSOR_HANDLE ldr_create(void * storage, size_t size);
 void ldr_destroy(SENSOR_HANDLE handle);
 void ldr_set_options(SENSOR_HANDLE handle, void * options);
 void* ldr_get_options(SENSOR_HANDLE handle);
+int ldr_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema);
 int ldr_initialize(SENSOR_HANDLE handle);
-int ldr_read(SENSOR_HANDLE handle);
-int ldr_post(SENSOR_HANDLE handle, telemetry_message_handle_t message);
+int ldr_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer);
+uint32_t ldr_get_bus(SENSOR_HANDLE handle);
+int ldr_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time);
+int ldr_fetch(SENSOR_HANDLE handle);
 
 static const SENSOR_INTERFACE_DESCRIPTION ldr_handle_interface_description =
 {
@@ -23,9 +40,17 @@ static const SENSOR_INTERFACE_DESCRIPTION ldr_handle_interface_description =
     ldr_destroy,
     ldr_set_options,
     ldr_get_options,
+    ldr_declare_fields,
     ldr_initialize,
-    ldr_read,
-    ldr_post
+    NULL,
+    ldr_post,
+    ldr_get_bus,
+    ldr_begin_read,
+    NULL,
+    ldr_fetch,
+    NULL,
+    NULL,
+    NULL
 };
 
 typedef enum
@@ -37,10 +62,22 @@ typedef enum
 
 typedef struct LDR_SENSOR_TAG
 {
-    LDR_SENSOR_OPTIONS * options;
+    LDR_SENSOR_OPTIONS options;
+    adc1_channel_t channel;
     double voltage;
     double lightResistance;
+    LDR_WINDOW_STATISTICS statistics;   // The last reported window, stream mode only
+    telemetry_field_id_t voltage_field;
+    telemetry_field_id_t lightResistance_field;
+    telemetry_field_id_t min_field;
+    telemetry_field_id_t max_field;
+    telemetry_field_id_t rms_field;
+    telemetry_field_id_t flicker_field;
+    telemetry_field_id_t samples_field;
     LDR_SENSOR_STATUS status;
+    LDR_WINDOW window;                  // Accumulated by the stream task, guarded by lock
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
 } LDR_SENSOR;
 
 static const char *TAG = "LDR Sensor";
@@ -50,13 +87,31 @@ const SENSOR_INTERFACE_DESCRIPTION * ldr_get_inteface()
     return &ldr_handle_interface_description;
 }
 
-SENSOR_HANDLE ldr_create()
+SENSOR_HANDLE ldr_create(void * storage, size_t size)
 {
-    LDR_SENSOR * sensor = malloc(sizeof(LDR_SENSOR));
-    sensor->options = malloc(sizeof(LDR_SENSOR_OPTIONS));
+    if (size < sizeof(LDR_SENSOR))
+    {
+        ESP_LOGE(TAG, "Sensor storage too small: %d bytes, expected %d\n", (int) size, (int) sizeof(LDR_SENSOR));
+        return 0;
+    }
+
+    LDR_SENSOR * sensor = (LDR_SENSOR *) storage;
+    memset(&sensor->options, 0, sizeof(sensor->options));
+    memset(&sensor->statistics, 0, sizeof(sensor->statistics));
+    sensor->channel = ADC1_CHANNEL_MAX;
     sensor->voltage = 0;
     sensor->lightResistance = 0;
+    sensor->voltage_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->lightResistance_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->min_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->max_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->rms_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->flicker_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->samples_field = TELEMETRY_FIELD_ID_INVALID;
     sensor->status = LDR_SENSOR_STATUS_CREATED;
+    sensor->lock = NULL;
+    sensor->task = NULL;
+    ldr_window_reset(&sensor->window, -1);
 
     return (SENSOR_HANDLE) sensor;
 }
@@ -65,14 +120,27 @@ void ldr_destroy(SENSOR_HANDLE handle)
 {
     LDR_SENSOR * sensor = (LDR_SENSOR *) handle;
 
+    // The storage belongs to the device
     if (sensor != NULL)
     {
-        if(sensor->options != NULL)
+        // The stream task is deleted out of the window's updates
+        if (sensor->task != NULL)
         {
-            free(sensor->options);
+            xSemaphoreTake(sensor->lock, portMAX_DELAY);
+            vTaskDelete(sensor->task);
+            sensor->task = NULL;
+
+            i2s_adc_disable(LDR_I2S_PORT);
+            i2s_driver_uninstall(LDR_I2S_PORT);
         }
 
-        free(sensor);
+        if (sensor->lock != NULL)
+        {
+            vSemaphoreDelete(sensor->lock);
+            sensor->lock = NULL;
+        }
+
+        sensor->status = LDR_SENSOR_STATUS_CREATED;
     }
 }
 
@@ -83,14 +151,126 @@ void ldr_set_options(SENSOR_HANDLE handle, void * options)
 
     if (sensor != NULL)
     {
-        sensor->options->pin = opt->pin;
+        sensor->options.pin = opt->pin;
+        sensor->options.mode = opt->mode;
+        sensor->options.sample_rate = (opt->sample_rate < LDR_MIN_SAMPLE_RATE) ? LDR_MIN_SAMPLE_RATE :
+                                      (opt->sample_rate > LDR_MAX_SAMPLE_RATE) ? LDR_MAX_SAMPLE_RATE : opt->sample_rate;
     }
 }
 
 void* ldr_get_options(SENSOR_HANDLE handle)
 {
     LDR_SENSOR * sensor = (LDR_SENSOR *) handle;
-    return (void *) sensor->options;
+    return (void *) &sensor->options;
+}
+
+int ldr_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema)
+{
+    LDR_SENSOR * sensor = (LDR_SENSOR *) handle;
+
+    // A 12 bits reading over 3.3V resolves about 0.8mV
+    sensor->voltage_field = telemetry_schema_add_number_range(schema, "ldrVoltage", 3, 0, LDR_ADC_VOLTAGE);
+    sensor->lightResistance_field = telemetry_schema_add_number_range(schema, "ldrResistance", 3, 0, LDR_MAX_RESISTANCE);
+
+    if (sensor->voltage_field == TELEMETRY_FIELD_ID_INVALID ||
+        sensor->lightResistance_field == TELEMETRY_FIELD_ID_INVALID)
+    {
+        ESP_LOGE(TAG, "Unable to declare telemetry fields\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (sensor->options.mode != LDR_MODE_STREAM)
+    {
+        return SENSOR_STATUS_OK;
+    }
+
+    // The window's spread, and the frequency of the light's flicker with a tenth of a Hz
+    sensor->min_field = telemetry_schema_add_number_range(schema, "ldrMin", 3, 0, LDR_ADC_VOLTAGE);
+    sensor->max_field = telemetry_schema_add_number_range(schema, "ldrMax", 3, 0, LDR_ADC_VOLTAGE);
+    sensor->rms_field = telemetry_schema_add_number_range(schema, "ldrRms", 3, 0, LDR_ADC_VOLTAGE);
+    sensor->flicker_field = telemetry_schema_add_number_range(schema, "ldrFlicker", 1, 0, LDR_MAX_SAMPLE_RATE / 2);
+    sensor->samples_field = telemetry_schema_add_number_range(schema, "ldrSamples", 0, 0, UINT32_MAX);
+
+    if (sensor->min_field == TELEMETRY_FIELD_ID_INVALID || sensor->max_field == TELEMETRY_FIELD_ID_INVALID ||
+        sensor->rms_field == TELEMETRY_FIELD_ID_INVALID || sensor->flicker_field == TELEMETRY_FIELD_ID_INVALID ||
+        sensor->samples_field == TELEMETRY_FIELD_ID_INVALID)
+    {
+        ESP_LOGE(TAG, "Unable to declare telemetry fields\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    return SENSOR_STATUS_OK;
+}
+
+// Add each DMA block to the window, a block holds LDR_DMA_BUFFER_LENGTH conversions
+static void ldr_stream_task(void * arg)
+{
+    LDR_SENSOR * sensor = (LDR_SENSOR *) arg;
+    uint16_t words[LDR_DMA_BUFFER_LENGTH];
+
+    while (true)
+    {
+        int length = i2s_read_bytes(LDR_I2S_PORT, (char *) words, sizeof(words), portMAX_DELAY);
+
+        if (length <= 0)
+        {
+            continue;
+        }
+
+        // Converted in place, out of the lock
+        size_t count = ldr_window_convert(words, length / sizeof(uint16_t), sensor->channel, words);
+
+        xSemaphoreTake(sensor->lock, portMAX_DELAY);
+        ldr_window_add(&sensor->window, words, count);
+        xSemaphoreGive(sensor->lock);
+    }
+}
+
+static int ldr_initialize_stream(LDR_SENSOR * sensor)
+{
+    i2s_config_t config =
+    {
+        .mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
+        .sample_rate = sensor->options.sample_rate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT,
+        .communication_format = I2S_COMM_FORMAT_I2S_MSB,
+        .intr_alloc_flags = 0,
+        .dma_buf_count = LDR_DMA_BUFFER_COUNT,
+        .dma_buf_len = LDR_DMA_BUFFER_LENGTH
+    };
+
+    if ((sensor->lock = xSemaphoreCreateMutex()) == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to create the window's lock\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (i2s_driver_install(LDR_I2S_PORT, &config, 0, NULL) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to install the I2S driver\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (i2s_set_adc_mode(ADC_UNIT_1, sensor->channel) != ESP_OK || i2s_adc_enable(LDR_I2S_PORT) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to stream the ADC through I2S\n");
+        i2s_driver_uninstall(LDR_I2S_PORT);
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (xTaskCreate(ldr_stream_task, "LDR Stream Thread", LDR_STREAM_STACK_SIZE, (void *) sensor, 5, &sensor->task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Unable to create the stream task\n");
+        sensor->task = NULL;
+        i2s_adc_disable(LDR_I2S_PORT);
+        i2s_driver_uninstall(LDR_I2S_PORT);
+        return SENSOR_STATUS_FAILED;
+    }
+
+    ESP_LOGI(TAG, "Streaming %u samples per second\n", (unsigned int) sensor->options.sample_rate);
+
+    return SENSOR_STATUS_OK;
 }
 
 int ldr_initialize(SENSOR_HANDLE handle)
@@ -99,7 +279,7 @@ int ldr_initialize(SENSOR_HANDLE handle)
 
     adc1_channel_t channel;
 
-    switch(sensor->options->pin)
+    switch(sensor->options.pin)
     {
         case 32: channel = ADC1_CHANNEL_4; break;
         case 33: channel = ADC1_CHANNEL_5; break;
@@ -114,37 +294,166 @@ int ldr_initialize(SENSOR_HANDLE handle)
             return SENSOR_STATUS_FAILED;
     }
 
+    sensor->channel = channel;
+
     adc1_config_width(ADC_WIDTH_12Bit);
     adc1_config_channel_atten(channel, ADC_ATTEN_11db);
+
+    if (sensor->options.mode == LDR_MODE_STREAM)
+    {
+        return ldr_initialize_stream(sensor);
+    }
     
     return SENSOR_STATUS_OK;
 }
 
-int ldr_read(SENSOR_HANDLE handle)
+int ldr_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time)
+{
+    // An ADC1 conversion completes within the fetch's call, a stream's window is ready at any time
+    *conversion_time = 0;
+
+    return SENSOR_STATUS_OK;
+}
+
+// Report the window accumulated since the last reading, the next one starts empty
+static int ldr_fetch_window(LDR_SENSOR * sensor)
+{
+    if (xSemaphoreTake(sensor->lock, LDR_LOCK_TIMEOUT / portTICK_PERIOD_MS) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Window busy for %dms\n", LDR_LOCK_TIMEOUT);
+        return SENSOR_STATUS_TIMEDOUT;
+    }
+
+    LDR_WINDOW window = sensor->window;
+
+    // The flicker of the next window crosses this one's mean
+    ldr_window_reset(&sensor->window, (window.count > 0) ? (int32_t) (window.sum / window.count) : -1);
+    xSemaphoreGive(sensor->lock);
+
+    if (window.count == 0)
+    {
+        ESP_LOGE(TAG, "No sample streamed since the last reading\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    ldr_window_get_statistics(&window, sensor->options.sample_rate, &sensor->statistics);
+    sensor->voltage = sensor->statistics.mean;
+
+    return SENSOR_STATUS_OK;
+}
+
+int ldr_fetch(SENSOR_HANDLE handle)
 {
     LDR_SENSOR * sensor = (LDR_SENSOR *) handle;
-    sensor->status = LDR_SENSOR_STATUS_READY;
+    sensor->status = LDR_SENSOR_STATUS_INVALID_TELEMETRY;
 
-    int reading = adc1_get_voltage(ADC1_CHANNEL_4);
+    if (sensor->options.mode == LDR_MODE_STREAM)
+    {
+        int status = ldr_fetch_window(sensor);
 
-    sensor->voltage = (double) reading / 4095.0 * 3.3;
-    sensor->lightResistance = 10.0 * (3.3 - sensor->voltage) / 3.3;
+        if (status != SENSOR_STATUS_OK)
+        {
+            return status;
+        }
+
+        ESP_LOGI(TAG, "Samples = %u; Voltage = %f; Min = %f; Max = %f; Flicker = %fHz\n", (unsigned int) sensor->statistics.count,
+            sensor->voltage, sensor->statistics.min, sensor->statistics.max, sensor->statistics.flicker);
+    }
+    else
+    {
+        int reading = adc1_get_voltage(sensor->channel);
+        sensor->voltage = (double) reading / LDR_ADC_MAX * LDR_ADC_VOLTAGE;
 
-    ESP_LOGI(TAG, "Reading = %d; Voltage = %f; Resisance = %fk\n", reading, sensor->voltage, sensor->lightResistance);
+        ESP_LOGI(TAG, "Reading = %d; Voltage = %f\n", reading, sensor->voltage);
+    }
+
+    sensor->status = LDR_SENSOR_STATUS_READY;
+    sensor->lightResistance = LDR_MAX_RESISTANCE * (LDR_ADC_VOLTAGE - sensor->voltage) / LDR_ADC_VOLTAGE;
+
+    ESP_LOGI(TAG, "Resisance = %fk\n", sensor->lightResistance);
     
     return SENSOR_STATUS_OK;
 }
 
-int ldr_post(SENSOR_HANDLE handle, telemetry_message_handle_t message)
+int ldr_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer)
 {
     LDR_SENSOR * sensor = (LDR_SENSOR *) handle;
     
     if (sensor->status == LDR_SENSOR_STATUS_READY)
     {
-        telemetry_message_add_number(message, "ldrVoltage", sensor->voltage);
-        telemetry_message_add_number(message, "ldrResistance", sensor->lightResistance);
+        telemetry_sample_write(writer, sensor->voltage_field, sensor->voltage);
+        telemetry_sample_write(writer, sensor->lightResistance_field, sensor->lightResistance);
+
+        if (sensor->options.mode == LDR_MODE_STREAM)
+        {
+            telemetry_sample_write(writer, sensor->min_field, sensor->statistics.min);
+            telemetry_sample_write(writer, sensor->max_field, sensor->statistics.max);
+            telemetry_sample_write(writer, sensor->rms_field, sensor->statistics.rms);
+            telemetry_sample_write(writer, sensor->flicker_field, sensor->statistics.flicker);
+            telemetry_sample_write(writer, sensor->samples_field, sensor->statistics.count);
+        }
+
         return SENSOR_STATUS_OK;
     }
 
     return SENSOR_STATUS_FAILED;
 }
+
+uint32_t ldr_get_bus(SENSOR_HANDLE handle)
+{
+    // Every LDR is read through ADC1
+    return SENSOR_BUS_ADC(1);
+}
+
+/**
+ * @brief Measure the cost of the stream mode's background work: DMA blocks of a 100Hz flicker are converted and
+ *        added to a window, then the window's statistics are taken. The run blocks the calling task, which yields a
+ *        tick every 64 blocks.
+ *
+ * @param[in]  iterations  The number of DMA blocks
+ * @param[out] result      The benchmark result
+ */
+void ldr_benchmark_run(uint32_t iterations, LDR_BENCHMARK_RESULT * result)
+{
+    static const uint32_t sample_rate = 4000;
+    uint16_t words[LDR_DMA_BUFFER_LENGTH];
+    uint16_t samples[LDR_DMA_BUFFER_LENGTH];
+    LDR_WINDOW window;
+    LDR_WINDOW_STATISTICS statistics;
+
+    ldr_window_reset(&window, -1);
+    *result = (LDR_BENCHMARK_RESULT) { .samples = 0 };
+
+    // Only the kernels are timed, not the signal's synthesis
+    int64_t elapsed = 0;
+
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        // The blocks follow each other, as streamed from ADC1_CHANNEL_4
+        for (size_t index = 0; index < LDR_DMA_BUFFER_LENGTH; ++index)
+        {
+            uint32_t sample = iteration * LDR_DMA_BUFFER_LENGTH + index;
+            words[index] = (ADC1_CHANNEL_4 << 12) | (uint16_t) (2048 + 1024 * sin(2 * M_PI * 100 * sample / sample_rate));
+        }
+
+        int64_t started = esp_timer_get_time();
+        size_t count = ldr_window_convert(words, LDR_DMA_BUFFER_LENGTH, ADC1_CHANNEL_4, samples);
+        ldr_window_add(&window, samples, count);
+        elapsed += esp_timer_get_time() - started;
+
+        result->samples += count;
+
+        // Let the idle task run now and then, for the task watchdog, outside the timed kernels
+        if ((iteration & 0x3F) == 0x3F)
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    int64_t started = esp_timer_get_time();
+    ldr_window_get_statistics(&window, sample_rate, &statistics);
+    elapsed += esp_timer_get_time() - started;
+
+    result->flicker = statistics.flicker;
+    result->samples_per_second = (elapsed > 0) ? (uint32_t) ((int64_t) result->samples * 1000000 / elapsed) : UINT32_MAX;
+}
@@ -1,26 +1,53 @@
 #include "mcp9808.h"
 
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
 #include "esp_log.h"
 
-#define ACK_CHECK_EN   0x1     /*!< I2C master will check ack from slave*/
-#define ACK_CHECK_DIS  0x0     /*!< I2C master will not check ack from slave */
-#define ACK_VAL    0x0         /*!< I2C ack value */
-#define NACK_VAL   0x1         /*!< I2C nack value */
+#include "driver/gpio.h"
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MCP9808_REG_CONFIG             0x01
 #define MCP9808_REG_UPPER_TEMP         0x02
 #define MCP9808_REG_LOWER_TEMP         0x03
 #define MCP9808_REG_CRIT_TEMP          0x04
 #define MCP9808_REG_AMBIENT_TEMP       0x05
 #define MCP9808_REG_MANUF_ID           0x06
 #define MCP9808_REG_DEVICE_ID          0x07
+#define MCP9808_REG_RESOLUTION         0x08
+
+#define MCP9808_MANUFACTURER_ID        0x0054
+#define MCP9808_DEVICE_ID              0x0400
+#define MCP9808_MAX_BUSES              I2C_NUM_MAX
+#define MCP9808_KEY_LENGTH             32
+#define MCP9808_MIN_TEMPERATURE        -256    /*!< Range of the ambient temperature register, in degrees */
+#define MCP9808_MAX_TEMPERATURE        256
+
+/* Configuration register bits, the alert output is active low in comparator mode */
+#define MCP9808_CONFIG_HYSTERESIS_SHIFT  9
+#define MCP9808_CONFIG_SHUTDOWN          0x0100
+#define MCP9808_CONFIG_ALERT_CONTROL     0x0008
+
+/* ms of a conversion and decimals of the ambient temperature, by MCP9808_RESOLUTION */
+static const uint32_t _conversion_times[] = { 250, 130, 65, 30 };
+static const int8_t _precisions[] = { 4, 3, 2, 1 };
 
-SENSOR_HANDLE mcp9808_create();
+SENSOR_HANDLE mcp9808_create(void * storage, size_t size);
 void mcp9808_destroy(SENSOR_HANDLE handle);
 void mcp9808_set_options(SENSOR_HANDLE handle, void * options);
 void* mcp9808_get_options(SENSOR_HANDLE handle);
+int mcp9808_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema);
 int mcp9808_initialize(SENSOR_HANDLE handle);
-int mcp9808_read(SENSOR_HANDLE handle);
-int mcp9808_post(SENSOR_HANDLE handle, telemetry_message_handle_t message);
+int mcp9808_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer);
+uint32_t mcp9808_get_bus(SENSOR_HANDLE handle);
+int mcp9808_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time);
+int mcp9808_fetch(SENSOR_HANDLE handle);
+uint32_t mcp9808_get_min_interval(SENSOR_HANDLE handle);
+void mcp9808_set_trigger(SENSOR_HANDLE handle, SENSOR_TRIGGER trigger, void * context);
+int mcp9808_set_alert(SENSOR_HANDLE handle, const SENSOR_ALERT * alert);
 
 static const SENSOR_INTERFACE_DESCRIPTION mcp9808_handle_interface_description =
 {
@@ -28,9 +55,17 @@ static const SENSOR_INTERFACE_DESCRIPTION mcp9808_handle_interface_description =
     mcp9808_destroy,
     mcp9808_set_options,
     mcp9808_get_options,
+    mcp9808_declare_fields,
     mcp9808_initialize,
-    mcp9808_read,
-    mcp9808_post
+    NULL,
+    mcp9808_post,
+    mcp9808_get_bus,
+    mcp9808_begin_read,
+    NULL,
+    mcp9808_fetch,
+    mcp9808_get_min_interval,
+    mcp9808_set_trigger,
+    mcp9808_set_alert
 };
 
 typedef enum
@@ -40,13 +75,40 @@ typedef enum
     MCP9808_SENSOR_STATUS_INVALID_TELEMETRY
 } MCP9808_SENSOR_STATUS;
 
+struct MCP9808_GROUP_TAG;
+
 typedef struct MCP9808_SENSOR_TAG
 {
-    MCP9808_SENSOR_OPTIONS * options;
+    MCP9808_SENSOR_OPTIONS options;
+    i2c_bus_device_handle_t device;
+    struct MCP9808_GROUP_TAG * group;
+    bool pending;               // Its reading began, the ambient temperature is due in the group's next batch
+    bool fetched;               // The group's batch read its ambient temperature
+    int fetch_status;
+    uint8_t data[2];            // The ambient temperature register read by the batch
     float temperature;
+    telemetry_field_id_t temperature_field;
+    telemetry_field_id_t latency_field;
+    telemetry_field_id_t errors_field;
+    telemetry_field_id_t alert_field;
+    uint16_t config;            // Content of the configuration register
     MCP9808_SENSOR_STATUS status;
+    SENSOR_TRIGGER trigger;
+    void * trigger_context;
 } MCP9808_SENSOR;
 
+/*
+ * The sensors on a bus, their ambient temperatures are read in a single transaction
+ */
+typedef struct MCP9808_GROUP_TAG
+{
+    i2c_bus_handle_t bus;
+    size_t count;
+    MCP9808_SENSOR * sensors[MCP9808_MAX_SENSORS];
+} MCP9808_GROUP;
+
+static MCP9808_GROUP _groups[MCP9808_MAX_BUSES];
+
 static const char *TAG = "MCP9808 Sensor";
 
 const SENSOR_INTERFACE_DESCRIPTION * mcp9808_get_inteface()
@@ -54,14 +116,37 @@ const SENSOR_INTERFACE_DESCRIPTION * mcp9808_get_inteface()
     return &mcp9808_handle_interface_description;
 }
 
-int i2c_read_16(MCP9808_SENSOR_OPTIONS * options, uint8_t reg, uint16_t * data);
+static int mcp9808_read_register(i2c_bus_device_handle_t device, uint8_t reg, uint16_t * data);
+static int mcp9808_write_register(MCP9808_SENSOR * sensor, uint8_t reg, uint16_t data);
+static int mcp9808_write_config(MCP9808_SENSOR * sensor, uint16_t config);
+static int mcp9808_check_ids(i2c_bus_device_handle_t device);
+static bool mcp9808_join_group(MCP9808_SENSOR * sensor);
+static void mcp9808_leave_group(MCP9808_SENSOR * sensor);
 
-SENSOR_HANDLE mcp9808_create()
+SENSOR_HANDLE mcp9808_create(void * storage, size_t size)
 {
-    MCP9808_SENSOR * sensor = malloc(sizeof(MCP9808_SENSOR));
-    sensor->options = malloc(sizeof(MCP9808_SENSOR_OPTIONS));
+    if (size < sizeof(MCP9808_SENSOR))
+    {
+        ESP_LOGE(TAG, "Sensor storage too small: %d bytes, expected %d\n", (int) size, (int) sizeof(MCP9808_SENSOR));
+        return 0;
+    }
+
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) storage;
+    memset(&sensor->options, 0, sizeof(sensor->options));
+    sensor->device = 0;
+    sensor->group = NULL;
+    sensor->pending = false;
+    sensor->fetched = false;
+    sensor->fetch_status = SENSOR_STATUS_FAILED;
     sensor->temperature = 0;
+    sensor->temperature_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->latency_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->errors_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->alert_field = TELEMETRY_FIELD_ID_INVALID;
+    sensor->config = 0;
     sensor->status = MCP9808_SENSOR_STATUS_CREATED;
+    sensor->trigger = NULL;
+    sensor->trigger_context = NULL;
 
     return (SENSOR_HANDLE) sensor;
 }
@@ -70,14 +155,17 @@ void mcp9808_destroy(SENSOR_HANDLE handle)
 {
     MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
 
+    // The storage belongs to the device
     if (sensor != NULL)
     {
-        if(sensor->options != NULL)
+        if (sensor->options.alert_pin >= 0)
         {
-            free(sensor->options);
+            gpio_isr_handler_remove(sensor->options.alert_pin);
         }
 
-        free(sensor);
+        mcp9808_leave_group(sensor);
+
+        sensor->status = MCP9808_SENSOR_STATUS_CREATED;
     }
 }
 
@@ -88,57 +176,238 @@ void mcp9808_set_options(SENSOR_HANDLE handle, void * options)
 
     if (sensor != NULL)
     {
-        sensor->options->i2c_port = opt->i2c_port;
-        sensor->options->i2c_address = opt->i2c_address;
+        sensor->options.i2c_bus = opt->i2c_bus;
+        sensor->options.i2c_address = opt->i2c_address;
+        sensor->options.alert_pin = opt->alert_pin;
+        sensor->options.resolution = (opt->resolution <= MCP9808_RESOLUTION_0_5) ? opt->resolution : MCP9808_RESOLUTION_0_0625;
+        sensor->options.mode = opt->mode;
+        sensor->options.address_keys = opt->address_keys;
     }
 }
 
 void* mcp9808_get_options(SENSOR_HANDLE handle)
 {
     MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
-    return (void *) sensor->options;
+    return (void *) &sensor->options;
+}
+
+int mcp9808_declare_fields(SENSOR_HANDLE handle, telemetry_schema_handle_t schema)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
+    char prefix[MCP9808_KEY_LENGTH];
+    char key[MCP9808_KEY_LENGTH];
+
+    // Several sensors on a bus are told apart by their address
+    if (sensor->options.address_keys) {
+        snprintf(prefix, sizeof(prefix), "mcp9808_%02x", sensor->options.i2c_address);
+    } else {
+        strcpy(prefix, "mcp9808");
+    }
+
+    // As many decimals as the resolution
+    snprintf(key, sizeof(key), "%s_temperature", prefix);
+    sensor->temperature_field = telemetry_schema_add_number_range(schema, key, _precisions[sensor->options.resolution],
+        MCP9808_MIN_TEMPERATURE, MCP9808_MAX_TEMPERATURE);
+
+    // The sensor's I2C transactions, in ms
+    snprintf(key, sizeof(key), "%s_i2c_latency", prefix);
+    sensor->latency_field = telemetry_schema_add_number_range(schema, key, 3, 0, UINT16_MAX);
+    snprintf(key, sizeof(key), "%s_i2c_errors", prefix);
+    sensor->errors_field = telemetry_schema_add_number_range(schema, key, 0, 0, UINT32_MAX);
+
+    if (sensor->temperature_field == TELEMETRY_FIELD_ID_INVALID || sensor->latency_field == TELEMETRY_FIELD_ID_INVALID ||
+        sensor->errors_field == TELEMETRY_FIELD_ID_INVALID)
+    {
+        ESP_LOGE(TAG, "Unable to declare telemetry fields\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    // 1 while the temperature is out of the alert window
+    snprintf(key, sizeof(key), "%s_alert", prefix);
+
+    if (sensor->options.alert_pin >= 0 &&
+        (sensor->alert_field = telemetry_schema_add_number_range(schema, key, 0, 0, 1)) == TELEMETRY_FIELD_ID_INVALID)
+    {
+        ESP_LOGE(TAG, "Unable to declare telemetry fields\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    return SENSOR_STATUS_OK;
+}
+
+// A limit register holds a two's complement temperature in quarter degrees, in bits 12 to 2
+static uint16_t mcp9808_encode_limit(float temperature)
+{
+    return ((uint16_t) (int16_t) lroundf(temperature * 4) << 2) & 0x1FFC;
+}
+
+// The closest hysteresis the sensor supports, not above the requested one: 0, 1.5, 3 or 6 degrees
+static uint16_t mcp9808_encode_hysteresis(float hysteresis)
+{
+    return (hysteresis >= 6) ? 3 : (hysteresis >= 3) ? 2 : (hysteresis >= 1.5f) ? 1 : 0;
+}
+
+// Read the sensor out of its schedule whenever the alert output changes. In IRAM, as is the trigger it calls.
+static void IRAM_ATTR mcp9808_alert_isr(void * arg)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) arg;
+
+    if (sensor->trigger != NULL)
+    {
+        sensor->trigger(sensor->trigger_context);
+    }
+}
+
+static int mcp9808_initialize_alert_pin(MCP9808_SENSOR * sensor)
+{
+    gpio_num_t pin = sensor->options.alert_pin;
+
+    // The alert output is open drain
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+    gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+
+    // The service is shared with other drivers, it may already be installed. Its handlers are all in IRAM.
+    esp_err_t status = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+
+    if (status != ESP_OK && status != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Unable to install the GPIO interrupt service: %d\n", status);
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (gpio_isr_handler_add(pin, mcp9808_alert_isr, sensor) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to add the alert pin's interrupt handler\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    gpio_intr_enable(pin);
+
+    return SENSOR_STATUS_OK;
 }
 
 int mcp9808_initialize(SENSOR_HANDLE handle)
 {
     MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
 
-    uint16_t data = 0;
-    esp_err_t status = i2c_read_16(sensor->options, MCP9808_REG_MANUF_ID, &data);
+    sensor->device = i2c_bus_add_device(sensor->options.i2c_bus, sensor->options.i2c_address);
 
-    if (status != ESP_OK) {
-        ESP_LOGE(TAG, "Unable to read manufacturer Id\n");
+    if (sensor->device == 0) {
         return SENSOR_STATUS_FAILED;
     }
 
-    if (data != 0x0054) {
-        ESP_LOGE(TAG, "Invalid manufacturer Id: %x\n", data);
+    if (mcp9808_check_ids(sensor->device) != SENSOR_STATUS_OK) {
         return SENSOR_STATUS_FAILED;
     }
 
-    status = i2c_read_16(sensor->options, MCP9808_REG_DEVICE_ID, &data);
+    // The register holds the resolution's two bits, 3 for 0.0625C
+    uint8_t resolution[2] = { MCP9808_REG_RESOLUTION, MCP9808_RESOLUTION_0_5 - sensor->options.resolution };
 
-    if (status != ESP_OK) {
-        ESP_LOGE(TAG, "Unable to read device Id\n");
+    if (i2c_bus_write(sensor->device, resolution, sizeof(resolution)) != I2C_BUS_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to set the resolution\n");
         return SENSOR_STATUS_FAILED;
     }
 
-    if (data != 0x0400) {
-        ESP_LOGE(TAG, "Invalid Device Id\n");
+    // The one-shot mode shuts the sensor down until its first reading
+    if (mcp9808_write_config(sensor, 0) != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to configure the sensor\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (sensor->options.alert_pin >= 0 && mcp9808_initialize_alert_pin(sensor) != SENSOR_STATUS_OK) {
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (!mcp9808_join_group(sensor)) {
+        ESP_LOGE(TAG, "Too many sensors on the bus\n");
         return SENSOR_STATUS_FAILED;
     }
     
     return SENSOR_STATUS_OK;
 }
 
-int mcp9808_read(SENSOR_HANDLE handle)
+int mcp9808_begin_read(SENSOR_HANDLE handle, uint32_t * conversion_time)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
+
+    // A continuous sensor's last conversion is read right away, the minimum interval keeps it fresh
+    *conversion_time = 0;
+    sensor->pending = false;
+    sensor->fetched = false;
+
+    if (sensor->options.mode == MCP9808_MODE_CONTINUOUS) {
+        sensor->pending = true;
+        return SENSOR_STATUS_OK;
+    }
+
+    // Woken up, the sensor starts converting, the ambient temperature register is updated once the conversion ends
+    if (mcp9808_write_register(sensor, MCP9808_REG_CONFIG, sensor->config & ~MCP9808_CONFIG_SHUTDOWN) != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to wake the sensor up\n");
+        sensor->status = MCP9808_SENSOR_STATUS_INVALID_TELEMETRY;
+        return SENSOR_STATUS_FAILED;
+    }
+
+    *conversion_time = _conversion_times[sensor->options.resolution];
+    sensor->pending = true;
+
+    return SENSOR_STATUS_OK;
+}
+
+// Read the ambient temperature of every pending sensor of the group in a single transaction
+static void mcp9808_fetch_group(MCP9808_GROUP * group)
+{
+    static const uint8_t reg = MCP9808_REG_AMBIENT_TEMP;
+    I2C_BUS_TRANSFER transfers[MCP9808_MAX_SENSORS];
+    MCP9808_SENSOR * sensors[MCP9808_MAX_SENSORS];
+    size_t count = 0;
+
+    for (size_t index = 0; index < group->count; ++index)
+    {
+        MCP9808_SENSOR * sensor = group->sensors[index];
+
+        if (sensor->pending && !sensor->fetched)
+        {
+            transfers[count].device = sensor->device;
+            transfers[count].write = &reg;
+            transfers[count].write_length = 1;
+            transfers[count].read = sensor->data;
+            transfers[count].read_length = sizeof(sensor->data);
+            sensors[count++] = sensor;
+        }
+    }
+
+    i2c_bus_transfer_batch(group->bus, transfers, count);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        sensors[index]->fetch_status = (transfers[index].status == I2C_BUS_STATUS_OK) ? SENSOR_STATUS_OK : SENSOR_STATUS_FAILED;
+        sensors[index]->fetched = true;
+    }
+}
+
+int mcp9808_fetch(SENSOR_HANDLE handle)
 {
-    uint16_t rawData;
     MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
 
     sensor->status = MCP9808_SENSOR_STATUS_READY;
-    
-    if (i2c_read_16(sensor->options, MCP9808_REG_AMBIENT_TEMP, &rawData) != SENSOR_STATUS_OK) {
+
+    // The first sensor of the group fetched reads the others' temperature along with its own
+    if (!sensor->fetched) {
+        sensor->fetch_status = SENSOR_STATUS_FAILED;
+        mcp9808_fetch_group(sensor->group);
+    }
+
+    int status = sensor->fetch_status;
+    uint16_t rawData = (sensor->data[0] << 8) | sensor->data[1];
+    sensor->pending = false;
+    sensor->fetched = false;
+
+    // Back to sleep once its conversion was read, a failed reading included
+    if (sensor->options.mode == MCP9808_MODE_ONE_SHOT &&
+        mcp9808_write_register(sensor, MCP9808_REG_CONFIG, sensor->config) != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to shut the sensor down");
+    }
+
+    if (status != SENSOR_STATUS_OK) {
         ESP_LOGE(TAG, "Unable to read temperature");
         sensor->status = MCP9808_SENSOR_STATUS_INVALID_TELEMETRY;
         return SENSOR_STATUS_FAILED;
@@ -156,52 +425,235 @@ int mcp9808_read(SENSOR_HANDLE handle)
     return SENSOR_STATUS_OK;
 }
 
-int mcp9808_post(SENSOR_HANDLE handle, telemetry_message_handle_t message)
+int mcp9808_post(SENSOR_HANDLE handle, TELEMETRY_SAMPLE_WRITER * writer)
 {
     MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
     
     if (sensor->status == MCP9808_SENSOR_STATUS_READY)
     {
-        telemetry_message_add_number(message, "mcp9808_temperature", sensor->temperature);
+        I2C_BUS_STATISTICS statistics;
+        i2c_bus_get_statistics(sensor->device, &statistics);
+
+        telemetry_sample_write(writer, sensor->temperature_field, sensor->temperature);
+        telemetry_sample_write(writer, sensor->latency_field, statistics.latency / 1000.0);
+        telemetry_sample_write(writer, sensor->errors_field, statistics.errors + statistics.timeouts);
+
+        if (sensor->options.alert_pin >= 0)
+        {
+            telemetry_sample_write(writer, sensor->alert_field, gpio_get_level(sensor->options.alert_pin) == 0);
+        }
+
         return SENSOR_STATUS_OK;
     }
 
     return SENSOR_STATUS_FAILED;
 }
 
+uint32_t mcp9808_get_min_interval(SENSOR_HANDLE handle)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
+
+    // The ambient temperature register only changes once per conversion
+    return _conversion_times[sensor->options.resolution];
+}
+
+void mcp9808_set_trigger(SENSOR_HANDLE handle, SENSOR_TRIGGER trigger, void * context)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
 
-// Read 16 bits data from the specified registry
-int i2c_read_16(MCP9808_SENSOR_OPTIONS * options, uint8_t reg, uint16_t * data)
+    // Set before the interrupt is enabled by the alert
+    sensor->trigger_context = context;
+    sensor->trigger = trigger;
+}
+
+int mcp9808_set_alert(SENSOR_HANDLE handle, const SENSOR_ALERT * alert)
 {
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-	i2c_master_start(cmd);
-	i2c_master_write_byte(cmd, (options->i2c_address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
-	i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);
-	i2c_master_stop(cmd);
-	
-	int status = i2c_master_cmd_begin(options->i2c_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
+
+    if (sensor->options.alert_pin < 0) {
+        ESP_LOGE(TAG, "The sensor's alert output is not connected\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    // The limits are locked while the alert is enabled, it is disabled first
+    uint16_t config = mcp9808_encode_hysteresis(alert->hysteresis) << MCP9808_CONFIG_HYSTERESIS_SHIFT;
 
-    if (status != ESP_OK) {
+    if (mcp9808_write_config(sensor, config) != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to disable the alert\n");
         return SENSOR_STATUS_FAILED;
     }
 
-    vTaskDelay(30 / portTICK_RATE_MS);
+    if (!alert->enabled) {
+        ESP_LOGI(TAG, "Alert disabled\n");
+        return SENSOR_STATUS_OK;
+    }
+
+    if (mcp9808_write_register(sensor, MCP9808_REG_UPPER_TEMP, mcp9808_encode_limit(alert->upper)) != SENSOR_STATUS_OK ||
+        mcp9808_write_register(sensor, MCP9808_REG_LOWER_TEMP, mcp9808_encode_limit(alert->lower)) != SENSOR_STATUS_OK ||
+        mcp9808_write_register(sensor, MCP9808_REG_CRIT_TEMP, mcp9808_encode_limit(alert->critical)) != SENSOR_STATUS_OK ||
+        mcp9808_write_config(sensor, config | MCP9808_CONFIG_ALERT_CONTROL) != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to program the alert\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    ESP_LOGI(TAG, "Alert window %.2f to %.2f, critical %.2f\n", alert->lower, alert->upper, alert->critical);
+
+    return SENSOR_STATUS_OK;
+}
+
+uint32_t mcp9808_get_bus(SENSOR_HANDLE handle)
+{
+    MCP9808_SENSOR * sensor = (MCP9808_SENSOR *) handle;
+
+    // Sensors on the same I2C port share the bus
+    return SENSOR_BUS_I2C(i2c_bus_get_port(sensor->options.i2c_bus));
+}
+
+// Check the manufacturer and device Ids, a device at an MCP9808 address may be another part
+static int mcp9808_check_ids(i2c_bus_device_handle_t device)
+{
+    uint16_t data = 0;
+    int status = mcp9808_read_register(device, MCP9808_REG_MANUF_ID, &data);
+
+    if (status != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to read manufacturer Id\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (data != MCP9808_MANUFACTURER_ID) {
+        ESP_LOGE(TAG, "Invalid manufacturer Id: %x\n", data);
+        return SENSOR_STATUS_FAILED;
+    }
+
+    status = mcp9808_read_register(device, MCP9808_REG_DEVICE_ID, &data);
+
+    if (status != SENSOR_STATUS_OK) {
+        ESP_LOGE(TAG, "Unable to read device Id\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    if (data != MCP9808_DEVICE_ID) {
+        ESP_LOGE(TAG, "Invalid Device Id\n");
+        return SENSOR_STATUS_FAILED;
+    }
+
+    return SENSOR_STATUS_OK;
+}
+
+size_t mcp9808_scan(i2c_bus_handle_t bus, uint8_t * addresses, size_t size)
+{
+    size_t count = 0;
+
+    for (uint8_t address = MCP9808_FIRST_ADDRESS; address < MCP9808_FIRST_ADDRESS + MCP9808_MAX_SENSORS && count < size; ++address)
+    {
+        if (!i2c_bus_probe(bus, address))
+        {
+            continue;
+        }
+
+        i2c_bus_device_handle_t device = i2c_bus_add_device(bus, address);
+
+        if (device != 0 && mcp9808_check_ids(device) == SENSOR_STATUS_OK)
+        {
+            ESP_LOGI(TAG, "Sensor found at 0x%02x\n", address);
+            addresses[count++] = address;
+        }
+    }
+
+    return count;
+}
 
-    uint8_t data_h, data_l;
+// Add the sensor to the group of its bus, the group is created with its first sensor
+static bool mcp9808_join_group(MCP9808_SENSOR * sensor)
+{
+    MCP9808_GROUP * free_group = NULL;
 
-    cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (options->i2c_address << 1) | I2C_MASTER_READ, ACK_CHECK_EN);
+    for (size_t index = 0; index < MCP9808_MAX_BUSES; ++index)
+    {
+        MCP9808_GROUP * group = &_groups[index];
 
-    i2c_master_read_byte(cmd, &data_h, ACK_VAL);
-    i2c_master_read_byte(cmd, &data_l, NACK_VAL);
+        if (group->count > 0 && group->bus == sensor->options.i2c_bus)
+        {
+            if (group->count == MCP9808_MAX_SENSORS)
+            {
+                return false;
+            }
+
+            group->sensors[group->count++] = sensor;
+            sensor->group = group;
+            return true;
+        }
 
-    i2c_master_stop(cmd);
+        if (group->count == 0 && free_group == NULL)
+        {
+            free_group = group;
+        }
+    }
+
+    if (free_group == NULL)
+    {
+        return false;
+    }
 
-	status = i2c_master_cmd_begin(options->i2c_port, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
+    free_group->bus = sensor->options.i2c_bus;
+    free_group->sensors[0] = sensor;
+    free_group->count = 1;
+    sensor->group = free_group;
 
-    *data = (data_h << 8) + data_l;
-    return status == ESP_OK ? SENSOR_STATUS_OK : SENSOR_STATUS_FAILED;
+    return true;
+}
+
+static void mcp9808_leave_group(MCP9808_SENSOR * sensor)
+{
+    MCP9808_GROUP * group = sensor->group;
+
+    if (group == NULL)
+    {
+        return;
+    }
+
+    for (size_t index = 0; index < group->count; ++index)
+    {
+        if (group->sensors[index] == sensor)
+        {
+            group->sensors[index] = group->sensors[--group->count];
+            break;
+        }
+    }
+
+    sensor->group = NULL;
+}
+
+// Write a 16 bits register, most significant byte first
+static int mcp9808_write_register(MCP9808_SENSOR * sensor, uint8_t reg, uint16_t data)
+{
+    uint8_t bytes[3] = { reg, data >> 8, data & 0xFF };
+
+    return (i2c_bus_write(sensor->device, bytes, sizeof(bytes)) == I2C_BUS_STATUS_OK) ? SENSOR_STATUS_OK : SENSOR_STATUS_FAILED;
+}
+
+// Write the configuration register, with the shutdown bit of the one-shot mode
+static int mcp9808_write_config(MCP9808_SENSOR * sensor, uint16_t config)
+{
+    config |= (sensor->options.mode == MCP9808_MODE_ONE_SHOT) ? MCP9808_CONFIG_SHUTDOWN : 0;
+
+    if (mcp9808_write_register(sensor, MCP9808_REG_CONFIG, config) != SENSOR_STATUS_OK) {
+        return SENSOR_STATUS_FAILED;
+    }
+
+    sensor->config = config;
+    return SENSOR_STATUS_OK;
+}
+
+// Read a 16 bits register, the pointer is written and the register read in a single transaction
+static int mcp9808_read_register(i2c_bus_device_handle_t device, uint8_t reg, uint16_t * data)
+{
+    uint8_t bytes[2];
+
+    if (i2c_bus_write_read(device, &reg, 1, bytes, sizeof(bytes)) != I2C_BUS_STATUS_OK) {
+        return SENSOR_STATUS_FAILED;
+    }
+
+    *data = (bytes[0] << 8) | bytes[1];
+    return SENSOR_STATUS_OK;
 }
@@ -0,0 +1,115 @@
+#include "sensor.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Start a sensor's reading. A sensor with only a blocking SENSOR_READ is read right away.
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ * @param[out] conversion_time   Number of ms before the reading may be polled
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading started
+ *          - SENSOR_STATUS_FAILED if unable to start the reading
+ */
+int sensor_begin_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle, uint32_t * conversion_time)
+{
+    *conversion_time = 0;
+
+    if (sensor_interface->sensor_begin_read == NULL)
+    {
+        return sensor_interface->sensor_read(handle);
+    }
+
+    return sensor_interface->sensor_begin_read(handle, conversion_time);
+}
+
+/**
+ * @brief Check whether a started reading is complete
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading is complete
+ *          - SENSOR_STATUS_PENDING if the conversion is still in progress
+ *          - SENSOR_STATUS_FAILED if the reading failed
+ */
+int sensor_poll_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle)
+{
+    // A blocking reading completed in sensor_begin_reading
+    return (sensor_interface->sensor_poll != NULL) ? sensor_interface->sensor_poll(handle) : SENSOR_STATUS_OK;
+}
+
+/**
+ * @brief Collect a complete reading, the sensor then posts it with SENSOR_POST_RESULTS
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading was collected
+ *          - SENSOR_STATUS_FAILED if the reading is invalid
+ */
+int sensor_fetch_reading(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle)
+{
+    return (sensor_interface->sensor_fetch != NULL) ? sensor_interface->sensor_fetch(handle) : SENSOR_STATUS_OK;
+}
+
+/**
+ * @brief Get the shortest number of ms between two readings of a sensor
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ *
+ * @return
+ *          - The sensor's minimum reading interval, 0 if it has none
+ */
+uint32_t sensor_get_min_interval(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle)
+{
+    return (sensor_interface->sensor_get_min_interval != NULL) ? sensor_interface->sensor_get_min_interval(handle) : 0;
+}
+
+/**
+ * @brief Read a sensor, blocking the calling task until the reading is complete or timed out
+ *
+ * @param[in]  sensor_interface  The sensor's interface
+ * @param[in]  handle            The sensor's handle
+ * @param[in]  timeout           Number of ms to wait for the conversion past its announced time
+ *
+ * @return
+ *          - SENSOR_STATUS_OK if the reading is complete
+ *          - SENSOR_STATUS_TIMEDOUT if the conversion did not complete in time
+ *          - SENSOR_STATUS_FAILED if the reading failed
+ */
+int sensor_read_blocking(const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, SENSOR_HANDLE handle, uint32_t timeout)
+{
+    uint32_t conversion_time;
+    int status = sensor_begin_reading(sensor_interface, handle, &conversion_time);
+
+    if (status != SENSOR_STATUS_OK)
+    {
+        return status;
+    }
+
+    if (conversion_time > 0)
+    {
+        vTaskDelay(conversion_time / portTICK_PERIOD_MS + 1);
+    }
+
+    TickType_t deadline = xTaskGetTickCount() + timeout / portTICK_PERIOD_MS;
+
+    while ((status = sensor_poll_reading(sensor_interface, handle)) == SENSOR_STATUS_PENDING)
+    {
+        if ((int32_t)(xTaskGetTickCount() - deadline) >= 0)
+        {
+            return SENSOR_STATUS_TIMEDOUT;
+        }
+
+        vTaskDelay(1);
+    }
+
+    return (status == SENSOR_STATUS_OK) ? sensor_fetch_reading(sensor_interface, handle) : status;
+}
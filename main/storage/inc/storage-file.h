@@ -0,0 +1,33 @@
+#ifndef __STORAGE_FILE_H__
+#define __STORAGE_FILE_H__
+
+#include "storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Open a file standing in for a flash partition, with the same erase and write semantics. A missing
+ *        file is created erased. Every write is flushed to the file before it returns.
+ *
+ * @param[in]  path        The file's path
+ * @param[in]  size        The storage size, a multiple of the sector size
+ * @param[in]  sector_size The erase unit
+ *
+ * @return
+ *          - Handle to the storage
+ *          - 0 if the file could not be opened or created
+ */
+STORAGE_HANDLE storage_file_create(const char * path, size_t size, size_t sector_size);
+
+/**
+ * @brief Get the file storage interface
+ */
+const STORAGE_INTERFACE_DESCRIPTION * storage_file_get_interface();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __STORAGE_PARTITION_H__
+#define __STORAGE_PARTITION_H__
+
+#include "storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Open a data partition of the flash partition table as storage
+ *
+ * @param[in]  label       The partition's label
+ *
+ * @return
+ *          - Handle to the storage
+ *          - 0 if the partition does not exist
+ */
+STORAGE_HANDLE storage_partition_create(const char * label);
+
+/**
+ * @brief Get the flash partition storage interface
+ */
+const STORAGE_INTERFACE_DESCRIPTION * storage_partition_get_interface();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __STORAGE_H__
+#define __STORAGE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t STORAGE_HANDLE;
+
+#define STORAGE_STATUS_OK          0x0000
+#define STORAGE_STATUS_FAILED      0x0001
+
+/*
+ * A storage area with NOR flash semantics: erasing a sector sets all its bytes to 0xFF and writing only clears
+ * bits, a location already written can be written again to clear more of its bits without an erase. Erases
+ * are aligned on the sector size. Backends are created by their own create function and disposed of by
+ * STORAGE_DESTROY.
+ */
+typedef void (*STORAGE_DESTROY) (STORAGE_HANDLE handle);
+typedef int (*STORAGE_READ) (STORAGE_HANDLE handle, size_t offset, void * data, size_t size);
+typedef int (*STORAGE_WRITE) (STORAGE_HANDLE handle, size_t offset, const void * data, size_t size);
+typedef int (*STORAGE_ERASE) (STORAGE_HANDLE handle, size_t offset, size_t size);
+typedef size_t (*STORAGE_GET_SIZE) (STORAGE_HANDLE handle);
+typedef size_t (*STORAGE_GET_SECTOR_SIZE) (STORAGE_HANDLE handle);
+
+typedef struct STORAGE_INTERFACE_DESCRIPTION_TAG
+{
+    STORAGE_DESTROY storage_destroy;
+    STORAGE_READ storage_read;
+    STORAGE_WRITE storage_write;
+    STORAGE_ERASE storage_erase;
+    STORAGE_GET_SIZE storage_get_size;
+    STORAGE_GET_SECTOR_SIZE storage_get_sector_size;
+} STORAGE_INTERFACE_DESCRIPTION;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,192 @@
+#include "storage-file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STORAGE_FILE_CHUNK_SIZE    64      /*!< Bytes read, merged and written at once */
+
+void storage_file_destroy(STORAGE_HANDLE handle);
+int storage_file_read(STORAGE_HANDLE handle, size_t offset, void * data, size_t size);
+int storage_file_write(STORAGE_HANDLE handle, size_t offset, const void * data, size_t size);
+int storage_file_erase(STORAGE_HANDLE handle, size_t offset, size_t size);
+size_t storage_file_get_size(STORAGE_HANDLE handle);
+size_t storage_file_get_sector_size(STORAGE_HANDLE handle);
+
+static const STORAGE_INTERFACE_DESCRIPTION storage_file_interface_description =
+{
+    storage_file_destroy,
+    storage_file_read,
+    storage_file_write,
+    storage_file_erase,
+    storage_file_get_size,
+    storage_file_get_sector_size
+};
+
+typedef struct STORAGE_FILE_TAG
+{
+    FILE * file;
+    size_t size;
+    size_t sector_size;
+} STORAGE_FILE;
+
+/**
+ * @brief Get the file storage interface
+ */
+const STORAGE_INTERFACE_DESCRIPTION * storage_file_get_interface()
+{
+    return &storage_file_interface_description;
+}
+
+/**
+ * @brief Open a file standing in for a flash partition, with the same erase and write semantics. A missing
+ *        file is created erased. Every write is flushed to the file before it returns.
+ *
+ * @param[in]  path        The file's path
+ * @param[in]  size        The storage size, a multiple of the sector size
+ * @param[in]  sector_size The erase unit
+ *
+ * @return
+ *          - Handle to the storage
+ *          - 0 if the file could not be opened or created
+ */
+STORAGE_HANDLE storage_file_create(const char * path, size_t size, size_t sector_size)
+{
+    if (sector_size == 0 || size % sector_size != 0)
+    {
+        return 0;
+    }
+
+    STORAGE_FILE * storage = malloc(sizeof(STORAGE_FILE));
+
+    if (storage == NULL)
+    {
+        return 0;
+    }
+
+    storage->size = size;
+    storage->sector_size = sector_size;
+    storage->file = fopen(path, "r+b");
+
+    if (storage->file == NULL && (storage->file = fopen(path, "w+b")) != NULL)
+    {
+        // A new file starts erased, like a blank partition
+        if (storage_file_erase((STORAGE_HANDLE) storage, 0, size) != STORAGE_STATUS_OK)
+        {
+            fclose(storage->file);
+            storage->file = NULL;
+        }
+    }
+
+    if (storage->file == NULL)
+    {
+        free(storage);
+        return 0;
+    }
+
+    return (STORAGE_HANDLE) storage;
+}
+
+void storage_file_destroy(STORAGE_HANDLE handle)
+{
+    STORAGE_FILE * storage = (STORAGE_FILE *) handle;
+
+    if (storage != NULL)
+    {
+        fclose(storage->file);
+        free(storage);
+    }
+}
+
+int storage_file_read(STORAGE_HANDLE handle, size_t offset, void * data, size_t size)
+{
+    STORAGE_FILE * storage = (STORAGE_FILE *) handle;
+
+    if (offset + size > storage->size || fseek(storage->file, offset, SEEK_SET) != 0)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    return (fread(data, 1, size, storage->file) == size) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+int storage_file_write(STORAGE_HANDLE handle, size_t offset, const void * data, size_t size)
+{
+    STORAGE_FILE * storage = (STORAGE_FILE *) handle;
+    const uint8_t * bytes = (const uint8_t *) data;
+    uint8_t chunk[STORAGE_FILE_CHUNK_SIZE];
+
+    if (offset + size > storage->size)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    while (size > 0)
+    {
+        size_t length = (size < sizeof(chunk)) ? size : sizeof(chunk);
+
+        if (storage_file_read(handle, offset, chunk, length) != STORAGE_STATUS_OK)
+        {
+            return STORAGE_STATUS_FAILED;
+        }
+
+        // Writing flash only clears bits
+        for (size_t index = 0; index < length; ++index)
+        {
+            chunk[index] &= bytes[index];
+        }
+
+        if (fseek(storage->file, offset, SEEK_SET) != 0 || fwrite(chunk, 1, length, storage->file) != length)
+        {
+            return STORAGE_STATUS_FAILED;
+        }
+
+        offset += length;
+        bytes += length;
+        size -= length;
+    }
+
+    return (fflush(storage->file) == 0) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+int storage_file_erase(STORAGE_HANDLE handle, size_t offset, size_t size)
+{
+    STORAGE_FILE * storage = (STORAGE_FILE *) handle;
+    uint8_t chunk[STORAGE_FILE_CHUNK_SIZE];
+
+    if (offset % storage->sector_size != 0 || size % storage->sector_size != 0 || offset + size > storage->size)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    memset(chunk, 0xFF, sizeof(chunk));
+
+    if (fseek(storage->file, offset, SEEK_SET) != 0)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    while (size > 0)
+    {
+        size_t length = (size < sizeof(chunk)) ? size : sizeof(chunk);
+
+        if (fwrite(chunk, 1, length, storage->file) != length)
+        {
+            return STORAGE_STATUS_FAILED;
+        }
+
+        size -= length;
+    }
+
+    return (fflush(storage->file) == 0) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+size_t storage_file_get_size(STORAGE_HANDLE handle)
+{
+    return ((STORAGE_FILE *) handle)->size;
+}
+
+size_t storage_file_get_sector_size(STORAGE_HANDLE handle)
+{
+    return ((STORAGE_FILE *) handle)->sector_size;
+}
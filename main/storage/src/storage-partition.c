@@ -0,0 +1,86 @@
+#include "storage-partition.h"
+
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "esp_log.h"
+
+void storage_partition_destroy(STORAGE_HANDLE handle);
+int storage_partition_read(STORAGE_HANDLE handle, size_t offset, void * data, size_t size);
+int storage_partition_write(STORAGE_HANDLE handle, size_t offset, const void * data, size_t size);
+int storage_partition_erase(STORAGE_HANDLE handle, size_t offset, size_t size);
+size_t storage_partition_get_size(STORAGE_HANDLE handle);
+size_t storage_partition_get_sector_size(STORAGE_HANDLE handle);
+
+static const STORAGE_INTERFACE_DESCRIPTION storage_partition_interface_description =
+{
+    storage_partition_destroy,
+    storage_partition_read,
+    storage_partition_write,
+    storage_partition_erase,
+    storage_partition_get_size,
+    storage_partition_get_sector_size
+};
+
+static const char *TAG = "storage-partition";
+
+/**
+ * @brief Get the flash partition storage interface
+ */
+const STORAGE_INTERFACE_DESCRIPTION * storage_partition_get_interface()
+{
+    return &storage_partition_interface_description;
+}
+
+/**
+ * @brief Open a data partition of the flash partition table as storage
+ *
+ * @param[in]  label       The partition's label
+ *
+ * @return
+ *          - Handle to the storage
+ *          - 0 if the partition does not exist
+ */
+STORAGE_HANDLE storage_partition_create(const char * label)
+{
+    const esp_partition_t * partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+
+    if (partition == NULL)
+    {
+        ESP_LOGW(TAG, "No %s data partition in the partition table", label);
+        return 0;
+    }
+
+    ESP_LOGI(TAG, "Partition %s: %d bytes at 0x%x", label, (int) partition->size, (int) partition->address);
+
+    // The partition descriptors are owned by the partition API
+    return (STORAGE_HANDLE) partition;
+}
+
+void storage_partition_destroy(STORAGE_HANDLE handle)
+{
+}
+
+int storage_partition_read(STORAGE_HANDLE handle, size_t offset, void * data, size_t size)
+{
+    return (esp_partition_read((const esp_partition_t *) handle, offset, data, size) == ESP_OK) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+int storage_partition_write(STORAGE_HANDLE handle, size_t offset, const void * data, size_t size)
+{
+    return (esp_partition_write((const esp_partition_t *) handle, offset, data, size) == ESP_OK) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+int storage_partition_erase(STORAGE_HANDLE handle, size_t offset, size_t size)
+{
+    return (esp_partition_erase_range((const esp_partition_t *) handle, offset, size) == ESP_OK) ? STORAGE_STATUS_OK : STORAGE_STATUS_FAILED;
+}
+
+size_t storage_partition_get_size(STORAGE_HANDLE handle)
+{
+    return ((const esp_partition_t *) handle)->size;
+}
+
+size_t storage_partition_get_sector_size(STORAGE_HANDLE handle)
+{
+    return SPI_FLASH_SEC_SIZE;
+}
@@ -0,0 +1,98 @@
+#ifndef __TELEMETRY_BATCH_H__
+#define __TELEMETRY_BATCH_H__
+
+#include "telemetry-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batches of telemetry messages sent as a single IoT hub message. A json batch is an array of
+ * the messages' objects, a cbor batch is a definite length array of the messages' maps.
+ */
+
+typedef uint32_t telemetry_batch_handle_t;
+
+/**
+ * @brief Create an empty batch
+ *
+ * @return
+ *          - Handle to the batch
+ *          - 0 if the batch could not be allocated
+ */
+telemetry_batch_handle_t telemetry_batch_create();
+
+/**
+ * @brief Dispose of the memory allocated for the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ */
+void telemetry_batch_destroy(telemetry_batch_handle_t handle);
+
+/**
+ * @brief Set the maximum size of the serialized batch, capped to TELEMETRY_BATCH_MAX_PAYLOAD
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[in]  max_payload The maximum payload size in bytes
+ */
+void telemetry_batch_set_max_payload(telemetry_batch_handle_t handle, size_t max_payload);
+
+/**
+ * @brief Serialize a telemetry message and append it to the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[in]  message     The message to append, it is not destroyed
+ * @param[in]  encoding    The wire format, json or cbor
+ *
+ * @return
+ *          - true if the message was appended
+ *          - false if it does not fit in the maximum payload or the batch holds messages of another
+ *            encoding, the batch must then be sent and reset before appending again
+ */
+bool telemetry_batch_append(telemetry_batch_handle_t handle, telemetry_message_handle_t message, TELEMETRY_ENCODING encoding);
+
+/**
+ * @brief Get the number of messages in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ *
+ * @return
+ *          - The number of messages appended since the batch was reset
+ */
+uint16_t telemetry_batch_get_count(telemetry_batch_handle_t handle);
+
+/**
+ * @brief Get the wire format of the messages in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ *
+ * @return
+ *          - The encoding of the first message appended since the batch was reset
+ */
+TELEMETRY_ENCODING telemetry_batch_get_encoding(telemetry_batch_handle_t handle);
+
+/**
+ * @brief Close the batch's array and get the payload to send
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[out] length      The length of the serialized batch in bytes
+ *
+ * @return
+ *          - The serialized batch, valid until the batch is reset
+ *          - NULL if the batch is empty
+ */
+const uint8_t * telemetry_batch_serialize(telemetry_batch_handle_t handle, size_t * length);
+
+/**
+ * @brief Remove every message from the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ */
+void telemetry_batch_reset(telemetry_batch_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __TELEMETRY_BENCHMARK_H__
+#define __TELEMETRY_BENCHMARK_H__
+
+#include "telemetry-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_BENCHMARK_FIELD_COUNTS    { 3, 8, 16, 32, 64 }    // Number fields of the benchmarked sensor sets
+
+/**
+ * @brief   Result of a telemetry serialization benchmark run
+ */
+typedef struct TELEMETRY_BENCHMARK_RESULT_TAG
+{
+    uint8_t field_count;            // Number fields of the benchmark schema, the deviceId string excluded
+    TELEMETRY_ENCODING encoding;
+    uint32_t iterations;            // Messages built, filled, serialized and destroyed
+    bool completed;                 // false if the schema does not fit in the message limits set from menu-config
+    uint32_t messages_per_second;
+    uint32_t bytes_per_message;     // Serialized payload size
+    uint32_t arena_bytes_per_message;   // Peak arena use of a message, its memory footprint besides the field table
+    int32_t heap_allocations;       // Heap blocks still allocated after the run, expected to be 0
+    int32_t heap_bytes;             // Heap bytes still allocated after the run, expected to be 0
+} TELEMETRY_BENCHMARK_RESULT;
+
+/**
+ * @brief Measure the cost of a sampling cycle's message: a message is created from a schema of field_count
+ *        number fields, every field is set, the message is serialized then destroyed. The run blocks the
+ *        calling task.
+ *
+ * @param[in]  field_count  The number of number fields in the schema
+ * @param[in]  encoding     The wire format
+ * @param[in]  iterations   The number of messages to serialize
+ * @param[out] result       The benchmark result
+ *
+ * @return
+ *          - true if the benchmark ran
+ *          - false if the schema did not fit in the message limits or no pool message was available
+ */
+bool telemetry_benchmark_run(uint8_t field_count, TELEMETRY_ENCODING encoding, uint32_t iterations, TELEMETRY_BENCHMARK_RESULT * result);
+
+/**
+ * @brief Write benchmark results as a json object: { "benchmarks": [ { "fields": 3, "encoding": "json", ... } ] }
+ *
+ * @param[in]  results      The benchmark results
+ * @param[in]  count        The number of results
+ * @param[out] json         The output buffer
+ * @param[in]  size         The output buffer size in bytes
+ *
+ * @return
+ *          - The length of the json output, excluding the null terminator
+ *          - 0 if the output buffer is too small
+ */
+size_t telemetry_benchmark_write_json(const TELEMETRY_BENCHMARK_RESULT * results, size_t count, char * json, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
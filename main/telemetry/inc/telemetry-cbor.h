@@ -0,0 +1,113 @@
+#ifndef __TELEMETRY_CBOR_H__
+#define __TELEMETRY_CBOR_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   CBOR (RFC 7049) writer over a caller supplied buffer. Writes past the end of the buffer
+ *          are dropped and flag the writer as overflowed. A writer without buffer only counts the
+ *          encoded length.
+ */
+typedef struct CBOR_WRITER_TAG
+{
+    uint8_t * buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} CBOR_WRITER;
+
+/**
+ * @brief Initialize a writer over the given buffer
+ *
+ * @param[out] writer      The writer to initialize
+ * @param[in]  buffer      The output buffer, NULL to measure the encoded length without writing it
+ * @param[in]  size        The output buffer size in bytes
+ */
+void cbor_writer_init(CBOR_WRITER * writer, uint8_t * buffer, size_t size);
+
+/**
+ * @brief Write a definite length map header. Must be followed by count key/value pairs.
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  count       The number of key/value pairs in the map
+ */
+void cbor_write_map(CBOR_WRITER * writer, size_t count);
+
+/**
+ * @brief Write a definite length array header. Must be followed by count items.
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  count       The number of items in the array
+ */
+void cbor_write_array(CBOR_WRITER * writer, size_t count);
+
+/**
+ * @brief Write a null terminated utf-8 text string
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The string to write
+ */
+void cbor_write_string(CBOR_WRITER * writer, const char * value);
+
+/**
+ * @brief Write a byte string
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  data        The bytes to write
+ * @param[in]  length      The number of bytes
+ */
+void cbor_write_byte_string(CBOR_WRITER * writer, const uint8_t * data, size_t length);
+
+/**
+ * @brief Write a boolean value
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_boolean(CBOR_WRITER * writer, bool value);
+
+/**
+ * @brief Write a signed integer value using the smallest encoding
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_integer(CBOR_WRITER * writer, int64_t value);
+
+/**
+ * @brief Write a number using the smallest encoding that preserves its value: integer, half,
+ *        single or double precision float
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_number(CBOR_WRITER * writer, double value);
+
+/**
+ * @brief Write a null value
+ *
+ * @param[in]  writer      The cbor writer
+ */
+void cbor_write_null(CBOR_WRITER * writer);
+
+/**
+ * @brief Get the number of bytes written so far
+ *
+ * @param[in]  writer      The cbor writer
+ *
+ * @return
+ *          - The number of bytes written
+ */
+size_t cbor_writer_get_length(const CBOR_WRITER * writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
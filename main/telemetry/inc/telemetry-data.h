@@ -5,20 +5,74 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "telemetry-format.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef uint32_t telemetry_message_handle_t;
+typedef uint32_t telemetry_schema_handle_t;
+typedef uint8_t telemetry_field_id_t;
+
+#define TELEMETRY_FIELD_ID_INVALID      0xFF
+#define TELEMETRY_NUMBER_DEFAULT_MAX    9999999999.0    // Largest magnitude of a fixed precision field declared without a range
+
+/**
+ * @brief   Telemetry wire formats
+ */
+typedef enum
+{
+    TELEMETRY_ENCODING_JSON,    // utf-8 json object
+    TELEMETRY_ENCODING_CBOR,    // RFC 7049 cbor map, numbers in their smallest lossless encoding
+    TELEMETRY_ENCODING_SERIES   // Batches of compressed time series blocks in a cbor map (see telemetry-series.h)
+} TELEMETRY_ENCODING;
+
+/**
+ * @brief   Telemetry arena usage statistics. Messages are built in fixed, statically allocated arenas
+ *          so no heap allocation takes place while sampling.
+ */
+typedef struct TELEMETRY_STATISTICS_TAG
+{
+    size_t arena_size;          // Size of each message arena in bytes
+    size_t high_water_mark;     // Largest number of arena bytes used by a single message
+    uint8_t pool_size;          // Number of messages in the pool
+    uint8_t pool_in_use;        // Number of messages currently allocated
+    uint8_t pool_high_water_mark;   // Largest number of messages allocated at the same time
+    uint32_t pool_exhausted;    // Number of times telemetry_message_create_new failed for lack of a free message
+    uint32_t arena_overflows;   // Number of values dropped because the message arena or field table was full
+} TELEMETRY_STATISTICS;
 
 /**
  * @brief Create a new telemetry message to send to the IoT hub
  * 
  * @return 
  *          - Handle to the telemetry message
+ *          - 0 if every message of the pool is in use
  */
 telemetry_message_handle_t telemetry_message_create_new();
 
+/**
+ * @brief Create a new telemetry message from a schema. The message holds every field of the schema, number
+ *        fields are null until set with telemetry_message_set_number.
+ *
+ * @param[in]  schema      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - Handle to the telemetry message
+ *          - 0 if every message of the pool is in use
+ */
+telemetry_message_handle_t telemetry_message_create_from_schema(telemetry_schema_handle_t schema);
+
+/**
+ * @brief Set the value of a number field declared in the message's schema
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_from_schema
+ * @param[in]  field_id    The field id returned from telemetry_schema_add_number
+ * @param[in]  value       The telemetry result's value
+ */
+void telemetry_message_set_number(telemetry_message_handle_t handle, telemetry_field_id_t field_id, double value);
+
 /**
  * @brief Add a boolean result to the telemetry message (e.g. light on or off...)
  *
@@ -52,10 +106,93 @@ void telemetry_message_add_string(telemetry_message_handle_t handle, const char
  * @param[in]  handle      The message handle returned from telemetry_message_create_new
  *
  * @return
- *            - The serialized json string
+ *            - The serialized json string, stored in the message arena and valid until the message is destroyed
+ *            - NULL if the serialized message does not fit in the arena
  */
 char * telemetry_message_to_json(telemetry_message_handle_t handle);
 
+/**
+ * @brief Serialize the telemetry results in the requested wire format
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ * @param[out] length      The length of the serialized message in bytes
+ *
+ * @return
+ *            - The serialized message, stored in the message arena and valid until the message is destroyed
+ *            - NULL if the serialized message does not fit in the arena
+ */
+const uint8_t * telemetry_message_serialize(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding, size_t * length);
+
+/**
+ * @brief Serialize the telemetry results in the requested wire format into a caller supplied buffer, e.g. the
+ *        payload buffer of the outgoing message
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ * @param[out] buffer      The output buffer. Json output is null terminated and needs one more byte than its length.
+ * @param[in]  size        The output buffer size in bytes
+ *
+ * @return
+ *            - The length of the serialized message in bytes
+ *            - 0 if the serialized message does not fit in the buffer
+ */
+size_t telemetry_message_serialize_to(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding, uint8_t * buffer, size_t size);
+
+/**
+ * @brief Get the length of the serialized message without serializing it, to size its output buffer up front
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The length of the serialized message in bytes, excluding the json null terminator
+ *            - 0 if the message is a json message without compiled schema that does not fit in its arena
+ */
+size_t telemetry_message_get_serialized_size(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding);
+
+/**
+ * @brief Get the content type of a wire format (e.g. application/json)
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The content type to set on the outgoing message
+ */
+const char * telemetry_encoding_get_content_type(TELEMETRY_ENCODING encoding);
+
+/**
+ * @brief Get the content encoding of a wire format (e.g. utf-8)
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The content encoding to set on the outgoing message
+ *            - NULL for binary formats
+ */
+const char * telemetry_encoding_get_content_encoding(TELEMETRY_ENCODING encoding);
+
+/**
+ * @brief Get a wire format from its name as used in the device twin ("json", "cbor" or "series")
+ *
+ * @param[in]  name        The wire format name
+ * @param[out] encoding    The wire format
+ *
+ * @return
+ *            - true if the name is a known wire format
+ */
+bool telemetry_encoding_from_name(const char * name, TELEMETRY_ENCODING * encoding);
+
+/**
+ * @brief Get the name of a wire format as used in the device twin
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The wire format name
+ */
+const char * telemetry_encoding_get_name(TELEMETRY_ENCODING encoding);
+
  /**
   * @brief Dispose of the memory allocated for the json output message
   *
@@ -69,7 +206,153 @@ void telemetry_message_dispose_json(char * json);
   * @param[in]  handle      The message handle returned from telemetry_message_create_new
   */
 void telemetry_message_destroy(telemetry_message_handle_t handle);
+
+ /**
+  * @brief Get the number of arena bytes used by the message, including its serialized output if any
+  *
+  * @param[in]  handle      The message handle returned from telemetry_message_create_new
+  *
+  * @return
+  *            - The number of bytes used in the message arena
+  */
+size_t telemetry_message_get_bytes_used(telemetry_message_handle_t handle);
+
+ /**
+  * @brief Get the telemetry arena usage statistics
+  *
+  * @param[out]  statistics  The statistics snapshot
+  */
+void telemetry_get_statistics(TELEMETRY_STATISTICS * statistics);
  
+/**
+ * @brief Create a telemetry schema. Sensors declare the fields they post once, the schema is then compiled
+ *        to a serialized skeleton in which each message only patches its values.
+ *
+ * @return
+ *          - Handle to the telemetry schema
+ *          - 0 if the schema could not be allocated
+ */
+telemetry_schema_handle_t telemetry_schema_create();
+
+/**
+ * @brief Dispose of the memory allocated for the schema. No message created from the schema may remain.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ */
+void telemetry_schema_destroy(telemetry_schema_handle_t handle);
+
+/**
+ * @brief Declare a constant string field (e.g. the device id). The value is copied into the schema.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  value       The constant value
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_string(telemetry_schema_handle_t handle, const char * szKey, const char * value);
+
+/**
+ * @brief Declare a number field, set in each message with telemetry_message_set_number. A fixed precision
+ *        field's slot holds values up to TELEMETRY_NUMBER_DEFAULT_MAX in magnitude.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  precision   The number of decimals of the json output, matching the sensor's resolution,
+ *                         or TELEMETRY_PRECISION_SHORTEST
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_number(telemetry_schema_handle_t handle, const char * szKey, int8_t precision);
+
+/**
+ * @brief Declare a number field whose values lie in a range. The range and the precision size the field's slot
+ *        in the compiled skeleton: a value whose json output does not fit its slot is sent as null.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  precision   The number of decimals of the json output, matching the sensor's resolution,
+ *                         or TELEMETRY_PRECISION_SHORTEST
+ * @param[in]  minimum     The lowest value of the field
+ * @param[in]  maximum     The highest value of the field
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_number_range(telemetry_schema_handle_t handle, const char * szKey, int8_t precision, double minimum, double maximum);
+
+/**
+ * @brief Compile the schema to a json skeleton with fixed width value slots. No field can be added afterward.
+ *        A skeleton larger than a message arena is logged with the size it needs.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - true if the schema compiled and its skeleton fits in a message arena
+ */
+bool telemetry_schema_compile(telemetry_schema_handle_t handle);
+
+/**
+ * @brief Get the size of the skeleton the declared fields compile to, to be checked against the message arena
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - The size of the json skeleton in bytes, including the null terminator
+ */
+size_t telemetry_schema_get_skeleton_size(telemetry_schema_handle_t handle);
+
+/**
+ * @brief Get the number of fields declared in the schema
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - The number of fields, field ids range from 0 to the count - 1
+ */
+size_t telemetry_schema_get_field_count(telemetry_schema_handle_t handle);
+
+/**
+ * @brief Remove the fields declared after the first ones, to roll back the declarations of a sensor that is left
+ *        out. The schema must not be compiled yet.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_count The number of fields kept, from telemetry_schema_get_field_count before the declarations
+ *
+ * @return
+ *          - true if the schema holds field_count fields
+ */
+bool telemetry_schema_truncate(telemetry_schema_handle_t handle, size_t field_count);
+
+/**
+ * @brief Get the key of a schema field
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_id    The field id
+ *
+ * @return
+ *          - The field's key
+ *          - NULL if the field id is out of range
+ */
+const char * telemetry_schema_get_key(telemetry_schema_handle_t handle, telemetry_field_id_t field_id);
+
+/**
+ * @brief Get the value of a constant string field of the schema
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_id    The field id
+ *
+ * @return
+ *          - The field's constant value
+ *          - NULL if the field is a number field or the field id is out of range
+ */
+const char * telemetry_schema_get_string(telemetry_schema_handle_t handle, telemetry_field_id_t field_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,34 @@
+#ifndef __TELEMETRY_FORMAT_H__
+#define __TELEMETRY_FORMAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_PRECISION_SHORTEST    -1      // Shortest decimal output that parses back to the same double
+#define TELEMETRY_PRECISION_MAX         9       // Largest number of decimals of a fixed precision field
+
+/**
+ * @brief Format a number for the json output without going through the printf floating point path.
+ *        NaN and infinite values are written as null.
+ *
+ * @param[out] buffer      The output buffer, null terminated when the output fits
+ * @param[in]  size        The output buffer size in bytes
+ * @param[in]  value       The value to format
+ * @param[in]  precision   The number of decimals to round to, trailing zeros removed, or
+ *                         TELEMETRY_PRECISION_SHORTEST for the shortest round trip output
+ *
+ * @return
+ *          - The length of the output, excluding the null terminator. Nothing is written if it is
+ *            larger than or equal to size.
+ */
+int telemetry_format_number(char * buffer, size_t size, double value, int8_t precision);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
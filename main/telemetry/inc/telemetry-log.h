@@ -0,0 +1,110 @@
+#ifndef __TELEMETRY_LOG_H__
+#define __TELEMETRY_LOG_H__
+
+#include "telemetry-sample.h"
+#include "storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Append-only ring log of TELEMETRY_SAMPLE records on flash storage, in which the hub task spills the samples
+ * it cannot send. Records are written once, in sequence, and never span a sector. A sector is erased when the
+ * log enters it, overwriting its oldest records, so every sector is erased once per turn of the ring. The read
+ * cursor is persisted by clearing the consumed word of the last replayed record, without an erase. A record
+ * torn by a power loss fails its CRC and is skipped when the log is mounted.
+ */
+typedef uint32_t telemetry_log_handle_t;
+
+/**
+ * @brief   Log counters, since the log was mounted except for capacity and pending
+ */
+typedef struct TELEMETRY_LOG_STATISTICS_TAG
+{
+    uint32_t capacity;              // Records the storage holds
+    uint32_t pending;               // Records not replayed yet
+    uint32_t appended;              // Records appended
+    uint32_t replayed;              // Records read back
+    uint32_t dropped;               // Records overwritten before they were replayed
+    uint32_t erases;                // Sectors erased
+    uint32_t commits;               // Read cursors persisted
+    uint32_t failures;              // Failed storage reads, writes and erases
+    uint32_t torn;                  // Incomplete records found when mounting the log
+} TELEMETRY_LOG_STATISTICS;
+
+/**
+ * @brief Mount the log kept on a storage, recovering its records and its read cursor
+ *
+ * @param[in]  storage_interface  The storage's interface
+ * @param[in]  storage            The storage's handle, owned by the caller
+ *
+ * @return
+ *          - Handle to the log
+ *          - 0 if the storage holds less than two sectors or the log could not be allocated
+ */
+telemetry_log_handle_t telemetry_log_create(const STORAGE_INTERFACE_DESCRIPTION * storage_interface, STORAGE_HANDLE storage);
+
+/**
+ * @brief Dispose of the memory allocated for the log, its records stay on the storage
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ */
+void telemetry_log_destroy(telemetry_log_handle_t handle);
+
+/**
+ * @brief Append a sample to the log, overwriting the oldest sector when the log is full
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[in]  sample      The sample
+ *
+ * @return
+ *          - true if the sample was written
+ *          - false if the storage failed
+ */
+bool telemetry_log_append(telemetry_log_handle_t handle, const TELEMETRY_SAMPLE * sample);
+
+/**
+ * @brief Read the oldest sample not replayed yet. The read cursor only moves in memory until
+ *        telemetry_log_commit persists it, a reboot replays the samples read since the last commit.
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[out] sample      The sample
+ *
+ * @return
+ *          - true if a sample was read
+ *          - false if every sample was replayed
+ */
+bool telemetry_log_read(telemetry_log_handle_t handle, TELEMETRY_SAMPLE * sample);
+
+/**
+ * @brief Persist the read cursor, once the samples read so far were delivered
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ *
+ * @return
+ *          - true if the cursor is persisted
+ *          - false if the storage failed
+ */
+bool telemetry_log_commit(telemetry_log_handle_t handle);
+
+/**
+ * @brief Get the number of samples not replayed yet
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ */
+uint32_t telemetry_log_get_pending(telemetry_log_handle_t handle);
+
+/**
+ * @brief Get the log counters
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[out] statistics  The log counters
+ */
+void telemetry_log_get_statistics(telemetry_log_handle_t handle, TELEMETRY_LOG_STATISTICS * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
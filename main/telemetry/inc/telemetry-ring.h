@@ -0,0 +1,103 @@
+#ifndef __TELEMETRY_RING_H__
+#define __TELEMETRY_RING_H__
+
+#include "telemetry-sample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free single producer, single consumer ring of TELEMETRY_SAMPLE records between the sensor task and
+ * the hub task. The producer only moves the head and the consumer only moves the tail, except when the
+ * drop oldest policy makes the producer discard the oldest sample: both then race for the tail with a
+ * compare and swap. A waiting task is woken with a task notification.
+ */
+
+typedef enum
+{
+    TELEMETRY_RING_DROP_OLDEST,     // A full ring discards its oldest sample to make room
+    TELEMETRY_RING_DROP_NEWEST,     // A full ring discards the sample being pushed
+    TELEMETRY_RING_BLOCK            // The producer waits for room until its deadline, then discards the sample
+} TELEMETRY_RING_POLICY;
+
+/**
+ * @brief   Ring counters. The consumer only updates read, the producer the other counters.
+ */
+typedef struct TELEMETRY_RING_STATISTICS_TAG
+{
+    uint32_t written;               // Samples pushed in the ring
+    uint32_t read;                  // Samples popped from the ring
+    uint32_t dropped_oldest;        // Samples discarded by the drop oldest policy
+    uint32_t dropped_newest;        // Samples discarded by the drop newest policy
+    uint32_t blocked;               // Pushes that waited for room
+    uint32_t timed_out;             // Samples discarded once a blocked push reached its deadline
+    uint32_t high_water_mark;       // Most samples held at once
+} TELEMETRY_RING_STATISTICS;
+
+/**
+ * @brief Create an empty ring
+ *
+ * @param[in]  capacity    The number of samples the ring holds, rounded up to a power of two
+ * @param[in]  policy      What a push does when the ring is full
+ *
+ * @return
+ *          - Handle to the ring
+ *          - 0 if the ring could not be allocated
+ */
+telemetry_ring_handle_t telemetry_ring_create(size_t capacity, TELEMETRY_RING_POLICY policy);
+
+/**
+ * @brief Dispose of the memory allocated for the ring. Neither task may use it anymore.
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ */
+void telemetry_ring_destroy(telemetry_ring_handle_t handle);
+
+/**
+ * @brief Set what a push does when the ring is full
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[in]  policy      The overflow policy
+ */
+void telemetry_ring_set_policy(telemetry_ring_handle_t handle, TELEMETRY_RING_POLICY policy);
+
+/**
+ * @brief Push a sample, from the producer task only
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[in]  sample      The sample, copied in the ring
+ * @param[in]  timeout     Number of ticks the block policy waits for room
+ *
+ * @return
+ *          - true if the sample was pushed
+ *          - false if the sample was discarded
+ */
+bool telemetry_ring_push(telemetry_ring_handle_t handle, const TELEMETRY_SAMPLE * sample, TickType_t timeout);
+
+/**
+ * @brief Pop the oldest sample, from the consumer task only
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[out] sample      The sample
+ * @param[in]  timeout     Number of ticks to wait for a sample
+ *
+ * @return
+ *          - true if a sample was popped
+ *          - false if the ring stayed empty
+ */
+bool telemetry_ring_pop(telemetry_ring_handle_t handle, TELEMETRY_SAMPLE * sample, TickType_t timeout);
+
+/**
+ * @brief Get the ring counters
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[out] statistics  The ring counters
+ */
+void telemetry_ring_get_statistics(telemetry_ring_handle_t handle, TELEMETRY_RING_STATISTICS * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
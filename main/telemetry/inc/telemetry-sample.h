@@ -0,0 +1,88 @@
+#ifndef __TELEMETRY_SAMPLE_H__
+#define __TELEMETRY_SAMPLE_H__
+
+#include "telemetry-data.h"
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_SAMPLE_END_OF_CYCLE   0x01    // Last record of a sampling cycle
+
+/*
+ * The telemetry queue, a ring of samples from telemetry-ring.h
+ */
+typedef uint32_t telemetry_ring_handle_t;
+
+/**
+ * @brief   A single sensor reading. Samples are posted by value on the telemetry queue by the sensor task
+ *          and encoded into telemetry messages by the hub task.
+ */
+typedef struct TELEMETRY_SAMPLE_TAG
+{
+    uint32_t timestamp;             // Sampling cycle start time, in ms since boot
+    float value;
+    uint8_t sensor_id;              // Index of the sensor in its device
+    telemetry_field_id_t field_id;  // Field id in the device's telemetry schema, TELEMETRY_FIELD_ID_INVALID for markers
+    uint8_t flags;
+} TELEMETRY_SAMPLE;
+
+/**
+ * @brief   Posts the samples of one sampling cycle on the telemetry queue
+ */
+typedef struct TELEMETRY_SAMPLE_WRITER_TAG
+{
+    telemetry_ring_handle_t queue;
+    uint32_t timestamp;
+    uint8_t sensor_id;
+    uint16_t written;
+    uint16_t dropped;
+    TELEMETRY_SAMPLE * capture;     // Copy of the samples written since telemetry_sample_writer_capture, or NULL
+    uint8_t capture_length;
+    uint8_t captured;               // Samples written since the capture started, past capture_length included
+} TELEMETRY_SAMPLE_WRITER;
+
+/**
+ * @brief Start a sampling cycle. Every sample of the cycle shares its start time.
+ *
+ * @param[out] writer      The writer to initialize
+ * @param[in]  queue       The telemetry queue
+ */
+void telemetry_sample_writer_begin(TELEMETRY_SAMPLE_WRITER * writer, telemetry_ring_handle_t queue);
+
+/**
+ * @brief Post a sensor reading on the telemetry queue
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ * @param[in]  field_id    The field id returned from telemetry_schema_add_number
+ * @param[in]  value       The telemetry result's value
+ */
+void telemetry_sample_write(TELEMETRY_SAMPLE_WRITER * writer, telemetry_field_id_t field_id, double value);
+
+/**
+ * @brief Start copying the written samples, until the capture is set again. The samples are still posted.
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ * @param[out] samples     Receives the samples written from now on, NULL to stop copying
+ * @param[in]  length      Number of samples the capture holds
+ */
+void telemetry_sample_writer_capture(TELEMETRY_SAMPLE_WRITER * writer, TELEMETRY_SAMPLE * samples, uint8_t length);
+
+/**
+ * @brief End the sampling cycle, posting the end of cycle marker on the telemetry queue
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ *
+ * @return
+ *          - The number of the cycle's samples, including the marker, discarded because the queue was full.
+ *            Samples of older cycles discarded by the drop oldest policy are only counted by the queue.
+ */
+uint16_t telemetry_sample_writer_end(TELEMETRY_SAMPLE_WRITER * writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
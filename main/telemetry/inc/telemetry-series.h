@@ -0,0 +1,173 @@
+#ifndef __TELEMETRY_SERIES_H__
+#define __TELEMETRY_SERIES_H__
+
+#include "telemetry-sample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compressed time series blocks. A block holds the samples of a single field:
+ *   - 16 bits sample count, 32 bits first timestamp and 32 bits first value (float bits)
+ *   - then for each following sample the delta-of-delta of its timestamp and the XOR of its value
+ *     with the previous one, bit packed most significant bit first as in Facebook's Gorilla:
+ *       timestamp: '0' same delta, '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits, '1111' + 32 bits
+ *       value:     '0' same value, '10' + bits within the previous window,
+ *                  '11' + 5 bits leading zeros + 5 bits (length - 1) + meaningful bits
+ */
+
+typedef uint32_t telemetry_series_batch_handle_t;
+
+/**
+ * @brief   Appends samples to a compressed time series block
+ */
+typedef struct TELEMETRY_SERIES_ENCODER_TAG
+{
+    uint8_t * buffer;
+    size_t size;
+    size_t bit_count;
+    uint16_t count;
+    uint32_t previous_timestamp;
+    int32_t previous_delta;
+    uint32_t previous_value;
+    uint8_t previous_leading;       // 0xFF until a first XOR window is written
+    uint8_t previous_trailing;
+} TELEMETRY_SERIES_ENCODER;
+
+/**
+ * @brief   Reads the samples back from a compressed time series block
+ */
+typedef struct TELEMETRY_SERIES_DECODER_TAG
+{
+    const uint8_t * data;
+    size_t length;
+    size_t bit_index;
+    uint16_t count;
+    uint16_t index;
+    uint32_t timestamp;
+    int32_t delta;
+    uint32_t value;
+    uint8_t leading;
+    uint8_t trailing;
+} TELEMETRY_SERIES_DECODER;
+
+/**
+ * @brief Initialize an encoder over an empty block
+ *
+ * @param[out] encoder     The encoder to initialize
+ * @param[in]  buffer      The block buffer
+ * @param[in]  size        The block buffer size in bytes
+ */
+void telemetry_series_encoder_init(TELEMETRY_SERIES_ENCODER * encoder, uint8_t * buffer, size_t size);
+
+/**
+ * @brief Append a sample to the block
+ *
+ * @param[in]  encoder     The block encoder
+ * @param[in]  timestamp   The sample's timestamp in ms, not older than the previous sample's
+ * @param[in]  value       The sample's value
+ *
+ * @return
+ *          - false if the block is full, the encoder is then left unchanged
+ */
+bool telemetry_series_append(TELEMETRY_SERIES_ENCODER * encoder, uint32_t timestamp, float value);
+
+/**
+ * @brief Get the length of the encoded block
+ *
+ * @param[in]  encoder     The block encoder
+ *
+ * @return
+ *          - The block length in bytes
+ */
+size_t telemetry_series_get_length(const TELEMETRY_SERIES_ENCODER * encoder);
+
+/**
+ * @brief Initialize a decoder over an encoded block
+ *
+ * @param[out] decoder     The decoder to initialize
+ * @param[in]  data        The encoded block
+ * @param[in]  length      The encoded block length in bytes
+ *
+ * @return
+ *          - false if the block is too short to hold its header
+ */
+bool telemetry_series_decoder_init(TELEMETRY_SERIES_DECODER * decoder, const uint8_t * data, size_t length);
+
+/**
+ * @brief Read the next sample of the block
+ *
+ * @param[in]  decoder     The block decoder
+ * @param[out] timestamp   The sample's timestamp in ms
+ * @param[out] value       The sample's value
+ *
+ * @return
+ *          - false once every sample has been read or if the block is truncated
+ */
+bool telemetry_series_next(TELEMETRY_SERIES_DECODER * decoder, uint32_t * timestamp, float * value);
+
+/**
+ * @brief Create a batch of compressed time series, one block for each number field of the schema
+ *
+ * @param[in]  schema      The compiled telemetry schema in which the samples' fields are declared
+ *
+ * @return
+ *          - Handle to the batch
+ *          - 0 if the batch could not be allocated
+ */
+telemetry_series_batch_handle_t telemetry_series_batch_create(telemetry_schema_handle_t schema);
+
+/**
+ * @brief Dispose of the memory allocated for the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ */
+void telemetry_series_batch_destroy(telemetry_series_batch_handle_t handle);
+
+/**
+ * @brief Append a sample from the telemetry queue to its field's block. End of cycle markers count the cycles.
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ * @param[in]  sample      The sample
+ *
+ * @return
+ *          - false if the field's block is full, the batch must be sent and reset before appending again
+ */
+bool telemetry_series_batch_append(telemetry_series_batch_handle_t handle, const TELEMETRY_SAMPLE * sample);
+
+/**
+ * @brief Get the number of sampling cycles in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ *
+ * @return
+ *          - The number of end of cycle markers appended since the batch was reset
+ */
+uint16_t telemetry_series_batch_get_cycle_count(telemetry_series_batch_handle_t handle);
+
+/**
+ * @brief Serialize the batch as a cbor map of the schema's constant strings and a "series" map of field
+ *        keys to encoded blocks
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ * @param[out] length      The length of the serialized batch in bytes
+ *
+ * @return
+ *          - The serialized batch, valid until the batch is reset
+ *          - NULL if the batch is empty or its output buffer is too small
+ */
+const uint8_t * telemetry_series_batch_serialize(telemetry_series_batch_handle_t handle, size_t * length);
+
+/**
+ * @brief Empty every block of the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ */
+void telemetry_series_batch_reset(telemetry_series_batch_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+#include "telemetry-batch.h"
+#include "telemetry-cbor.h"
+
+#include <stdlib.h>
+
+#include "device-config.h"
+
+#define TELEMETRY_BATCH_HEADER_SIZE     3       // Largest cbor array header of a uint16_t count
+
+typedef struct TELEMETRY_BATCH_TAG
+{
+    TELEMETRY_ENCODING encoding;
+    uint16_t count;
+    size_t used;
+    size_t max_payload;
+    // The array header is written right before the messages once their count is known
+    uint8_t buffer[TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_MAX_PAYLOAD + 1];
+} TELEMETRY_BATCH;
+
+static size_t telemetry_batch_get_header_size(TELEMETRY_ENCODING encoding, uint16_t count)
+{
+    if (encoding != TELEMETRY_ENCODING_CBOR)
+    {
+        return 1;
+    }
+
+    return (count < 24) ? 1 : (count <= UINT8_MAX) ? 2 : 3;
+}
+
+// Size of the payload with count messages using used bytes, including the array header and the json closing bracket
+static size_t telemetry_batch_get_payload_size(TELEMETRY_ENCODING encoding, uint16_t count, size_t used)
+{
+    return telemetry_batch_get_header_size(encoding, count) + used + (encoding == TELEMETRY_ENCODING_CBOR ? 0 : 1);
+}
+
+/**
+ * @brief Create an empty batch
+ *
+ * @return
+ *          - Handle to the batch
+ *          - 0 if the batch could not be allocated
+ */
+telemetry_batch_handle_t telemetry_batch_create()
+{
+    TELEMETRY_BATCH * batch = malloc(sizeof(TELEMETRY_BATCH));
+
+    if (batch != NULL)
+    {
+        batch->max_payload = TELEMETRY_BATCH_MAX_PAYLOAD;
+        telemetry_batch_reset((telemetry_batch_handle_t) batch);
+    }
+
+    return (telemetry_batch_handle_t) batch;
+}
+
+/**
+ * @brief Dispose of the memory allocated for the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ */
+void telemetry_batch_destroy(telemetry_batch_handle_t handle)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+
+    if (batch != NULL)
+    {
+        free(batch);
+    }
+}
+
+/**
+ * @brief Set the maximum size of the serialized batch, capped to TELEMETRY_BATCH_MAX_PAYLOAD
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[in]  max_payload The maximum payload size in bytes
+ */
+void telemetry_batch_set_max_payload(telemetry_batch_handle_t handle, size_t max_payload)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+    batch->max_payload = (max_payload < TELEMETRY_BATCH_MAX_PAYLOAD) ? max_payload : TELEMETRY_BATCH_MAX_PAYLOAD;
+}
+
+/**
+ * @brief Serialize a telemetry message and append it to the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[in]  message     The message to append, it is not destroyed
+ * @param[in]  encoding    The wire format, json or cbor
+ *
+ * @return
+ *          - true if the message was appended
+ *          - false if it does not fit in the maximum payload or the batch holds messages of another
+ *            encoding, the batch must then be sent and reset before appending again
+ */
+bool telemetry_batch_append(telemetry_batch_handle_t handle, telemetry_message_handle_t message, TELEMETRY_ENCODING encoding)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+
+    if (batch->count > 0 && batch->encoding != encoding)
+    {
+        return false;
+    }
+
+    // The message is sized up front and serialized in place, after the previous ones
+    size_t length = telemetry_message_get_serialized_size(message, encoding);
+
+    if (length == 0 || batch->count == UINT16_MAX)
+    {
+        return false;
+    }
+
+    // Json messages are separated by commas
+    size_t separator = (encoding != TELEMETRY_ENCODING_CBOR && batch->count > 0) ? 1 : 0;
+
+    if (telemetry_batch_get_payload_size(encoding, batch->count + 1, batch->used + separator + length) > batch->max_payload)
+    {
+        return false;
+    }
+
+    uint8_t * cursor = batch->buffer + TELEMETRY_BATCH_HEADER_SIZE + batch->used;
+
+    if (separator > 0)
+    {
+        *cursor++ = ',';
+    }
+
+    // The buffer's last byte leaves room for the json null terminator
+    size_t available = sizeof(batch->buffer) - (cursor - batch->buffer);
+
+    if (telemetry_message_serialize_to(message, encoding, cursor, available) != length)
+    {
+        return false;
+    }
+
+    batch->encoding = encoding;
+    batch->used += separator + length;
+    batch->count++;
+
+    return true;
+}
+
+/**
+ * @brief Get the number of messages in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ *
+ * @return
+ *          - The number of messages appended since the batch was reset
+ */
+uint16_t telemetry_batch_get_count(telemetry_batch_handle_t handle)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+    return batch->count;
+}
+
+/**
+ * @brief Get the wire format of the messages in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ *
+ * @return
+ *          - The encoding of the first message appended since the batch was reset
+ */
+TELEMETRY_ENCODING telemetry_batch_get_encoding(telemetry_batch_handle_t handle)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+    return batch->encoding;
+}
+
+/**
+ * @brief Close the batch's array and get the payload to send
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ * @param[out] length      The length of the serialized batch in bytes
+ *
+ * @return
+ *          - The serialized batch, valid until the batch is reset
+ *          - NULL if the batch is empty
+ */
+const uint8_t * telemetry_batch_serialize(telemetry_batch_handle_t handle, size_t * length)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+
+    *length = 0;
+
+    if (batch->count == 0)
+    {
+        return NULL;
+    }
+
+    size_t header_size = telemetry_batch_get_header_size(batch->encoding, batch->count);
+    uint8_t * payload = batch->buffer + TELEMETRY_BATCH_HEADER_SIZE - header_size;
+
+    if (batch->encoding == TELEMETRY_ENCODING_CBOR)
+    {
+        CBOR_WRITER writer;
+        cbor_writer_init(&writer, payload, header_size);
+        cbor_write_array(&writer, batch->count);
+    }
+    else
+    {
+        payload[0] = '[';
+        payload[header_size + batch->used] = ']';
+        payload[header_size + batch->used + 1] = '\0';
+    }
+
+    *length = telemetry_batch_get_payload_size(batch->encoding, batch->count, batch->used);
+
+    return payload;
+}
+
+/**
+ * @brief Remove every message from the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_batch_create
+ */
+void telemetry_batch_reset(telemetry_batch_handle_t handle)
+{
+    TELEMETRY_BATCH * batch = (TELEMETRY_BATCH *) handle;
+
+    batch->encoding = TELEMETRY_ENCODING_JSON;
+    batch->count = 0;
+    batch->used = 0;
+}
@@ -0,0 +1,153 @@
+#include "telemetry-benchmark.h"
+
+#include <stdio.h>
+
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+/**
+ * @brief Measure the cost of a sampling cycle's message: a message is created from a schema of field_count
+ *        number fields, every field is set, the message is serialized then destroyed. The run blocks the
+ *        calling task.
+ *
+ * @param[in]  field_count  The number of number fields in the schema
+ * @param[in]  encoding     The wire format
+ * @param[in]  iterations   The number of messages to serialize
+ * @param[out] result       The benchmark result
+ *
+ * @return
+ *          - true if the benchmark ran
+ *          - false if the schema did not fit in the message limits or no pool message was available
+ */
+bool telemetry_benchmark_run(uint8_t field_count, TELEMETRY_ENCODING encoding, uint32_t iterations, TELEMETRY_BENCHMARK_RESULT * result)
+{
+    *result = (TELEMETRY_BENCHMARK_RESULT) { .field_count = field_count, .encoding = encoding, .iterations = iterations };
+
+    telemetry_schema_handle_t schema = telemetry_schema_create();
+
+    if (schema == 0)
+    {
+        return false;
+    }
+
+    // A device with field_count readings of mixed precisions, as declared by the sensors
+    bool declared = (telemetry_schema_add_string(schema, "deviceId", "benchmark") != TELEMETRY_FIELD_ID_INVALID);
+
+    for (uint8_t index = 0; declared && index < field_count; ++index)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "sensor%02d", index);
+        declared = (telemetry_schema_add_number(schema, key, index % 5) != TELEMETRY_FIELD_ID_INVALID);
+    }
+
+    if (!declared || !telemetry_schema_compile(schema))
+    {
+        telemetry_schema_destroy(schema);
+        return false;
+    }
+
+    multi_heap_info_t heap_before;
+    heap_caps_get_info(&heap_before, MALLOC_CAP_8BIT);
+
+    int64_t started = esp_timer_get_time();
+    uint64_t bytes = 0;
+    uint32_t iteration;
+
+    for (iteration = 0; iteration < iterations; ++iteration)
+    {
+        telemetry_message_handle_t message = telemetry_message_create_from_schema(schema);
+
+        if (message == 0)
+        {
+            break;
+        }
+
+        // The deviceId string is field 0
+        for (uint8_t index = 0; index < field_count; ++index)
+        {
+            telemetry_message_set_number(message, index + 1, 20.0 + (iteration % 64) * 0.0625 + index);
+        }
+
+        size_t length;
+        bool serialized = (telemetry_message_serialize(message, encoding, &length) != NULL);
+
+        bytes += length;
+        result->arena_bytes_per_message = telemetry_message_get_bytes_used(message);
+        telemetry_message_destroy(message);
+
+        if (!serialized)
+        {
+            break;
+        }
+    }
+
+    int64_t elapsed = esp_timer_get_time() - started;
+    result->completed = (iteration == iterations);
+
+    multi_heap_info_t heap_after;
+    heap_caps_get_info(&heap_after, MALLOC_CAP_8BIT);
+
+    telemetry_schema_destroy(schema);
+
+    if (result->completed && iterations > 0)
+    {
+        result->messages_per_second = (elapsed > 0) ? (uint32_t)((int64_t) iterations * 1000000 / elapsed) : UINT32_MAX;
+        result->bytes_per_message = bytes / iterations;
+        result->heap_allocations = (int32_t) heap_after.allocated_blocks - (int32_t) heap_before.allocated_blocks;
+        result->heap_bytes = (int32_t) heap_after.total_allocated_bytes - (int32_t) heap_before.total_allocated_bytes;
+    }
+
+    return result->completed;
+}
+
+/**
+ * @brief Write benchmark results as a json object: { "benchmarks": [ { "fields": 3, "encoding": "json", ... } ] }
+ *
+ * @param[in]  results      The benchmark results
+ * @param[in]  count        The number of results
+ * @param[out] json         The output buffer
+ * @param[in]  size         The output buffer size in bytes
+ *
+ * @return
+ *          - The length of the json output, excluding the null terminator
+ *          - 0 if the output buffer is too small
+ */
+size_t telemetry_benchmark_write_json(const TELEMETRY_BENCHMARK_RESULT * results, size_t count, char * json, size_t size)
+{
+    int written = snprintf(json, size, "{\"benchmarks\":[");
+    size_t length = 0;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        const TELEMETRY_BENCHMARK_RESULT * result = &results[index];
+
+        if (written < 0 || (size_t) written >= size - length)
+        {
+            return 0;
+        }
+
+        length += written;
+        written = snprintf(json + length, size - length,
+            "%s{\"fields\":%u,\"encoding\":\"%s\",\"iterations\":%u,\"completed\":%s,\"messagesPerSecond\":%u,"
+            "\"bytesPerMessage\":%u,\"arenaBytesPerMessage\":%u,\"heapAllocations\":%d,\"heapBytes\":%d}",
+            (index > 0) ? "," : "", result->field_count, telemetry_encoding_get_name(result->encoding),
+            (unsigned int) result->iterations, result->completed ? "true" : "false",
+            (unsigned int) result->messages_per_second, (unsigned int) result->bytes_per_message,
+            (unsigned int) result->arena_bytes_per_message, (int) result->heap_allocations, (int) result->heap_bytes);
+    }
+
+    if (written < 0 || (size_t) written >= size - length)
+    {
+        return 0;
+    }
+
+    length += written;
+    written = snprintf(json + length, size - length, "]}");
+
+    if (written < 0 || (size_t) written >= size - length)
+    {
+        return 0;
+    }
+
+    return length + written;
+}
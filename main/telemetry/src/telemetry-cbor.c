@@ -0,0 +1,261 @@
+#include "telemetry-cbor.h"
+
+#include <math.h>
+#include <string.h>
+
+#define CBOR_MAJOR_UNSIGNED     0x00
+#define CBOR_MAJOR_NEGATIVE     0x20
+#define CBOR_MAJOR_BYTES        0x40
+#define CBOR_MAJOR_TEXT         0x60
+#define CBOR_MAJOR_ARRAY        0x80
+#define CBOR_MAJOR_MAP          0xA0
+
+#define CBOR_FALSE              0xF4
+#define CBOR_TRUE               0xF5
+#define CBOR_NULL               0xF6
+#define CBOR_HALF_FLOAT         0xF9
+#define CBOR_SINGLE_FLOAT       0xFA
+#define CBOR_DOUBLE_FLOAT       0xFB
+
+static void cbor_write_bytes(CBOR_WRITER * writer, const void * data, size_t length)
+{
+    if (writer->overflow || writer->size - writer->length < length)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    if (writer->buffer != NULL)
+    {
+        memcpy(writer->buffer + writer->length, data, length);
+    }
+
+    writer->length += length;
+}
+
+// Write a big endian value of 1, 2, 4 or 8 bytes
+static void cbor_write_big_endian(CBOR_WRITER * writer, uint8_t initial_byte, uint64_t value, size_t length)
+{
+    uint8_t data[9];
+
+    data[0] = initial_byte;
+
+    for (size_t index = 0; index < length; ++index)
+    {
+        data[length - index] = (uint8_t)(value >> (8 * index));
+    }
+
+    cbor_write_bytes(writer, data, length + 1);
+}
+
+static void cbor_write_type_and_value(CBOR_WRITER * writer, uint8_t major_type, uint64_t value)
+{
+    if (value < 24)
+    {
+        cbor_write_big_endian(writer, major_type | (uint8_t) value, 0, 0);
+    }
+    else if (value <= UINT8_MAX)
+    {
+        cbor_write_big_endian(writer, major_type | 24, value, 1);
+    }
+    else if (value <= UINT16_MAX)
+    {
+        cbor_write_big_endian(writer, major_type | 25, value, 2);
+    }
+    else if (value <= UINT32_MAX)
+    {
+        cbor_write_big_endian(writer, major_type | 26, value, 4);
+    }
+    else
+    {
+        cbor_write_big_endian(writer, major_type | 27, value, 8);
+    }
+}
+
+/**
+ * @brief Convert a single precision float to half precision if it can be done without loss
+ *
+ * @return
+ *          - true if the value is exactly representable as a normal half precision float
+ */
+static bool cbor_float_to_half(float value, uint16_t * half)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127;
+    uint32_t mantissa = bits & 0x007FFFFF;
+
+    if (exponent == 128)
+    {
+        // Infinity and NaN
+        *half = sign | 0x7C00 | (mantissa != 0 ? 0x0200 : 0);
+        return true;
+    }
+
+    if (exponent < -14 || exponent > 15 || (mantissa & 0x1FFF) != 0)
+    {
+        return false;
+    }
+
+    *half = sign | (uint16_t)((exponent + 15) << 10) | (uint16_t)(mantissa >> 13);
+    return true;
+}
+
+/**
+ * @brief Initialize a writer over the given buffer
+ *
+ * @param[out] writer      The writer to initialize
+ * @param[in]  buffer      The output buffer, NULL to measure the encoded length without writing it
+ * @param[in]  size        The output buffer size in bytes
+ */
+void cbor_writer_init(CBOR_WRITER * writer, uint8_t * buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+/**
+ * @brief Write a definite length map header. Must be followed by count key/value pairs.
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  count       The number of key/value pairs in the map
+ */
+void cbor_write_map(CBOR_WRITER * writer, size_t count)
+{
+    cbor_write_type_and_value(writer, CBOR_MAJOR_MAP, count);
+}
+
+/**
+ * @brief Write a definite length array header. Must be followed by count items.
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  count       The number of items in the array
+ */
+void cbor_write_array(CBOR_WRITER * writer, size_t count)
+{
+    cbor_write_type_and_value(writer, CBOR_MAJOR_ARRAY, count);
+}
+
+/**
+ * @brief Write a null terminated utf-8 text string
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The string to write
+ */
+void cbor_write_string(CBOR_WRITER * writer, const char * value)
+{
+    size_t length = strlen(value);
+
+    cbor_write_type_and_value(writer, CBOR_MAJOR_TEXT, length);
+    cbor_write_bytes(writer, value, length);
+}
+
+/**
+ * @brief Write a byte string
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  data        The bytes to write
+ * @param[in]  length      The number of bytes
+ */
+void cbor_write_byte_string(CBOR_WRITER * writer, const uint8_t * data, size_t length)
+{
+    cbor_write_type_and_value(writer, CBOR_MAJOR_BYTES, length);
+    cbor_write_bytes(writer, data, length);
+}
+
+/**
+ * @brief Write a boolean value
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_boolean(CBOR_WRITER * writer, bool value)
+{
+    cbor_write_big_endian(writer, value ? CBOR_TRUE : CBOR_FALSE, 0, 0);
+}
+
+/**
+ * @brief Write a signed integer value using the smallest encoding
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_integer(CBOR_WRITER * writer, int64_t value)
+{
+    if (value >= 0)
+    {
+        cbor_write_type_and_value(writer, CBOR_MAJOR_UNSIGNED, (uint64_t) value);
+    }
+    else
+    {
+        cbor_write_type_and_value(writer, CBOR_MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+    }
+}
+
+/**
+ * @brief Write a number using the smallest encoding that preserves its value: integer, half,
+ *        single or double precision float
+ *
+ * @param[in]  writer      The cbor writer
+ * @param[in]  value       The value to write
+ */
+void cbor_write_number(CBOR_WRITER * writer, double value)
+{
+    // Integral values within the exact double range are sent as integers (negative zero excluded)
+    if (value == floor(value) && fabs(value) < 9007199254740992.0 && !(value == 0 && signbit(value)))
+    {
+        cbor_write_integer(writer, (int64_t) value);
+        return;
+    }
+
+    float single = (float) value;
+
+    if ((double) single == value || isnan(value))
+    {
+        uint16_t half;
+
+        if (cbor_float_to_half(single, &half))
+        {
+            cbor_write_big_endian(writer, CBOR_HALF_FLOAT, half, 2);
+        }
+        else
+        {
+            uint32_t bits;
+            memcpy(&bits, &single, sizeof(bits));
+            cbor_write_big_endian(writer, CBOR_SINGLE_FLOAT, bits, 4);
+        }
+
+        return;
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    cbor_write_big_endian(writer, CBOR_DOUBLE_FLOAT, bits, 8);
+}
+
+/**
+ * @brief Write a null value
+ *
+ * @param[in]  writer      The cbor writer
+ */
+void cbor_write_null(CBOR_WRITER * writer)
+{
+    cbor_write_big_endian(writer, CBOR_NULL, 0, 0);
+}
+
+/**
+ * @brief Get the number of bytes written so far
+ *
+ * @param[in]  writer      The cbor writer
+ *
+ * @return
+ *          - The number of bytes written
+ */
+size_t cbor_writer_get_length(const CBOR_WRITER * writer)
+{
+    return writer->length;
+}
@@ -1,64 +1,512 @@
 #include "telemetry-data.h"
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
-#include "parson.h"
-#include "parson.c"
-
+#include "telemetry-cbor.h"
 #include "device-config.h"
 
+#include "esp_log.h"
+
+typedef enum
+{
+    TELEMETRY_FIELD_BOOLEAN,
+    TELEMETRY_FIELD_NUMBER,
+    TELEMETRY_FIELD_STRING,
+    TELEMETRY_FIELD_NULL        // Schema field for which no value was set
+} TELEMETRY_FIELD_TYPE;
+
+// Width of the value slot of a shortest precision number in a compiled schema, large enough for any
+// telemetry_format_number output. Fixed precision slots are sized from the field's range.
+#define TELEMETRY_NUMBER_SLOT_WIDTH     24
+
+typedef struct TELEMETRY_FIELD_TAG
+{
+    const char * key;       // Points into the message arena
+    TELEMETRY_FIELD_TYPE type;
+    int8_t precision;       // Decimals of a number field's json output, TELEMETRY_PRECISION_SHORTEST if not declared
+    union
+    {
+        bool boolean;
+        double number;
+        const char * string;    // Points into the message arena
+    } value;
+} TELEMETRY_FIELD;
+
+typedef struct TELEMETRY_SCHEMA_TAG
+{
+    size_t field_count;
+    TELEMETRY_FIELD fields[TELEMETRY_MESSAGE_MAX_FIELDS];   // Number fields are declared as TELEMETRY_FIELD_NULL
+    uint16_t slot_offsets[TELEMETRY_MESSAGE_MAX_FIELDS];    // Offset of each number's value slot in the skeleton
+    uint8_t slot_widths[TELEMETRY_MESSAGE_MAX_FIELDS];      // Width of each number's value slot
+    size_t strings_used;
+    char strings[TELEMETRY_MESSAGE_ARENA_SIZE];             // Keys and constant string values
+    bool compiled;
+    size_t skeleton_length;
+    char skeleton[TELEMETRY_MESSAGE_ARENA_SIZE];            // Serialized json with blank value slots
+} TELEMETRY_SCHEMA;
+
+typedef struct TELEMETRY_MESSAGE_TAG
+{
+    bool in_use;
+    const TELEMETRY_SCHEMA * schema;
+    size_t field_count;
+    TELEMETRY_FIELD fields[TELEMETRY_MESSAGE_MAX_FIELDS];
+    size_t arena_used;
+    char arena[TELEMETRY_MESSAGE_ARENA_SIZE];
+} TELEMETRY_MESSAGE;
+
+static const char *TAG = "telemetry";
+
+static TELEMETRY_MESSAGE _message_pool[TELEMETRY_MESSAGE_POOL_SIZE];
+static TELEMETRY_STATISTICS _statistics;
+static portMUX_TYPE _poolMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Reserve bytes at the end of the message arena
+ *
+ * @return
+ *          - Pointer to the reserved bytes
+ *          - NULL if the arena is full
+ */
+static char * telemetry_arena_alloc(TELEMETRY_MESSAGE * message, size_t size)
+{
+    if (message->arena_used + size > sizeof(message->arena))
+    {
+        return NULL;
+    }
+
+    char * data = message->arena + message->arena_used;
+    message->arena_used += size;
+
+    return data;
+}
+
+static const char * telemetry_arena_strdup(TELEMETRY_MESSAGE * message, const char * value)
+{
+    size_t length = strlen(value) + 1;
+    char * data = telemetry_arena_alloc(message, length);
+
+    if (data != NULL)
+    {
+        memcpy(data, value, length);
+    }
+
+    return data;
+}
+
+static void telemetry_update_high_water_mark(TELEMETRY_MESSAGE * message)
+{
+    if (message->arena_used > _statistics.high_water_mark)
+    {
+        _statistics.high_water_mark = message->arena_used;
+    }
+}
+
+/**
+ * @brief Add a new field to the message. The key is copied into the message arena.
+ *
+ * @return
+ *          - The new field
+ *          - NULL if the field table or the arena is full
+ */
+static TELEMETRY_FIELD * telemetry_message_add_field(telemetry_message_handle_t handle, const char * szKey, TELEMETRY_FIELD_TYPE type)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    if (message == NULL)
+    {
+        return NULL;
+    }
+
+    const char * key = NULL;
+
+    if (message->field_count < TELEMETRY_MESSAGE_MAX_FIELDS)
+    {
+        key = telemetry_arena_strdup(message, szKey);
+    }
+
+    if (key == NULL)
+    {
+        _statistics.arena_overflows++;
+        return NULL;
+    }
+
+    TELEMETRY_FIELD * field = &message->fields[message->field_count++];
+    field->key = key;
+    field->type = type;
+    field->precision = TELEMETRY_PRECISION_SHORTEST;
+
+    return field;
+}
+
+/**
+ * @brief Write a json escaped string, including the enclosing quotes
+ *
+ * @return
+ *          - false if the output buffer is too small
+ */
+static bool telemetry_write_json_string(char ** output, const char * end, const char * value)
+{
+    char * cursor = *output;
+
+    if (cursor >= end)
+    {
+        return false;
+    }
+
+    *cursor++ = '"';
+
+    for (const char * c = value; *c != '\0'; ++c)
+    {
+        unsigned char ch = (unsigned char) *c;
+
+        if (ch == '"' || ch == '\\')
+        {
+            if (end - cursor < 2)
+            {
+                return false;
+            }
+
+            *cursor++ = '\\';
+            *cursor++ = ch;
+        }
+        else if (ch < 0x20)
+        {
+            if (end - cursor < 6)
+            {
+                return false;
+            }
+
+            cursor += snprintf(cursor, end - cursor, "\\u%04x", ch);
+        }
+        else
+        {
+            if (cursor >= end)
+            {
+                return false;
+            }
+
+            *cursor++ = ch;
+        }
+    }
+
+    if (cursor >= end)
+    {
+        return false;
+    }
+
+    *cursor++ = '"';
+    *output = cursor;
+
+    return true;
+}
+
 /**
  * @brief Create a new telemetry message to send to the IoT hub
- * 
- * @return 
+ *
+ * @return
  *          - Handle to the telemetry message
+ *          - 0 if every message of the pool is in use
  */
 telemetry_message_handle_t telemetry_message_create_new()
 {
-    telemetry_message_handle_t handle = (telemetry_message_handle_t) json_value_init_object();
-    return handle;
+    TELEMETRY_MESSAGE * message = NULL;
+
+    taskENTER_CRITICAL(&_poolMux);
+
+    for (size_t index = 0; index < TELEMETRY_MESSAGE_POOL_SIZE; ++index)
+    {
+        if (!_message_pool[index].in_use)
+        {
+            message = &_message_pool[index];
+            message->in_use = true;
+
+            if (++_statistics.pool_in_use > _statistics.pool_high_water_mark)
+            {
+                _statistics.pool_high_water_mark = _statistics.pool_in_use;
+            }
+
+            break;
+        }
+    }
+
+    if (message == NULL)
+    {
+        _statistics.pool_exhausted++;
+    }
+
+    taskEXIT_CRITICAL(&_poolMux);
+
+    if (message != NULL)
+    {
+        message->schema = NULL;
+        message->field_count = 0;
+        message->arena_used = 0;
+    }
+
+    return (telemetry_message_handle_t) message;
 }
 
 /**
  * @brief Add a boolean result to the telemetry message (e.g. light on or off...)
  *
  * @param[in]  handle      The message handle returned from telemetry_message_create_new
- * @param[in]  szKey       The telemetry key 
+ * @param[in]  szKey       The telemetry key
  * @param[in]  value       The telemetry result's value
  */
  void telemetry_message_add_boolean(telemetry_message_handle_t handle, const char * szKey, bool value)
  {
-    JSON_Value * root_value = (JSON_Value *) handle;
-    JSON_Object * root_object = json_value_get_object(root_value);
-    json_object_set_boolean(root_object, szKey, value);
+    TELEMETRY_FIELD * field = telemetry_message_add_field(handle, szKey, TELEMETRY_FIELD_BOOLEAN);
+
+    if (field != NULL)
+    {
+        field->value.boolean = value;
+    }
 }
 
 /**
  * @brief Add a number result to the telemetry message (e.g. temperature, pressure, humidity...)
  *
  * @param[in]  handle      The message handle returned from telemetry_message_create_new
- * @param[in]  szKey       The telemetry key 
+ * @param[in]  szKey       The telemetry key
  * @param[in]  value       The telemetry result's value
  */
  void telemetry_message_add_number(telemetry_message_handle_t handle, const char * szKey, double value)
  {
-    JSON_Value * root_value = (JSON_Value *) handle;
-    JSON_Object * root_object = json_value_get_object(root_value);
-    json_object_set_number(root_object, szKey, value);
+    TELEMETRY_FIELD * field = telemetry_message_add_field(handle, szKey, TELEMETRY_FIELD_NUMBER);
+
+    if (field != NULL)
+    {
+        field->value.number = value;
+    }
  }
- 
+
  /**
  * @brief Add a string result to the telemetry message (e.g. value type: celcius, meter... )
  *
  * @param[in]  handle      The message handle returned from telemetry_message_create_new
- * @param[in]  szKey       The telemetry key 
+ * @param[in]  szKey       The telemetry key
  * @param[in]  value       The telemetry result's value
  */
 void telemetry_message_add_string(telemetry_message_handle_t handle, const char * szKey, const char * value)
 {
-    JSON_Value * root_value = (JSON_Value *) handle;
-    JSON_Object * root_object = json_value_get_object(root_value);
-    json_object_set_string(root_object, szKey, value);
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+    TELEMETRY_FIELD * field = telemetry_message_add_field(handle, szKey, TELEMETRY_FIELD_STRING);
+
+    if (field != NULL)
+    {
+        field->value.string = telemetry_arena_strdup(message, value);
+
+        if (field->value.string == NULL)
+        {
+            // Roll back the field, its key stays in the arena until the message is destroyed
+            message->field_count--;
+            _statistics.arena_overflows++;
+        }
+    }
+}
+
+/**
+ * @brief Serialize the message fields as a null terminated json object
+ *
+ * @return
+ *          - The length of the serialized object, excluding the null terminator
+ *          - 0 if the output buffer is too small
+ */
+static size_t telemetry_message_write_json(TELEMETRY_MESSAGE * message, char * json, size_t size)
+{
+    const char * end = json + size;
+    char * cursor = json;
+
+    if (cursor >= end)
+    {
+        return 0;
+    }
+
+    *cursor++ = '{';
+
+    for (size_t index = 0; index < message->field_count; ++index)
+    {
+        TELEMETRY_FIELD * field = &message->fields[index];
+
+        if (index > 0 && cursor < end)
+        {
+            *cursor++ = ',';
+        }
+
+        if (!telemetry_write_json_string(&cursor, end, field->key) || cursor >= end)
+        {
+            return 0;
+        }
+
+        *cursor++ = ':';
+
+        int written = 0;
+
+        switch (field->type)
+        {
+            case TELEMETRY_FIELD_BOOLEAN:
+                written = snprintf(cursor, end - cursor, "%s", field->value.boolean ? "true" : "false");
+                break;
+            case TELEMETRY_FIELD_NUMBER:
+                written = telemetry_format_number(cursor, end - cursor, field->value.number, field->precision);
+                break;
+            case TELEMETRY_FIELD_STRING:
+                written = telemetry_write_json_string(&cursor, end, field->value.string) ? 0 : -1;
+                break;
+            case TELEMETRY_FIELD_NULL:
+                written = snprintf(cursor, end - cursor, "null");
+                break;
+        }
+
+        if (written < 0 || written >= end - cursor)
+        {
+            return 0;
+        }
+
+        cursor += written;
+    }
+
+    if (end - cursor < 2)
+    {
+        return 0;
+    }
+
+    *cursor++ = '}';
+    *cursor = '\0';
+
+    return cursor - json;
+}
+
+/**
+ * @brief Serialize the message fields as a cbor map. A NULL output only measures the map's length.
+ *
+ * @return
+ *          - The length of the serialized map
+ *          - 0 if the output buffer is too small
+ */
+static size_t telemetry_message_write_cbor(TELEMETRY_MESSAGE * message, uint8_t * cbor, size_t size)
+{
+    CBOR_WRITER writer;
+    cbor_writer_init(&writer, cbor, size);
+    cbor_write_map(&writer, message->field_count);
+
+    for (size_t index = 0; index < message->field_count; ++index)
+    {
+        TELEMETRY_FIELD * field = &message->fields[index];
+
+        cbor_write_string(&writer, field->key);
+
+        switch (field->type)
+        {
+            case TELEMETRY_FIELD_BOOLEAN:
+                cbor_write_boolean(&writer, field->value.boolean);
+                break;
+            case TELEMETRY_FIELD_NUMBER:
+                cbor_write_number(&writer, field->value.number);
+                break;
+            case TELEMETRY_FIELD_STRING:
+                cbor_write_string(&writer, field->value.string);
+                break;
+            case TELEMETRY_FIELD_NULL:
+                cbor_write_null(&writer);
+                break;
+        }
+    }
+
+    return writer.overflow ? 0 : cbor_writer_get_length(&writer);
+}
+
+/**
+ * @brief Serialize a schema message by copying the compiled skeleton and patching the number slots in place
+ *
+ * @return
+ *          - The length of the serialized object, excluding the null terminator
+ *          - 0 if the output buffer is too small
+ */
+static size_t telemetry_message_write_json_template(TELEMETRY_MESSAGE * message, char * json, size_t size)
+{
+    const TELEMETRY_SCHEMA * schema = message->schema;
+
+    if (size < schema->skeleton_length + 1)
+    {
+        return 0;
+    }
+
+    memcpy(json, schema->skeleton, schema->skeleton_length + 1);
+
+    for (size_t index = 0; index < message->field_count; ++index)
+    {
+        TELEMETRY_FIELD * field = &message->fields[index];
+
+        if (field->type == TELEMETRY_FIELD_NUMBER)
+        {
+            // Right align the value in its slot, the skeleton pads the slot with spaces
+            char value[TELEMETRY_NUMBER_SLOT_WIDTH + 8];
+            int width = schema->slot_widths[index];
+            int length = telemetry_format_number(value, sizeof(value), field->value.number, field->precision);
+
+            if (length > 0 && length <= width)
+            {
+                char * slot = json + schema->slot_offsets[index];
+                memset(slot, ' ', width - length);
+                memcpy(slot + width - length, value, length);
+            }
+        }
+    }
+
+    return schema->skeleton_length;
+}
+
+/**
+ * @brief Create a new telemetry message from a schema. The message holds every field of the schema, number
+ *        fields are null until set with telemetry_message_set_number.
+ *
+ * @param[in]  schema      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - Handle to the telemetry message
+ *          - 0 if every message of the pool is in use
+ */
+telemetry_message_handle_t telemetry_message_create_from_schema(telemetry_schema_handle_t schema)
+{
+    const TELEMETRY_SCHEMA * telemetry_schema = (const TELEMETRY_SCHEMA *) schema;
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) telemetry_message_create_new();
+
+    if (message != NULL && telemetry_schema != NULL)
+    {
+        message->schema = telemetry_schema;
+        message->field_count = telemetry_schema->field_count;
+        memcpy(message->fields, telemetry_schema->fields, telemetry_schema->field_count * sizeof(TELEMETRY_FIELD));
+    }
+
+    return (telemetry_message_handle_t) message;
+}
+
+/**
+ * @brief Set the value of a number field declared in the message's schema
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_from_schema
+ * @param[in]  field_id    The field id returned from telemetry_schema_add_number
+ * @param[in]  value       The telemetry result's value
+ */
+void telemetry_message_set_number(telemetry_message_handle_t handle, telemetry_field_id_t field_id, double value)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    if (message != NULL && message->schema != NULL && field_id < message->schema->field_count)
+    {
+        TELEMETRY_FIELD * field = &message->fields[field_id];
+
+        if (field->type == TELEMETRY_FIELD_NULL || field->type == TELEMETRY_FIELD_NUMBER)
+        {
+            field->type = TELEMETRY_FIELD_NUMBER;
+            field->value.number = value;
+        }
+    }
 }
 
 /**
@@ -67,14 +515,220 @@ void telemetry_message_add_string(telemetry_message_handle_t handle, const char
  * @param[in]  handle      The message handle returned from telemetry_message_create_new
  *
  * @return
- *            - The serialized json string
+ *            - The serialized json string, stored in the message arena and valid until the message is destroyed
+ *            - NULL if the serialized message does not fit in the arena
  */
  char * telemetry_message_to_json(telemetry_message_handle_t handle)
  {
-    JSON_Value * root_value = (JSON_Value *) handle;
-    return json_serialize_to_string(root_value);    
+    size_t length;
+    return (char *) telemetry_message_serialize(handle, TELEMETRY_ENCODING_JSON, &length);
  }
- 
+
+static bool telemetry_message_uses_template(const TELEMETRY_MESSAGE * message)
+{
+    return message->schema != NULL && message->schema->compiled && message->field_count == message->schema->field_count;
+}
+
+/**
+ * @brief Serialize the telemetry results in the requested wire format into a caller supplied buffer, e.g. the
+ *        payload buffer of the outgoing message
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ * @param[out] buffer      The output buffer. Json output is null terminated and needs one more byte than its length.
+ * @param[in]  size        The output buffer size in bytes
+ *
+ * @return
+ *            - The length of the serialized message in bytes
+ *            - 0 if the serialized message does not fit in the buffer
+ */
+size_t telemetry_message_serialize_to(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding, uint8_t * buffer, size_t size)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    if (message == NULL || buffer == NULL)
+    {
+        return 0;
+    }
+
+    // A single message has no time series to compress, it is sent as a cbor map
+    if (encoding == TELEMETRY_ENCODING_CBOR || encoding == TELEMETRY_ENCODING_SERIES)
+    {
+        return telemetry_message_write_cbor(message, buffer, size);
+    }
+
+    if (telemetry_message_uses_template(message))
+    {
+        return telemetry_message_write_json_template(message, (char *) buffer, size);
+    }
+
+    return telemetry_message_write_json(message, (char *) buffer, size);
+}
+
+/**
+ * @brief Get the length of the serialized message without serializing it, to size its output buffer up front
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The length of the serialized message in bytes, excluding the json null terminator
+ *            - 0 if the message is a json message without compiled schema that does not fit in its arena
+ */
+size_t telemetry_message_get_serialized_size(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    if (message == NULL)
+    {
+        return 0;
+    }
+
+    if (encoding == TELEMETRY_ENCODING_CBOR || encoding == TELEMETRY_ENCODING_SERIES)
+    {
+        return telemetry_message_write_cbor(message, NULL, SIZE_MAX);
+    }
+
+    if (telemetry_message_uses_template(message))
+    {
+        return message->schema->skeleton_length;
+    }
+
+    // Free form json is measured by serializing it in the arena's free space, which is not reserved
+    return telemetry_message_write_json(message, message->arena + message->arena_used, sizeof(message->arena) - message->arena_used);
+}
+
+/**
+ * @brief Serialize the telemetry results in the requested wire format
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ * @param[in]  encoding    The wire format
+ * @param[out] length      The length of the serialized message in bytes
+ *
+ * @return
+ *            - The serialized message, stored in the message arena and valid until the message is destroyed
+ *            - NULL if the serialized message does not fit in the arena
+ */
+const uint8_t * telemetry_message_serialize(telemetry_message_handle_t handle, TELEMETRY_ENCODING encoding, size_t * length)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    *length = 0;
+
+    if (message == NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t * output = (uint8_t *)(message->arena + message->arena_used);
+    *length = telemetry_message_serialize_to(handle, encoding, output, sizeof(message->arena) - message->arena_used);
+
+    if (*length == 0)
+    {
+        _statistics.arena_overflows++;
+        return NULL;
+    }
+
+    // Json output is null terminated
+    message->arena_used += *length + ((encoding == TELEMETRY_ENCODING_JSON) ? 1 : 0);
+    telemetry_update_high_water_mark(message);
+
+    return output;
+}
+
+/**
+ * @brief Get the content type of a wire format (e.g. application/json)
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The content type to set on the outgoing message
+ */
+const char * telemetry_encoding_get_content_type(TELEMETRY_ENCODING encoding)
+{
+    switch (encoding)
+    {
+        case TELEMETRY_ENCODING_CBOR:
+            return "application/cbor";
+        case TELEMETRY_ENCODING_SERIES:
+            return "application/vnd.esp32monitor.series+cbor";
+        default:
+            return "application/json";
+    }
+}
+
+/**
+ * @brief Get the content encoding of a wire format (e.g. utf-8)
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The content encoding to set on the outgoing message
+ *            - NULL for binary formats
+ */
+const char * telemetry_encoding_get_content_encoding(TELEMETRY_ENCODING encoding)
+{
+    return (encoding == TELEMETRY_ENCODING_JSON) ? "utf-8" : NULL;
+}
+
+/**
+ * @brief Get a wire format from its name as used in the device twin ("json", "cbor" or "series")
+ *
+ * @param[in]  name        The wire format name
+ * @param[out] encoding    The wire format
+ *
+ * @return
+ *            - true if the name is a known wire format
+ */
+bool telemetry_encoding_from_name(const char * name, TELEMETRY_ENCODING * encoding)
+{
+    if (name == NULL)
+    {
+        return false;
+    }
+
+    if (strcasecmp(name, "json") == 0)
+    {
+        *encoding = TELEMETRY_ENCODING_JSON;
+        return true;
+    }
+
+    if (strcasecmp(name, "cbor") == 0)
+    {
+        *encoding = TELEMETRY_ENCODING_CBOR;
+        return true;
+    }
+
+    if (strcasecmp(name, "series") == 0)
+    {
+        *encoding = TELEMETRY_ENCODING_SERIES;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Get the name of a wire format as used in the device twin
+ *
+ * @param[in]  encoding    The wire format
+ *
+ * @return
+ *            - The wire format name
+ */
+const char * telemetry_encoding_get_name(TELEMETRY_ENCODING encoding)
+{
+    switch (encoding)
+    {
+        case TELEMETRY_ENCODING_CBOR:
+            return "cbor";
+        case TELEMETRY_ENCODING_SERIES:
+            return "series";
+        default:
+            return "json";
+    }
+}
+
 /**
  * @brief Dispose of the memory allocated for the json output message
  *
@@ -82,9 +736,9 @@ void telemetry_message_add_string(telemetry_message_handle_t handle, const char
  */
 void telemetry_message_dispose_json(char * json)
 {
-    json_free_serialized_string(json);
+    // The json output lives in the message arena and is released with the message
 }
-  
+
 /**
  * @brief Dispose of the memory allocated for the message;
  *
@@ -92,6 +746,437 @@ void telemetry_message_dispose_json(char * json)
  */
 void telemetry_message_destroy(telemetry_message_handle_t handle)
 {
-    JSON_Value * root_value = (JSON_Value *) handle;
-    json_value_free(root_value);    
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+
+    if (message != NULL)
+    {
+        telemetry_update_high_water_mark(message);
+
+        taskENTER_CRITICAL(&_poolMux);
+        message->in_use = false;
+        _statistics.pool_in_use--;
+        taskEXIT_CRITICAL(&_poolMux);
+    }
+}
+
+/**
+ * @brief Get the number of arena bytes used by the message, including its serialized output if any
+ *
+ * @param[in]  handle      The message handle returned from telemetry_message_create_new
+ *
+ * @return
+ *            - The number of bytes used in the message arena
+ */
+size_t telemetry_message_get_bytes_used(telemetry_message_handle_t handle)
+{
+    TELEMETRY_MESSAGE * message = (TELEMETRY_MESSAGE *) handle;
+    return (message != NULL) ? message->arena_used : 0;
+}
+
+/**
+ * @brief Get the telemetry arena usage statistics
+ *
+ * @param[out]  statistics  The statistics snapshot
+ */
+void telemetry_get_statistics(TELEMETRY_STATISTICS * statistics)
+{
+    taskENTER_CRITICAL(&_poolMux);
+    *statistics = _statistics;
+    taskEXIT_CRITICAL(&_poolMux);
+
+    statistics->arena_size = TELEMETRY_MESSAGE_ARENA_SIZE;
+    statistics->pool_size = TELEMETRY_MESSAGE_POOL_SIZE;
+}
+
+static const char * telemetry_schema_strdup(TELEMETRY_SCHEMA * schema, const char * value)
+{
+    size_t length = strlen(value) + 1;
+
+    if (schema->strings_used + length > sizeof(schema->strings))
+    {
+        return NULL;
+    }
+
+    char * data = schema->strings + schema->strings_used;
+    memcpy(data, value, length);
+    schema->strings_used += length;
+
+    return data;
+}
+
+// Length of a string's json output, quotes and escapes included
+static size_t telemetry_json_string_length(const char * value)
+{
+    size_t length = 2;
+
+    for (const char * c = value; *c != '\0'; ++c)
+    {
+        unsigned char ch = (unsigned char) *c;
+        length += (ch == '"' || ch == '\\') ? 2 : (ch < 0x20) ? 6 : 1;
+    }
+
+    return length;
+}
+
+// Width of the longest json output of a number within its range: sign, integer digits and decimals
+static uint8_t telemetry_number_slot_width(int8_t precision, double minimum, double maximum)
+{
+    double magnitude = fmax(fabs(minimum), fabs(maximum));
+
+    if (precision < 0 || !isfinite(magnitude))
+    {
+        return TELEMETRY_NUMBER_SLOT_WIDTH;
+    }
+
+    if (precision > TELEMETRY_PRECISION_MAX)
+    {
+        precision = TELEMETRY_PRECISION_MAX;
+    }
+
+    // Rounded to an integer, the magnitude gets the digits rounding to the precision may carry over
+    char digits[TELEMETRY_NUMBER_SLOT_WIDTH + 8];
+    int width = telemetry_format_number(digits, sizeof(digits), magnitude, 0) + (minimum < 0 ? 1 : 0) +
+        (precision > 0 ? precision + 1 : 0);
+
+    // Room for the null of a field without value
+    return (width < 4) ? 4 : (width > TELEMETRY_NUMBER_SLOT_WIDTH) ? TELEMETRY_NUMBER_SLOT_WIDTH : width;
+}
+
+static telemetry_field_id_t telemetry_schema_add_field(telemetry_schema_handle_t handle, const char * szKey, TELEMETRY_FIELD_TYPE type)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL || schema->compiled || schema->field_count >= TELEMETRY_MESSAGE_MAX_FIELDS)
+    {
+        return TELEMETRY_FIELD_ID_INVALID;
+    }
+
+    const char * key = telemetry_schema_strdup(schema, szKey);
+
+    if (key == NULL)
+    {
+        return TELEMETRY_FIELD_ID_INVALID;
+    }
+
+    telemetry_field_id_t field_id = schema->field_count++;
+    schema->fields[field_id].key = key;
+    schema->fields[field_id].type = type;
+    schema->fields[field_id].precision = TELEMETRY_PRECISION_SHORTEST;
+
+    return field_id;
+}
+
+/**
+ * @brief Create a telemetry schema. Sensors declare the fields they post once, the schema is then compiled
+ *        to a serialized skeleton in which each message only patches its values.
+ *
+ * @return
+ *          - Handle to the telemetry schema
+ *          - 0 if the schema could not be allocated
+ */
+telemetry_schema_handle_t telemetry_schema_create()
+{
+    TELEMETRY_SCHEMA * schema = calloc(1, sizeof(TELEMETRY_SCHEMA));
+    return (telemetry_schema_handle_t) schema;
+}
+
+/**
+ * @brief Dispose of the memory allocated for the schema. No message created from the schema may remain.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ */
+void telemetry_schema_destroy(telemetry_schema_handle_t handle)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema != NULL)
+    {
+        free(schema);
+    }
+}
+
+/**
+ * @brief Declare a constant string field (e.g. the device id). The value is copied into the schema.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  value       The constant value
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_string(telemetry_schema_handle_t handle, const char * szKey, const char * value)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+    telemetry_field_id_t field_id = telemetry_schema_add_field(handle, szKey, TELEMETRY_FIELD_STRING);
+
+    if (field_id != TELEMETRY_FIELD_ID_INVALID)
+    {
+        schema->fields[field_id].value.string = telemetry_schema_strdup(schema, value);
+
+        if (schema->fields[field_id].value.string == NULL)
+        {
+            schema->field_count--;
+            return TELEMETRY_FIELD_ID_INVALID;
+        }
+    }
+
+    return field_id;
+}
+
+/**
+ * @brief Declare a number field, set in each message with telemetry_message_set_number. A fixed precision
+ *        field's slot holds values up to TELEMETRY_NUMBER_DEFAULT_MAX in magnitude.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  precision   The number of decimals of the json output, matching the sensor's resolution,
+ *                         or TELEMETRY_PRECISION_SHORTEST
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_number(telemetry_schema_handle_t handle, const char * szKey, int8_t precision)
+{
+    return telemetry_schema_add_number_range(handle, szKey, precision, -TELEMETRY_NUMBER_DEFAULT_MAX, TELEMETRY_NUMBER_DEFAULT_MAX);
+}
+
+/**
+ * @brief Declare a number field whose values lie in a range. The range and the precision size the field's slot
+ *        in the compiled skeleton: a value whose json output does not fit its slot is sent as null.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  szKey       The telemetry key
+ * @param[in]  precision   The number of decimals of the json output, matching the sensor's resolution,
+ *                         or TELEMETRY_PRECISION_SHORTEST
+ * @param[in]  minimum     The lowest value of the field
+ * @param[in]  maximum     The highest value of the field
+ *
+ * @return
+ *          - The field id
+ *          - TELEMETRY_FIELD_ID_INVALID if the schema is full or already compiled
+ */
+telemetry_field_id_t telemetry_schema_add_number_range(telemetry_schema_handle_t handle, const char * szKey, int8_t precision, double minimum, double maximum)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+    telemetry_field_id_t field_id = telemetry_schema_add_field(handle, szKey, TELEMETRY_FIELD_NULL);
+
+    if (field_id != TELEMETRY_FIELD_ID_INVALID)
+    {
+        schema->fields[field_id].precision = precision;
+        schema->slot_widths[field_id] = telemetry_number_slot_width(precision, minimum, maximum);
+    }
+
+    return field_id;
+}
+
+/**
+ * @brief Compile the schema to a json skeleton with fixed width value slots. No field can be added afterward.
+ *        A skeleton larger than a message arena is logged with the size it needs.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - true if the schema compiled and its skeleton fits in a message arena
+ */
+bool telemetry_schema_compile(telemetry_schema_handle_t handle)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL)
+    {
+        return false;
+    }
+
+    if (schema->compiled)
+    {
+        return true;
+    }
+
+    size_t required = telemetry_schema_get_skeleton_size(handle);
+
+    if (required > sizeof(schema->skeleton))
+    {
+        ESP_LOGE(TAG, "The telemetry schema of %d fields needs %d bytes, more than the %d bytes of a message arena",
+            (int) schema->field_count, (int) required, (int) sizeof(schema->skeleton));
+        return false;
+    }
+
+    const char * end = schema->skeleton + sizeof(schema->skeleton);
+    char * cursor = schema->skeleton;
+
+    *cursor++ = '{';
+
+    for (size_t index = 0; index < schema->field_count; ++index)
+    {
+        TELEMETRY_FIELD * field = &schema->fields[index];
+
+        if (index > 0 && cursor < end)
+        {
+            *cursor++ = ',';
+        }
+
+        if (!telemetry_write_json_string(&cursor, end, field->key) || cursor >= end)
+        {
+            return false;
+        }
+
+        *cursor++ = ':';
+
+        if (field->type == TELEMETRY_FIELD_STRING)
+        {
+            if (!telemetry_write_json_string(&cursor, end, field->value.string))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            // Blank slot holding a right aligned null until the value is patched
+            uint8_t width = schema->slot_widths[index];
+
+            if (end - cursor < width)
+            {
+                return false;
+            }
+
+            schema->slot_offsets[index] = cursor - schema->skeleton;
+            memset(cursor, ' ', width);
+            memcpy(cursor + width - 4, "null", 4);
+            cursor += width;
+        }
+    }
+
+    if (end - cursor < 2)
+    {
+        return false;
+    }
+
+    *cursor++ = '}';
+    *cursor = '\0';
+
+    schema->skeleton_length = cursor - schema->skeleton;
+    schema->compiled = true;
+
+    return true;
+}
+
+/**
+ * @brief Get the size of the skeleton the declared fields compile to, to be checked against the message arena
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - The size of the json skeleton in bytes, including the null terminator
+ */
+size_t telemetry_schema_get_skeleton_size(telemetry_schema_handle_t handle)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL)
+    {
+        return 0;
+    }
+
+    // Braces and null terminator, then a comma before each field but the first
+    size_t size = 3;
+
+    for (size_t index = 0; index < schema->field_count; ++index)
+    {
+        TELEMETRY_FIELD * field = &schema->fields[index];
+
+        size += (index > 0 ? 1 : 0) + telemetry_json_string_length(field->key) + 1;
+        size += (field->type == TELEMETRY_FIELD_STRING) ? telemetry_json_string_length(field->value.string) : schema->slot_widths[index];
+    }
+
+    return size;
+}
+
+/**
+ * @brief Get the number of fields declared in the schema
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ *
+ * @return
+ *          - The number of fields, field ids range from 0 to the count - 1
+ */
+size_t telemetry_schema_get_field_count(telemetry_schema_handle_t handle)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+    return (schema != NULL) ? schema->field_count : 0;
+}
+
+/**
+ * @brief Remove the fields declared after the first ones, to roll back the declarations of a sensor that is left
+ *        out. The schema must not be compiled yet.
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_count The number of fields kept, from telemetry_schema_get_field_count before the declarations
+ *
+ * @return
+ *          - true if the schema holds field_count fields
+ */
+bool telemetry_schema_truncate(telemetry_schema_handle_t handle, size_t field_count)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL || schema->compiled || field_count > schema->field_count)
+    {
+        return false;
+    }
+
+    // The strings are copied in the order of the fields, the first removed key starts the strings to free
+    if (field_count < schema->field_count)
+    {
+        schema->strings_used = schema->fields[field_count].key - schema->strings;
+        schema->field_count = field_count;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get the key of a schema field
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_id    The field id
+ *
+ * @return
+ *          - The field's key
+ *          - NULL if the field id is out of range
+ */
+const char * telemetry_schema_get_key(telemetry_schema_handle_t handle, telemetry_field_id_t field_id)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL || field_id >= schema->field_count)
+    {
+        return NULL;
+    }
+
+    return schema->fields[field_id].key;
+}
+
+/**
+ * @brief Get the value of a constant string field of the schema
+ *
+ * @param[in]  handle      The schema handle returned from telemetry_schema_create
+ * @param[in]  field_id    The field id
+ *
+ * @return
+ *          - The field's constant value
+ *          - NULL if the field is a number field or the field id is out of range
+ */
+const char * telemetry_schema_get_string(telemetry_schema_handle_t handle, telemetry_field_id_t field_id)
+{
+    TELEMETRY_SCHEMA * schema = (TELEMETRY_SCHEMA *) handle;
+
+    if (schema == NULL || field_id >= schema->field_count || schema->fields[field_id].type != TELEMETRY_FIELD_STRING)
+    {
+        return NULL;
+    }
+
+    return schema->fields[field_id].value.string;
 }
@@ -0,0 +1,233 @@
+#include "telemetry-format.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest number of decimals tried for the shortest round trip output before falling back to printf
+#define TELEMETRY_SHORTEST_MAX_DECIMALS     17
+
+// Integers below 2^53 are exact in double precision
+#define TELEMETRY_EXACT_INTEGER_LIMIT       9007199254740992.0
+
+static const double _powers_of_ten[TELEMETRY_SHORTEST_MAX_DECIMALS + 1] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17
+};
+
+/**
+ * @brief Write integer.fraction in fixed point notation, fraction holding the given number of decimals, removing
+ *        trailing zeros
+ */
+static int telemetry_format_fixed(char * buffer, size_t size, bool negative, uint64_t integer, uint64_t fraction,
+    uint8_t decimals)
+{
+    char digits[40];
+    int count = 0;
+
+    while (decimals > 0 && fraction % 10 == 0)
+    {
+        fraction /= 10;
+        decimals--;
+    }
+
+    // Least significant digit first: the decimals, then at least one digit before the decimal point
+    while (count < decimals)
+    {
+        digits[count++] = '0' + (fraction % 10);
+        fraction /= 10;
+    }
+
+    do
+    {
+        digits[count++] = '0' + (integer % 10);
+        integer /= 10;
+    }
+    while (integer > 0);
+
+    negative = negative && (count > 1 || digits[0] != '0');
+
+    int length = negative + count + (decimals > 0 ? 1 : 0);
+
+    if ((size_t) length >= size)
+    {
+        return length;
+    }
+
+    char * cursor = buffer;
+
+    if (negative)
+    {
+        *cursor++ = '-';
+    }
+
+    while (count > 0)
+    {
+        if (count == decimals)
+        {
+            *cursor++ = '.';
+        }
+
+        *cursor++ = digits[--count];
+    }
+
+    *cursor = '\0';
+
+    return length;
+}
+
+/**
+ * @brief Error of the double product of value and factor against the exact product (Dekker)
+ */
+static double telemetry_product_error(double value, double factor, double product)
+{
+    double split = value * 134217729.0;
+    double value_high = split - (split - value);
+    double value_low = value - value_high;
+
+    split = factor * 134217729.0;
+    double factor_high = split - (split - factor);
+    double factor_low = factor - factor_high;
+
+    return ((value_high * factor_high - product) + value_high * factor_low + value_low * factor_high) +
+        value_low * factor_low;
+}
+
+/**
+ * @brief Round the exact product of value and factor to the nearest integer, halfway cases away from zero
+ */
+static double telemetry_round_product(double value, double factor)
+{
+    double product = value * factor;
+    double rounded = round(product);
+
+    // A product rounded to a halfway case may come from an exact product just short of it
+    if (fabs(product - trunc(product)) == 0.5)
+    {
+        double error = telemetry_product_error(value, factor, product);
+
+        if (error != 0 && (error < 0) == (product > 0))
+        {
+            rounded -= (product > 0) ? 1 : -1;
+        }
+    }
+
+    return rounded;
+}
+
+/**
+ * @brief Write the value with the fewest significant digits that parse back to it, in printf's %g notation
+ */
+static int telemetry_format_general(char * buffer, size_t size, double value)
+{
+    char output[32];
+    int low = 1;
+    int high = 17;      // 17 significant digits always parse back to the same double
+
+    // More digits never parse back further from the value, so search for the fewest
+    while (low < high)
+    {
+        int digits = (low + high) / 2;
+        snprintf(output, sizeof(output), "%.*g", digits, value);
+
+        if (strtod(output, NULL) == value)
+        {
+            high = digits;
+        }
+        else
+        {
+            low = digits + 1;
+        }
+    }
+
+    int length = snprintf(output, sizeof(output), "%.*g", low, value);
+
+    if ((size_t) length < size)
+    {
+        memcpy(buffer, output, length + 1);
+    }
+
+    return length;
+}
+
+/**
+ * @brief Format a number for the json output without going through the printf floating point path.
+ *        NaN and infinite values are written as null.
+ *
+ * @param[out] buffer      The output buffer, null terminated when the output fits
+ * @param[in]  size        The output buffer size in bytes
+ * @param[in]  value       The value to format
+ * @param[in]  precision   The number of decimals to round to, trailing zeros removed, or
+ *                         TELEMETRY_PRECISION_SHORTEST for the shortest round trip output
+ *
+ * @return
+ *          - The length of the output, excluding the null terminator. Nothing is written if it is
+ *            larger than or equal to size.
+ */
+int telemetry_format_number(char * buffer, size_t size, double value, int8_t precision)
+{
+    if (isnan(value) || isinf(value))
+    {
+        if (size > 4)
+        {
+            memcpy(buffer, "null", 5);
+        }
+
+        return 4;
+    }
+
+    if (precision >= 0)
+    {
+        if (precision > TELEMETRY_PRECISION_MAX)
+        {
+            precision = TELEMETRY_PRECISION_MAX;
+        }
+
+        // Doubles from 2^53 up are integers
+        if (fabs(value) >= TELEMETRY_EXACT_INTEGER_LIMIT)
+        {
+            int length = snprintf(NULL, 0, "%.0f", value);
+
+            return ((size_t) length < size) ? snprintf(buffer, size, "%.0f", value) : length;
+        }
+
+        // The integer part and the fraction are exact, only the fraction is rounded
+        double integer = trunc(value);
+        double fraction = fabs(telemetry_round_product(value - integer, _powers_of_ten[precision]));
+
+        // 9.9996 rounds up to 10 with 3 decimals
+        if (fraction == _powers_of_ten[precision])
+        {
+            integer += (value < 0) ? -1 : 1;
+            fraction = 0;
+        }
+
+        return telemetry_format_fixed(buffer, size, value < 0, (uint64_t) fabs(integer), (uint64_t) fraction,
+            precision);
+    }
+
+    // scaled and 10^decimals are exact, so their correctly rounded quotient is what a parser reads back
+    for (uint8_t decimals = 0; decimals <= TELEMETRY_SHORTEST_MAX_DECIMALS; ++decimals)
+    {
+        double scaled = round(value * _powers_of_ten[decimals]);
+
+        if (fabs(scaled) >= TELEMETRY_EXACT_INTEGER_LIMIT)
+        {
+            break;
+        }
+
+        if (scaled / _powers_of_ten[decimals] == value)
+        {
+            uint64_t magnitude = (uint64_t) fabs(scaled);
+            uint64_t power = (uint64_t) _powers_of_ten[decimals];
+
+            return telemetry_format_fixed(buffer, size, scaled < 0, magnitude / power, magnitude % power, decimals);
+        }
+    }
+
+    // Very large or very small values
+    return telemetry_format_general(buffer, size, value);
+}
@@ -0,0 +1,490 @@
+#include "telemetry-log.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#define TELEMETRY_LOG_UNCONSUMED   0xFFFFFFFF
+
+/*
+ * A record as written on the storage. The consumed word is left erased when the record is appended and cleared
+ * by telemetry_log_commit, it is not covered by the CRC.
+ */
+typedef struct TELEMETRY_LOG_RECORD_TAG
+{
+    uint32_t sequence;              // Consecutive numbers, the order of the records around the ring
+    uint32_t timestamp;
+    float value;
+    uint8_t sensor_id;
+    uint8_t field_id;
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t crc;                   // CRC-32 of the fields above
+    uint32_t consumed;              // TELEMETRY_LOG_UNCONSUMED until the read cursor is persisted on this record
+} TELEMETRY_LOG_RECORD;
+
+typedef struct TELEMETRY_LOG_TAG
+{
+    const STORAGE_INTERFACE_DESCRIPTION * storage_interface;
+    STORAGE_HANDLE storage;
+    size_t sector_size;
+    uint32_t sector_records;        // Records per sector, the rest of a sector is unused
+    uint32_t slots;                 // Records the storage holds
+    uint32_t head;                  // Slot of the next append
+    uint32_t next_sequence;         // Sequence of the next append
+    uint32_t read_slot;             // Slot from which the next replayed record is searched
+    uint32_t read_sequence;         // Sequence of the next replayed record
+    uint32_t commit_slot;           // Slot of the last replayed record
+    bool commit_pending;            // Records were replayed since the cursor was persisted
+    TELEMETRY_LOG_STATISTICS statistics;
+} TELEMETRY_LOG;
+
+static const char *TAG = "telemetry-log";
+
+static uint32_t telemetry_log_crc32(const void * data, size_t size)
+{
+    const uint8_t * bytes = (const uint8_t *) data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (size-- > 0)
+    {
+        crc ^= *bytes++;
+
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static size_t telemetry_log_get_offset(TELEMETRY_LOG * log, uint32_t slot)
+{
+    return (slot / log->sector_records) * log->sector_size + (slot % log->sector_records) * sizeof(TELEMETRY_LOG_RECORD);
+}
+
+static uint32_t telemetry_log_next_slot(TELEMETRY_LOG * log, uint32_t slot)
+{
+    return (slot + 1 < log->slots) ? slot + 1 : 0;
+}
+
+// Sequences are compared over their difference, they keep their order when they wrap around
+static bool telemetry_log_sequence_before(uint32_t sequence, uint32_t other)
+{
+    return (int32_t) (sequence - other) < 0;
+}
+
+static bool telemetry_log_is_erased(const TELEMETRY_LOG_RECORD * record)
+{
+    const uint8_t * bytes = (const uint8_t *) record;
+
+    for (size_t index = 0; index < sizeof(TELEMETRY_LOG_RECORD); ++index)
+    {
+        if (bytes[index] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool telemetry_log_is_valid(const TELEMETRY_LOG_RECORD * record)
+{
+    return record->crc == telemetry_log_crc32(record, offsetof(TELEMETRY_LOG_RECORD, crc));
+}
+
+static bool telemetry_log_read_record(TELEMETRY_LOG * log, uint32_t slot, TELEMETRY_LOG_RECORD * record)
+{
+    if (log->storage_interface->storage_read(log->storage, telemetry_log_get_offset(log, slot), record, sizeof(TELEMETRY_LOG_RECORD)) != STORAGE_STATUS_OK)
+    {
+        ++log->statistics.failures;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Find the first valid record from a slot up to the head that was not replayed yet
+ */
+static bool telemetry_log_find_unread(TELEMETRY_LOG * log, uint32_t slot, uint32_t * found, TELEMETRY_LOG_RECORD * record)
+{
+    while (slot != log->head)
+    {
+        if (telemetry_log_read_record(log, slot, record) &&
+            telemetry_log_is_valid(record) &&
+            !telemetry_log_sequence_before(record->sequence, log->read_sequence))
+        {
+            *found = slot;
+            return true;
+        }
+
+        slot = telemetry_log_next_slot(log, slot);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Erase the sector the head enters, moving the read cursor past it when it held records not replayed yet
+ */
+static bool telemetry_log_erase_sector(TELEMETRY_LOG * log)
+{
+    uint32_t sector = log->head / log->sector_records;
+
+    if (log->storage_interface->storage_erase(log->storage, sector * log->sector_size, log->sector_size) != STORAGE_STATUS_OK)
+    {
+        ++log->statistics.failures;
+        return false;
+    }
+
+    ++log->statistics.erases;
+
+    if (log->commit_pending && log->commit_slot / log->sector_records == sector)
+    {
+        log->commit_pending = false;
+    }
+
+    if (log->read_sequence != log->next_sequence && log->read_slot / log->sector_records == sector)
+    {
+        TELEMETRY_LOG_RECORD record;
+        uint32_t slot = (log->head + log->sector_records < log->slots) ? log->head + log->sector_records : 0;
+
+        if (telemetry_log_find_unread(log, slot, &slot, &record))
+        {
+            log->statistics.dropped += record.sequence - log->read_sequence;
+            log->read_slot = slot;
+            log->read_sequence = record.sequence;
+        }
+        else
+        {
+            log->statistics.dropped += log->next_sequence - log->read_sequence;
+            log->read_slot = log->head;
+            log->read_sequence = log->next_sequence;
+        }
+
+        ESP_LOGW(TAG, "Log full, overwriting samples not replayed yet");
+    }
+
+    return true;
+}
+
+/**
+ * @brief Recover the head and the read cursor from the records on the storage
+ */
+static void telemetry_log_mount(TELEMETRY_LOG * log)
+{
+    TELEMETRY_LOG_RECORD record;
+    bool found = false;
+    bool consumed = false;
+    uint32_t last_slot = 0;
+    uint32_t last_sequence = 0;
+    uint32_t first_sequence = 0;
+    uint32_t consumed_sequence = 0;
+
+    for (uint32_t slot = 0; slot < log->slots; ++slot)
+    {
+        if (!telemetry_log_read_record(log, slot, &record) || telemetry_log_is_erased(&record))
+        {
+            continue;
+        }
+
+        if (!telemetry_log_is_valid(&record))
+        {
+            ++log->statistics.torn;
+            continue;
+        }
+
+        if (!found || telemetry_log_sequence_before(last_sequence, record.sequence))
+        {
+            last_sequence = record.sequence;
+            last_slot = slot;
+        }
+
+        if (!found || telemetry_log_sequence_before(record.sequence, first_sequence))
+        {
+            first_sequence = record.sequence;
+        }
+
+        // A partly cleared word is a commit interrupted by a power loss, its records were already delivered
+        if (record.consumed != TELEMETRY_LOG_UNCONSUMED && (!consumed || telemetry_log_sequence_before(consumed_sequence, record.sequence)))
+        {
+            consumed_sequence = record.sequence;
+            consumed = true;
+        }
+
+        found = true;
+    }
+
+    if (!found)
+    {
+        // A blank or foreign storage, each sector is erased when the log enters it
+        log->head = 0;
+        log->next_sequence = 0;
+        log->read_slot = 0;
+        log->read_sequence = 0;
+        return;
+    }
+
+    // Skip the slots past the last record that a power loss left partly written
+    log->head = telemetry_log_next_slot(log, last_slot);
+    log->next_sequence = last_sequence + 1;
+
+    while (log->head % log->sector_records != 0 &&
+           telemetry_log_read_record(log, log->head, &record) &&
+           !telemetry_log_is_erased(&record))
+    {
+        log->head = telemetry_log_next_slot(log, log->head);
+    }
+
+    // The head entered a sector without erasing it: it holds the oldest records, about to be overwritten anyway
+    log->read_sequence = log->next_sequence;
+
+    if (log->head % log->sector_records == 0 &&
+        telemetry_log_read_record(log, log->head, &record) &&
+        !telemetry_log_is_erased(&record))
+    {
+        telemetry_log_erase_sector(log);
+    }
+
+    // Replay from the record following the persisted cursor, or from the oldest one when it was overwritten
+    log->read_sequence = first_sequence;
+
+    if (consumed && telemetry_log_sequence_before(first_sequence, consumed_sequence + 1))
+    {
+        log->read_sequence = consumed_sequence + 1;
+    }
+
+    log->read_slot = log->head;
+
+    if (log->read_sequence != log->next_sequence)
+    {
+        uint32_t slot = telemetry_log_next_slot(log, log->head);
+
+        // The oldest records follow the head around the ring
+        if (telemetry_log_find_unread(log, slot, &slot, &record))
+        {
+            log->read_slot = slot;
+            log->read_sequence = record.sequence;
+        }
+        else
+        {
+            log->read_sequence = log->next_sequence;
+        }
+    }
+}
+
+/**
+ * @brief Mount the log kept on a storage, recovering its records and its read cursor
+ *
+ * @param[in]  storage_interface  The storage's interface
+ * @param[in]  storage            The storage's handle, owned by the caller
+ *
+ * @return
+ *          - Handle to the log
+ *          - 0 if the storage holds less than two sectors or the log could not be allocated
+ */
+telemetry_log_handle_t telemetry_log_create(const STORAGE_INTERFACE_DESCRIPTION * storage_interface, STORAGE_HANDLE storage)
+{
+    size_t sector_size = storage_interface->storage_get_sector_size(storage);
+    size_t sectors = (sector_size > 0) ? storage_interface->storage_get_size(storage) / sector_size : 0;
+
+    // The sector being overwritten must not be the only one
+    if (sectors < 2 || sector_size < sizeof(TELEMETRY_LOG_RECORD))
+    {
+        ESP_LOGE(TAG, "Storage too small for the telemetry log: %d sectors of %d bytes", (int) sectors, (int) sector_size);
+        return 0;
+    }
+
+    TELEMETRY_LOG * log = calloc(1, sizeof(TELEMETRY_LOG));
+
+    if (log == NULL)
+    {
+        ESP_LOGE(TAG, "No memory for the telemetry log");
+        return 0;
+    }
+
+    log->storage_interface = storage_interface;
+    log->storage = storage;
+    log->sector_size = sector_size;
+    log->sector_records = sector_size / sizeof(TELEMETRY_LOG_RECORD);
+    log->slots = sectors * log->sector_records;
+    log->statistics.capacity = log->slots;
+
+    telemetry_log_mount(log);
+
+    ESP_LOGI(TAG, "Telemetry log mounted: %d samples pending of %d, %d torn records",
+        (int) (log->next_sequence - log->read_sequence), (int) log->slots, (int) log->statistics.torn);
+
+    return (telemetry_log_handle_t) log;
+}
+
+/**
+ * @brief Dispose of the memory allocated for the log, its records stay on the storage
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ */
+void telemetry_log_destroy(telemetry_log_handle_t handle)
+{
+    free((TELEMETRY_LOG *) handle);
+}
+
+/**
+ * @brief Append a sample to the log, overwriting the oldest sector when the log is full
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[in]  sample      The sample
+ *
+ * @return
+ *          - true if the sample was written
+ *          - false if the storage failed
+ */
+bool telemetry_log_append(telemetry_log_handle_t handle, const TELEMETRY_SAMPLE * sample)
+{
+    TELEMETRY_LOG * log = (TELEMETRY_LOG *) handle;
+
+    if (log->head % log->sector_records == 0 && !telemetry_log_erase_sector(log))
+    {
+        return false;
+    }
+
+    TELEMETRY_LOG_RECORD record =
+    {
+        .sequence = log->next_sequence,
+        .timestamp = sample->timestamp,
+        .value = sample->value,
+        .sensor_id = sample->sensor_id,
+        .field_id = sample->field_id,
+        .flags = sample->flags,
+        .reserved = 0xFF
+    };
+
+    record.crc = telemetry_log_crc32(&record, offsetof(TELEMETRY_LOG_RECORD, crc));
+
+    // The consumed word is left erased
+    int status = log->storage_interface->storage_write(log->storage, telemetry_log_get_offset(log, log->head), &record, offsetof(TELEMETRY_LOG_RECORD, consumed));
+
+    // A failed slot is left behind, its record fails the CRC
+    log->head = telemetry_log_next_slot(log, log->head);
+
+    if (status != STORAGE_STATUS_OK)
+    {
+        ++log->statistics.failures;
+        return false;
+    }
+
+    ++log->next_sequence;
+    ++log->statistics.appended;
+
+    return true;
+}
+
+/**
+ * @brief Read the oldest sample not replayed yet. The read cursor only moves in memory until
+ *        telemetry_log_commit persists it, a reboot replays the samples read since the last commit.
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[out] sample      The sample
+ *
+ * @return
+ *          - true if a sample was read
+ *          - false if every sample was replayed
+ */
+bool telemetry_log_read(telemetry_log_handle_t handle, TELEMETRY_SAMPLE * sample)
+{
+    TELEMETRY_LOG * log = (TELEMETRY_LOG *) handle;
+    TELEMETRY_LOG_RECORD record;
+    uint32_t slot;
+
+    if (log->read_sequence == log->next_sequence)
+    {
+        return false;
+    }
+
+    if (!telemetry_log_find_unread(log, log->read_slot, &slot, &record))
+    {
+        // The remaining records could not be read back
+        log->statistics.dropped += log->next_sequence - log->read_sequence;
+        log->read_slot = log->head;
+        log->read_sequence = log->next_sequence;
+        return false;
+    }
+
+    log->statistics.dropped += record.sequence - log->read_sequence;
+    log->read_slot = telemetry_log_next_slot(log, slot);
+    log->read_sequence = record.sequence + 1;
+    log->commit_slot = slot;
+    log->commit_pending = true;
+    ++log->statistics.replayed;
+
+    sample->timestamp = record.timestamp;
+    sample->value = record.value;
+    sample->sensor_id = record.sensor_id;
+    sample->field_id = record.field_id;
+    sample->flags = record.flags;
+
+    return true;
+}
+
+/**
+ * @brief Persist the read cursor, once the samples read so far were delivered
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ *
+ * @return
+ *          - true if the cursor is persisted
+ *          - false if the storage failed
+ */
+bool telemetry_log_commit(telemetry_log_handle_t handle)
+{
+    TELEMETRY_LOG * log = (TELEMETRY_LOG *) handle;
+    uint32_t consumed = 0;
+
+    if (!log->commit_pending)
+    {
+        return true;
+    }
+
+    size_t offset = telemetry_log_get_offset(log, log->commit_slot) + offsetof(TELEMETRY_LOG_RECORD, consumed);
+
+    if (log->storage_interface->storage_write(log->storage, offset, &consumed, sizeof(consumed)) != STORAGE_STATUS_OK)
+    {
+        ++log->statistics.failures;
+        return false;
+    }
+
+    log->commit_pending = false;
+    ++log->statistics.commits;
+
+    return true;
+}
+
+/**
+ * @brief Get the number of samples not replayed yet
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ */
+uint32_t telemetry_log_get_pending(telemetry_log_handle_t handle)
+{
+    TELEMETRY_LOG * log = (TELEMETRY_LOG *) handle;
+
+    return log->next_sequence - log->read_sequence;
+}
+
+/**
+ * @brief Get the log counters
+ *
+ * @param[in]  handle      The log handle returned from telemetry_log_create
+ * @param[out] statistics  The log counters
+ */
+void telemetry_log_get_statistics(telemetry_log_handle_t handle, TELEMETRY_LOG_STATISTICS * statistics)
+{
+    TELEMETRY_LOG * log = (TELEMETRY_LOG *) handle;
+
+    *statistics = log->statistics;
+    statistics->pending = log->next_sequence - log->read_sequence;
+}
@@ -0,0 +1,266 @@
+#include "telemetry-ring.h"
+
+#include <stdlib.h>
+
+#include "freertos/task.h"
+
+typedef struct TELEMETRY_RING_TAG
+{
+    uint32_t head;                  // Position of the next push, written by the producer
+    uint32_t tail;                  // Position of the next pop, moved by the consumer and by drop oldest
+    size_t capacity;                // A power of two, so that positions keep their slot when they wrap around
+    uint32_t mask;
+    TELEMETRY_RING_POLICY policy;
+    TaskHandle_t producer;          // Set while the producer waits for room
+    TaskHandle_t consumer;          // Set while the consumer waits for a sample
+    TELEMETRY_RING_STATISTICS statistics;
+    TELEMETRY_SAMPLE samples[];
+} TELEMETRY_RING;
+
+static uint32_t telemetry_ring_load(const uint32_t * position)
+{
+    return __atomic_load_n(position, __ATOMIC_ACQUIRE);
+}
+
+// Wake a task waiting on the ring. The waiter publishes itself before checking the ring again, the sequentially
+// consistent exchange guarantees that either the waiter sees the change or the notifier sees the waiter.
+static void telemetry_ring_notify(TaskHandle_t * waiter)
+{
+    TaskHandle_t task = __atomic_exchange_n(waiter, NULL, __ATOMIC_SEQ_CST);
+
+    if (task != NULL)
+    {
+        xTaskNotifyGive(task);
+    }
+}
+
+static void telemetry_ring_wait(TaskHandle_t * waiter, TickType_t timeout)
+{
+    ulTaskNotifyTake(pdTRUE, timeout);
+    __atomic_store_n(waiter, NULL, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Create an empty ring
+ *
+ * @param[in]  capacity    The number of samples the ring holds, rounded up to a power of two
+ * @param[in]  policy      What a push does when the ring is full
+ *
+ * @return
+ *          - Handle to the ring
+ *          - 0 if the ring could not be allocated
+ */
+telemetry_ring_handle_t telemetry_ring_create(size_t capacity, TELEMETRY_RING_POLICY policy)
+{
+    size_t slots = 1;
+
+    while (slots < capacity)
+    {
+        slots <<= 1;
+    }
+
+    TELEMETRY_RING * ring = calloc(1, sizeof(TELEMETRY_RING) + slots * sizeof(TELEMETRY_SAMPLE));
+
+    if (ring != NULL)
+    {
+        ring->capacity = slots;
+        ring->mask = slots - 1;
+        ring->policy = policy;
+    }
+
+    return (telemetry_ring_handle_t) ring;
+}
+
+/**
+ * @brief Dispose of the memory allocated for the ring. Neither task may use it anymore.
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ */
+void telemetry_ring_destroy(telemetry_ring_handle_t handle)
+{
+    free((TELEMETRY_RING *) handle);
+}
+
+/**
+ * @brief Set what a push does when the ring is full
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[in]  policy      The overflow policy
+ */
+void telemetry_ring_set_policy(telemetry_ring_handle_t handle, TELEMETRY_RING_POLICY policy)
+{
+    TELEMETRY_RING * ring = (TELEMETRY_RING *) handle;
+
+    if (ring != NULL)
+    {
+        __atomic_store_n(&ring->policy, policy, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Push a sample, from the producer task only
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[in]  sample      The sample, copied in the ring
+ * @param[in]  timeout     Number of ticks the block policy waits for room
+ *
+ * @return
+ *          - true if the sample was pushed
+ *          - false if the sample was discarded
+ */
+bool telemetry_ring_push(telemetry_ring_handle_t handle, const TELEMETRY_SAMPLE * sample, TickType_t timeout)
+{
+    TELEMETRY_RING * ring = (TELEMETRY_RING *) handle;
+
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    uint32_t head = ring->head;
+    uint32_t tail = telemetry_ring_load(&ring->tail);
+
+    if (head - tail >= ring->capacity)
+    {
+        switch (__atomic_load_n(&ring->policy, __ATOMIC_RELAXED))
+        {
+            case TELEMETRY_RING_DROP_OLDEST:
+                // The consumer may pop the oldest sample first, either way there is room once the swap is settled
+                if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    ring->statistics.dropped_oldest++;
+                }
+                break;
+
+            case TELEMETRY_RING_DROP_NEWEST:
+                ring->statistics.dropped_newest++;
+                return false;
+
+            default:
+            {
+                TickType_t started = xTaskGetTickCount();
+                ring->statistics.blocked++;
+
+                while (head - tail >= ring->capacity)
+                {
+                    TickType_t elapsed = xTaskGetTickCount() - started;
+
+                    if (elapsed >= timeout)
+                    {
+                        ring->statistics.timed_out++;
+                        return false;
+                    }
+
+                    __atomic_store_n(&ring->producer, xTaskGetCurrentTaskHandle(), __ATOMIC_SEQ_CST);
+                    tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+
+                    if (head - tail >= ring->capacity)
+                    {
+                        telemetry_ring_wait(&ring->producer, timeout - elapsed);
+                        tail = telemetry_ring_load(&ring->tail);
+                    }
+                    else
+                    {
+                        __atomic_store_n(&ring->producer, NULL, __ATOMIC_SEQ_CST);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    ring->samples[head & ring->mask] = *sample;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+    ring->statistics.written++;
+    tail = telemetry_ring_load(&ring->tail);
+
+    if (head + 1 - tail > ring->statistics.high_water_mark)
+    {
+        ring->statistics.high_water_mark = head + 1 - tail;
+    }
+
+    telemetry_ring_notify(&ring->consumer);
+
+    return true;
+}
+
+/**
+ * @brief Pop the oldest sample, from the consumer task only
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[out] sample      The sample
+ * @param[in]  timeout     Number of ticks to wait for a sample
+ *
+ * @return
+ *          - true if a sample was popped
+ *          - false if the ring stayed empty
+ */
+bool telemetry_ring_pop(telemetry_ring_handle_t handle, TELEMETRY_SAMPLE * sample, TickType_t timeout)
+{
+    TELEMETRY_RING * ring = (TELEMETRY_RING *) handle;
+
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    uint32_t tail = telemetry_ring_load(&ring->tail);
+
+    while (true)
+    {
+        if (telemetry_ring_load(&ring->head) == tail)
+        {
+            if (timeout == 0)
+            {
+                return false;
+            }
+
+            __atomic_store_n(&ring->consumer, xTaskGetCurrentTaskHandle(), __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+            {
+                telemetry_ring_wait(&ring->consumer, timeout);
+
+                // A single wait: the caller polls again on its own schedule
+                timeout = 0;
+            }
+            else
+            {
+                __atomic_store_n(&ring->consumer, NULL, __ATOMIC_SEQ_CST);
+            }
+
+            tail = telemetry_ring_load(&ring->tail);
+            continue;
+        }
+
+        // Copy first, the sample is ours only if the producer did not drop it meanwhile
+        *sample = ring->samples[tail & ring->mask];
+
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+    }
+
+    ring->statistics.read++;
+    telemetry_ring_notify(&ring->producer);
+
+    return true;
+}
+
+/**
+ * @brief Get the ring counters
+ *
+ * @param[in]  handle      The ring handle returned from telemetry_ring_create
+ * @param[out] statistics  The ring counters
+ */
+void telemetry_ring_get_statistics(telemetry_ring_handle_t handle, TELEMETRY_RING_STATISTICS * statistics)
+{
+    TELEMETRY_RING * ring = (TELEMETRY_RING *) handle;
+
+    if (ring != NULL)
+    {
+        *statistics = ring->statistics;
+    }
+}
@@ -0,0 +1,109 @@
+#include "telemetry-sample.h"
+#include "telemetry-ring.h"
+
+#include "freertos/task.h"
+
+#include "device-config.h"
+
+static void telemetry_sample_post(TELEMETRY_SAMPLE_WRITER * writer, const TELEMETRY_SAMPLE * sample)
+{
+    // Once the queue overflowed, the remaining samples of the cycle are dropped without waiting again
+    TickType_t timeout = (writer->dropped == 0) ? TELEMETRY_SAMPLE_SEND_TIMEOUT / portTICK_PERIOD_MS : 0;
+
+    if (telemetry_ring_push(writer->queue, sample, timeout))
+    {
+        writer->written++;
+    }
+    else
+    {
+        writer->dropped++;
+    }
+}
+
+/**
+ * @brief Start a sampling cycle. Every sample of the cycle shares its start time.
+ *
+ * @param[out] writer      The writer to initialize
+ * @param[in]  queue       The telemetry queue
+ */
+void telemetry_sample_writer_begin(TELEMETRY_SAMPLE_WRITER * writer, telemetry_ring_handle_t queue)
+{
+    writer->queue = queue;
+    writer->timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    writer->sensor_id = 0;
+    writer->written = 0;
+    writer->dropped = 0;
+    writer->capture = NULL;
+    writer->capture_length = 0;
+    writer->captured = 0;
+}
+
+/**
+ * @brief Start copying the written samples, until the capture is set again. The samples are still posted.
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ * @param[out] samples     Receives the samples written from now on, NULL to stop copying
+ * @param[in]  length      Number of samples the capture holds
+ */
+void telemetry_sample_writer_capture(TELEMETRY_SAMPLE_WRITER * writer, TELEMETRY_SAMPLE * samples, uint8_t length)
+{
+    writer->capture = samples;
+    writer->capture_length = (samples != NULL) ? length : 0;
+    writer->captured = 0;
+}
+
+/**
+ * @brief Post a sensor reading on the telemetry queue
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ * @param[in]  field_id    The field id returned from telemetry_schema_add_number
+ * @param[in]  value       The telemetry result's value
+ */
+void telemetry_sample_write(TELEMETRY_SAMPLE_WRITER * writer, telemetry_field_id_t field_id, double value)
+{
+    TELEMETRY_SAMPLE sample =
+    {
+        .timestamp = writer->timestamp,
+        .value = (float) value,
+        .sensor_id = writer->sensor_id,
+        .field_id = field_id,
+        .flags = 0
+    };
+
+    if (writer->capture != NULL)
+    {
+        if (writer->captured < writer->capture_length)
+        {
+            writer->capture[writer->captured] = sample;
+        }
+
+        writer->captured += (writer->captured < UINT8_MAX) ? 1 : 0;
+    }
+
+    telemetry_sample_post(writer, &sample);
+}
+
+/**
+ * @brief End the sampling cycle, posting the end of cycle marker on the telemetry queue
+ *
+ * @param[in]  writer      The writer of the current sampling cycle
+ *
+ * @return
+ *          - The number of the cycle's samples, including the marker, discarded because the queue was full.
+ *            Samples of older cycles discarded by the drop oldest policy are only counted by the queue.
+ */
+uint16_t telemetry_sample_writer_end(TELEMETRY_SAMPLE_WRITER * writer)
+{
+    TELEMETRY_SAMPLE marker =
+    {
+        .timestamp = writer->timestamp,
+        .value = 0,
+        .sensor_id = 0,
+        .field_id = TELEMETRY_FIELD_ID_INVALID,
+        .flags = TELEMETRY_SAMPLE_END_OF_CYCLE
+    };
+
+    telemetry_sample_post(writer, &marker);
+
+    return writer->dropped;
+}
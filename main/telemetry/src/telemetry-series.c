@@ -0,0 +1,558 @@
+#include "telemetry-series.h"
+#include "telemetry-cbor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "device-config.h"
+
+#define TELEMETRY_SERIES_HEADER_BITS    80      // 16 bits count, 32 bits timestamp, 32 bits value
+#define TELEMETRY_SERIES_NO_WINDOW      0xFF
+
+typedef struct TELEMETRY_SERIES_BATCH_TAG
+{
+    telemetry_schema_handle_t schema;
+    uint16_t cycle_count;
+    TELEMETRY_SERIES_ENCODER channels[TELEMETRY_MESSAGE_MAX_FIELDS];
+    uint8_t blocks[TELEMETRY_MESSAGE_MAX_FIELDS][TELEMETRY_SERIES_BLOCK_SIZE];
+    uint8_t output[TELEMETRY_SERIES_OUTPUT_SIZE];
+} TELEMETRY_SERIES_BATCH;
+
+static bool series_write_bits(TELEMETRY_SERIES_ENCODER * encoder, uint32_t value, uint8_t bits)
+{
+    if (encoder->bit_count + bits > encoder->size * 8)
+    {
+        return false;
+    }
+
+    for (int8_t bit = bits - 1; bit >= 0; --bit)
+    {
+        uint8_t * byte = &encoder->buffer[encoder->bit_count >> 3];
+        uint8_t mask = 0x80 >> (encoder->bit_count & 7);
+
+        if ((value >> bit) & 1)
+        {
+            *byte |= mask;
+        }
+        else
+        {
+            *byte &= ~mask;
+        }
+
+        encoder->bit_count++;
+    }
+
+    return true;
+}
+
+static bool series_read_bits(TELEMETRY_SERIES_DECODER * decoder, uint8_t bits, uint32_t * value)
+{
+    if (decoder->bit_index + bits > decoder->length * 8)
+    {
+        return false;
+    }
+
+    uint32_t result = 0;
+
+    for (uint8_t bit = 0; bit < bits; ++bit)
+    {
+        uint8_t byte = decoder->data[decoder->bit_index >> 3];
+        result = (result << 1) | ((byte >> (7 - (decoder->bit_index & 7))) & 1);
+        decoder->bit_index++;
+    }
+
+    *value = result;
+    return true;
+}
+
+static bool series_write_timestamp(TELEMETRY_SERIES_ENCODER * encoder, int32_t delta_of_delta)
+{
+    if (delta_of_delta == 0)
+    {
+        return series_write_bits(encoder, 0x0, 1);
+    }
+    else if (delta_of_delta >= -63 && delta_of_delta <= 64)
+    {
+        return series_write_bits(encoder, 0x2, 2) && series_write_bits(encoder, delta_of_delta + 63, 7);
+    }
+    else if (delta_of_delta >= -255 && delta_of_delta <= 256)
+    {
+        return series_write_bits(encoder, 0x6, 3) && series_write_bits(encoder, delta_of_delta + 255, 9);
+    }
+    else if (delta_of_delta >= -2047 && delta_of_delta <= 2048)
+    {
+        return series_write_bits(encoder, 0xE, 4) && series_write_bits(encoder, delta_of_delta + 2047, 12);
+    }
+
+    return series_write_bits(encoder, 0xF, 4) && series_write_bits(encoder, (uint32_t) delta_of_delta, 32);
+}
+
+static bool series_read_timestamp(TELEMETRY_SERIES_DECODER * decoder, int32_t * delta_of_delta)
+{
+    uint32_t prefix = 0;
+    uint32_t bit;
+    uint8_t ones = 0;
+
+    // Count the leading ones of the '0', '10', '110', '1110' or '1111' prefix
+    while (ones < 4)
+    {
+        if (!series_read_bits(decoder, 1, &bit))
+        {
+            return false;
+        }
+
+        if (bit == 0)
+        {
+            break;
+        }
+
+        ones++;
+    }
+
+    switch (ones)
+    {
+        case 0:
+            *delta_of_delta = 0;
+            return true;
+        case 1:
+            if (!series_read_bits(decoder, 7, &prefix)) return false;
+            *delta_of_delta = (int32_t) prefix - 63;
+            return true;
+        case 2:
+            if (!series_read_bits(decoder, 9, &prefix)) return false;
+            *delta_of_delta = (int32_t) prefix - 255;
+            return true;
+        case 3:
+            if (!series_read_bits(decoder, 12, &prefix)) return false;
+            *delta_of_delta = (int32_t) prefix - 2047;
+            return true;
+        default:
+            if (!series_read_bits(decoder, 32, &prefix)) return false;
+            *delta_of_delta = (int32_t) prefix;
+            return true;
+    }
+}
+
+static bool series_write_value(TELEMETRY_SERIES_ENCODER * encoder, uint32_t value)
+{
+    uint32_t xor = value ^ encoder->previous_value;
+
+    if (xor == 0)
+    {
+        return series_write_bits(encoder, 0x0, 1);
+    }
+
+    uint8_t leading = __builtin_clz(xor);
+    uint8_t trailing = __builtin_ctz(xor);
+
+    // Reuse the previous window when the meaningful bits fit in it
+    if (encoder->previous_leading != TELEMETRY_SERIES_NO_WINDOW &&
+        leading >= encoder->previous_leading && trailing >= encoder->previous_trailing)
+    {
+        uint8_t length = 32 - encoder->previous_leading - encoder->previous_trailing;
+        return series_write_bits(encoder, 0x2, 2) && series_write_bits(encoder, xor >> encoder->previous_trailing, length);
+    }
+
+    uint8_t length = 32 - leading - trailing;
+
+    encoder->previous_leading = leading;
+    encoder->previous_trailing = trailing;
+
+    return series_write_bits(encoder, 0x3, 2) &&
+        series_write_bits(encoder, leading, 5) &&
+        series_write_bits(encoder, length - 1, 5) &&
+        series_write_bits(encoder, xor >> trailing, length);
+}
+
+static bool series_read_value(TELEMETRY_SERIES_DECODER * decoder, uint32_t * value)
+{
+    uint32_t control;
+    uint32_t bits;
+
+    if (!series_read_bits(decoder, 1, &control))
+    {
+        return false;
+    }
+
+    if (control == 0)
+    {
+        *value = decoder->value;
+        return true;
+    }
+
+    if (!series_read_bits(decoder, 1, &control))
+    {
+        return false;
+    }
+
+    if (control == 1)
+    {
+        uint32_t leading;
+        uint32_t length;
+
+        if (!series_read_bits(decoder, 5, &leading) || !series_read_bits(decoder, 5, &length))
+        {
+            return false;
+        }
+
+        if (leading + length + 1 > 32)
+        {
+            return false;
+        }
+
+        decoder->leading = leading;
+        decoder->trailing = 32 - leading - (length + 1);
+    }
+    else if (decoder->leading == TELEMETRY_SERIES_NO_WINDOW)
+    {
+        return false;
+    }
+
+    if (!series_read_bits(decoder, 32 - decoder->leading - decoder->trailing, &bits))
+    {
+        return false;
+    }
+
+    *value = decoder->value ^ (bits << decoder->trailing);
+    return true;
+}
+
+/**
+ * @brief Initialize an encoder over an empty block
+ *
+ * @param[out] encoder     The encoder to initialize
+ * @param[in]  buffer      The block buffer
+ * @param[in]  size        The block buffer size in bytes
+ */
+void telemetry_series_encoder_init(TELEMETRY_SERIES_ENCODER * encoder, uint8_t * buffer, size_t size)
+{
+    encoder->buffer = buffer;
+    encoder->size = size;
+    encoder->bit_count = 0;
+    encoder->count = 0;
+    encoder->previous_timestamp = 0;
+    encoder->previous_delta = 0;
+    encoder->previous_value = 0;
+    encoder->previous_leading = TELEMETRY_SERIES_NO_WINDOW;
+    encoder->previous_trailing = 0;
+}
+
+/**
+ * @brief Append a sample to the block
+ *
+ * @param[in]  encoder     The block encoder
+ * @param[in]  timestamp   The sample's timestamp in ms, not older than the previous sample's
+ * @param[in]  value       The sample's value
+ *
+ * @return
+ *          - false if the block is full, the encoder is then left unchanged
+ */
+bool telemetry_series_append(TELEMETRY_SERIES_ENCODER * encoder, uint32_t timestamp, float value)
+{
+    TELEMETRY_SERIES_ENCODER saved = *encoder;
+    uint32_t bits;
+    bool written;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (encoder->count == UINT16_MAX)
+    {
+        return false;
+    }
+
+    if (encoder->count == 0)
+    {
+        written = series_write_bits(encoder, 0, 16) &&
+            series_write_bits(encoder, timestamp, 32) &&
+            series_write_bits(encoder, bits, 32);
+        encoder->previous_delta = 0;
+    }
+    else
+    {
+        int32_t delta = (int32_t)(timestamp - encoder->previous_timestamp);
+
+        written = series_write_timestamp(encoder, delta - encoder->previous_delta) &&
+            series_write_value(encoder, bits);
+        encoder->previous_delta = delta;
+    }
+
+    if (!written)
+    {
+        *encoder = saved;
+        return false;
+    }
+
+    encoder->previous_timestamp = timestamp;
+    encoder->previous_value = bits;
+    encoder->count++;
+
+    // Keep the count in the block header up to date
+    encoder->buffer[0] = encoder->count >> 8;
+    encoder->buffer[1] = encoder->count & 0xFF;
+
+    return true;
+}
+
+/**
+ * @brief Get the length of the encoded block
+ *
+ * @param[in]  encoder     The block encoder
+ *
+ * @return
+ *          - The block length in bytes
+ */
+size_t telemetry_series_get_length(const TELEMETRY_SERIES_ENCODER * encoder)
+{
+    return (encoder->bit_count + 7) / 8;
+}
+
+/**
+ * @brief Initialize a decoder over an encoded block
+ *
+ * @param[out] decoder     The decoder to initialize
+ * @param[in]  data        The encoded block
+ * @param[in]  length      The encoded block length in bytes
+ *
+ * @return
+ *          - false if the block is too short to hold its header
+ */
+bool telemetry_series_decoder_init(TELEMETRY_SERIES_DECODER * decoder, const uint8_t * data, size_t length)
+{
+    decoder->data = data;
+    decoder->length = length;
+    decoder->bit_index = 0;
+    decoder->count = 0;
+    decoder->index = 0;
+    decoder->timestamp = 0;
+    decoder->delta = 0;
+    decoder->value = 0;
+    decoder->leading = TELEMETRY_SERIES_NO_WINDOW;
+    decoder->trailing = 0;
+
+    if (length * 8 < TELEMETRY_SERIES_HEADER_BITS)
+    {
+        return false;
+    }
+
+    uint32_t count;
+    series_read_bits(decoder, 16, &count);
+    decoder->count = count;
+
+    return true;
+}
+
+/**
+ * @brief Read the next sample of the block
+ *
+ * @param[in]  decoder     The block decoder
+ * @param[out] timestamp   The sample's timestamp in ms
+ * @param[out] value       The sample's value
+ *
+ * @return
+ *          - false once every sample has been read or if the block is truncated
+ */
+bool telemetry_series_next(TELEMETRY_SERIES_DECODER * decoder, uint32_t * timestamp, float * value)
+{
+    if (decoder->index >= decoder->count)
+    {
+        return false;
+    }
+
+    if (decoder->index == 0)
+    {
+        if (!series_read_bits(decoder, 32, &decoder->timestamp) || !series_read_bits(decoder, 32, &decoder->value))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        int32_t delta_of_delta;
+        uint32_t bits;
+
+        if (!series_read_timestamp(decoder, &delta_of_delta) || !series_read_value(decoder, &bits))
+        {
+            return false;
+        }
+
+        decoder->delta += delta_of_delta;
+        decoder->timestamp += decoder->delta;
+        decoder->value = bits;
+    }
+
+    decoder->index++;
+
+    *timestamp = decoder->timestamp;
+    memcpy(value, &decoder->value, sizeof(*value));
+
+    return true;
+}
+
+/**
+ * @brief Create a batch of compressed time series, one block for each number field of the schema
+ *
+ * @param[in]  schema      The compiled telemetry schema in which the samples' fields are declared
+ *
+ * @return
+ *          - Handle to the batch
+ *          - 0 if the batch could not be allocated
+ */
+telemetry_series_batch_handle_t telemetry_series_batch_create(telemetry_schema_handle_t schema)
+{
+    TELEMETRY_SERIES_BATCH * batch = malloc(sizeof(TELEMETRY_SERIES_BATCH));
+
+    if (batch != NULL)
+    {
+        batch->schema = schema;
+        telemetry_series_batch_reset((telemetry_series_batch_handle_t) batch);
+    }
+
+    return (telemetry_series_batch_handle_t) batch;
+}
+
+/**
+ * @brief Dispose of the memory allocated for the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ */
+void telemetry_series_batch_destroy(telemetry_series_batch_handle_t handle)
+{
+    TELEMETRY_SERIES_BATCH * batch = (TELEMETRY_SERIES_BATCH *) handle;
+
+    if (batch != NULL)
+    {
+        free(batch);
+    }
+}
+
+/**
+ * @brief Append a sample from the telemetry queue to its field's block. End of cycle markers count the cycles.
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ * @param[in]  sample      The sample
+ *
+ * @return
+ *          - false if the field's block is full, the batch must be sent and reset before appending again
+ */
+bool telemetry_series_batch_append(telemetry_series_batch_handle_t handle, const TELEMETRY_SAMPLE * sample)
+{
+    TELEMETRY_SERIES_BATCH * batch = (TELEMETRY_SERIES_BATCH *) handle;
+
+    if (sample->flags & TELEMETRY_SAMPLE_END_OF_CYCLE)
+    {
+        batch->cycle_count++;
+    }
+
+    if (sample->field_id >= TELEMETRY_MESSAGE_MAX_FIELDS)
+    {
+        return true;
+    }
+
+    return telemetry_series_append(&batch->channels[sample->field_id], sample->timestamp, sample->value);
+}
+
+/**
+ * @brief Get the number of sampling cycles in the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ *
+ * @return
+ *          - The number of end of cycle markers appended since the batch was reset
+ */
+uint16_t telemetry_series_batch_get_cycle_count(telemetry_series_batch_handle_t handle)
+{
+    TELEMETRY_SERIES_BATCH * batch = (TELEMETRY_SERIES_BATCH *) handle;
+    return batch->cycle_count;
+}
+
+/**
+ * @brief Serialize the batch as a cbor map of the schema's constant strings and a "series" map of field
+ *        keys to encoded blocks
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ * @param[out] length      The length of the serialized batch in bytes
+ *
+ * @return
+ *          - The serialized batch, valid until the batch is reset
+ *          - NULL if the batch is empty or its output buffer is too small
+ */
+const uint8_t * telemetry_series_batch_serialize(telemetry_series_batch_handle_t handle, size_t * length)
+{
+    TELEMETRY_SERIES_BATCH * batch = (TELEMETRY_SERIES_BATCH *) handle;
+    size_t field_count = telemetry_schema_get_field_count(batch->schema);
+    size_t string_count = 0;
+    size_t series_count = 0;
+
+    *length = 0;
+
+    for (telemetry_field_id_t field_id = 0; field_id < field_count; ++field_id)
+    {
+        if (telemetry_schema_get_string(batch->schema, field_id) != NULL)
+        {
+            string_count++;
+        }
+        else if (batch->channels[field_id].count > 0)
+        {
+            series_count++;
+        }
+    }
+
+    if (series_count == 0)
+    {
+        return NULL;
+    }
+
+    CBOR_WRITER writer;
+    cbor_writer_init(&writer, batch->output, sizeof(batch->output));
+    cbor_write_map(&writer, string_count + 1);
+
+    for (telemetry_field_id_t field_id = 0; field_id < field_count; ++field_id)
+    {
+        const char * value = telemetry_schema_get_string(batch->schema, field_id);
+
+        if (value != NULL)
+        {
+            cbor_write_string(&writer, telemetry_schema_get_key(batch->schema, field_id));
+            cbor_write_string(&writer, value);
+        }
+    }
+
+    cbor_write_string(&writer, "series");
+    cbor_write_map(&writer, series_count);
+
+    for (telemetry_field_id_t field_id = 0; field_id < field_count; ++field_id)
+    {
+        TELEMETRY_SERIES_ENCODER * channel = &batch->channels[field_id];
+
+        if (telemetry_schema_get_string(batch->schema, field_id) == NULL && channel->count > 0)
+        {
+            cbor_write_string(&writer, telemetry_schema_get_key(batch->schema, field_id));
+            cbor_write_byte_string(&writer, channel->buffer, telemetry_series_get_length(channel));
+        }
+    }
+
+    if (writer.overflow)
+    {
+        return NULL;
+    }
+
+    *length = cbor_writer_get_length(&writer);
+    return batch->output;
+}
+
+/**
+ * @brief Empty every block of the batch
+ *
+ * @param[in]  handle      The batch handle returned from telemetry_series_batch_create
+ */
+void telemetry_series_batch_reset(telemetry_series_batch_handle_t handle)
+{
+    TELEMETRY_SERIES_BATCH * batch = (TELEMETRY_SERIES_BATCH *) handle;
+
+    batch->cycle_count = 0;
+
+    for (size_t index = 0; index < TELEMETRY_MESSAGE_MAX_FIELDS; ++index)
+    {
+        telemetry_series_encoder_init(&batch->channels[index], batch->blocks[index], TELEMETRY_SERIES_BLOCK_SIZE);
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Host benchmark of the json number formatter against printf's %1.17g, on the values the sensors send: readings
+ * with a few decimals, in the shortest output and at each fixed precision. One json line per path and precision.
+ */
+#include "telemetry-format.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCHMARK_ITERATIONS    1000000
+#define BENCHMARK_VALUES        1024
+
+static double _values[BENCHMARK_VALUES];
+
+static double benchmark_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Temperatures, humidities and voltages as the drivers compute them, from their raw readings
+ */
+static void benchmark_fill(void)
+{
+    for (int index = 0; index < BENCHMARK_VALUES; ++index)
+    {
+        switch (index % 4)
+        {
+            case 0:
+                _values[index] = (index % 800 - 400) / 10.0;            // DHT22 temperature, 0.1 degree
+                break;
+            case 1:
+                _values[index] = (index % 1000) / 10.0;                 // DHT22 humidity, 0.1%
+                break;
+            case 2:
+                _values[index] = (index % 4096 - 2048) * 0.0625;        // MCP9808 temperature, 1/16 degree
+                break;
+            default:
+                _values[index] = (index % 4096) / 4095.0 * 3.3;         // LDR voltage, 12 bits ADC
+                break;
+        }
+    }
+}
+
+static void benchmark_report(const char * path, int precision, double elapsed, uint64_t bytes)
+{
+    printf("{\"path\":\"%s\",\"precision\":%d,\"iterations\":%d,\"numbersPerSecond\":%.0f,\"nsPerNumber\":%.1f,"
+        "\"bytesPerNumber\":%.2f}\n", path, precision, BENCHMARK_ITERATIONS, BENCHMARK_ITERATIONS / elapsed,
+        elapsed * 1e9 / BENCHMARK_ITERATIONS, (double) bytes / BENCHMARK_ITERATIONS);
+}
+
+static void benchmark_format(int8_t precision)
+{
+    char buffer[32];
+    uint64_t bytes = 0;
+    double started = benchmark_now();
+
+    for (uint32_t iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+    {
+        bytes += telemetry_format_number(buffer, sizeof(buffer), _values[iteration % BENCHMARK_VALUES], precision);
+    }
+
+    benchmark_report("format", precision, benchmark_now() - started, bytes);
+}
+
+static void benchmark_printf(void)
+{
+    char buffer[32];
+    uint64_t bytes = 0;
+    double started = benchmark_now();
+
+    for (uint32_t iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+    {
+        bytes += snprintf(buffer, sizeof(buffer), "%1.17g", _values[iteration % BENCHMARK_VALUES]);
+    }
+
+    benchmark_report("printf", TELEMETRY_PRECISION_SHORTEST, benchmark_now() - started, bytes);
+}
+
+int main(void)
+{
+    benchmark_fill();
+    benchmark_printf();
+    benchmark_format(TELEMETRY_PRECISION_SHORTEST);
+
+    for (int8_t precision = 0; precision <= TELEMETRY_PRECISION_MAX; ++precision)
+    {
+        benchmark_format(precision);
+    }
+
+    return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * Host run of the device's sampling cycle on its real sensor drivers: DHT, MCP9808 and LDR over simulated GPIO,
+ * ADC, I2S and I2C peripherals. Each sensor set is created, declares its fields and is read once as the device
+ * does, then every cycle posts the sensors' results on the telemetry queue and the hub's side pops them into a
+ * message and serializes it. device.c is not built on the host: its own fields and the health fields it adds for
+ * each sensor are declared and written here the way it does. One json line per sensor set and wire format.
+ */
+#include "dht.h"
+#include "mcp9808.h"
+#include "ldr.h"
+#include "telemetry-ring.h"
+
+#include "device-config.h"
+
+#include "driver/gpio.h"
+#include "driver/adc.h"
+#include "driver/i2c.h"
+#include "driver/i2s.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "heap-count.h"
+
+#define BENCHMARK_ITERATIONS    100000
+#define BENCHMARK_MAX_SENSORS   (2 + MCP9808_MAX_SENSORS)
+#define BENCHMARK_RING_LENGTH   128     // Room for the largest set's cycle, the hub's side empties it every cycle
+#define BENCHMARK_DHT_PIN       18
+#define BENCHMARK_ALERT_PIN     19
+#define BENCHMARK_LDR_PIN       32
+#define BENCHMARK_LDR_READING   2000
+#define BENCHMARK_LDR_BLOCKS    16      // DMA blocks streamed before the stream set's reading
+#define BENCHMARK_AMBIENT       0x0193  // 25.1875C in the MCP9808's ambient temperature register
+#define BENCHMARK_REG_AMBIENT   0x05    // The MCP9808's registers checked and read by its driver, with their values
+#define BENCHMARK_REG_MANUF_ID  0x06
+#define BENCHMARK_REG_DEVICE_ID 0x07
+#define BENCHMARK_MANUF_ID      0x0054
+#define BENCHMARK_DEVICE_ID     0x0400
+#define BENCHMARK_RELEASED      1000000 // Simulated us at which the DHT's line is released
+
+typedef enum
+{
+    BENCHMARK_SET_DEFAULT,              // DHT11, LDR read once per cycle, one MCP9808 with its ALERT output wired
+    BENCHMARK_SET_STREAM,               // As the default set, with the LDR's stream mode
+    BENCHMARK_SET_SCAN                  // DHT11, LDR and the 8 MCP9808 found on the bus, keyed by address
+} BENCHMARK_SET;
+
+typedef struct BENCHMARK_SENSOR_TAG
+{
+    const SENSOR_INTERFACE_DESCRIPTION * interface;
+    SENSOR_HANDLE handle;
+    uint64_t state[(DEVICE_SENSOR_STATE_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    telemetry_field_id_t health_field;
+    telemetry_field_id_t failures_field;
+    telemetry_field_id_t age_field;
+} BENCHMARK_SENSOR;
+
+typedef struct BENCHMARK_DEVICE_TAG
+{
+    telemetry_schema_handle_t schema;
+    telemetry_field_id_t cycle_time_field;
+    telemetry_field_id_t read_time_field;
+    telemetry_field_id_t jitter_field;
+    telemetry_field_id_t overruns_field;
+    telemetry_field_id_t sample_time_field;
+    BENCHMARK_SENSOR sensors[BENCHMARK_MAX_SENSORS];
+    size_t count;
+} BENCHMARK_DEVICE;
+
+typedef struct BENCHMARK_RESULT_TAG
+{
+    bool completed;
+    size_t fields;                      // Fields of the device's schema
+    uint32_t messages_per_second;
+    uint32_t samples_per_message;       // Samples popped from the queue, the end of cycle marker included
+    uint32_t bytes_per_message;
+    uint32_t arena_bytes_per_message;
+} BENCHMARK_RESULT;
+
+static const char * const _set_names[] = { "default", "stream", "scan" };
+
+// Static as the device's heap block: the sensors' handles are their storage's address cast to 32 bits
+static BENCHMARK_DEVICE _device;
+
+// The device's own fields, as device_create declares them
+static void benchmark_device_create(BENCHMARK_DEVICE * device)
+{
+    device->count = 0;
+    device->schema = telemetry_schema_create();
+    telemetry_schema_add_string(device->schema, "deviceId", CONFIG_AZURE_DEVICE_ID);
+    device->cycle_time_field = telemetry_schema_add_number_range(device->schema, "cycleTime", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+    device->read_time_field = telemetry_schema_add_number_range(device->schema, "readTime", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+    device->jitter_field = telemetry_schema_add_number_range(device->schema, "jitter", 1, 0, DEVICE_MAX_SENSOR_INTERVAL);
+    device->overruns_field = telemetry_schema_add_number_range(device->schema, "overruns", 0, 0, UINT32_MAX);
+    device->sample_time_field = telemetry_schema_add_number(device->schema, "sampleTime", 0);
+}
+
+static void benchmark_device_destroy(BENCHMARK_DEVICE * device)
+{
+    for (size_t index = 0; index < device->count; ++index)
+    {
+        device->sensors[index].interface->sensor_destroy(device->sensors[index].handle);
+    }
+
+    telemetry_schema_destroy(device->schema);
+}
+
+// A sensor declares its fields, followed by the health fields of device_add_sensor, then it is initialized
+static bool benchmark_add_sensor(BENCHMARK_DEVICE * device, const char * name, const SENSOR_INTERFACE_DESCRIPTION * sensor_interface, void * options)
+{
+    BENCHMARK_SENSOR * sensor = &device->sensors[device->count];
+    char key[DEVICE_SENSOR_NAME_LENGTH + 8];
+
+    if (device->count == BENCHMARK_MAX_SENSORS)
+    {
+        return false;
+    }
+
+    sensor->interface = sensor_interface;
+    sensor->handle = sensor_interface->sensor_create(sensor->state, sizeof(sensor->state));
+
+    if (sensor->handle == 0)
+    {
+        return false;
+    }
+
+    device->count++;
+    sensor_interface->sensor_set_options(sensor->handle, options);
+
+    if (sensor_interface->sensor_declare_fields(sensor->handle, device->schema) != SENSOR_STATUS_OK)
+    {
+        return false;
+    }
+
+    snprintf(key, sizeof(key), "%sHealth", name);
+    sensor->health_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, DEVICE_SENSOR_HEALTH_HALF_OPEN);
+    snprintf(key, sizeof(key), "%sFailures", name);
+    sensor->failures_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, UINT16_MAX);
+    snprintf(key, sizeof(key), "%sAge", name);
+    sensor->age_field = telemetry_schema_add_number_range(device->schema, key, 0, 0, DEVICE_SENSOR_MAX_AGE);
+
+    return sensor->health_field != TELEMETRY_FIELD_ID_INVALID && sensor->failures_field != TELEMETRY_FIELD_ID_INVALID &&
+        sensor->age_field != TELEMETRY_FIELD_ID_INVALID &&
+        telemetry_schema_get_skeleton_size(device->schema) <= TELEMETRY_MESSAGE_ARENA_SIZE &&
+        sensor_interface->sensor_initialize(sensor->handle) == SENSOR_STATUS_OK;
+}
+
+static void benchmark_dht_edge(uint32_t time, bool level)
+{
+    host_timer_set(BENCHMARK_RELEASED + time);
+    host_gpio_set_level(BENCHMARK_DHT_PIN, level);
+}
+
+/**
+ * @brief Read the DHT: once its start signal ended, the sensor's transmission of 40% and 23C is replayed on the
+ *        line at the nominal timings, edge by edge, for its interrupt handler to capture
+ */
+static int benchmark_read_dht(BENCHMARK_SENSOR * sensor)
+{
+    static const uint8_t data[DHT_DATA_SIZE] = { 40, 0, 23, 0, 63 };
+    uint32_t conversion_time;
+    uint32_t time = 0;
+
+    host_timer_set(BENCHMARK_RELEASED);
+
+    if (sensor_begin_reading(sensor->interface, sensor->handle, &conversion_time) != SENSOR_STATUS_OK ||
+        sensor_poll_reading(sensor->interface, sensor->handle) != SENSOR_STATUS_PENDING)
+    {
+        return SENSOR_STATUS_FAILED;
+    }
+
+    benchmark_dht_edge(time, true);
+    benchmark_dht_edge(time += 30, false);
+    benchmark_dht_edge(time += 80, true);
+    time += 80;
+
+    for (uint8_t bit = 0; bit < DHT_DATA_SIZE * 8; ++bit)
+    {
+        benchmark_dht_edge(time, false);
+        benchmark_dht_edge(time += 50, true);
+        time += (data[bit / 8] & (0x80 >> (bit % 8))) ? 70 : 27;
+    }
+
+    benchmark_dht_edge(time, false);
+    benchmark_dht_edge(time += 50, true);
+
+    // The transmission's time elapsed
+    host_timer_set(BENCHMARK_RELEASED + 6000);
+    int status = sensor_poll_reading(sensor->interface, sensor->handle);
+    host_timer_set(-1);
+
+    return (status == SENSOR_STATUS_OK) ? sensor_fetch_reading(sensor->interface, sensor->handle) : status;
+}
+
+static bool benchmark_read_sensors(BENCHMARK_DEVICE * device)
+{
+    bool read = true;
+
+    for (size_t index = 0; index < device->count; ++index)
+    {
+        BENCHMARK_SENSOR * sensor = &device->sensors[index];
+        int status = (sensor->interface == dht_get_inteface()) ? benchmark_read_dht(sensor) :
+            sensor_read_blocking(sensor->interface, sensor->handle, 1000);
+
+        read = read && (status == SENSOR_STATUS_OK);
+    }
+
+    return read;
+}
+
+static bool benchmark_add_sensors(BENCHMARK_DEVICE * device, BENCHMARK_SET set, i2c_bus_handle_t bus)
+{
+    DHT_SENSOR_OPTIONS dht_options =
+    {
+        .type = DHT_11,
+        .pin = BENCHMARK_DHT_PIN,
+        .capture = DHT_CAPTURE_INTERRUPT
+    };
+
+    MCP9808_SENSOR_OPTIONS mcp9808_options =
+    {
+        .i2c_bus = bus,
+        .i2c_address = MCP9808_FIRST_ADDRESS,
+        .alert_pin = BENCHMARK_ALERT_PIN,
+        .resolution = MCP9808_DEFAULT_RESOLUTION,
+        .mode = MCP9808_DEFAULT_MODE
+    };
+
+    LDR_SENSOR_OPTIONS ldr_options =
+    {
+        .pin = BENCHMARK_LDR_PIN,
+        .mode = (set == BENCHMARK_SET_STREAM) ? LDR_MODE_STREAM : LDR_MODE_SINGLE,
+        .sample_rate = LDR_SAMPLE_RATE
+    };
+
+    if (!benchmark_add_sensor(device, "dht", dht_get_inteface(), &dht_options) ||
+        !benchmark_add_sensor(device, "ldr", ldr_get_inteface(), &ldr_options))
+    {
+        return false;
+    }
+
+    if (set != BENCHMARK_SET_SCAN)
+    {
+        return benchmark_add_sensor(device, "mcp9808", mcp9808_get_inteface(), &mcp9808_options);
+    }
+
+    uint8_t addresses[MCP9808_MAX_SENSORS];
+    size_t count = mcp9808_scan(bus, addresses, MCP9808_MAX_SENSORS);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        char name[DEVICE_SENSOR_NAME_LENGTH];
+        MCP9808_SENSOR_OPTIONS options = mcp9808_options;
+        options.i2c_address = addresses[index];
+        options.alert_pin = -1;
+        options.address_keys = true;
+
+        snprintf(name, sizeof(name), "mcp9808_%02x", addresses[index]);
+
+        if (!benchmark_add_sensor(device, name, mcp9808_get_inteface(), &options))
+        {
+            return false;
+        }
+    }
+
+    return count == MCP9808_MAX_SENSORS;
+}
+
+// A sampling cycle as the device posts it, every sensor read: each sensor's results then its age and health
+static void benchmark_post_cycle(BENCHMARK_DEVICE * device, telemetry_ring_handle_t queue)
+{
+    TELEMETRY_SAMPLE_WRITER writer;
+    TELEMETRY_SAMPLE cache[DEVICE_SENSOR_CACHE_SIZE];
+
+    telemetry_sample_writer_begin(&writer, queue);
+
+    for (size_t index = 0; index < device->count; ++index)
+    {
+        BENCHMARK_SENSOR * sensor = &device->sensors[index];
+        writer.sensor_id = index;
+
+        telemetry_sample_writer_capture(&writer, cache, DEVICE_SENSOR_CACHE_SIZE);
+        sensor->interface->sensor_post_results(sensor->handle, &writer);
+        telemetry_sample_writer_capture(&writer, NULL, 0);
+
+        telemetry_sample_write(&writer, sensor->age_field, 0);
+        telemetry_sample_write(&writer, sensor->health_field, DEVICE_SENSOR_HEALTH_CLOSED);
+        telemetry_sample_write(&writer, sensor->failures_field, 0);
+    }
+
+    writer.sensor_id = 0xFF;
+    telemetry_sample_write(&writer, device->cycle_time_field, 12.5);
+    telemetry_sample_write(&writer, device->read_time_field, 31.2);
+    telemetry_sample_write(&writer, device->jitter_field, 0.4);
+    telemetry_sample_write(&writer, device->overruns_field, 0);
+    telemetry_sample_writer_end(&writer);
+}
+
+// The hub's side: the cycle's samples are popped into a message, which is serialized then destroyed
+static bool benchmark_send_cycle(BENCHMARK_DEVICE * device, telemetry_ring_handle_t queue, TELEMETRY_ENCODING encoding, size_t * length, uint32_t * samples, BENCHMARK_RESULT * result)
+{
+    telemetry_message_handle_t message = telemetry_message_create_from_schema(device->schema);
+    TELEMETRY_SAMPLE sample = { .flags = 0 };
+
+    if (message == 0)
+    {
+        return false;
+    }
+
+    while (!(sample.flags & TELEMETRY_SAMPLE_END_OF_CYCLE) && telemetry_ring_pop(queue, &sample, 0))
+    {
+        if (*samples == 0)
+        {
+            telemetry_message_set_number(message, device->sample_time_field, sample.timestamp);
+        }
+
+        if (sample.field_id != TELEMETRY_FIELD_ID_INVALID)
+        {
+            telemetry_message_set_number(message, sample.field_id, sample.value);
+        }
+
+        ++*samples;
+    }
+
+    bool serialized = (sample.flags & TELEMETRY_SAMPLE_END_OF_CYCLE) &&
+        telemetry_message_serialize(message, encoding, length) != NULL;
+
+    result->arena_bytes_per_message = telemetry_message_get_bytes_used(message);
+    telemetry_message_destroy(message);
+
+    return serialized;
+}
+
+static bool benchmark_run(BENCHMARK_DEVICE * device, TELEMETRY_ENCODING encoding, uint32_t iterations, BENCHMARK_RESULT * result, HEAP_COUNT * heap)
+{
+    telemetry_ring_handle_t queue = telemetry_ring_create(BENCHMARK_RING_LENGTH, TELEMETRY_RING_DROP_NEWEST);
+    uint64_t bytes = 0;
+    uint64_t samples = 0;
+    uint32_t iteration;
+
+    heap_count_reset();
+    int64_t started = esp_timer_get_time();
+
+    for (iteration = 0; iteration < iterations; ++iteration)
+    {
+        size_t length = 0;
+        uint32_t count = 0;
+
+        benchmark_post_cycle(device, queue);
+
+        if (!benchmark_send_cycle(device, queue, encoding, &length, &count, result))
+        {
+            break;
+        }
+
+        bytes += length;
+        samples += count;
+    }
+
+    int64_t elapsed = esp_timer_get_time() - started;
+    heap_count_get(heap);
+    telemetry_ring_destroy(queue);
+
+    result->completed = (iteration == iterations) && iterations > 0;
+
+    if (result->completed)
+    {
+        result->messages_per_second = (elapsed > 0) ? (uint32_t) ((int64_t) iterations * 1000000 / elapsed) : UINT32_MAX;
+        result->samples_per_message = samples / iterations;
+        result->bytes_per_message = bytes / iterations;
+    }
+
+    return result->completed;
+}
+
+int main(int argc, char ** argv)
+{
+    static const TELEMETRY_ENCODING encodings[] = { TELEMETRY_ENCODING_JSON, TELEMETRY_ENCODING_CBOR };
+    uint32_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : BENCHMARK_ITERATIONS;
+    int failures = 0;
+
+    i2c_config_t config =
+    {
+        .mode = I2C_MODE_MASTER,
+        .master.clk_speed = I2C_FREQ_HZ
+    };
+
+    // The MCP9808 at every address of the bus
+    for (uint8_t address = MCP9808_FIRST_ADDRESS; address < MCP9808_FIRST_ADDRESS + MCP9808_MAX_SENSORS; ++address)
+    {
+        host_i2c_set_register(address, BENCHMARK_REG_MANUF_ID, BENCHMARK_MANUF_ID);
+        host_i2c_set_register(address, BENCHMARK_REG_DEVICE_ID, BENCHMARK_DEVICE_ID);
+        host_i2c_set_register(address, BENCHMARK_REG_AMBIENT, BENCHMARK_AMBIENT);
+    }
+
+    // The open drain ALERT output is pulled up while the temperature is in its window
+    host_gpio_set_level(BENCHMARK_ALERT_PIN, true);
+    host_adc_set_reading(BENCHMARK_LDR_READING);
+
+    for (BENCHMARK_SET set = BENCHMARK_SET_DEFAULT; set <= BENCHMARK_SET_SCAN; ++set)
+    {
+        i2c_bus_handle_t bus = i2c_bus_create(I2C_PORT, &config);
+        benchmark_device_create(&_device);
+        bool ready = benchmark_add_sensors(&_device, set, bus) && telemetry_schema_compile(_device.schema);
+
+        if (ready && set == BENCHMARK_SET_STREAM)
+        {
+            host_i2s_add_blocks(BENCHMARK_LDR_BLOCKS);
+            host_i2s_wait_read();
+        }
+
+        ready = ready && benchmark_read_sensors(&_device);
+
+        for (size_t encoding = 0; encoding < sizeof(encodings) / sizeof(encodings[0]); ++encoding)
+        {
+            BENCHMARK_RESULT result = { .fields = telemetry_schema_get_field_count(_device.schema) };
+            HEAP_COUNT heap = { 0 };
+            bool completed = ready && benchmark_run(&_device, encodings[encoding], iterations, &result, &heap);
+
+            failures += completed ? 0 : 1;
+
+            printf("{\"sensors\":\"%s\",\"fields\":%u,\"encoding\":\"%s\",\"iterations\":%u,\"completed\":%s,\"messagesPerSecond\":%u,"
+                "\"samplesPerMessage\":%u,\"bytesPerMessage\":%u,\"arenaBytesPerMessage\":%u,\"mallocCallsPerMessage\":%.3f}\n",
+                _set_names[set], (unsigned int) result.fields, telemetry_encoding_get_name(encodings[encoding]),
+                (unsigned int) iterations, completed ? "true" : "false", (unsigned int) result.messages_per_second,
+                (unsigned int) result.samples_per_message, (unsigned int) result.bytes_per_message,
+                (unsigned int) result.arena_bytes_per_message, completed ? (double) heap.allocations / iterations : 0);
+        }
+
+        benchmark_device_destroy(&_device);
+        i2c_bus_destroy(bus);
+    }
+
+    return (failures > 0) ? 1 : 0;
+}
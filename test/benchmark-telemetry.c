@@ -0,0 +1,57 @@
+/*
+ * Host run of the telemetry serialization benchmark of the device, with the heap calls of the host. One json
+ * line per sensor set and wire format, to be compared across releases.
+ */
+#include "telemetry-benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "heap-count.h"
+
+#define BENCHMARK_ITERATIONS    100000
+
+// Heap use of a run, its schema included
+static bool benchmark_run(uint8_t field_count, TELEMETRY_ENCODING encoding, uint32_t iterations, TELEMETRY_BENCHMARK_RESULT * result, HEAP_COUNT * heap)
+{
+    heap_count_reset();
+    bool completed = telemetry_benchmark_run(field_count, encoding, iterations, result);
+    heap_count_get(heap);
+
+    return completed;
+}
+
+int main(int argc, char ** argv)
+{
+    static const uint8_t field_counts[] = TELEMETRY_BENCHMARK_FIELD_COUNTS;
+    static const TELEMETRY_ENCODING encodings[] = { TELEMETRY_ENCODING_JSON, TELEMETRY_ENCODING_CBOR };
+    uint32_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : BENCHMARK_ITERATIONS;
+    int failures = 0;
+
+    for (size_t field = 0; field < sizeof(field_counts); ++field)
+    {
+        for (size_t encoding = 0; encoding < sizeof(encodings) / sizeof(encodings[0]); ++encoding)
+        {
+            TELEMETRY_BENCHMARK_RESULT baseline;
+            TELEMETRY_BENCHMARK_RESULT result;
+            HEAP_COUNT baseline_heap;
+            HEAP_COUNT heap;
+
+            // A run without message gives the heap use of the schema alone
+            bool completed = benchmark_run(field_counts[field], encodings[encoding], 0, &baseline, &baseline_heap) &&
+                benchmark_run(field_counts[field], encodings[encoding], iterations, &result, &heap);
+
+            failures += completed ? 0 : 1;
+
+            printf("{\"fields\":%u,\"encoding\":\"%s\",\"iterations\":%u,\"completed\":%s,\"messagesPerSecond\":%u,"
+                "\"bytesPerMessage\":%u,\"arenaBytesPerMessage\":%u,\"mallocCallsPerMessage\":%.3f,\"peakHeapBytesPerMessage\":%d}\n",
+                field_counts[field], telemetry_encoding_get_name(encodings[encoding]), (unsigned int) iterations,
+                completed ? "true" : "false", (unsigned int) result.messages_per_second,
+                (unsigned int) result.bytes_per_message, (unsigned int) result.arena_bytes_per_message,
+                completed ? (double) (heap.allocations - baseline_heap.allocations) / iterations : 0,
+                completed ? (int) (heap.peak_bytes - baseline_heap.peak_bytes) : 0);
+        }
+    }
+
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Host benchmark of the json serialization of the device's message: the precompiled skeleton patched in place
+ * against the message built key by key. One json line per path.
+ */
+#include "telemetry-data.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "heap-count.h"
+
+#define BENCHMARK_ITERATIONS    200000
+
+static const char * _keys[] = { "temperature", "humidity", "mcp9808_temperature", "ldrVoltage", "ldrResistance" };
+static const int8_t _precisions[] = { 0, 0, 4, 3, 3 };
+static const double _maximums[] = { 80, 100, 256, 3.3, 10 };    // The ranges the sensors declare
+static const double _minimums[] = { -40, 0, -256, 0, 0 };
+
+#define FIELD_COUNT (sizeof(_keys) / sizeof(_keys[0]))
+
+static double benchmark_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double benchmark_value(uint32_t iteration, size_t index)
+{
+    return 20.0 + (iteration % 64) * 0.0625 + index;
+}
+
+static void benchmark_report(const char * path, double elapsed, uint64_t bytes)
+{
+    HEAP_COUNT heap;
+    heap_count_get(&heap);
+
+    printf("{\"path\":\"%s\",\"iterations\":%d,\"messagesPerSecond\":%.0f,\"nsPerMessage\":%.0f,\"bytesPerMessage\":%d,"
+        "\"mallocCalls\":%u}\n", path, BENCHMARK_ITERATIONS, BENCHMARK_ITERATIONS / elapsed,
+        elapsed * 1e9 / BENCHMARK_ITERATIONS, (int) (bytes / BENCHMARK_ITERATIONS), (unsigned int) heap.allocations);
+}
+
+static int benchmark_template(void)
+{
+    telemetry_schema_handle_t schema = telemetry_schema_create();
+    telemetry_field_id_t fields[FIELD_COUNT];
+
+    telemetry_schema_add_string(schema, "deviceId", "MyEsp32Device");
+
+    for (size_t index = 0; index < FIELD_COUNT; ++index)
+    {
+        fields[index] = telemetry_schema_add_number_range(schema, _keys[index], _precisions[index], _minimums[index], _maximums[index]);
+    }
+
+    if (!telemetry_schema_compile(schema))
+    {
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    heap_count_reset();
+    double started = benchmark_now();
+
+    for (uint32_t iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+    {
+        size_t length;
+        telemetry_message_handle_t message = telemetry_message_create_from_schema(schema);
+
+        for (size_t index = 0; index < FIELD_COUNT; ++index)
+        {
+            telemetry_message_set_number(message, fields[index], benchmark_value(iteration, index));
+        }
+
+        if (telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length) == NULL)
+        {
+            return 1;
+        }
+
+        bytes += length;
+        telemetry_message_destroy(message);
+    }
+
+    benchmark_report("template", benchmark_now() - started, bytes);
+    telemetry_schema_destroy(schema);
+
+    return 0;
+}
+
+static int benchmark_keyed(void)
+{
+    uint64_t bytes = 0;
+    heap_count_reset();
+    double started = benchmark_now();
+
+    for (uint32_t iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+    {
+        size_t length;
+        telemetry_message_handle_t message = telemetry_message_create_new();
+
+        telemetry_message_add_string(message, "deviceId", "MyEsp32Device");
+
+        for (size_t index = 0; index < FIELD_COUNT; ++index)
+        {
+            telemetry_message_add_number(message, _keys[index], benchmark_value(iteration, index));
+        }
+
+        if (telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length) == NULL)
+        {
+            return 1;
+        }
+
+        bytes += length;
+        telemetry_message_destroy(message);
+    }
+
+    benchmark_report("keyed", benchmark_now() - started, bytes);
+
+    return 0;
+}
+
+int main(void)
+{
+    return benchmark_template() || benchmark_keyed();
+}
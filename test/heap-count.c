@@ -0,0 +1,111 @@
+#include "heap-count.h"
+
+#include <malloc.h>
+#include <pthread.h>
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * pointer, size_t size);
+void __real_free(void * pointer);
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static HEAP_COUNT _count;
+
+static void heap_count_update(void * freed, size_t freed_size, void * allocated)
+{
+    pthread_mutex_lock(&_lock);
+
+    if (freed != NULL)
+    {
+        _count.frees++;
+        _count.blocks--;
+        _count.bytes -= freed_size;
+    }
+
+    if (allocated != NULL)
+    {
+        _count.blocks++;
+        _count.bytes += malloc_usable_size(allocated);
+
+        if (_count.bytes > _count.peak_bytes)
+        {
+            _count.peak_bytes = _count.bytes;
+        }
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+static void heap_count_call(void)
+{
+    pthread_mutex_lock(&_lock);
+    _count.allocations++;
+    pthread_mutex_unlock(&_lock);
+}
+
+void * __wrap_malloc(size_t size)
+{
+    void * pointer = __real_malloc(size);
+
+    heap_count_call();
+    heap_count_update(NULL, 0, pointer);
+
+    return pointer;
+}
+
+void * __wrap_calloc(size_t count, size_t size)
+{
+    void * pointer = __real_calloc(count, size);
+
+    heap_count_call();
+    heap_count_update(NULL, 0, pointer);
+
+    return pointer;
+}
+
+void * __wrap_realloc(void * pointer, size_t size)
+{
+    size_t previous_size = (pointer != NULL) ? malloc_usable_size(pointer) : 0;
+    void * reallocated = __real_realloc(pointer, size);
+
+    heap_count_call();
+
+    if (reallocated != NULL || size == 0)
+    {
+        heap_count_update(pointer, previous_size, reallocated);
+    }
+
+    return reallocated;
+}
+
+void __wrap_free(void * pointer)
+{
+    if (pointer != NULL)
+    {
+        heap_count_update(pointer, malloc_usable_size(pointer), NULL);
+    }
+
+    __real_free(pointer);
+}
+
+/**
+ * @brief Zero the counters
+ */
+void heap_count_reset(void)
+{
+    pthread_mutex_lock(&_lock);
+    _count = (HEAP_COUNT) { 0 };
+    pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * @brief Get the counters
+ *
+ * @param[out] count       The counters
+ */
+void heap_count_get(HEAP_COUNT * count)
+{
+    pthread_mutex_lock(&_lock);
+    *count = _count;
+    pthread_mutex_unlock(&_lock);
+}
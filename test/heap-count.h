@@ -0,0 +1,44 @@
+#ifndef __HEAP_COUNT_H__
+#define __HEAP_COUNT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Heap counters of the host tests. The test programs are linked with --wrap for malloc, calloc, realloc and free
+ * so that every heap call of the modules under test goes through the counters.
+ */
+
+/**
+ * @brief   Heap calls and use since the last heap_count_reset
+ */
+typedef struct HEAP_COUNT_TAG
+{
+    uint32_t allocations;           // malloc, calloc and realloc calls
+    uint32_t frees;                 // free calls of a block
+    int64_t blocks;                 // Blocks allocated less blocks freed
+    int64_t bytes;                  // Bytes allocated less bytes freed
+    int64_t peak_bytes;             // Highest bytes
+} HEAP_COUNT;
+
+/**
+ * @brief Zero the counters
+ */
+void heap_count_reset(void);
+
+/**
+ * @brief Get the counters
+ *
+ * @param[out] count       The counters
+ */
+void heap_count_get(HEAP_COUNT * count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * The ADC1 driver, its conversions return the level set with host_adc_set_reading
+ */
+#ifndef __HOST_ADC_H__
+#define __HOST_ADC_H__
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ADC1_CHANNEL_0,
+    ADC1_CHANNEL_1,
+    ADC1_CHANNEL_2,
+    ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4,
+    ADC1_CHANNEL_5,
+    ADC1_CHANNEL_6,
+    ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX
+} adc1_channel_t;
+
+typedef enum
+{
+    ADC_WIDTH_12Bit = 3
+} adc_bits_width_t;
+
+typedef enum
+{
+    ADC_ATTEN_11db = 3
+} adc_atten_t;
+
+typedef enum
+{
+    ADC_UNIT_1 = 1
+} adc_unit_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int adc1_get_voltage(adc1_channel_t channel);
+
+/**
+ * @brief Set the 12 bits reading of the single conversions and of the I2S stream
+ */
+void host_adc_set_reading(int reading);
+
+#endif
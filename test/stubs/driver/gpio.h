@@ -0,0 +1,55 @@
+/*
+ * The GPIO driver on the simulated lines of host-drivers.c: a level set with host_gpio_set_level runs the pin's
+ * interrupt handler while its interrupt is enabled.
+ */
+#ifndef __HOST_GPIO_H__
+#define __HOST_GPIO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#define GPIO_PIN_COUNT      40
+
+typedef int gpio_num_t;
+
+typedef enum
+{
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT
+} gpio_mode_t;
+
+typedef enum
+{
+    GPIO_PULLUP_ONLY,
+    GPIO_FLOATING
+} gpio_pull_mode_t;
+
+typedef enum
+{
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE
+} gpio_int_type_t;
+
+typedef void (*gpio_isr_t) (void * arg);
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void * arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+esp_err_t gpio_intr_enable(gpio_num_t pin);
+esp_err_t gpio_intr_disable(gpio_num_t pin);
+
+/**
+ * @brief Drive a simulated input line, as the sensor wired to it does
+ */
+void host_gpio_set_level(gpio_num_t pin, bool level);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * The I2C master driver on the simulated devices of host-i2c.c: a command link is recorded, then run against the
+ * 16 bits registers set with host_i2c_set_register. An address without register does not acknowledge.
+ */
+#ifndef __HOST_I2C_H__
+#define __HOST_I2C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0           0
+#define I2C_NUM_1           1
+#define I2C_NUM_MAX         2
+
+#define I2C_MASTER_WRITE    0
+#define I2C_MASTER_READ     1
+
+typedef enum
+{
+    I2C_MODE_MASTER
+} i2c_mode_t;
+
+typedef enum
+{
+    I2C_MASTER_ACK,
+    I2C_MASTER_NACK,
+    I2C_MASTER_LAST_NACK
+} i2c_ack_type_t;
+
+typedef struct
+{
+    i2c_mode_t mode;
+    int sda_io_num;
+    int sda_pullup_en;
+    int scl_io_num;
+    int scl_pullup_en;
+    struct
+    {
+        uint32_t clk_speed;
+    } master;
+} i2c_config_t;
+
+typedef void * i2c_cmd_handle_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t * config);
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buffer, size_t tx_buffer, int flags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_check);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t * data, size_t length, bool ack_check);
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t * data, i2c_ack_type_t ack);
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t * data, size_t length, i2c_ack_type_t ack);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t timeout);
+
+/**
+ * @brief Set a 16 bits register of a simulated device, which then acknowledges its address
+ */
+void host_i2c_set_register(uint8_t address, uint8_t reg, uint16_t value);
+
+#endif
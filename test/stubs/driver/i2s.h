@@ -0,0 +1,71 @@
+/*
+ * The I2S driver streaming ADC1, its DMA blocks hold the reading set with host_adc_set_reading. A read returns
+ * a block as long as the stream has blocks left, see host_i2s_add_blocks, then waits.
+ */
+#ifndef __HOST_I2S_H__
+#define __HOST_I2S_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/adc.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum
+{
+    I2S_NUM_0
+} i2s_port_t;
+
+typedef enum
+{
+    I2S_MODE_MASTER = 1,
+    I2S_MODE_RX = 8,
+    I2S_MODE_ADC_BUILT_IN = 32
+} i2s_mode_t;
+
+typedef enum
+{
+    I2S_BITS_PER_SAMPLE_16BIT = 16
+} i2s_bits_per_sample_t;
+
+typedef enum
+{
+    I2S_CHANNEL_FMT_ONLY_RIGHT = 3
+} i2s_channel_fmt_t;
+
+typedef enum
+{
+    I2S_COMM_FORMAT_I2S_MSB = 2
+} i2s_comm_format_t;
+
+typedef struct
+{
+    i2s_mode_t mode;
+    int sample_rate;
+    i2s_bits_per_sample_t bits_per_sample;
+    i2s_channel_fmt_t channel_format;
+    i2s_comm_format_t communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+} i2s_config_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t * config, int queue_size, void * queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t port);
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel);
+esp_err_t i2s_adc_enable(i2s_port_t port);
+esp_err_t i2s_adc_disable(i2s_port_t port);
+int i2s_read_bytes(i2s_port_t port, char * buffer, size_t size, TickType_t timeout);
+
+/**
+ * @brief Queue DMA blocks on the stream
+ */
+void host_i2s_add_blocks(uint32_t count);
+
+/**
+ * @brief Wait until the stream's reader processed every queued block and waits for the next one
+ */
+void host_i2s_wait_read(void);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_ESP_ATTR_H__
+#define __HOST_ESP_ATTR_H__
+
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_ESP_INTR_ALLOC_H__
+#define __HOST_ESP_INTR_ALLOC_H__
+
+#define ESP_INTR_FLAG_IRAM          (1 << 10)
+
+#endif
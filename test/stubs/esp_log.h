@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...)  fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  ((void) (tag))
+#define ESP_LOGD(tag, format, ...)  ((void) (tag))
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+/**
+ * @brief Stop the timer at a simulated time in us, negative to follow the monotonic clock again
+ */
+void host_timer_set(int64_t time);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * The FreeRTOS types and macros used by the modules built on the host. Tasks are threads, see host-freertos.c.
+ */
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef void * TaskHandle_t;
+typedef void * QueueHandle_t;
+typedef void * SemaphoreHandle_t;
+typedef void * EventGroupHandle_t;
+
+typedef struct
+{
+    volatile bool locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { false }
+#define portMAX_DELAY                   ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS              1
+#define portTICK_RATE_MS                portTICK_PERIOD_MS
+#define configTICK_RATE_HZ              1000
+#define pdMS_TO_TICKS(ms)               ((TickType_t) (ms))
+#define pdFALSE                         0
+#define pdTRUE                          1
+#define pdPASS                          pdTRUE
+#define pdFAIL                          pdFALSE
+
+#define BIT0                            0x00000001
+#define BIT1                            0x00000002
+#define BIT2                            0x00000004
+#define BIT3                            0x00000008
+
+#define IRAM_ATTR
+#define PRIVILEGED_DATA
+
+#define vPortCPUInitializeMutex(mux)    ((mux)->locked = false)
+
+#define taskENTER_CRITICAL(mux)         do { while (__atomic_test_and_set(&(mux)->locked, __ATOMIC_ACQUIRE)); } while (0)
+#define taskEXIT_CRITICAL(mux)          __atomic_clear(&(mux)->locked, __ATOMIC_RELEASE)
+#define portENTER_CRITICAL(mux)         taskENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)          taskEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux)     taskENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      taskEXIT_CRITICAL(mux)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_EVENT_GROUPS_H__
+#define __HOST_EVENT_GROUPS_H__
+
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_QUEUE_H__
+#define __HOST_QUEUE_H__
+
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __HOST_TASK_H__
+#define __HOST_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+BaseType_t xTaskCreate(void (*function) (void *), const char * name, uint32_t stack_size, void * arg,
+    UBaseType_t priority, TaskHandle_t * task);
+void vTaskDelete(TaskHandle_t task);
+
+// From the ROM functions, a busy wait on the device
+void ets_delay_us(uint32_t us);
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * The GPIO, ADC1 and I2S drivers used by the sensor drivers built on the host, on simulated peripherals: GPIO
+ * input lines driven by the host, ADC conversions of a set reading, and an I2S stream of DMA blocks queued by
+ * the host.
+ */
+#include "driver/gpio.h"
+#include "driver/adc.h"
+#include "driver/i2s.h"
+#include "soc/gpio_struct.h"
+
+#include <pthread.h>
+#include <string.h>
+
+typedef struct HOST_GPIO_PIN_TAG
+{
+    gpio_isr_t handler;
+    void * arg;
+    bool enabled;
+} HOST_GPIO_PIN;
+
+gpio_dev_t GPIO;
+
+static HOST_GPIO_PIN _pins[GPIO_PIN_COUNT];
+static int _reading;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint32_t queued;                // Blocks added and not read yet
+    bool waiting;                   // The reader is back for the next block, the previous ones are processed
+    adc1_channel_t channel;
+} _stream = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false, ADC1_CHANNEL_0 };
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    return (pin >= 0 && pin < GPIO_PIN_COUNT) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull)
+{
+    return (pin >= 0 && pin < GPIO_PIN_COUNT) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    return (pin >= 0 && pin < GPIO_PIN_COUNT) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    return (pin < 32) ? (GPIO.in >> pin) & 0x01 : (GPIO.in1.data >> (pin - 32)) & 0x01;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void * arg)
+{
+    _pins[pin].handler = handler;
+    _pins[pin].arg = arg;
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    _pins[pin].handler = NULL;
+    _pins[pin].enabled = false;
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin)
+{
+    _pins[pin].enabled = true;
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin)
+{
+    _pins[pin].enabled = false;
+
+    return ESP_OK;
+}
+
+void host_gpio_set_level(gpio_num_t pin, bool level)
+{
+    volatile uint32_t * bits = (pin < 32) ? &GPIO.in : &GPIO.in1.data;
+    uint32_t mask = 1u << (pin % 32);
+
+    *bits = level ? (*bits | mask) : (*bits & ~mask);
+
+    if (_pins[pin].enabled && _pins[pin].handler != NULL)
+    {
+        _pins[pin].handler(_pins[pin].arg);
+    }
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten)
+{
+    return ESP_OK;
+}
+
+int adc1_get_voltage(adc1_channel_t channel)
+{
+    return _reading;
+}
+
+void host_adc_set_reading(int reading)
+{
+    _reading = reading;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t * config, int queue_size, void * queue)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t port)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel)
+{
+    _stream.channel = channel;
+
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_enable(i2s_port_t port)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_disable(i2s_port_t port)
+{
+    return ESP_OK;
+}
+
+static void host_i2s_unlock(void * arg)
+{
+    pthread_mutex_unlock(&_stream.lock);
+}
+
+int i2s_read_bytes(i2s_port_t port, char * buffer, size_t size, TickType_t timeout)
+{
+    uint16_t * words = (uint16_t *) buffer;
+
+    // The reading task is deleted while it waits for a block
+    pthread_mutex_lock(&_stream.lock);
+    pthread_cleanup_push(host_i2s_unlock, NULL);
+
+    while (_stream.queued == 0)
+    {
+        _stream.waiting = true;
+        pthread_cond_broadcast(&_stream.changed);
+        pthread_cond_wait(&_stream.changed, &_stream.lock);
+    }
+
+    pthread_cleanup_pop(0);
+    _stream.waiting = false;
+
+    for (size_t index = 0; index < size / sizeof(uint16_t); ++index)
+    {
+        words[index] = (uint16_t) ((_stream.channel << 12) | (_reading & 0x0FFF));
+    }
+
+    _stream.queued--;
+    pthread_cond_broadcast(&_stream.changed);
+    pthread_mutex_unlock(&_stream.lock);
+
+    return (int) size;
+}
+
+void host_i2s_add_blocks(uint32_t count)
+{
+    pthread_mutex_lock(&_stream.lock);
+    _stream.queued += count;
+    pthread_cond_broadcast(&_stream.changed);
+    pthread_mutex_unlock(&_stream.lock);
+}
+
+void host_i2s_wait_read(void)
+{
+    pthread_mutex_lock(&_stream.lock);
+
+    while (_stream.queued > 0 || !_stream.waiting)
+    {
+        pthread_cond_wait(&_stream.changed, &_stream.lock);
+    }
+
+    pthread_mutex_unlock(&_stream.lock);
+}
@@ -0,0 +1,54 @@
+/*
+ * The ESP-IDF timer and heap services used by the modules built on the host. The heap information comes from
+ * the counters of heap-count.c. The timer can be stopped at a simulated time, which the busy waits advance.
+ */
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/task.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "heap-count.h"
+
+static int64_t _simulated_time = -1;
+
+void host_timer_set(int64_t time)
+{
+    _simulated_time = time;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    if (_simulated_time >= 0)
+    {
+        return _simulated_time;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void ets_delay_us(uint32_t us)
+{
+    if (_simulated_time >= 0)
+    {
+        _simulated_time += us;
+        return;
+    }
+
+    struct timespec delay = { us / 1000000, (us % 1000000) * 1000L };
+    nanosleep(&delay, NULL);
+}
+
+void heap_caps_get_info(multi_heap_info_t * info, uint32_t caps)
+{
+    HEAP_COUNT count;
+    heap_count_get(&count);
+
+    memset(info, 0, sizeof(*info));
+    info->allocated_blocks = (size_t) count.blocks;
+    info->total_allocated_bytes = (size_t) count.bytes;
+}
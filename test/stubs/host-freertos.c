@@ -0,0 +1,193 @@
+/*
+ * The FreeRTOS task services used by the modules built on the host: each thread is a task with its own
+ * notification value, ticks are milliseconds of the monotonic clock. Semaphores are POSIX semaphores.
+ */
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct HOST_TASK_TAG
+{
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t value;
+    pthread_t thread;
+} HOST_TASK;
+
+typedef struct HOST_TASK_START_TAG
+{
+    void (*function) (void *);
+    void * arg;
+    sem_t started;
+    HOST_TASK * task;
+} HOST_TASK_START;
+
+static __thread HOST_TASK _task = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+
+static void host_deadline(struct timespec * deadline, TickType_t timeout)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (timeout % 1000) * 1000000L;
+
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static void * host_task_run(void * context)
+{
+    HOST_TASK_START * start = (HOST_TASK_START *) context;
+    void (*function) (void *) = start->function;
+    void * arg = start->arg;
+
+    _task.thread = pthread_self();
+    start->task = &_task;
+    sem_post(&start->started);
+
+    function(arg);
+
+    return NULL;
+}
+
+BaseType_t xTaskCreate(void (*function) (void *), const char * name, uint32_t stack_size, void * arg,
+    UBaseType_t priority, TaskHandle_t * task)
+{
+    HOST_TASK_START start = { .function = function, .arg = arg, .task = NULL };
+    pthread_t thread;
+
+    sem_init(&start.started, 0, 0);
+
+    if (pthread_create(&thread, NULL, host_task_run, &start) != 0)
+    {
+        sem_destroy(&start.started);
+        return pdFAIL;
+    }
+
+    // The task's handle is its notification state, known once it runs
+    sem_wait(&start.started);
+    sem_destroy(&start.started);
+
+    if (task != NULL)
+    {
+        *task = start.task;
+    }
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    HOST_TASK * task = (HOST_TASK *) handle;
+    pthread_t thread = task->thread;
+
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    sem_t * semaphore = malloc(sizeof(sem_t));
+
+    if (semaphore != NULL)
+    {
+        sem_init(semaphore, 0, 1);
+    }
+
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout)
+{
+    if (timeout == portMAX_DELAY)
+    {
+        return (sem_wait((sem_t *) semaphore) == 0) ? pdTRUE : pdFALSE;
+    }
+
+    struct timespec deadline;
+    host_deadline(&deadline, timeout);
+
+    return (sem_timedwait((sem_t *) semaphore, &deadline) == 0) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return (sem_post((sem_t *) semaphore) == 0) ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    sem_destroy((sem_t *) semaphore);
+    free(semaphore);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (TickType_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &_task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = { ticks / 1000, (ticks % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    HOST_TASK * task = (HOST_TASK *) handle;
+
+    pthread_mutex_lock(&task->lock);
+    task->value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout)
+{
+    struct timespec deadline;
+    host_deadline(&deadline, timeout);
+
+    pthread_mutex_lock(&_task.lock);
+
+    while (_task.value == 0 && timeout > 0)
+    {
+        if (timeout != portMAX_DELAY)
+        {
+            if (pthread_cond_timedwait(&_task.notified, &_task.lock, &deadline) != 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            pthread_cond_wait(&_task.notified, &_task.lock);
+        }
+    }
+
+    uint32_t value = _task.value;
+
+    if (value > 0)
+    {
+        _task.value = clear ? 0 : value - 1;
+    }
+
+    pthread_mutex_unlock(&_task.lock);
+
+    return value;
+}
@@ -0,0 +1,195 @@
+/*
+ * The I2C master driver used by the bus built on the host. A command link records the commands, i2c_master_cmd_begin
+ * runs them against simulated devices of 16 bits registers, most significant byte first: the first byte written
+ * after the address selects the register, the next two write it, and reads start at the selected register.
+ */
+#include "driver/i2c.h"
+
+#include <stdlib.h>
+
+#define HOST_I2C_MAX_COMMANDS   64
+#define HOST_I2C_REGISTERS      16
+
+typedef enum
+{
+    HOST_I2C_START,
+    HOST_I2C_STOP,
+    HOST_I2C_WRITE,
+    HOST_I2C_READ
+} HOST_I2C_COMMAND_TYPE;
+
+typedef struct HOST_I2C_COMMAND_TAG
+{
+    HOST_I2C_COMMAND_TYPE type;
+    uint8_t * data;
+    size_t length;
+    uint8_t byte;                   // A single byte written, data points to it
+} HOST_I2C_COMMAND;
+
+typedef struct HOST_I2C_LINK_TAG
+{
+    HOST_I2C_COMMAND commands[HOST_I2C_MAX_COMMANDS];
+    size_t count;
+} HOST_I2C_LINK;
+
+typedef struct HOST_I2C_DEVICE_TAG
+{
+    bool present;
+    uint8_t pointer;                // The selected register
+    uint16_t registers[HOST_I2C_REGISTERS];
+} HOST_I2C_DEVICE;
+
+static HOST_I2C_DEVICE _devices[128];
+
+void host_i2c_set_register(uint8_t address, uint8_t reg, uint16_t value)
+{
+    _devices[address].present = true;
+    _devices[address].registers[reg % HOST_I2C_REGISTERS] = value;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t * config)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buffer, size_t tx_buffer, int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(HOST_I2C_LINK));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    free(cmd);
+}
+
+static esp_err_t host_i2c_add(i2c_cmd_handle_t cmd, HOST_I2C_COMMAND_TYPE type, uint8_t * data, size_t length)
+{
+    HOST_I2C_LINK * link = (HOST_I2C_LINK *) cmd;
+
+    if (link->count == HOST_I2C_MAX_COMMANDS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    link->commands[link->count++] = (HOST_I2C_COMMAND) { .type = type, .data = data, .length = length };
+
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    return host_i2c_add(cmd, HOST_I2C_START, NULL, 0);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    return host_i2c_add(cmd, HOST_I2C_STOP, NULL, 0);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_check)
+{
+    HOST_I2C_LINK * link = (HOST_I2C_LINK *) cmd;
+    esp_err_t status = host_i2c_add(cmd, HOST_I2C_WRITE, NULL, 1);
+
+    if (status == ESP_OK)
+    {
+        HOST_I2C_COMMAND * command = &link->commands[link->count - 1];
+        command->byte = data;
+        command->data = &command->byte;
+    }
+
+    return status;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t * data, size_t length, bool ack_check)
+{
+    return host_i2c_add(cmd, HOST_I2C_WRITE, data, length);
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t * data, i2c_ack_type_t ack)
+{
+    return host_i2c_add(cmd, HOST_I2C_READ, data, 1);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t * data, size_t length, i2c_ack_type_t ack)
+{
+    return host_i2c_add(cmd, HOST_I2C_READ, data, length);
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t timeout)
+{
+    HOST_I2C_LINK * link = (HOST_I2C_LINK *) cmd;
+    HOST_I2C_DEVICE * device = NULL;
+    bool addressed = false;         // The next byte written is the address
+    size_t written = 0;             // Bytes written to the device since the address
+    size_t read = 0;                // Bytes read from the device since the address
+    uint16_t value = 0;
+
+    for (size_t index = 0; index < link->count; ++index)
+    {
+        HOST_I2C_COMMAND * command = &link->commands[index];
+
+        switch (command->type)
+        {
+            case HOST_I2C_START:
+                addressed = false;
+                written = 0;
+                read = 0;
+                break;
+
+            case HOST_I2C_STOP:
+                break;
+
+            case HOST_I2C_WRITE:
+                for (size_t offset = 0; offset < command->length; ++offset)
+                {
+                    uint8_t byte = command->data[offset];
+
+                    if (!addressed)
+                    {
+                        // Not acknowledged
+                        if (!_devices[byte >> 1].present)
+                        {
+                            return ESP_FAIL;
+                        }
+
+                        device = &_devices[byte >> 1];
+                        addressed = true;
+                    }
+                    else if (written++ == 0)
+                    {
+                        device->pointer = byte % HOST_I2C_REGISTERS;
+                    }
+                    else if (written == 2)
+                    {
+                        value = byte << 8;
+                    }
+                    else if (written == 3)
+                    {
+                        device->registers[device->pointer] = value | byte;
+                    }
+                }
+                break;
+
+            case HOST_I2C_READ:
+                for (size_t offset = 0; offset < command->length; ++offset, ++read)
+                {
+                    uint16_t reg = device->registers[(device->pointer + read / 2) % HOST_I2C_REGISTERS];
+                    command->data[offset] = (read % 2 == 0) ? reg >> 8 : reg & 0xFF;
+                }
+                break;
+        }
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,25 @@
+/*
+ * Menu-config defaults of the host test build, see main/Kconfig.projbuild
+ */
+#ifndef __SDKCONFIG_H__
+#define __SDKCONFIG_H__
+
+#define CONFIG_AZURE_DEVICE_ID "MyEsp32Device"
+#define CONFIG_TELEMETRY_MESSAGE_POOL_SIZE 4
+#define CONFIG_TELEMETRY_QUEUE_LENGTH 64
+#define CONFIG_TELEMETRY_QUEUE_BLOCK 1
+#define CONFIG_TELEMETRY_BACKLOG_LENGTH 256
+#define CONFIG_TELEMETRY_LOG_PARTITION "telemetry"
+#define CONFIG_TELEMETRY_LOG_REPLAY_BATCH 128
+#define CONFIG_TELEMETRY_LOG_REPLAY_INTERVAL 1000
+#define CONFIG_TELEMETRY_MESSAGE_ARENA_SIZE 2048
+#define CONFIG_TELEMETRY_MESSAGE_MAX_FIELDS 80
+#define CONFIG_TELEMETRY_ENCODING_JSON 1
+#define CONFIG_TELEMETRY_SERIES_BLOCK_SIZE 128
+#define CONFIG_TELEMETRY_SERIES_BATCH_CYCLES 60
+#define CONFIG_TELEMETRY_BATCH_SIZE 1
+#define CONFIG_TELEMETRY_BATCH_INTERVAL 300000
+#define CONFIG_TELEMETRY_BATCH_MAX_PAYLOAD 4096
+#define CONFIG_DEVICE_OVERRUN_SKIP 1
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * The GPIO input registers, set by the simulated lines of host-drivers.c
+ */
+#ifndef __HOST_GPIO_STRUCT_H__
+#define __HOST_GPIO_STRUCT_H__
+
+#include <stdint.h>
+
+typedef volatile struct
+{
+    uint32_t in;
+    struct
+    {
+        uint32_t data;
+    } in1;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Host test of the DHT decoder on edge traces of the sensor's transmission, as the GPIO interrupt captures them:
+ * clean traces with the nominal timings, noisy traces with jitter, glitches and repeated edges, and traces cut
+ * short at every edge. The traces start near the end of the 15 bits timer so that their times wrap around.
+ */
+#include "dht-decode.h"
+
+#include <string.h>
+
+#include "test.h"
+
+#define TRACE_COUNT         2000
+#define TRACE_MAX_EDGES     (DHT_MAX_EDGES * 2)
+
+typedef struct
+{
+    uint16_t edges[TRACE_MAX_EDGES];
+    size_t count;
+    uint32_t time;                  // us
+} TRACE;
+
+typedef struct
+{
+    int jitter;                     // Largest difference with the nominal pulse length, in us
+    int glitches;                   // One bit in glitches has a 3us glitch in its low pulse, 0 for none
+    int repeated;                   // One bit in repeated has its falling edge captured twice, 0 for none
+} TRACE_NOISE;
+
+static uint32_t _random = 777;
+
+static uint32_t trace_random(void)
+{
+    _random = _random * 1103515245 + 12345;
+    return (_random >> 16) & 0x7FFF;
+}
+
+static int trace_jitter(int jitter)
+{
+    return (jitter > 0) ? (int) (trace_random() % (2 * jitter + 1)) - jitter : 0;
+}
+
+static void trace_edge(TRACE * trace, bool level)
+{
+    trace->edges[trace->count++] = (trace->time & DHT_EDGE_TIME_MASK) | (level ? DHT_EDGE_LEVEL : 0);
+}
+
+/**
+ * @brief Capture a transmission: the host releases the line, the sensor responds with 80us low and 80us high, then
+ *        sends each bit as 50us low followed by 27us high for a 0 or 70us high for a 1
+ */
+static void trace_capture(TRACE * trace, const uint8_t * data, const TRACE_NOISE * noise)
+{
+    trace->count = 0;
+    trace->time = DHT_EDGE_TIME_MASK - 2000 + trace_random() % 1000;
+
+    trace_edge(trace, true);
+    trace->time += 30 + trace_jitter(noise->jitter);
+    trace_edge(trace, false);
+    trace->time += 80 + trace_jitter(noise->jitter);
+    trace_edge(trace, true);
+    trace->time += 80 + trace_jitter(noise->jitter);
+
+    for (uint8_t bit = 0; bit < DHT_DATA_SIZE * 8; ++bit)
+    {
+        trace_edge(trace, false);
+
+        if (noise->repeated > 0 && trace_random() % noise->repeated == 0)
+        {
+            trace->time += 2;
+            trace_edge(trace, false);
+        }
+
+        trace->time += 50 + trace_jitter(noise->jitter);
+
+        if (noise->glitches > 0 && trace_random() % noise->glitches == 0)
+        {
+            // A glitch 20us before the end of the low pulse
+            uint32_t end = trace->time;
+            trace->time -= 20;
+            trace_edge(trace, true);
+            trace->time += 3;
+            trace_edge(trace, false);
+            trace->time = end;
+        }
+
+        trace_edge(trace, true);
+        trace->time += ((data[bit / 8] & (0x80 >> (bit % 8))) ? 70 : 27) + trace_jitter(noise->jitter);
+    }
+
+    // The sensor releases the line after the last bit
+    trace_edge(trace, false);
+    trace->time += 50;
+    trace_edge(trace, true);
+}
+
+static void trace_data(uint8_t * data)
+{
+    for (uint8_t index = 0; index < DHT_DATA_SIZE - 1; ++index)
+    {
+        data[index] = (uint8_t) trace_random();
+    }
+
+    data[4] = (uint8_t) (data[0] + data[1] + data[2] + data[3]);
+}
+
+static void test_clean(void)
+{
+    static const TRACE_NOISE noise = { 0, 0, 0 };
+    TRACE trace;
+    uint8_t data[DHT_DATA_SIZE];
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    for (int index = 0; index < TRACE_COUNT; ++index)
+    {
+        trace_data(data);
+        trace_capture(&trace, data, &noise);
+
+        CHECK(trace.count <= DHT_MAX_EDGES);
+        CHECK(dht_decode(trace.edges, trace.count, decoded) == DHT_DECODE_OK);
+        CHECK(memcmp(data, decoded, DHT_DATA_SIZE) == 0);
+    }
+}
+
+static void test_noisy(void)
+{
+    static const TRACE_NOISE noise = { 8, 20, 30 };
+    TRACE trace;
+    uint8_t data[DHT_DATA_SIZE];
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    for (int index = 0; index < TRACE_COUNT; ++index)
+    {
+        trace_data(data);
+        trace_capture(&trace, data, &noise);
+
+        CHECK(dht_decode(trace.edges, trace.count, decoded) == DHT_DECODE_OK);
+        CHECK(memcmp(data, decoded, DHT_DATA_SIZE) == 0);
+    }
+}
+
+static void test_truncated(void)
+{
+    static const TRACE_NOISE noise = { 8, 20, 30 };
+    TRACE trace;
+    uint8_t data[DHT_DATA_SIZE];
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    for (int index = 0; index < TRACE_COUNT / 20; ++index)
+    {
+        trace_data(data);
+        trace_capture(&trace, data, (index % 2 == 0) ? &noise : &(TRACE_NOISE) { 0, 0, 0 });
+
+        // Cut before the rising edge ending the last bit, the trace misses at least one bit
+        for (size_t count = 0; count + 2 < trace.count; ++count)
+        {
+            int status = dht_decode(trace.edges, count, decoded);
+            CHECK(status == DHT_DECODE_TRUNCATED || status == DHT_DECODE_NO_RESPONSE);
+        }
+    }
+}
+
+static void test_checksum(void)
+{
+    static const TRACE_NOISE noise = { 0, 0, 0 };
+    TRACE trace;
+    uint8_t data[DHT_DATA_SIZE];
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    trace_data(data);
+    data[4] ^= 0x01;
+    trace_capture(&trace, data, &noise);
+
+    CHECK(dht_decode(trace.edges, trace.count, decoded) == DHT_DECODE_CHECKSUM);
+}
+
+static void test_no_response(void)
+{
+    TRACE trace = { .count = 0, .time = 0 };
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    // The line stays high
+    trace_edge(&trace, true);
+    trace.time += 6000;
+    trace_edge(&trace, true);
+
+    CHECK(dht_decode(trace.edges, trace.count, decoded) == DHT_DECODE_NO_RESPONSE);
+    CHECK(dht_decode(trace.edges, 0, decoded) == DHT_DECODE_NO_RESPONSE);
+}
+
+static void test_invalid_pulse(void)
+{
+    static const TRACE_NOISE noise = { 0, 0, 0 };
+    static const uint8_t data[DHT_DATA_SIZE] = { 0x55, 0x55, 0x55, 0x55, 0x54 };
+    TRACE trace;
+    uint8_t decoded[DHT_DATA_SIZE];
+
+    trace_capture(&trace, data, &noise);
+
+    // A bit's low pulse lasts 300us
+    for (size_t index = 20; index < trace.count; ++index)
+    {
+        trace.edges[index] = (trace.edges[index] & DHT_EDGE_LEVEL) | ((trace.edges[index] + 250) & DHT_EDGE_TIME_MASK);
+    }
+
+    CHECK(dht_decode(trace.edges, trace.count, decoded) == DHT_DECODE_INVALID_PULSE);
+}
+
+static void test_convert(void)
+{
+    static const uint8_t dht22[DHT_DATA_SIZE] = { 0x02, 0x8C, 0x80, 0x65, 0x73 };
+    static const uint8_t dht11[DHT_DATA_SIZE] = { 40, 0, 23, 0, 63 };
+    double temperature;
+    double humidity;
+
+    dht_convert(DHT_22, dht22, &temperature, &humidity);
+    CHECK(temperature == -10.1 && humidity == 65.2);
+
+    dht_convert(DHT_11, dht11, &temperature, &humidity);
+    CHECK(temperature == 23 && humidity == 40);
+}
+
+int main(void)
+{
+    TEST_RUN(test_clean);
+    TEST_RUN(test_noisy);
+    TEST_RUN(test_truncated);
+    TEST_RUN(test_checksum);
+    TEST_RUN(test_no_response);
+    TEST_RUN(test_invalid_pulse);
+    TEST_RUN(test_convert);
+
+    return TEST_EXIT();
+}
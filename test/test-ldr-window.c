@@ -0,0 +1,176 @@
+/*
+ * Host test of the LDR sampling window: DMA buffers of I2S ADC words, with the words of another channel
+ * interleaved, are converted and added block by block. The statistics are checked against the signal's known
+ * level, range and flicker frequency.
+ */
+#include "ldr-window.h"
+
+#include <math.h>
+
+#include "test.h"
+
+#define WINDOW_CHANNEL      4
+#define WINDOW_OTHER        5       // Another ADC1 channel sampled by the same I2S DMA
+#define WINDOW_SAMPLE_RATE  4000
+#define WINDOW_SAMPLES      4000    // One second of readings
+#define WINDOW_BLOCK        256     // Words per DMA buffer
+#define WINDOW_WORDS        (WINDOW_SAMPLES + WINDOW_SAMPLES / 6 + 1)
+
+static uint16_t _words[WINDOW_WORDS];
+static uint16_t _samples[WINDOW_BLOCK];
+static uint32_t _random = 99;
+
+static int window_noise(int amplitude)
+{
+    _random = _random * 1103515245 + 12345;
+    return (int) ((_random >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+/**
+ * @brief Fill the DMA words with a second of a light flickering at a frequency around a level, with ADC noise
+ *
+ * @return
+ *          - The number of words, one in 7 belongs to the other channel
+ */
+static size_t window_signal(double level, double amplitude, double frequency, int noise)
+{
+    size_t count = 0;
+
+    for (int index = 0; index < WINDOW_SAMPLES; ++index)
+    {
+        double reading = level + amplitude * sin(2 * M_PI * frequency * index / WINDOW_SAMPLE_RATE) + window_noise(noise);
+        reading = (reading < 0) ? 0 : (reading > LDR_ADC_MAX) ? LDR_ADC_MAX : reading;
+
+        _words[count++] = (WINDOW_CHANNEL << 12) | (uint16_t) lround(reading);
+
+        if (index % 6 == 5)
+        {
+            _words[count++] = (WINDOW_OTHER << 12) | 0x0123;
+        }
+    }
+
+    return count;
+}
+
+static void window_add_blocks(LDR_WINDOW * window, size_t count, size_t block)
+{
+    for (size_t offset = 0; offset < count; offset += block)
+    {
+        size_t length = (count - offset < block) ? count - offset : block;
+        size_t converted = ldr_window_convert(_words + offset, length, WINDOW_CHANNEL, _samples);
+        ldr_window_add(window, _samples, converted);
+    }
+}
+
+static void test_convert(void)
+{
+    static const uint16_t words[] = { 0x4FFF, 0x5123, 0x4000, 0x0ABC, 0x4800 };
+    uint16_t samples[5];
+
+    CHECK(ldr_window_convert(words, 5, WINDOW_CHANNEL, samples) == 3);
+    CHECK(samples[0] == 0x0FFF && samples[1] == 0 && samples[2] == 0x0800);
+    CHECK(ldr_window_convert(words, 5, 7, samples) == 0);
+}
+
+static void test_empty(void)
+{
+    LDR_WINDOW window;
+    LDR_WINDOW_STATISTICS statistics;
+
+    ldr_window_reset(&window, -1);
+    ldr_window_add(&window, _samples, 0);
+    ldr_window_get_statistics(&window, WINDOW_SAMPLE_RATE, &statistics);
+
+    CHECK(statistics.count == 0);
+    CHECK(statistics.mean == 0 && statistics.min == 0 && statistics.max == 0);
+    CHECK(statistics.rms == 0 && statistics.flicker == 0);
+}
+
+static void test_steady(void)
+{
+    LDR_WINDOW window;
+    LDR_WINDOW_STATISTICS statistics;
+    double volts = 2000.0 / LDR_ADC_MAX * LDR_ADC_VOLTAGE;
+
+    ldr_window_reset(&window, -1);
+    window_add_blocks(&window, window_signal(2000, 0, 0, 0), WINDOW_BLOCK);
+    ldr_window_get_statistics(&window, WINDOW_SAMPLE_RATE, &statistics);
+
+    CHECK(statistics.count == WINDOW_SAMPLES);
+    CHECK(fabs(statistics.mean - volts) < 1e-9);
+    CHECK(fabs(statistics.min - volts) < 1e-9 && fabs(statistics.max - volts) < 1e-9);
+    CHECK(fabs(statistics.rms - volts) < 1e-9);
+    CHECK(statistics.flicker == 0);
+
+    // The ADC's noise stays within the hysteresis, it is not taken for flicker
+    ldr_window_reset(&window, -1);
+    window_add_blocks(&window, window_signal(2000, 0, 0, 10), WINDOW_BLOCK);
+    ldr_window_get_statistics(&window, WINDOW_SAMPLE_RATE, &statistics);
+
+    CHECK(fabs(statistics.mean - volts) < 0.005);
+    CHECK(statistics.flicker == 0);
+}
+
+static void test_flicker(void)
+{
+    static const double frequencies[] = { 50, 100, 120, 300 };
+
+    for (size_t index = 0; index < sizeof(frequencies) / sizeof(frequencies[0]); ++index)
+    {
+        LDR_WINDOW window;
+        LDR_WINDOW_STATISTICS statistics;
+
+        ldr_window_reset(&window, -1);
+        window_add_blocks(&window, window_signal(2000, 600, frequencies[index], 10), WINDOW_BLOCK);
+        ldr_window_get_statistics(&window, WINDOW_SAMPLE_RATE, &statistics);
+
+        CHECK(statistics.count == WINDOW_SAMPLES);
+        CHECK(fabs(statistics.flicker - frequencies[index]) < frequencies[index] * 0.02);
+        CHECK(fabs(statistics.mean - 2000.0 / LDR_ADC_MAX * LDR_ADC_VOLTAGE) < 0.01);
+        CHECK(fabs(statistics.min - 1390.0 / LDR_ADC_MAX * LDR_ADC_VOLTAGE) < 0.02);
+        CHECK(fabs(statistics.max - 2610.0 / LDR_ADC_MAX * LDR_ADC_VOLTAGE) < 0.02);
+
+        // The RMS of a sine around its level
+        double rms = sqrt(2000.0 * 2000.0 + 600.0 * 600.0 / 2) / LDR_ADC_MAX * LDR_ADC_VOLTAGE;
+        CHECK(fabs(statistics.rms - rms) < 0.01);
+    }
+}
+
+static void test_blocks(void)
+{
+    LDR_WINDOW whole;
+    LDR_WINDOW blocks;
+    LDR_WINDOW_STATISTICS expected;
+    LDR_WINDOW_STATISTICS statistics;
+    size_t count = window_signal(1500, 400, 100, 10);
+
+    // The statistics do not depend on how the DMA splits the words
+    ldr_window_reset(&whole, -1);
+    window_add_blocks(&whole, count, WINDOW_BLOCK);
+    ldr_window_get_statistics(&whole, WINDOW_SAMPLE_RATE, &expected);
+
+    static const size_t sizes[] = { 1, 7, 64, 255 };
+
+    for (size_t index = 0; index < sizeof(sizes) / sizeof(sizes[0]); ++index)
+    {
+        ldr_window_reset(&blocks, -1);
+        window_add_blocks(&blocks, count, sizes[index]);
+        ldr_window_get_statistics(&blocks, WINDOW_SAMPLE_RATE, &statistics);
+
+        CHECK(statistics.count == expected.count);
+        CHECK(statistics.mean == expected.mean && statistics.rms == expected.rms);
+        CHECK(statistics.min == expected.min && statistics.max == expected.max);
+        CHECK(statistics.flicker == expected.flicker);
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(test_convert);
+    TEST_RUN(test_empty);
+    TEST_RUN(test_steady);
+    TEST_RUN(test_flicker);
+    TEST_RUN(test_blocks);
+
+    return TEST_EXIT();
+}
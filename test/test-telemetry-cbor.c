@@ -0,0 +1,289 @@
+/*
+ * Host test of the cbor wire format: messages decoded by a reference decoder hold the values they were built
+ * with, in fewer bytes than their json.
+ */
+#include "telemetry-data.h"
+#include "telemetry-cbor.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "test.h"
+
+typedef enum
+{
+    ITEM_INTEGER,
+    ITEM_NUMBER,
+    ITEM_STRING,
+    ITEM_BOOLEAN,
+    ITEM_NULL,
+    ITEM_MAP,
+    ITEM_INVALID
+} ITEM_TYPE;
+
+typedef struct
+{
+    ITEM_TYPE type;
+    int64_t integer;
+    double number;
+    const uint8_t * string;
+    size_t length;                  // String length, map pairs
+} ITEM;
+
+typedef struct
+{
+    const uint8_t * data;
+    size_t length;
+    size_t offset;
+} READER;
+
+static uint64_t read_big_endian(READER * reader, size_t length)
+{
+    uint64_t value = 0;
+
+    for (size_t index = 0; index < length && reader->offset < reader->length; ++index)
+    {
+        value = (value << 8) | reader->data[reader->offset++];
+    }
+
+    return value;
+}
+
+static double half_to_double(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1F;
+    double mantissa = half & 0x3FF;
+    double value;
+
+    if (exponent == 0)
+    {
+        value = ldexp(mantissa, -24);
+    }
+    else if (exponent == 31)
+    {
+        value = (mantissa == 0) ? INFINITY : NAN;
+    }
+    else
+    {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    }
+
+    return (half & 0x8000) ? -value : value;
+}
+
+// RFC 7049 decoding of a single data item, the items of a map are read by the following calls
+static ITEM read_item(READER * reader)
+{
+    ITEM item = { .type = ITEM_INVALID };
+
+    if (reader->offset >= reader->length)
+    {
+        return item;
+    }
+
+    uint8_t initial = reader->data[reader->offset++];
+    uint8_t major = initial >> 5;
+    uint8_t additional = initial & 0x1F;
+    uint64_t value = additional;
+
+    if (major != 7 && additional >= 24)
+    {
+        if (additional > 27)
+        {
+            return item;
+        }
+
+        value = read_big_endian(reader, 1 << (additional - 24));
+    }
+
+    switch (major)
+    {
+        case 0:
+            item.type = ITEM_INTEGER;
+            item.integer = (int64_t) value;
+            break;
+
+        case 1:
+            item.type = ITEM_INTEGER;
+            item.integer = -1 - (int64_t) value;
+            break;
+
+        case 3:
+            if (value <= reader->length - reader->offset)
+            {
+                item.type = ITEM_STRING;
+                item.string = reader->data + reader->offset;
+                item.length = value;
+                reader->offset += value;
+            }
+            break;
+
+        case 5:
+            item.type = ITEM_MAP;
+            item.length = value;
+            break;
+
+        case 7:
+            if (additional == 20 || additional == 21)
+            {
+                item.type = ITEM_BOOLEAN;
+                item.integer = (additional == 21);
+            }
+            else if (additional == 22)
+            {
+                item.type = ITEM_NULL;
+            }
+            else if (additional == 25)
+            {
+                item.type = ITEM_NUMBER;
+                item.number = half_to_double(read_big_endian(reader, 2));
+            }
+            else if (additional == 26)
+            {
+                uint32_t bits = read_big_endian(reader, 4);
+                float single;
+                memcpy(&single, &bits, sizeof(single));
+                item.type = ITEM_NUMBER;
+                item.number = single;
+            }
+            else if (additional == 27)
+            {
+                uint64_t bits = read_big_endian(reader, 8);
+                memcpy(&item.number, &bits, sizeof(item.number));
+                item.type = ITEM_NUMBER;
+            }
+            break;
+    }
+
+    return item;
+}
+
+static bool item_is_key(const ITEM * item, const char * key)
+{
+    return item->type == ITEM_STRING && item->length == strlen(key) && memcmp(item->string, key, item->length) == 0;
+}
+
+static double item_get_number(const ITEM * item)
+{
+    return (item->type == ITEM_INTEGER) ? (double) item->integer : item->number;
+}
+
+static const double _numbers[] =
+{
+    21.5, 0, -40, 1234567, -0.0625, 3.3, 0.1, 1e-7, 65504, 65505.5, -1e300, 9007199254740993.0
+};
+
+static void test_round_trip(void)
+{
+    char key[16];
+    size_t length;
+    telemetry_message_handle_t message = telemetry_message_create_new();
+
+    telemetry_message_add_string(message, "deviceId", "MyEsp32Device");
+    telemetry_message_add_boolean(message, "alert", true);
+
+    for (size_t index = 0; index < sizeof(_numbers) / sizeof(_numbers[0]); ++index)
+    {
+        snprintf(key, sizeof(key), "n%d", (int) index);
+        telemetry_message_add_number(message, key, _numbers[index]);
+    }
+
+    const uint8_t * cbor = telemetry_message_serialize(message, TELEMETRY_ENCODING_CBOR, &length);
+    CHECK(cbor != NULL);
+    CHECK(length == telemetry_message_get_serialized_size(message, TELEMETRY_ENCODING_CBOR));
+
+    READER reader = { cbor, length, 0 };
+    ITEM map = read_item(&reader);
+    CHECK(map.type == ITEM_MAP && map.length == 2 + sizeof(_numbers) / sizeof(_numbers[0]));
+
+    ITEM item = read_item(&reader);
+    CHECK(item_is_key(&item, "deviceId"));
+    item = read_item(&reader);
+    CHECK(item.type == ITEM_STRING && item.length == 13 && memcmp(item.string, "MyEsp32Device", 13) == 0);
+
+    item = read_item(&reader);
+    CHECK(item_is_key(&item, "alert"));
+    item = read_item(&reader);
+    CHECK(item.type == ITEM_BOOLEAN && item.integer == 1);
+
+    for (size_t index = 0; index < sizeof(_numbers) / sizeof(_numbers[0]); ++index)
+    {
+        snprintf(key, sizeof(key), "n%d", (int) index);
+        item = read_item(&reader);
+        CHECK(item_is_key(&item, key));
+
+        // Lossless: every value decodes to the very same double
+        item = read_item(&reader);
+        CHECK(item.type == ITEM_INTEGER || item.type == ITEM_NUMBER);
+        CHECK(item_get_number(&item) == _numbers[index]);
+    }
+
+    CHECK(reader.offset == length);
+
+    telemetry_message_destroy(message);
+}
+
+static void test_smallest_encoding(void)
+{
+    uint8_t buffer[16];
+    CBOR_WRITER writer;
+
+    // Integral values are integers, others the smallest float holding them exactly
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+    cbor_write_number(&writer, 23);
+    CHECK(cbor_writer_get_length(&writer) == 1 && buffer[0] == 0x17);
+
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+    cbor_write_number(&writer, -500);
+    CHECK(cbor_writer_get_length(&writer) == 3 && buffer[0] == 0x39 && buffer[1] == 0x01 && buffer[2] == 0xF3);
+
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+    cbor_write_number(&writer, 21.5);
+    CHECK(cbor_writer_get_length(&writer) == 3 && buffer[0] == 0xF9);
+
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+    cbor_write_number(&writer, 21.0625f + 1.0f / 4096);
+    CHECK(cbor_writer_get_length(&writer) == 5 && buffer[0] == 0xFA);
+
+    cbor_writer_init(&writer, buffer, sizeof(buffer));
+    cbor_write_number(&writer, 0.1);
+    CHECK(cbor_writer_get_length(&writer) == 9 && buffer[0] == 0xFB);
+
+    // An overflow is reported, not truncated
+    cbor_writer_init(&writer, buffer, 4);
+    cbor_write_number(&writer, 0.1);
+    CHECK(writer.overflow);
+}
+
+static void test_size_against_json(void)
+{
+    size_t json_length;
+    size_t cbor_length;
+    telemetry_message_handle_t message = telemetry_message_create_new();
+
+    // The readings of the device's sensors
+    telemetry_message_add_string(message, "deviceId", "MyEsp32Device");
+    telemetry_message_add_number(message, "temperature", 21);
+    telemetry_message_add_number(message, "humidity", 45);
+    telemetry_message_add_number(message, "mcp9808_temperature", 21.0625);
+    telemetry_message_add_number(message, "ldrVoltage", 1.5);
+    telemetry_message_add_number(message, "ldrResistance", 12000);
+
+    CHECK(telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &json_length) != NULL);
+    CHECK(telemetry_message_serialize(message, TELEMETRY_ENCODING_CBOR, &cbor_length) != NULL);
+    CHECK(cbor_length < json_length);
+
+    printf("json %d bytes, cbor %d bytes (%d%%)\n", (int) json_length, (int) cbor_length,
+        (int) (cbor_length * 100 / json_length));
+
+    telemetry_message_destroy(message);
+}
+
+int main(void)
+{
+    TEST_RUN(test_round_trip);
+    TEST_RUN(test_smallest_encoding);
+    TEST_RUN(test_size_against_json);
+
+    return TEST_EXIT();
+}
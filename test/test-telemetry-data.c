@@ -0,0 +1,238 @@
+/*
+ * Host test of the telemetry message builder: a sampling cycle builds, serializes and destroys its message
+ * without a single heap call.
+ */
+#include "telemetry-data.h"
+#include "device-config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "heap-count.h"
+#include "test.h"
+
+#define TEST_CYCLES     1000
+
+static void test_message_json(void)
+{
+    telemetry_message_handle_t message = telemetry_message_create_new();
+    CHECK(message != 0);
+
+    telemetry_message_add_string(message, "deviceId", "MyEsp32Device");
+    telemetry_message_add_number(message, "temperature", 21.5);
+    telemetry_message_add_boolean(message, "alert", true);
+
+    char * json = telemetry_message_to_json(message);
+    CHECK(json != NULL);
+    CHECK(json != NULL && strcmp(json, "{\"deviceId\":\"MyEsp32Device\",\"temperature\":21.5,\"alert\":true}") == 0);
+    CHECK(telemetry_message_get_bytes_used(message) > 0);
+
+    telemetry_message_dispose_json(json);
+    telemetry_message_destroy(message);
+}
+
+static void test_cycles_do_not_allocate(void)
+{
+    HEAP_COUNT count;
+
+    // The counters see the heap calls
+    heap_count_reset();
+    void * volatile block = malloc(16);
+    free(block);
+    heap_count_get(&count);
+    CHECK(count.allocations == 1 && count.frees == 1 && count.blocks == 0);
+
+    heap_count_reset();
+
+    for (int cycle = 0; cycle < TEST_CYCLES; ++cycle)
+    {
+        telemetry_message_handle_t message = telemetry_message_create_new();
+        CHECK(message != 0);
+
+        telemetry_message_add_string(message, "deviceId", "MyEsp32Device");
+        telemetry_message_add_number(message, "temperature", 20.0 + cycle * 0.0625);
+        telemetry_message_add_number(message, "humidity", 40 + cycle % 20);
+        telemetry_message_add_number(message, "mcp9808_temperature", 21.0625);
+        telemetry_message_add_number(message, "ldrVoltage", 1.234);
+        telemetry_message_add_number(message, "ldrResistance", 5600.5);
+
+        char * json = telemetry_message_to_json(message);
+        CHECK(json != NULL);
+
+        telemetry_message_dispose_json(json);
+        telemetry_message_destroy(message);
+    }
+
+    heap_count_get(&count);
+    CHECK(count.allocations == 0);
+    CHECK(count.frees == 0);
+    CHECK(count.peak_bytes == 0);
+}
+
+static void test_pool_exhaustion(void)
+{
+    telemetry_message_handle_t messages[TELEMETRY_MESSAGE_POOL_SIZE];
+    TELEMETRY_STATISTICS before;
+    TELEMETRY_STATISTICS after;
+
+    telemetry_get_statistics(&before);
+
+    for (int index = 0; index < TELEMETRY_MESSAGE_POOL_SIZE; ++index)
+    {
+        messages[index] = telemetry_message_create_new();
+        CHECK(messages[index] != 0);
+    }
+
+    CHECK(telemetry_message_create_new() == 0);
+
+    telemetry_get_statistics(&after);
+    CHECK(after.pool_exhausted == before.pool_exhausted + 1);
+    CHECK(after.pool_in_use == TELEMETRY_MESSAGE_POOL_SIZE);
+    CHECK(after.pool_high_water_mark == TELEMETRY_MESSAGE_POOL_SIZE);
+
+    for (int index = 0; index < TELEMETRY_MESSAGE_POOL_SIZE; ++index)
+    {
+        telemetry_message_destroy(messages[index]);
+    }
+
+    telemetry_get_statistics(&after);
+    CHECK(after.pool_in_use == 0);
+}
+
+static void test_arena_overflow(void)
+{
+    TELEMETRY_STATISTICS before;
+    TELEMETRY_STATISTICS after;
+    char value[TELEMETRY_MESSAGE_ARENA_SIZE];
+
+    telemetry_get_statistics(&before);
+
+    // A string larger than the arena is dropped, the message stays usable
+    memset(value, 'x', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+
+    telemetry_message_handle_t message = telemetry_message_create_new();
+    telemetry_message_add_string(message, "large", value);
+    telemetry_message_add_number(message, "small", 1);
+
+    char * json = telemetry_message_to_json(message);
+    CHECK(json != NULL && strcmp(json, "{\"small\":1}") == 0);
+
+    telemetry_message_dispose_json(json);
+    telemetry_message_destroy(message);
+
+    telemetry_get_statistics(&after);
+    CHECK(after.arena_overflows == before.arena_overflows + 1);
+    CHECK(after.high_water_mark <= TELEMETRY_MESSAGE_ARENA_SIZE);
+    CHECK(after.arena_size == TELEMETRY_MESSAGE_ARENA_SIZE);
+}
+
+static void test_schema_slots(void)
+{
+    size_t length;
+    telemetry_schema_handle_t schema = telemetry_schema_create();
+
+    telemetry_schema_add_string(schema, "deviceId", "d");
+    telemetry_field_id_t temperature = telemetry_schema_add_number_range(schema, "t", 1, -40, 80);
+    telemetry_field_id_t count = telemetry_schema_add_number(schema, "n", 0);
+    telemetry_field_id_t ratio = telemetry_schema_add_number(schema, "r", TELEMETRY_PRECISION_SHORTEST);
+
+    // Slots of a sign and 2 digits with a decimal, a sign and 10 digits, then the widest output
+    CHECK(telemetry_schema_get_skeleton_size(schema) == strlen("{\"deviceId\":\"d\",\"t\":,\"n\":,\"r\":}") + 5 + 11 + 24 + 1);
+    CHECK(telemetry_schema_compile(schema));
+
+    telemetry_message_handle_t message = telemetry_message_create_from_schema(schema);
+    const char * json = (const char *) telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length);
+    CHECK(json != NULL && strcmp(json, "{\"deviceId\":\"d\",\"t\": null,\"n\":       null,\"r\":                    null}") == 0);
+    CHECK(length == telemetry_schema_get_skeleton_size(schema) - 1);
+    telemetry_message_destroy(message);
+
+    message = telemetry_message_create_from_schema(schema);
+    telemetry_message_set_number(message, temperature, -12.34);
+    telemetry_message_set_number(message, count, -9999999999.0);
+    telemetry_message_set_number(message, ratio, 0.1);
+    json = (const char *) telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length);
+    CHECK(json != NULL && strcmp(json, "{\"deviceId\":\"d\",\"t\":-12.3,\"n\":-9999999999,\"r\":                     0.1}") == 0);
+    telemetry_message_destroy(message);
+
+    // Values too wide for their slot are sent as null
+    message = telemetry_message_create_from_schema(schema);
+    telemetry_message_set_number(message, temperature, -123.5);
+    telemetry_message_set_number(message, count, 1e12);
+    json = (const char *) telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length);
+    CHECK(json != NULL && strcmp(json, "{\"deviceId\":\"d\",\"t\": null,\"n\":       null,\"r\":                    null}") == 0);
+    telemetry_message_destroy(message);
+
+    telemetry_schema_destroy(schema);
+}
+
+static void test_schema_too_large(void)
+{
+    char key[32];
+    telemetry_schema_handle_t schema = telemetry_schema_create();
+
+    for (int index = 0; index < TELEMETRY_MESSAGE_MAX_FIELDS; ++index)
+    {
+        snprintf(key, sizeof(key), "a_rather_long_key_%02d", index);
+        CHECK(telemetry_schema_add_number(schema, key, TELEMETRY_PRECISION_SHORTEST) != TELEMETRY_FIELD_ID_INVALID);
+    }
+
+    // The size the skeleton needs is known before it fails to compile
+    CHECK(telemetry_schema_get_skeleton_size(schema) > TELEMETRY_MESSAGE_ARENA_SIZE);
+    CHECK(!telemetry_schema_compile(schema));
+
+    telemetry_schema_destroy(schema);
+}
+
+static void test_schema_truncate(void)
+{
+    char key[32];
+    size_t length;
+    telemetry_schema_handle_t schema = telemetry_schema_create();
+
+    telemetry_schema_add_string(schema, "deviceId", "d");
+    telemetry_schema_add_number_range(schema, "t", 1, -40, 80);
+
+    size_t field_count = telemetry_schema_get_field_count(schema);
+    size_t size = telemetry_schema_get_skeleton_size(schema);
+
+    // A sensor declaring more than fits is rolled back, the schema is left as it was
+    for (int index = 0; index < TELEMETRY_MESSAGE_MAX_FIELDS; ++index)
+    {
+        snprintf(key, sizeof(key), "a_rather_long_key_%02d", index);
+        telemetry_schema_add_string(schema, key, "value");
+    }
+
+    CHECK(telemetry_schema_get_skeleton_size(schema) > TELEMETRY_MESSAGE_ARENA_SIZE);
+    CHECK(!telemetry_schema_truncate(schema, TELEMETRY_MESSAGE_MAX_FIELDS + 1));
+    CHECK(telemetry_schema_truncate(schema, field_count));
+    CHECK(telemetry_schema_get_field_count(schema) == field_count);
+    CHECK(telemetry_schema_get_skeleton_size(schema) == size);
+
+    // The strings of the removed fields are freed for the next declarations
+    telemetry_field_id_t humidity = telemetry_schema_add_number_range(schema, "h", 0, 0, 100);
+    CHECK(humidity == field_count);
+    CHECK(telemetry_schema_compile(schema));
+    CHECK(!telemetry_schema_truncate(schema, field_count));
+
+    telemetry_message_handle_t message = telemetry_message_create_from_schema(schema);
+    telemetry_message_set_number(message, humidity, 45);
+    const char * json = (const char *) telemetry_message_serialize(message, TELEMETRY_ENCODING_JSON, &length);
+    CHECK(json != NULL && strcmp(json, "{\"deviceId\":\"d\",\"t\": null,\"h\":  45}") == 0);
+    telemetry_message_destroy(message);
+
+    telemetry_schema_destroy(schema);
+}
+
+int main(void)
+{
+    TEST_RUN(test_message_json);
+    TEST_RUN(test_cycles_do_not_allocate);
+    TEST_RUN(test_pool_exhaustion);
+    TEST_RUN(test_arena_overflow);
+    TEST_RUN(test_schema_slots);
+    TEST_RUN(test_schema_too_large);
+    TEST_RUN(test_schema_truncate);
+
+    return TEST_EXIT();
+}
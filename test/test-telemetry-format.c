@@ -0,0 +1,295 @@
+/*
+ * Host test of the json number formatter. The shortest output of random doubles must parse back to the same value
+ * with strtod, and no shorter output may: fewer decimals in fixed point notation, fewer significant digits in
+ * exponent notation. Fixed precisions are checked against the exact decimal expansion printf writes, rounded
+ * halfway away from zero.
+ */
+#include "telemetry-format.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+#define FORMAT_COUNT        1000000
+#define FORMAT_BUFFER       400     // Wide enough for the integer digits of the largest double
+#define EXACT_DECIMALS      1100    // More than the decimals of the smallest subnormal
+
+static uint32_t _random = 2024;
+static char _exact[FORMAT_BUFFER + EXACT_DECIMALS];
+
+static uint32_t format_random(void)
+{
+    _random = _random * 1103515245 + 12345;
+    return (_random >> 16) & 0x7FFF;
+}
+
+static double format_random_bits(void)
+{
+    uint64_t bits = 0;
+
+    for (int index = 0; index < 5; ++index)
+    {
+        bits = (bits << 15) | format_random();
+    }
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+/**
+ * @brief A random value in the range of the sensors, with a random number of decimals
+ */
+static double format_random_reading(void)
+{
+    double value = (format_random() * 32768.0 + format_random()) / pow(10, format_random() % 12);
+
+    return (format_random() % 2) ? -value : value;
+}
+
+/**
+ * @brief Whether the output parses back to the value and no shorter output does
+ */
+static bool format_check_shortest(double value, const char * output)
+{
+    char shorter[FORMAT_BUFFER];
+
+    if (strtod(output, NULL) != value)
+    {
+        return false;
+    }
+
+    const char * exponent = strpbrk(output, "eE");
+    const char * point = strchr(output, '.');
+
+    if (exponent != NULL)
+    {
+        int digits = 0;
+
+        for (const char * cursor = output; cursor < exponent; ++cursor)
+        {
+            digits += (*cursor >= '0' && *cursor <= '9') ? 1 : 0;
+        }
+
+        snprintf(shorter, sizeof(shorter), "%.*g", digits - 1, value);
+
+        return digits == 1 || strtod(shorter, NULL) != value;
+    }
+
+    if (point != NULL)
+    {
+        snprintf(shorter, sizeof(shorter), "%.*f", (int) strlen(point + 1) - 1, value);
+
+        return strtod(shorter, NULL) != value;
+    }
+
+    return true;
+}
+
+/**
+ * @brief The value rounded to the decimals, halfway cases away from zero, without trailing zeros
+ */
+static void format_reference(double value, int decimals, char * output)
+{
+    snprintf(_exact + 1, sizeof(_exact) - 1, "%.*f", EXACT_DECIMALS, fabs(value));
+    char * point = strchr(_exact + 1, '.');
+    char * next = point + 1 + decimals;
+    char * end = (decimals > 0) ? next : point;
+    bool up = *next >= '5';
+
+    // Room for a carry into a new leading digit
+    _exact[0] = '0';
+    *end = '\0';
+
+    for (char * cursor = end - 1; up && cursor >= _exact; --cursor)
+    {
+        if (*cursor == '.')
+        {
+            continue;
+        }
+
+        up = *cursor == '9';
+        *cursor = up ? '0' : *cursor + 1;
+    }
+
+    if (decimals > 0)
+    {
+        while (end[-1] == '0')
+        {
+            *--end = '\0';
+        }
+
+        if (end[-1] == '.')
+        {
+            end[-1] = '\0';
+        }
+    }
+
+    char * digits = (_exact[0] == '0') ? _exact + 1 : _exact;
+    bool zero = strcmp(digits, "0") == 0;
+
+    sprintf(output, "%s%s", (value < 0 && !zero) ? "-" : "", digits);
+}
+
+static void test_shortest_random(void)
+{
+    char output[FORMAT_BUFFER];
+    int failures = 0;
+
+    for (int index = 0; index < FORMAT_COUNT; ++index)
+    {
+        double value = (index % 2) ? format_random_bits() : format_random_reading();
+
+        if (isnan(value) || isinf(value))
+        {
+            continue;
+        }
+
+        int length = telemetry_format_number(output, sizeof(output), value, TELEMETRY_PRECISION_SHORTEST);
+
+        if (length != (int) strlen(output) || !format_check_shortest(value, output))
+        {
+            if (failures++ < 10)
+            {
+                printf("{\"value\":\"%a\",\"output\":\"%s\"}\n", value, output);
+            }
+        }
+    }
+
+    CHECK(failures == 0);
+}
+
+static void test_fixed_random(void)
+{
+    char output[FORMAT_BUFFER];
+    char expected[FORMAT_BUFFER + EXACT_DECIMALS];
+    int failures = 0;
+
+    for (int index = 0; index < FORMAT_COUNT; ++index)
+    {
+        double value = (index % 4) ? format_random_reading() : format_random_bits();
+        int8_t precision = index % (TELEMETRY_PRECISION_MAX + 1);
+
+        if (isnan(value) || isinf(value))
+        {
+            continue;
+        }
+
+        telemetry_format_number(output, sizeof(output), value, precision);
+        format_reference(value, precision, expected);
+
+        if (strcmp(output, expected) != 0)
+        {
+            if (failures++ < 10)
+            {
+                printf("{\"value\":\"%a\",\"precision\":%d,\"output\":\"%s\",\"expected\":\"%s\"}\n", value,
+                    precision, output, expected);
+            }
+        }
+    }
+
+    CHECK(failures == 0);
+}
+
+static void test_fixed_halfway(void)
+{
+    char output[FORMAT_BUFFER];
+    char expected[FORMAT_BUFFER + EXACT_DECIMALS];
+    int failures = 0;
+
+    // Decimal halfway cases, their doubles fall on either side of the halfway point or exactly on it
+    for (int index = 0; index < FORMAT_COUNT / 10; ++index)
+    {
+        int8_t precision = index % (TELEMETRY_PRECISION_MAX + 1);
+        double value = (format_random() * 32768.0 + format_random()) * 10 + 5;
+        value /= pow(10, precision + 1);
+
+        telemetry_format_number(output, sizeof(output), value, precision);
+        format_reference(value, precision, expected);
+
+        failures += strcmp(output, expected) != 0;
+    }
+
+    CHECK(failures == 0);
+}
+
+static void test_edges(void)
+{
+    char output[FORMAT_BUFFER];
+    char expected[FORMAT_BUFFER + EXACT_DECIMALS];
+
+    telemetry_format_number(output, sizeof(output), 0.0, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(strcmp(output, "0") == 0);
+    telemetry_format_number(output, sizeof(output), -0.0, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(strcmp(output, "0") == 0);
+    telemetry_format_number(output, sizeof(output), -0.0, 3);
+    CHECK(strcmp(output, "0") == 0);
+    telemetry_format_number(output, sizeof(output), -0.0004, 3);
+    CHECK(strcmp(output, "0") == 0);
+
+    // Subnormals
+    telemetry_format_number(output, sizeof(output), 4.9406564584124654e-324, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(strcmp(output, "5e-324") == 0);
+    telemetry_format_number(output, sizeof(output), DBL_MIN / 3, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(format_check_shortest(DBL_MIN / 3, output));
+    telemetry_format_number(output, sizeof(output), -DBL_MIN / 3, 9);
+    CHECK(strcmp(output, "0") == 0);
+
+    // Integers from 2^53 up, with and without decimals
+    telemetry_format_number(output, sizeof(output), 9007199254740992.0, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(strcmp(output, "9007199254740992") == 0);
+    telemetry_format_number(output, sizeof(output), 9007199254740994.0, 2);
+    CHECK(strcmp(output, "9007199254740994") == 0);
+    telemetry_format_number(output, sizeof(output), 1e300, TELEMETRY_PRECISION_SHORTEST);
+    CHECK(strcmp(output, "1e+300") == 0);
+    telemetry_format_number(output, sizeof(output), -DBL_MAX, 4);
+    format_reference(-DBL_MAX, 4, expected);
+    CHECK(strcmp(output, expected) == 0 && strlen(output) == 310);
+
+    // Below 2^53 with the decimals past 2^53 once scaled
+    telemetry_format_number(output, sizeof(output), 90071992547409.984375, 2);
+    CHECK(strcmp(output, "90071992547409.98") == 0);
+    telemetry_format_number(output, sizeof(output), 4503599627370495.5, 0);
+    CHECK(strcmp(output, "4503599627370496") == 0);
+
+    // Rounding carries, 9.9995 is slightly below its decimal
+    telemetry_format_number(output, sizeof(output), 9.9995, 3);
+    CHECK(strcmp(output, "9.999") == 0);
+    telemetry_format_number(output, sizeof(output), 9.9996, 3);
+    CHECK(strcmp(output, "10") == 0);
+    telemetry_format_number(output, sizeof(output), -9.9996, 3);
+    CHECK(strcmp(output, "-10") == 0);
+    telemetry_format_number(output, sizeof(output), 0.9999999999, 9);
+    CHECK(strcmp(output, "1") == 0);
+    telemetry_format_number(output, sizeof(output), 1.005, 2);
+    CHECK(strcmp(output, "1") == 0);
+
+    // Exact halfway cases round away from zero
+    telemetry_format_number(output, sizeof(output), 0.125, 2);
+    CHECK(strcmp(output, "0.13") == 0);
+    telemetry_format_number(output, sizeof(output), -2.5, 0);
+    CHECK(strcmp(output, "-3") == 0);
+
+    // Too wide for the buffer: the length, nothing written
+    strcpy(output, "unchanged");
+    CHECK(telemetry_format_number(output, 4, 1234.5, 1) == 6);
+    CHECK(telemetry_format_number(output, 4, 1e300, 0) == 301);
+    CHECK(telemetry_format_number(output, 4, NAN, 0) == 4);
+    CHECK(strcmp(output, "unchanged") == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_shortest_random);
+    TEST_RUN(test_fixed_random);
+    TEST_RUN(test_fixed_halfway);
+    TEST_RUN(test_edges);
+
+    return TEST_EXIT();
+}
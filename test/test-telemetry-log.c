@@ -0,0 +1,445 @@
+/*
+ * Host test of the telemetry log on a file-backed storage. A power loss is simulated by a budget of bytes the
+ * storage still writes or erases: the operation that exceeds it is torn, and every later one fails until the log
+ * is mounted again. After each power loss the remounted log must replay whole samples, in order, never one that
+ * was committed and never past one that is still pending.
+ */
+#include "telemetry-log.h"
+#include "storage-file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+#define LOG_SECTOR_SIZE     4096
+#define LOG_SIZE            (LOG_SECTOR_SIZE * 4)
+#define LOG_ROUNDS          2000
+
+static const STORAGE_INTERFACE_DESCRIPTION * _file_interface;
+static STORAGE_HANDLE _file;
+static char _path[256];
+static long _budget = -1;           // Bytes written or erased before the power is lost, -1 for no loss
+static bool _lost;
+
+static uint32_t _random = 4321;
+
+static uint32_t log_random(void)
+{
+    _random = _random * 1103515245 + 12345;
+    return (_random >> 16) & 0x7FFF;
+}
+
+static void power_destroy(STORAGE_HANDLE handle)
+{
+}
+
+static int power_read(STORAGE_HANDLE handle, size_t offset, void * data, size_t size)
+{
+    return _lost ? STORAGE_STATUS_FAILED : _file_interface->storage_read(_file, offset, data, size);
+}
+
+// Only the first bytes of the torn write reach the storage
+static int power_write(STORAGE_HANDLE handle, size_t offset, const void * data, size_t size)
+{
+    if (_lost)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    if (_budget >= 0 && (long) size > _budget)
+    {
+        _file_interface->storage_write(_file, offset, data, _budget);
+        _lost = true;
+
+        return STORAGE_STATUS_FAILED;
+    }
+
+    _budget -= (_budget >= 0) ? (long) size : 0;
+
+    return _file_interface->storage_write(_file, offset, data, size);
+}
+
+// Only the first bytes of the torn erase are erased, the rest of the sector keeps its content
+static int power_erase(STORAGE_HANDLE handle, size_t offset, size_t size)
+{
+    if (_lost)
+    {
+        return STORAGE_STATUS_FAILED;
+    }
+
+    if (_budget >= 0 && (long) size > _budget)
+    {
+        static uint8_t sector[LOG_SIZE];
+
+        _file_interface->storage_read(_file, offset, sector, size);
+        memset(sector, 0xFF, _budget);
+        _file_interface->storage_erase(_file, offset, size);
+        _file_interface->storage_write(_file, offset, sector, size);
+        _lost = true;
+
+        return STORAGE_STATUS_FAILED;
+    }
+
+    _budget -= (_budget >= 0) ? (long) size : 0;
+
+    return _file_interface->storage_erase(_file, offset, size);
+}
+
+static size_t power_get_size(STORAGE_HANDLE handle)
+{
+    return _file_interface->storage_get_size(_file);
+}
+
+static size_t power_get_sector_size(STORAGE_HANDLE handle)
+{
+    return _file_interface->storage_get_sector_size(_file);
+}
+
+static const STORAGE_INTERFACE_DESCRIPTION _power_interface =
+{
+    power_destroy,
+    power_read,
+    power_write,
+    power_erase,
+    power_get_size,
+    power_get_sector_size
+};
+
+/**
+ * @brief Reboot: the file is opened again, the power is back and the log is mounted from the storage
+ */
+static telemetry_log_handle_t log_mount(void)
+{
+    if (_file != 0)
+    {
+        _file_interface->storage_destroy(_file);
+    }
+
+    _file = storage_file_create(_path, LOG_SIZE, LOG_SECTOR_SIZE);
+    CHECK(_file != 0);
+
+    _budget = -1;
+    _lost = false;
+
+    return telemetry_log_create(&_power_interface, 1);
+}
+
+static telemetry_log_handle_t log_format(void)
+{
+    if (_file != 0)
+    {
+        _file_interface->storage_destroy(_file);
+        _file = 0;
+    }
+
+    remove(_path);
+
+    return log_mount();
+}
+
+// Every field of a sample follows from its number, carried in its value
+static TELEMETRY_SAMPLE log_sample(uint32_t number)
+{
+    TELEMETRY_SAMPLE sample =
+    {
+        .timestamp = number / 3,
+        .value = (float) number,
+        .sensor_id = number % 7,
+        .field_id = number % 5,
+        .flags = number & 0x01
+    };
+
+    return sample;
+}
+
+static bool log_sample_is_whole(const TELEMETRY_SAMPLE * sample)
+{
+    TELEMETRY_SAMPLE expected = log_sample((uint32_t) sample->value);
+
+    return sample->timestamp == expected.timestamp && sample->value == expected.value &&
+        sample->sensor_id == expected.sensor_id && sample->field_id == expected.field_id &&
+        sample->flags == expected.flags;
+}
+
+static void log_append(telemetry_log_handle_t log, uint32_t first, uint32_t count)
+{
+    for (uint32_t number = first; number < first + count; ++number)
+    {
+        TELEMETRY_SAMPLE sample = log_sample(number);
+        CHECK(telemetry_log_append(log, &sample));
+    }
+}
+
+/**
+ * @brief Read every pending sample: they must be whole and consecutive
+ *
+ * @return
+ *          - The number of samples read
+ */
+static uint32_t log_replay(telemetry_log_handle_t log, uint32_t * first, uint32_t * last)
+{
+    TELEMETRY_SAMPLE sample;
+    uint32_t count = 0;
+
+    while (telemetry_log_read(log, &sample))
+    {
+        uint32_t number = (uint32_t) sample.value;
+        CHECK(log_sample_is_whole(&sample));
+        CHECK(count == 0 || number == *last + 1);
+
+        *first = (count == 0) ? number : *first;
+        *last = number;
+        count++;
+    }
+
+    return count;
+}
+
+static void test_commit_remount(void)
+{
+    telemetry_log_handle_t log = log_format();
+    TELEMETRY_SAMPLE sample;
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    log_append(log, 0, 500);
+    CHECK(telemetry_log_get_pending(log) == 500);
+
+    for (uint32_t number = 0; number < 250; ++number)
+    {
+        CHECK(telemetry_log_read(log, &sample) && (uint32_t) sample.value == number);
+
+        if (number == 199)
+        {
+            CHECK(telemetry_log_commit(log));
+        }
+    }
+
+    // The samples read since the commit are replayed
+    telemetry_log_destroy(log);
+    log = log_mount();
+    CHECK(telemetry_log_get_pending(log) == 300);
+    CHECK(log_replay(log, &first, &last) == 300 && first == 200 && last == 499);
+    CHECK(telemetry_log_commit(log));
+
+    telemetry_log_destroy(log);
+    log = log_mount();
+    CHECK(telemetry_log_get_pending(log) == 0);
+    telemetry_log_destroy(log);
+}
+
+static void test_wrap(void)
+{
+    telemetry_log_handle_t log = log_format();
+    TELEMETRY_LOG_STATISTICS statistics;
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    telemetry_log_get_statistics(log, &statistics);
+    uint32_t appended = statistics.capacity * 4 + 17;
+    log_append(log, 0, appended);
+
+    // The oldest sectors are overwritten, the newest samples are all kept
+    uint32_t count = log_replay(log, &first, &last);
+    telemetry_log_get_statistics(log, &statistics);
+
+    CHECK(last == appended - 1);
+    CHECK(first == statistics.dropped);
+    CHECK(count >= statistics.capacity - statistics.capacity / 4);
+    CHECK(telemetry_log_commit(log));
+
+    telemetry_log_destroy(log);
+    log = log_mount();
+    CHECK(telemetry_log_get_pending(log) == 0);
+    telemetry_log_destroy(log);
+}
+
+static void test_torn_append(void)
+{
+    // Up to the last byte of the record written by an append
+    for (long cut = 0; cut < 20; ++cut)
+    {
+        telemetry_log_handle_t log = log_format();
+        TELEMETRY_SAMPLE sample = log_sample(10);
+        uint32_t first = 0;
+        uint32_t last = 0;
+
+        log_append(log, 0, 10);
+        _budget = cut;
+        CHECK(!telemetry_log_append(log, &sample));
+        telemetry_log_destroy(log);
+
+        // The torn record is skipped, the log goes on after it
+        log = log_mount();
+        CHECK(log_replay(log, &first, &last) == 10 && last == 9);
+        log_append(log, 10, 5);
+        CHECK(log_replay(log, &first, &last) == 5 && first == 10 && last == 14);
+        telemetry_log_destroy(log);
+
+        log = log_mount();
+        CHECK(log_replay(log, &first, &last) == 15 && first == 0 && last == 14);
+        telemetry_log_destroy(log);
+    }
+}
+
+static void test_torn_commit(void)
+{
+    for (long cut = 0; cut < 4; ++cut)
+    {
+        telemetry_log_handle_t log = log_format();
+        TELEMETRY_SAMPLE sample;
+        uint32_t first = 0;
+        uint32_t last = 0;
+
+        log_append(log, 0, 10);
+
+        for (uint8_t index = 0; index < 5; ++index)
+        {
+            CHECK(telemetry_log_read(log, &sample));
+        }
+
+        _budget = cut;
+        CHECK(!telemetry_log_commit(log));
+        telemetry_log_destroy(log);
+
+        // Either the commit is lost and every sample is replayed, or it went through
+        log = log_mount();
+        uint32_t count = log_replay(log, &first, &last);
+        CHECK((cut == 0) ? (count == 10 && first == 0) : (count == 5 && first == 5));
+        CHECK(last == 9);
+        telemetry_log_destroy(log);
+    }
+}
+
+static void test_torn_erase(void)
+{
+    static const long cuts[] = { 0, 1, 24, LOG_SECTOR_SIZE / 2, LOG_SECTOR_SIZE - 1 };
+
+    for (size_t index = 0; index < sizeof(cuts) / sizeof(cuts[0]); ++index)
+    {
+        telemetry_log_handle_t log = log_format();
+        TELEMETRY_LOG_STATISTICS statistics;
+        uint32_t first = 0;
+        uint32_t last = 0;
+
+        // A full log, the next append erases its oldest sector
+        telemetry_log_get_statistics(log, &statistics);
+        log_append(log, 0, statistics.capacity);
+
+        TELEMETRY_SAMPLE sample = log_sample(statistics.capacity);
+        _budget = cuts[index];
+        CHECK(!telemetry_log_append(log, &sample));
+        telemetry_log_destroy(log);
+
+        // The half erased sector only loses samples, the newest are kept
+        log = log_mount();
+        uint32_t count = log_replay(log, &first, &last);
+        CHECK(count > 0 && last == statistics.capacity - 1);
+        log_append(log, statistics.capacity, 10);
+        CHECK(log_replay(log, &first, &last) == 10 && last == statistics.capacity + 9);
+        telemetry_log_destroy(log);
+    }
+}
+
+/**
+ * @brief Random appends, reads and commits, with the power lost at a random byte in most rounds
+ */
+static void test_power_loss(void)
+{
+    telemetry_log_handle_t log = log_format();
+    uint32_t next = 0;              // Number of the next sample appended
+    uint32_t committed = 0;         // Samples before it were delivered and committed
+    uint32_t attempted = 0;         // Samples before it may be committed by a torn commit
+    uint32_t losses = 0;
+    uint32_t torn = 0;
+    TELEMETRY_SAMPLE sample;
+
+    telemetry_log_destroy(log);
+
+    for (uint32_t round = 0; round < LOG_ROUNDS; ++round)
+    {
+        log = log_mount();
+        _budget = (log_random() % 4 == 0) ? (long) (log_random() % LOG_SECTOR_SIZE) :
+            (long) ((log_random() % 3) * LOG_SECTOR_SIZE + log_random() % 3000);
+
+        uint32_t read = committed;
+        bool any = false;
+        uint32_t operations = log_random() % 200;
+
+        for (uint32_t operation = 0; operation < operations && !_lost; ++operation)
+        {
+            uint32_t choice = log_random() % 10;
+
+            if (choice < 6)
+            {
+                TELEMETRY_SAMPLE appended = log_sample(next);
+                next += telemetry_log_append(log, &appended) ? 1 : 0;
+            }
+            else if (choice < 9)
+            {
+                if (telemetry_log_read(log, &sample))
+                {
+                    uint32_t number = (uint32_t) sample.value;
+                    CHECK(log_sample_is_whole(&sample));
+                    CHECK(number >= committed && number < next);
+                    CHECK(!any || number >= read);
+
+                    read = number + 1;
+                    any = true;
+                }
+            }
+            else if (any)
+            {
+                attempted = (read > attempted) ? read : attempted;
+                committed = telemetry_log_commit(log) ? read : committed;
+            }
+        }
+
+        losses += _lost ? 1 : 0;
+        telemetry_log_destroy(log);
+
+        // After the reboot the pending samples run up to the last one appended, none of them was committed
+        TELEMETRY_LOG_STATISTICS statistics;
+        uint32_t first = 0;
+        uint32_t last = 0;
+
+        log = log_mount();
+        telemetry_log_get_statistics(log, &statistics);
+        torn += statistics.torn;
+
+        if (log_replay(log, &first, &last) > 0)
+        {
+            CHECK(first >= committed);
+            CHECK(last == next - 1);
+        }
+        else
+        {
+            CHECK(next <= attempted);
+        }
+
+        telemetry_log_destroy(log);
+    }
+
+    printf("{\"rounds\":%u,\"powerLosses\":%u,\"appended\":%u,\"tornRecords\":%u}\n", LOG_ROUNDS, losses, next, torn);
+    CHECK(losses > LOG_ROUNDS / 4);
+}
+
+int main(int argc, char ** argv)
+{
+    _file_interface = storage_file_get_interface();
+    snprintf(_path, sizeof(_path), "%s.bin", argv[0]);
+
+    TEST_RUN(test_commit_remount);
+    TEST_RUN(test_wrap);
+    TEST_RUN(test_torn_append);
+    TEST_RUN(test_torn_commit);
+    TEST_RUN(test_torn_erase);
+    TEST_RUN(test_power_loss);
+
+    _file_interface->storage_destroy(_file);
+    remove(_path);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,184 @@
+/*
+ * Host stress test of the telemetry ring: a producer and a consumer thread exchange numbered samples through
+ * a small ring under each overflow policy. The consumer must see every sample it gets whole, once and in order,
+ * and the ring counters must account for every sample pushed.
+ */
+#include "telemetry-ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "test.h"
+
+#define STRESS_SAMPLES      200000
+#define STRESS_CAPACITY     8
+#define STRESS_TIMEOUT      1000    // Ticks a blocked push waits, far longer than the consumer ever takes
+
+typedef struct
+{
+    telemetry_ring_handle_t ring;
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t torn;                  // Samples whose fields do not belong to the same push
+    uint32_t out_of_order;          // Samples not newer than the previous one
+    uint32_t last;
+    bool done;
+} STRESS;
+
+static void stress_fill(TELEMETRY_SAMPLE * sample, uint32_t sequence)
+{
+    sample->timestamp = sequence;
+    sample->value = (float) (sequence & 0xFFFF);
+    sample->sensor_id = (uint8_t) sequence;
+    sample->field_id = (telemetry_field_id_t) (sequence >> 8);
+    sample->flags = (uint8_t) (sequence >> 16);
+}
+
+static void stress_check(STRESS * stress, const TELEMETRY_SAMPLE * sample)
+{
+    TELEMETRY_SAMPLE expected;
+    stress_fill(&expected, sample->timestamp);
+
+    if (sample->value != expected.value || sample->sensor_id != expected.sensor_id ||
+        sample->field_id != expected.field_id || sample->flags != expected.flags)
+    {
+        stress->torn++;
+    }
+
+    // Sequences start at 1, so that the first sample is always newer than the initial last
+    if (sample->timestamp <= stress->last)
+    {
+        stress->out_of_order++;
+    }
+
+    stress->last = sample->timestamp;
+    stress->popped++;
+}
+
+static void * stress_produce(void * context)
+{
+    STRESS * stress = (STRESS *) context;
+    TELEMETRY_SAMPLE sample;
+
+    for (uint32_t sequence = 1; sequence <= STRESS_SAMPLES; ++sequence)
+    {
+        stress_fill(&sample, sequence);
+        stress->pushed += telemetry_ring_push(stress->ring, &sample, STRESS_TIMEOUT) ? 1 : 0;
+
+        // Let the consumer catch up now and then, the ring goes from full to empty
+        if ((sequence & 0x3FF) == 0)
+        {
+            sched_yield();
+        }
+    }
+
+    __atomic_store_n(&stress->done, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void * stress_consume(void * context)
+{
+    STRESS * stress = (STRESS *) context;
+    TELEMETRY_SAMPLE sample;
+
+    while (true)
+    {
+        if (telemetry_ring_pop(stress->ring, &sample, 10))
+        {
+            stress_check(stress, &sample);
+
+            // A slower consumer now and then, the ring fills up
+            if ((stress->popped & 0xFF) == 0)
+            {
+                sched_yield();
+            }
+        }
+        else if (__atomic_load_n(&stress->done, __ATOMIC_ACQUIRE))
+        {
+            while (telemetry_ring_pop(stress->ring, &sample, 0))
+            {
+                stress_check(stress, &sample);
+            }
+
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void stress_run(TELEMETRY_RING_POLICY policy, STRESS * stress, TELEMETRY_RING_STATISTICS * statistics)
+{
+    *stress = (STRESS) { 0 };
+    stress->ring = telemetry_ring_create(STRESS_CAPACITY, policy);
+    CHECK(stress->ring != 0);
+
+    pthread_t producer;
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, stress_consume, stress);
+    pthread_create(&producer, NULL, stress_produce, stress);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    telemetry_ring_get_statistics(stress->ring, statistics);
+    telemetry_ring_destroy(stress->ring);
+
+    CHECK(stress->torn == 0);
+    CHECK(stress->out_of_order == 0);
+    CHECK(statistics->written == stress->pushed);
+    CHECK(statistics->read == stress->popped);
+    CHECK(statistics->high_water_mark <= STRESS_CAPACITY);
+
+    printf("{\"policy\":%d,\"pushed\":%u,\"popped\":%u,\"droppedOldest\":%u,\"droppedNewest\":%u,\"blocked\":%u}\n",
+        policy, stress->pushed, stress->popped, statistics->dropped_oldest, statistics->dropped_newest,
+        statistics->blocked);
+}
+
+static void test_block(void)
+{
+    STRESS stress;
+    TELEMETRY_RING_STATISTICS statistics;
+    stress_run(TELEMETRY_RING_BLOCK, &stress, &statistics);
+
+    // Nothing is lost: every sample arrives, in sequence
+    CHECK(stress.pushed == STRESS_SAMPLES);
+    CHECK(stress.popped == STRESS_SAMPLES);
+    CHECK(stress.last == STRESS_SAMPLES);
+    CHECK(statistics.timed_out == 0);
+    CHECK(statistics.dropped_oldest == 0 && statistics.dropped_newest == 0);
+}
+
+static void test_drop_newest(void)
+{
+    STRESS stress;
+    TELEMETRY_RING_STATISTICS statistics;
+    stress_run(TELEMETRY_RING_DROP_NEWEST, &stress, &statistics);
+
+    // A discarded push never reaches the ring, what was pushed is all read
+    CHECK(stress.pushed + statistics.dropped_newest == STRESS_SAMPLES);
+    CHECK(stress.popped == stress.pushed);
+    CHECK(statistics.dropped_oldest == 0);
+}
+
+static void test_drop_oldest(void)
+{
+    STRESS stress;
+    TELEMETRY_RING_STATISTICS statistics;
+    stress_run(TELEMETRY_RING_DROP_OLDEST, &stress, &statistics);
+
+    // Every push succeeds, each sample is either read or dropped by the producer, never both
+    CHECK(stress.pushed == STRESS_SAMPLES);
+    CHECK(stress.popped + statistics.dropped_oldest == STRESS_SAMPLES);
+    CHECK(stress.last == STRESS_SAMPLES);
+    CHECK(statistics.dropped_newest == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_block);
+    TEST_RUN(test_drop_newest);
+    TEST_RUN(test_drop_oldest);
+
+    return TEST_EXIT();
+}
@@ -0,0 +1,302 @@
+/*
+ * Host test of the compressed time series blocks: a reference decoder written from the format's description
+ * reads back every sample of the traces, and the compression ratio of the traces is reported.
+ */
+#include "telemetry-series.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "test.h"
+
+#define TRACE_LENGTH        60      // Samples of a batch, as sent by default
+#define TRACE_PERIOD        10000   // ms between two samples
+#define TRACE_BLOCK_SIZE    1024
+
+typedef struct
+{
+    const char * name;
+    double start;
+    double step;                    // Sensor resolution
+    int drift;                      // Largest change between two samples, in steps
+} TRACE;
+
+// Sensors of the device in a room over 10 minutes
+static const TRACE _traces[] =
+{
+    { "mcp9808_temperature", 21.5, 0.0625, 1 },
+    { "temperature", 21, 1, 1 },
+    { "humidity", 45, 1, 1 },
+    { "ldrVoltage", 1.2, 3.3 / 4095, 6 }
+};
+
+static uint32_t _random = 12345;
+
+static uint32_t trace_random(void)
+{
+    _random = _random * 1103515245 + 12345;
+    return (_random >> 16) & 0x7FFF;
+}
+
+// A random walk at the sensor's resolution, sampled with a few ms of jitter
+static void trace_generate(const TRACE * trace, uint32_t * timestamps, float * values, size_t count)
+{
+    double value = trace->start;
+    uint32_t timestamp = 30000;
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        timestamps[index] = timestamp + trace_random() % 5;
+        values[index] = (float) (round(value / trace->step) * trace->step);
+
+        timestamp += TRACE_PERIOD;
+
+        if (trace_random() % 4 == 0)
+        {
+            value += ((int) (trace_random() % (2 * trace->drift + 1)) - trace->drift) * trace->step;
+        }
+    }
+}
+
+/*
+ * Reference decoder
+ */
+
+typedef struct
+{
+    const uint8_t * data;
+    size_t length;
+    size_t bit;
+} BITS;
+
+static bool bits_read(BITS * bits, int count, uint32_t * value)
+{
+    *value = 0;
+
+    for (int index = 0; index < count; ++index, ++bits->bit)
+    {
+        if (bits->bit >= bits->length * 8)
+        {
+            return false;
+        }
+
+        *value = (*value << 1) | ((bits->data[bits->bit / 8] >> (7 - bits->bit % 8)) & 1);
+    }
+
+    return true;
+}
+
+static size_t reference_decode(const uint8_t * data, size_t length, uint32_t * timestamps, float * values, size_t size)
+{
+    BITS bits = { data, length, 0 };
+    uint32_t count;
+    uint32_t timestamp;
+    uint32_t value;
+    int32_t delta = 0;
+    int leading = -1;
+    int trailing = 0;
+
+    if (!bits_read(&bits, 16, &count) || !bits_read(&bits, 32, &timestamp) || !bits_read(&bits, 32, &value) ||
+        count > size)
+    {
+        return 0;
+    }
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        if (index > 0)
+        {
+            // Delta-of-delta: '0', '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits, '1111' + 32 bits
+            static const int widths[] = { 0, 7, 9, 12, 32 };
+            static const int biases[] = { 0, 63, 255, 2047, 0 };
+            uint32_t bit = 1;
+            uint32_t field = 0;
+            int ones = 0;
+
+            while (ones < 4 && bits_read(&bits, 1, &bit) && bit == 1)
+            {
+                ones++;
+            }
+
+            if (!bits_read(&bits, widths[ones], &field))
+            {
+                return 0;
+            }
+
+            delta += (int32_t) field - biases[ones];
+            timestamp += delta;
+
+            // XOR: '0' same value, '10' + the previous window, '11' + 5 bits leading + 5 bits length - 1 + bits
+            uint32_t control;
+
+            if (!bits_read(&bits, 1, &control))
+            {
+                return 0;
+            }
+
+            if (control == 1)
+            {
+                uint32_t xor;
+
+                if (!bits_read(&bits, 1, &control))
+                {
+                    return 0;
+                }
+
+                if (control == 1)
+                {
+                    uint32_t window_leading;
+                    uint32_t window_length;
+
+                    if (!bits_read(&bits, 5, &window_leading) || !bits_read(&bits, 5, &window_length))
+                    {
+                        return 0;
+                    }
+
+                    leading = window_leading;
+                    trailing = 32 - leading - (window_length + 1);
+                }
+
+                if (leading < 0 || trailing < 0 || !bits_read(&bits, 32 - leading - trailing, &xor))
+                {
+                    return 0;
+                }
+
+                value ^= xor << trailing;
+            }
+        }
+
+        timestamps[index] = timestamp;
+        memcpy(&values[index], &value, sizeof(value));
+    }
+
+    return count;
+}
+
+static size_t encode(const uint32_t * timestamps, const float * values, size_t count, uint8_t * block, size_t size)
+{
+    TELEMETRY_SERIES_ENCODER encoder;
+    telemetry_series_encoder_init(&encoder, block, size);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        if (!telemetry_series_append(&encoder, timestamps[index], values[index]))
+        {
+            return 0;
+        }
+    }
+
+    return telemetry_series_get_length(&encoder);
+}
+
+static void check_round_trip(const uint32_t * timestamps, const float * values, size_t count)
+{
+    uint8_t block[TRACE_BLOCK_SIZE];
+    uint32_t decoded_timestamps[TRACE_LENGTH];
+    float decoded_values[TRACE_LENGTH];
+    size_t length = encode(timestamps, values, count, block, sizeof(block));
+
+    CHECK(length > 0);
+    CHECK(reference_decode(block, length, decoded_timestamps, decoded_values, TRACE_LENGTH) == count);
+    CHECK(memcmp(decoded_timestamps, timestamps, count * sizeof(uint32_t)) == 0);
+    CHECK(memcmp(decoded_values, values, count * sizeof(float)) == 0);
+
+    // The module's decoder agrees
+    TELEMETRY_SERIES_DECODER decoder;
+    CHECK(telemetry_series_decoder_init(&decoder, block, length));
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        uint32_t timestamp;
+        float value;
+
+        CHECK(telemetry_series_next(&decoder, &timestamp, &value));
+        CHECK(timestamp == timestamps[index] && memcmp(&value, &values[index], sizeof(value)) == 0);
+    }
+
+    uint32_t timestamp;
+    float value;
+    CHECK(!telemetry_series_next(&decoder, &timestamp, &value));
+}
+
+static void test_traces_round_trip(void)
+{
+    uint32_t timestamps[TRACE_LENGTH];
+    float values[TRACE_LENGTH];
+
+    for (size_t index = 0; index < sizeof(_traces) / sizeof(_traces[0]); ++index)
+    {
+        trace_generate(&_traces[index], timestamps, values, TRACE_LENGTH);
+        check_round_trip(timestamps, values, TRACE_LENGTH);
+    }
+}
+
+static void test_edge_cases_round_trip(void)
+{
+    // Every timestamp encoding, repeated and negative values, sign flips, NaN
+    uint32_t timestamps[] = { 0, 0, 1, 65, 2, 258, 600, 3000, 3000, 100000000, 100000001, UINT32_MAX - 5, UINT32_MAX };
+    float values[] = { 0, 0, -0.0f, 1, -1, 1e-30f, 3e38f, NAN, NAN, 21.0625f, 21.125f, 21.0625f, -40 };
+
+    check_round_trip(timestamps, values, sizeof(values) / sizeof(values[0]));
+    check_round_trip(timestamps, values, 1);
+}
+
+static void test_full_block(void)
+{
+    uint8_t block[32];
+    TELEMETRY_SERIES_ENCODER encoder;
+    uint32_t timestamps[TRACE_LENGTH];
+    float values[TRACE_LENGTH];
+    size_t count = 0;
+
+    telemetry_series_encoder_init(&encoder, block, sizeof(block));
+
+    for (count = 0; count < TRACE_LENGTH; ++count)
+    {
+        timestamps[count] = count * 1000 + (count * 7919) % 997;
+        values[count] = count * 1.1f;
+
+        if (!telemetry_series_append(&encoder, timestamps[count], values[count]))
+        {
+            break;
+        }
+    }
+
+    // A full block keeps the samples appended before
+    CHECK(count > 1 && count < TRACE_LENGTH);
+
+    uint32_t decoded_timestamps[TRACE_LENGTH];
+    float decoded_values[TRACE_LENGTH];
+    CHECK(reference_decode(block, telemetry_series_get_length(&encoder), decoded_timestamps, decoded_values, TRACE_LENGTH) == count);
+    CHECK(memcmp(decoded_values, values, count * sizeof(float)) == 0);
+}
+
+static void test_compression_ratio(void)
+{
+    uint8_t block[TRACE_BLOCK_SIZE];
+    uint32_t timestamps[TRACE_LENGTH];
+    float values[TRACE_LENGTH];
+
+    for (size_t index = 0; index < sizeof(_traces) / sizeof(_traces[0]); ++index)
+    {
+        trace_generate(&_traces[index], timestamps, values, TRACE_LENGTH);
+        size_t length = encode(timestamps, values, TRACE_LENGTH, block, sizeof(block));
+
+        // Against a 4 bytes timestamp and a 4 bytes float by sample
+        double ratio = (double) (TRACE_LENGTH * 8) / length;
+        printf("{\"trace\":\"%s\",\"samples\":%d,\"bytes\":%d,\"ratio\":%.1f}\n", _traces[index].name, TRACE_LENGTH,
+            (int) length, ratio);
+
+        CHECK(ratio > 3);
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(test_traces_round_trip);
+    TEST_RUN(test_edge_cases_round_trip);
+    TEST_RUN(test_full_block);
+    TEST_RUN(test_compression_ratio);
+
+    return TEST_EXIT();
+}
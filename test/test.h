@@ -0,0 +1,31 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+
+/*
+ * Checks of the host tests: a failed check is reported and the test goes on, the program exits with the
+ * number of failed checks.
+ */
+
+static int _test_failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            _test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test) \
+    do { \
+        int failures = _test_failures; \
+        test(); \
+        printf("%s %s\n", (_test_failures == failures) ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define TEST_EXIT() ((_test_failures > 0) ? 1 : 0)
+
+#endif